@@ -19,6 +19,22 @@ pub fn linkPcre(vendored_pcre: bool, libExe: *std.build.LibExeObjStep) void {
     }
 }
 
+// Input can be read ahead on a separate thread (except on Windows and
+// wasm, where the library reads on demand)
+pub fn linkThreads(libExe: *std.build.LibExeObjStep) void {
+    if (libExe.target.getOsTag() != .windows) {
+        libExe.linkSystemLibrary("pthread");
+    }
+}
+
+// SQLite output (--format=sqlite) inserts rows with the system's SQLite
+// library
+pub fn linkSqlite(sqlite: bool, libExe: *std.build.LibExeObjStep) void {
+    if (sqlite) {
+        libExe.linkSystemLibrary("sqlite3");
+    }
+}
+
 pub fn build(b: *std.Build) !void {
     const target = b.standardTargetOptions(.{});
     const optimize = b.standardOptimizeOption(.{
@@ -29,6 +45,8 @@ pub fn build(b: *std.Build) !void {
     const skip_lib: bool = b.option(bool, "skip-lib", "Skip compiling the library") orelse false;
     const wasm: bool = b.option(bool, "wasm", "Compile the wasm library") orelse false;
     const vendored_pcre: bool = b.option(bool, "vendored-pcre", "Use vendored pcre") orelse true;
+    const sqlite: bool = b.option(bool, "sqlite", "Support SQLite output (links the system SQLite)") orelse false;
+    const cflags: []const []const u8 = if (sqlite) &sqliteBuildOptions else &buildOptions;
 
     // Main build step
     if (!lib_only and !wasm) {
@@ -39,13 +57,19 @@ pub fn build(b: *std.Build) !void {
         });
 
         fastfec_cli.linkLibC();
+        linkThreads(fastfec_cli);
 
-        fastfec_cli.addCSourceFiles(&libSources, &buildOptions);
+        fastfec_cli.addCSourceFiles(&libSources, cflags);
         linkPcre(vendored_pcre, fastfec_cli);
+        linkSqlite(sqlite, fastfec_cli);
         fastfec_cli.addCSourceFiles(&.{
             "src/cli.c",
+            "src/serve.c",
+            "src/watch.c",
+            "src/cache.c",
+            "src/combine.c",
             "src/main.c",
-        }, &buildOptions);
+        }, cflags);
         b.installArtifact(fastfec_cli);
     }
 
@@ -63,8 +87,10 @@ pub fn build(b: *std.Build) !void {
             fastfec_lib.headerpad_max_install_names = true;
         }
         fastfec_lib.linkLibC();
-        fastfec_lib.addCSourceFiles(&libSources, &buildOptions);
+        linkThreads(fastfec_lib);
+        fastfec_lib.addCSourceFiles(&libSources, cflags);
         linkPcre(vendored_pcre, fastfec_lib);
+        linkSqlite(sqlite, fastfec_lib);
         b.installArtifact(fastfec_lib);
     } else if (wasm) {
         // Wasm library build step
@@ -92,11 +118,13 @@ pub fn build(b: *std.Build) !void {
             .name = base_file,
         });
         subtest_exe.linkLibC();
-        subtest_exe.addCSourceFiles(&testIncludes, &buildOptions);
+        linkThreads(subtest_exe);
+        subtest_exe.addCSourceFiles(&testIncludes, cflags);
         linkPcre(vendored_pcre, subtest_exe);
+        linkSqlite(sqlite, subtest_exe);
         subtest_exe.addCSourceFile(.{
             .file = .{ .path = test_file },
-            .flags = &buildOptions,
+            .flags = cflags,
         });
         const subtest_cmd = b.addRunArtifact(subtest_exe);
         if (prev_test_step != null) {
@@ -110,11 +138,23 @@ pub fn build(b: *std.Build) !void {
 }
 
 const libSources = [_][]const u8{
+    "src/cpu.c",
+    "src/allocator.c",
+    "src/arena.c",
+    "src/hash.c",
     "src/buffer.c",
     "src/memory.c",
     "src/encoding.c",
     "src/csv.c",
     "src/writer.c",
+    "src/pipeline.c",
+    "src/filter.c",
+    "src/json.c",
+    "src/count.c",
+    "src/pgcopy.c",
+    "src/tables.c",
+    "src/sqlite.c",
+    "src/columns.c",
     "src/fec.c",
 };
 const pcreSources = [_][]const u8{
@@ -140,8 +180,11 @@ const pcreSources = [_][]const u8{
     "src/pcre/pcre_version.c",
     "src/pcre/pcre_xclass.c",
 };
-const tests = [_][]const u8{ "src/buffer_test.c", "src/csv_test.c", "src/writer_test.c", "src/cli_test.c" };
-const testIncludes = [_][]const u8{ "src/buffer.c", "src/memory.c", "src/encoding.c", "src/csv.c", "src/writer.c", "src/cli.c" };
+const tests = [_][]const u8{ "src/buffer_test.c", "src/csv_test.c", "src/encoding_test.c", "src/writer_test.c", "src/filter_test.c", "src/json_test.c", "src/cli_test.c", "src/fec_test.c", "src/hash_test.c", "src/pgcopy_test.c", "src/sqlite_test.c", "src/columns_test.c" };
+const testIncludes = [_][]const u8{ "src/cpu.c", "src/allocator.c", "src/arena.c", "src/hash.c", "src/buffer.c", "src/memory.c", "src/encoding.c", "src/csv.c", "src/writer.c", "src/pipeline.c", "src/filter.c", "src/json.c", "src/count.c", "src/pgcopy.c", "src/tables.c", "src/sqlite.c", "src/columns.c", "src/fec.c", "src/cli.c", "src/serve.c", "src/watch.c", "src/cache.c", "src/combine.c" };
+// The version (shared with the Python package), which cached outputs
+// are tied to
+const version = std.mem.trim(u8, @embedFile("VERSION"), " \r\n");
 const buildOptions = [_][]const u8{
     "-std=c11",
     "-pedantic",
@@ -149,4 +192,6 @@ const buildOptions = [_][]const u8{
     "-Wall",
     "-W",
     "-Wno-missing-field-initializers",
+    "-DFASTFEC_VERSION=\"" ++ version ++ "\"",
 };
+const sqliteBuildOptions = buildOptions ++ [_][]const u8{"-DFASTFEC_SQLITE"};
@@ -64,5 +64,6 @@ setup(
     packages=["fastfec"],
     package_data={"fastfec": library_files},
     package_dir={"": "src"},
+    extras_require={"frames": ["numpy", "pandas", "pyarrow"]},
     cmdclass={"bdist_wheel": bdist_wheel},
 )
@@ -1,3 +1,3 @@
 """Provides the fastfec package"""
 
-from .client import FastFEC, LibFastFEC  # noqa: F401
+from .client import FastFEC, LibFastFEC, ParseResult, parse_many  # noqa: F401
@@ -4,12 +4,34 @@ A Python library to interface with FastFEC.
 This library provides methods to
   * parse a .fec file line by line, yieling a parsed result
   * parse a .fec file into parsed output .csv files
+  * parse many .fec files into parsed output .csv files in parallel
+  * parse a .fec file into a pandas DataFrame per form type
+
+Filings can be passed in as an open stream, a path on disk (read directly by C)
+or an object supporting the buffer protocol (parsed in place).
 """
 
+import atexit
 import contextlib
 import os
 import pathlib
-from ctypes import CDLL, c_char_p, c_int, c_void_p
+from collections import deque, namedtuple
+from concurrent.futures import FIRST_COMPLETED, ProcessPoolExecutor, wait
+from concurrent.futures.process import BrokenProcessPool
+from multiprocessing.util import Finalize
+from ctypes import (
+    CDLL,
+    POINTER,
+    Structure,
+    byref,
+    c_char,
+    c_char_p,
+    c_int,
+    c_int64,
+    c_size_t,
+    c_void_p,
+    cast,
+)
 from queue import Queue
 from threading import Thread
 
@@ -19,35 +41,130 @@ from .utils import (
     CUSTOM_LINE,
     CUSTOM_WRITE,
     as_bytes,
+    as_memory,
+    column_table_frames,
     find_fastfec_lib,
+    is_path,
     provide_line_callback,
     provide_read_callback,
     provide_write_callback,
 )
 
 
+class AllocatorStats(Structure):  # pylint: disable=too-few-public-methods
+    """
+    Mirrors ALLOCATOR_STATS in allocator.h
+    """
+
+    _fields_ = [
+        ("bytes_live", c_size_t),
+        ("bytes_peak", c_size_t),
+        ("allocations", c_size_t),
+        ("reallocations", c_size_t),
+        ("frees", c_size_t),
+        ("failures", c_size_t),
+    ]
+
+
+class Column(Structure):  # pylint: disable=too-few-public-methods
+    """
+    Mirrors COLUMN in columns.h
+    """
+
+    _fields_ = [
+        ("name", c_char_p),
+        ("type", c_char),
+        ("values", c_void_p),
+        ("data", c_void_p),
+        ("data_length", c_int64),
+        ("data_capacity", c_int64),
+    ]
+
+
+class ColumnTable(Structure):  # pylint: disable=too-few-public-methods
+    """
+    Mirrors COLUMN_TABLE in columns.h
+    """
+
+    # (starting with its TABLE_KEY: name, variant and header)
+    _fields_ = [
+        ("name", c_char_p),
+        ("variant", c_int),
+        ("header", c_char_p),
+        ("columns", POINTER(Column)),
+        ("num_columns", c_int),
+        ("num_rows", c_int64),
+        ("row_capacity", c_int64),
+    ]
+
+
+class ColumnTables(Structure):  # pylint: disable=too-few-public-methods
+    """
+    Mirrors COLUMN_TABLES in columns.h
+    """
+
+    # (its TABLE_LIST of COLUMN_TABLEs)
+    _fields_ = [
+        ("tables", POINTER(ColumnTable)),
+        ("table_size", c_size_t),
+        ("num_tables", c_int),
+        ("table_capacity", c_int),
+        ("table", c_void_p),
+        ("last_header", c_void_p),
+        ("allocator", c_void_p),
+    ]
+
+
 class LibFastFEC:
     """
     Python wrapper for the fastfec library
     """
 
-    def __init__(self):
+    def __init__(self, memory_limit=None):
+        """
+        Arguments:
+            memory_limit -- If set, the most bytes the library may hold at once. A parse
+                            that needs more stops early and fails, and one that can't
+                            start raises a MemoryError
+        """
         self.__init_lib()
 
-        # Initialize
-        self.persistent_memory_context = self.libfastfec.newPersistentMemoryContext()
-
-    def parse(self, file_handle, include_filing_id=None, should_parse_date=True):
+        # Initialize (all of the library's memory is tracked by the allocator)
+        self.allocator = self.libfastfec.newAllocator(None, None, None, None)
+        self.persistent_memory_context = self.libfastfec.newPersistentMemoryContext(self.allocator)
+
+        # Limit only what's allocated from here on, so that even a small limit leaves a
+        # usable instance
+        if memory_limit is not None:
+            self.libfastfec.setAllocatorLimit(self.allocator, memory_limit)
+
+    def parse(
+        self,
+        file_handle,
+        include_filing_id=None,
+        should_parse_date=True,
+        include_forms=None,
+        exclude_forms=None,
+        columns=None,
+    ):  # pylint: disable=too-many-arguments
         """
         Parses the input file line-by-line
 
         Arguments:
-            file_handle -- An input stream for reading a .fec file
+            file_handle -- An input stream for reading a .fec file, a path to a .fec file, or an
+                           object supporting the buffer protocol (e.g. bytes) holding its contents
             include_filing_id -- If set, prepend a column into each outputted csv for filing_id
                                  with the specified filing id (defaults to None)
             should_parse_date -- If true, yields parsed datetime.date objects for date fields; if
                                  false, yields strings for date fields. This would mainly be set to
                                  false for performance reasons (defaults to true)
+            include_forms -- If set, an iterable of form type prefixes (e.g. ["SA", "SB"]); only
+                             lines whose form type starts with one of them are parsed
+            exclude_forms -- If set, an iterable of form type prefixes whose lines are skipped
+            columns -- If set, a dictionary mapping form type prefixes to the list of column
+                       names to output for matching form types (e.g. {"SA": ["form_type",
+                       "contribution_amount"]}). Form types with no matching prefix output
+                       every column
 
         Returns:
             A generator that receives the form name and a dictionary
@@ -62,23 +179,11 @@ class LibFastFEC:
         filing_id_included = include_filing_id is not None
 
         # Provide a custom line callback
-        buffer_read_fn = provide_read_callback(file_handle)
         line_callback_fn = CUSTOM_LINE(provide_line_callback(queue, filing_id_included, should_parse_date))
-        fec_context = self.libfastfec.newFecContext(
-            self.persistent_memory_context,
-            buffer_read_fn,
-            BUFFER_SIZE,
-            CUSTOM_WRITE(0),
-            BUFFER_SIZE,
-            line_callback_fn,
-            0,
-            None,
-            include_filing_id,
-            None,
-            filing_id_included,
-            1,
-            0,
+        fec_context, _input_ref = self.__new_fec_context(
+            file_handle, CUSTOM_WRITE(0), line_callback_fn, include_filing_id
         )
+        fec_filter = self.__set_filter(fec_context, include_forms, exclude_forms, columns)
 
         # Run the parsing in a separate thread. It's essentially still single-threaded
         # but this provides a mechanism to yield the results of a callback function
@@ -100,18 +205,35 @@ class LibFastFEC:
 
         # Free FEC context
         self.libfastfec.freeFecContext(fec_context)
-
-    def parse_as_files(self, file_handle, output_directory, include_filing_id=None):
+        self.__free_filter(fec_filter)
+
+    def parse_as_files(
+        self,
+        file_handle,
+        output_directory,
+        include_filing_id=None,
+        include_forms=None,
+        exclude_forms=None,
+        columns=None,
+    ):  # pylint: disable=too-many-arguments
         """
         Parses the input file into output files in the output directory
 
         Parent directories will be automatically created as needed.
 
         Arguments:
-            file_handle -- An input stream for reading a .fec file
+            file_handle -- An input stream for reading a .fec file, a path to a .fec file, or an
+                           object supporting the buffer protocol (e.g. bytes) holding its contents
             output_directory -- A directory in which to place output parsed .csv files
             include_filing_id -- If set, prepend a column into each outputted csv for filing_id
                                  with the specified filing id (defaults to None)
+            include_forms -- If set, an iterable of form type prefixes (e.g. ["SA", "SB"]); only
+                             lines whose form type starts with one of them are parsed
+            exclude_forms -- If set, an iterable of form type prefixes whose lines are skipped
+            columns -- If set, a dictionary mapping form type prefixes to the list of column
+                       names to output for matching form types (e.g. {"SA": ["form_type",
+                       "contribution_amount"]}). Form types with no matching prefix output
+                       every column
 
         Returns:
             A status code. 1 indicates a successful parse, 0 an unsuccessful one.
@@ -125,68 +247,236 @@ class LibFastFEC:
             # pylint: disable=consider-using-with,unspecified-encoding,bad-option-value
             return open(filename, *args, **kwargs)
 
-        return self.parse_as_files_custom(file_handle, open_output_file, include_filing_id=include_filing_id)
+        return self.parse_as_files_custom(
+            file_handle,
+            open_output_file,
+            include_filing_id=include_filing_id,
+            include_forms=include_forms,
+            exclude_forms=exclude_forms,
+            columns=columns,
+        )
 
-    def parse_as_files_custom(self, file_handle, open_function, include_filing_id=None):
+    def parse_as_files_custom(
+        self,
+        file_handle,
+        open_function,
+        include_filing_id=None,
+        include_forms=None,
+        exclude_forms=None,
+        columns=None,
+    ):  # pylint: disable=too-many-arguments
         """
         Parses the input file into output files
 
         Arguments:
-            file_handle -- An input stream for reading a .fec file
+            file_handle -- An input stream for reading a .fec file, a path to a .fec file, or an
+                           object supporting the buffer protocol (e.g. bytes) holding its contents
             open_function -- A function to open an output file for writing. This can be set to
                              customize the output stream for each parsed .csv file
             include_filing_id -- If set, prepend a column into each outputted csv for filing_id
                                  with the specified filing id (defaults to None)
+            include_forms -- If set, an iterable of form type prefixes (e.g. ["SA", "SB"]); only
+                             lines whose form type starts with one of them are parsed
+            exclude_forms -- If set, an iterable of form type prefixes whose lines are skipped
+            columns -- If set, a dictionary mapping form type prefixes to the list of column
+                       names to output for matching form types (e.g. {"SA": ["form_type",
+                       "contribution_amount"]}). Form types with no matching prefix output
+                       every column
 
         Returns:
             A status code. 1 indicates a successful parse, 0 an unsuccessful one.
         """
         # Set callbacks
-        buffer_read_fn = provide_read_callback(file_handle)
         write_callback_fn, free_file_descriptors = provide_write_callback(open_function)
 
         # Prepare the filing id to include, if specified
         include_filing_id = as_bytes(include_filing_id)
-        filing_id_included = include_filing_id is not None
 
         # Initialize fastfec context
-        fec_context = self.libfastfec.newFecContext(
-            self.persistent_memory_context,
-            buffer_read_fn,
-            BUFFER_SIZE,
-            write_callback_fn,
-            BUFFER_SIZE,
-            CUSTOM_LINE(0),
-            0,
-            None,
-            include_filing_id,
-            None,
-            filing_id_included,
-            1,
-            0,
+        fec_context, _input_ref = self.__new_fec_context(
+            file_handle, write_callback_fn, CUSTOM_LINE(0), include_filing_id
         )
+        fec_filter = self.__set_filter(fec_context, include_forms, exclude_forms, columns)
 
         # Parse
         result = self.libfastfec.parseFec(fec_context)
 
         # Free memory and file descriptors
         self.libfastfec.freeFecContext(fec_context)
+        self.__free_filter(fec_filter)
         free_file_descriptors()
 
         return result
 
+    def parse_to_frames(
+        self,
+        file_handle,
+        include_filing_id=None,
+        include_forms=None,
+        exclude_forms=None,
+        columns=None,
+    ):  # pylint: disable=too-many-arguments
+        """
+        Parses the input file into a pandas DataFrame per form type
+
+        Rows are accumulated by the C library as typed columns, then copied into NumPy arrays a
+        column at a time, so no Python objects are made per row. Requires numpy, pandas and
+        pyarrow (without pyarrow, string columns fall back to a Python str per value).
+
+        Arguments:
+            file_handle -- An input stream for reading a .fec file, a path to a .fec file, or an
+                           object supporting the buffer protocol (e.g. bytes) holding its contents
+            include_filing_id -- If set, prepend a column into each DataFrame for filing_id
+                                 with the specified filing id (defaults to None)
+            include_forms -- If set, an iterable of form type prefixes (e.g. ["SA", "SB"]); only
+                             lines whose form type starts with one of them are parsed
+            exclude_forms -- If set, an iterable of form type prefixes whose lines are skipped
+            columns -- If set, a dictionary mapping form type prefixes to the list of column
+                       names to output for matching form types (e.g. {"SA": ["form_type",
+                       "contribution_amount"]}). Form types with no matching prefix output
+                       every column
+
+        Returns:
+            A dictionary mapping each form type (e.g. "SA11AI", in the order they first appear)
+            to a DataFrame of its rows. Rows of a form type whose columns differ from its first
+            rows' (e.g. from an older FEC version) are under "{form type}.2" and so on. Amounts
+            are float64 (NaN where empty), dates datetime64 (NaT where empty or invalid) and
+            other columns strings.
+
+        Raises:
+            MemoryError -- If the rows don't fit within the memory limit
+        """
+        include_filing_id = as_bytes(include_filing_id)
+        fec_context, _input_ref = self.__new_fec_context(
+            file_handle, CUSTOM_WRITE(0), CUSTOM_LINE(0), include_filing_id
+        )
+        fec_filter = self.__set_filter(fec_context, include_forms, exclude_forms, columns)
+        tables = self.libfastfec.newColumnTables(self.allocator)
+
+        try:
+            if not tables or not self.libfastfec.setFecColumns(fec_context, tables):
+                raise MemoryError("Unable to allocate column tables within the memory limit")
+            failures = self.memory_stats()["failures"]
+            self.libfastfec.parseFec(fec_context)
+            # Rows are dropped once memory runs out, so the frames would be incomplete
+            if self.memory_stats()["failures"] > failures:
+                raise MemoryError("Ran out of memory within the memory limit parsing to frames")
+            return column_table_frames(cast(tables, POINTER(ColumnTables)).contents)
+        finally:
+            self.libfastfec.freeFecContext(fec_context)
+            self.__free_filter(fec_filter)
+            self.libfastfec.freeColumnTables(tables)
+
     def free(self):
         """
-        Frees all the allocated memory from the fastfec library
+        Frees all the allocated memory from the fastfec library (only the first time it's
+        called)
         """
+        if self.allocator is None:
+            return
         self.libfastfec.freePersistentMemoryContext(self.persistent_memory_context)
+        self.libfastfec.freeAllocator(self.allocator)
+        self.persistent_memory_context = None
+        self.allocator = None
+
+    def memory_stats(self):
+        """
+        Returns:
+            A dictionary of the library's memory use so far: bytes_live, bytes_peak and the
+            number of allocations, reallocations, frees and failures
+        """
+        stats = AllocatorStats()
+        self.libfastfec.getAllocatorStats(self.allocator, byref(stats))
+        return {name: getattr(stats, name) for name, _ in AllocatorStats._fields_}
+
+    def __new_fec_context(self, file_input, write_callback_fn, line_callback_fn, include_filing_id):
+        """
+        Creates a fastfec context reading from the given input
+
+        Paths are opened and read by C directly and buffer protocol objects are parsed in
+        place; anything else is treated as a stream and read through a Python callback.
+
+        Returns:
+            The context and an object that must be kept alive until the context is freed
+        """
+        memory = None if is_path(file_input) else as_memory(file_input)
+        if is_path(file_input) or memory is not None:
+            buffer_read_fn = BUFFER_READ(0)
+        else:
+            buffer_read_fn = provide_read_callback(file_input)
+
+        fec_context = self.libfastfec.newFecContext(
+            self.persistent_memory_context,
+            buffer_read_fn,
+            BUFFER_SIZE,
+            write_callback_fn,
+            BUFFER_SIZE,
+            line_callback_fn,
+            0,
+            None,
+            include_filing_id,
+            None,
+            include_filing_id is not None,
+            1,
+            0,
+            None,
+        )
+        if not fec_context:
+            raise MemoryError("Unable to allocate a fastfec context within the memory limit")
+
+        if is_path(file_input):
+            if not self.libfastfec.setFecInputPath(fec_context, os.fsencode(file_input)):
+                self.libfastfec.freeFecContext(fec_context)
+                raise FileNotFoundError(f"Unable to open {file_input}")
+            return fec_context, None
+        if memory is not None:
+            contents, address, length = memory
+            self.libfastfec.setFecInputMemory(fec_context, address, length)
+            return fec_context, contents
+        return fec_context, buffer_read_fn
+
+    def __set_filter(self, fec_context, include_forms, exclude_forms, columns):
+        """
+        Restricts the lines and columns the context parses, if any filters are specified
+
+        Returns:
+            The filter, which must be freed with __free_filter after the context is freed
+        """
+        if include_forms is None and exclude_forms is None and columns is None:
+            return None
+
+        fec_filter = self.libfastfec.newFilter(self.allocator)
+        ok = bool(fec_filter)
+        for prefix in include_forms or []:
+            ok = ok and self.libfastfec.filterIncludeFormType(fec_filter, as_bytes(prefix))
+        for prefix in exclude_forms or []:
+            ok = ok and self.libfastfec.filterExcludeFormType(fec_filter, as_bytes(prefix))
+        for prefix, column_names in (columns or {}).items():
+            ok = ok and self.libfastfec.filterSelectColumns(
+                fec_filter, as_bytes(prefix), as_bytes(",".join(column_names))
+            )
+        if not ok:
+            self.libfastfec.freeFecContext(fec_context)
+            self.__free_filter(fec_filter)
+            raise MemoryError("Unable to allocate a filter within the memory limit")
+        self.libfastfec.setFecFilter(fec_context, fec_filter)
+        return fec_filter
+
+    def __free_filter(self, fec_filter):
+        if fec_filter:
+            self.libfastfec.freeFilter(fec_filter)
 
     def __init_lib(self):
         # Find the fastfec library
         self.libfastfec = CDLL(find_fastfec_lib())
 
         # Lay out arg/res types for C callbacks
-        self.libfastfec.newPersistentMemoryContext.argtypes = []
+        self.libfastfec.newAllocator.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p]
+        self.libfastfec.newAllocator.restype = c_void_p
+        self.libfastfec.setAllocatorLimit.argtypes = [c_void_p, c_size_t]
+        self.libfastfec.getAllocatorStats.argtypes = [c_void_p, c_void_p]
+        self.libfastfec.freeAllocator.argtypes = [c_void_p]
+        self.libfastfec.newPersistentMemoryContext.argtypes = [c_void_p]
         self.libfastfec.newPersistentMemoryContext.restype = c_void_p
 
         self.libfastfec.newFecContext.argtypes = [
@@ -203,8 +493,27 @@ class LibFastFEC:
             c_int,
             c_int,
             c_int,
+            c_void_p,
         ]
         self.libfastfec.newFecContext.restype = c_void_p
+        self.libfastfec.setFecInputPath.argtypes = [c_void_p, c_char_p]
+        self.libfastfec.setFecInputPath.restype = c_int
+        self.libfastfec.setFecInputMemory.argtypes = [c_void_p, c_void_p, c_size_t]
+        self.libfastfec.newFilter.argtypes = [c_void_p]
+        self.libfastfec.newFilter.restype = c_void_p
+        self.libfastfec.filterIncludeFormType.argtypes = [c_void_p, c_char_p]
+        self.libfastfec.filterIncludeFormType.restype = c_int
+        self.libfastfec.filterExcludeFormType.argtypes = [c_void_p, c_char_p]
+        self.libfastfec.filterExcludeFormType.restype = c_int
+        self.libfastfec.filterSelectColumns.argtypes = [c_void_p, c_char_p, c_char_p]
+        self.libfastfec.filterSelectColumns.restype = c_int
+        self.libfastfec.setFecFilter.argtypes = [c_void_p, c_void_p]
+        self.libfastfec.newColumnTables.argtypes = [c_void_p]
+        self.libfastfec.newColumnTables.restype = c_void_p
+        self.libfastfec.setFecColumns.argtypes = [c_void_p, c_void_p]
+        self.libfastfec.setFecColumns.restype = c_int
+        self.libfastfec.freeColumnTables.argtypes = [c_void_p]
+        self.libfastfec.freeFilter.argtypes = [c_void_p]
         self.libfastfec.parseFec.argtypes = [c_void_p]
         self.libfastfec.parseFec.restype = c_int
         self.libfastfec.freeFecContext.argtypes = [c_void_p]
@@ -212,7 +521,7 @@ class LibFastFEC:
 
 
 @contextlib.contextmanager
-def FastFEC():  # pylint: disable=invalid-name
+def FastFEC(memory_limit=None):  # pylint: disable=invalid-name
     """
     A convenience method to run fastfec and free memory afterwards
 
@@ -225,6 +534,130 @@ def FastFEC():  # pylint: disable=invalid-name
             # fastfec.free()
             ...
     """
-    instance = LibFastFEC()
+    instance = LibFastFEC(memory_limit=memory_limit)
     yield instance
     instance.free()
+
+
+# The result of parsing one filing with parse_many. status is 1 for a successful parse and
+# 0 for an unsuccessful one; error describes why the filing failed, if it did.
+ParseResult = namedtuple("ParseResult", ["path", "output_directory", "status", "error"])
+
+# The long-lived LibFastFEC instance of a parse_many worker process
+_WORKER_FASTFEC = None
+
+
+def _init_worker():
+    global _WORKER_FASTFEC  # pylint: disable=global-statement
+    _WORKER_FASTFEC = LibFastFEC()
+    # Forked workers exit without running atexit functions, but do run multiprocessing's
+    # finalizers (spawned ones run both, which free allows)
+    atexit.register(_WORKER_FASTFEC.free)
+    Finalize(_WORKER_FASTFEC, _WORKER_FASTFEC.free, exitpriority=0)
+
+
+def _parse_in_worker(path, output_directory, include_filing_id):
+    try:
+        status = _WORKER_FASTFEC.parse_as_files(path, output_directory, include_filing_id=include_filing_id)
+        return ParseResult(path, output_directory, status, None if status == 1 else "Parsing FEC failed")
+    except Exception as error:  # pylint: disable=broad-except
+        return ParseResult(path, output_directory, 0, repr(error))
+
+
+def _broke_pool(future):
+    return isinstance(future.exception(), BrokenProcessPool)
+
+
+def parse_many(paths, output_directory, workers=None, include_filing_id=False):
+    """
+    Parses many .fec files into output .csv files in parallel across worker processes
+
+    Each worker process keeps one LibFastFEC instance for its lifetime. The output of each
+    filing is written to a subdirectory of the output directory named after the filing's
+    file name without its extension, e.g. `{output_directory}/12345/` for `12345.fec`. So a
+    filing with the same file name as an earlier one (e.g. `a/12345.fec` and `b/12345.fec`)
+    isn't parsed, as its output would overwrite the earlier one's: it fails instead.
+
+    Arguments:
+        paths -- An iterable of paths to .fec files
+        output_directory -- A directory in which to place each filing's output directory
+        workers -- The number of worker processes (defaults to the number of CPUs)
+        include_filing_id -- If true, prepend a filing_id column into each outputted csv
+                             holding the name of the filing's output directory
+
+    Returns:
+        A generator yielding a ParseResult for each filing as it finishes (not necessarily in
+        input order). A filing that fails, or crashes its worker, yields a result with status 0
+        and doesn't stop the other filings from being parsed. When a worker crashes, the pool
+        is replaced and the filings that were in flight are parsed again one at a time, so
+        only the filing that crashes a worker on its own fails.
+    """
+    workers = workers or os.cpu_count() or 1
+    pending_paths = iter(paths)
+    filing_ids = set()
+    rejected = []
+    # Filings that were in flight when a worker crashed, to be parsed again alone
+    suspects = deque()
+    executor = ProcessPoolExecutor(max_workers=workers, initializer=_init_worker)
+    # Each in-flight filing's path, output directory and whether it's being parsed alone
+    in_flight = {}
+
+    def submit(path, filing_output_directory, alone):
+        filing_id = os.path.basename(filing_output_directory)
+        future = executor.submit(
+            _parse_in_worker, path, filing_output_directory, filing_id if include_filing_id else None
+        )
+        in_flight[future] = (path, filing_output_directory, alone)
+
+    def fill_queue():
+        if suspects:
+            # Suspects are parsed one at a time, so one that crashes its worker again is
+            # known to be the cause
+            if not in_flight:
+                submit(*suspects.popleft(), True)
+            return
+        # Keep a bounded number of filings queued so paths can be streamed in
+        for path in pending_paths:
+            filing_id = pathlib.Path(path).stem
+            filing_output_directory = os.path.join(output_directory, filing_id)
+            if filing_id in filing_ids:
+                rejected.append(
+                    ParseResult(path, filing_output_directory, 0, f"Another filing is already named {filing_id}")
+                )
+                continue
+            filing_ids.add(filing_id)
+            submit(path, filing_output_directory, False)
+            if len(in_flight) >= workers * 2:
+                break
+
+    try:
+        fill_queue()
+        while in_flight or rejected:
+            yield from rejected
+            rejected.clear()
+            if not in_flight:
+                break
+            done, _ = wait(in_flight, return_when=FIRST_COMPLETED)
+            if not any(_broke_pool(future) for future in done):
+                for future in done:
+                    del in_flight[future]
+                    yield future.result()
+            else:
+                # A worker died and took the pool down with it (failing every filing in
+                # flight): carry on with a fresh pool, suspecting the filings it failed
+                for future, (path, filing_output_directory, alone) in list(in_flight.items()):
+                    if not _broke_pool(future):
+                        yield future.result()
+                    elif alone:
+                        yield ParseResult(path, filing_output_directory, 0, repr(future.exception()))
+                    else:
+                        suspects.append((path, filing_output_directory))
+                in_flight.clear()
+                executor.shutdown(wait=False)
+                executor = ProcessPoolExecutor(max_workers=workers, initializer=_init_worker)
+
+            fill_queue()
+    finally:
+        for future in in_flight:
+            future.cancel()
+        executor.shutdown(wait=True)
@@ -14,12 +14,21 @@ import pathlib
 from ctypes import (
     CFUNCTYPE,
     POINTER,
+    Structure,
+    byref,
     c_char,
     c_char_p,
+    c_double,
     c_int,
+    c_int64,
     c_size_t,
+    c_ssize_t,
     c_void_p,
+    cast,
     memmove,
+    py_object,
+    pythonapi,
+    string_at,
 )
 from glob import glob
 
@@ -59,6 +68,84 @@ def make_read_buffer(file_input):
     return read_buffer
 
 
+def is_path(file_input):
+    """
+    Returns whether the input should be opened as a path to a file on disk
+    """
+    return isinstance(file_input, (str, os.PathLike))
+
+
+class PyBuffer(Structure):  # pylint: disable=too-few-public-methods
+    """
+    Mirrors Py_buffer in CPython's buffer protocol
+    """
+
+    _fields_ = [
+        ("buf", c_void_p),
+        ("obj", c_void_p),
+        ("len", c_ssize_t),
+        ("itemsize", c_ssize_t),
+        ("readonly", c_int),
+        ("ndim", c_int),
+        ("format", c_char_p),
+        ("shape", POINTER(c_ssize_t)),
+        ("strides", POINTER(c_ssize_t)),
+        ("suboffsets", POINTER(c_ssize_t)),
+        ("internal", c_void_p),
+    ]
+
+
+pythonapi.PyObject_GetBuffer.argtypes = [py_object, POINTER(PyBuffer), c_int]
+pythonapi.PyObject_GetBuffer.restype = c_int
+pythonapi.PyBuffer_Release.argtypes = [POINTER(PyBuffer)]
+pythonapi.PyBuffer_Release.restype = None
+
+# Requests a contiguous buffer of bytes, read-only or not
+PYBUF_SIMPLE = 0
+
+
+class BufferExport:  # pylint: disable=too-few-public-methods
+    """
+    Holds an object's buffer exported through the buffer protocol, releasing it once no
+    longer referenced (until then, e.g. an mmap can't be closed or a bytearray resized)
+    """
+
+    def __init__(self, buffer):
+        self.buffer = buffer
+
+    def __del__(self):
+        pythonapi.PyBuffer_Release(byref(self.buffer))
+
+
+def as_memory(file_input):
+    """
+    Exposes an object supporting the buffer protocol so that C code can read it in place
+
+    Contiguous buffers (e.g. bytes, bytearray, mmap, including read-only ones) are shared
+    without copying; only non-contiguous views are copied once up front.
+
+    Arguments:
+        file_input -- An object that may support the buffer protocol (e.g. bytes or mmap)
+
+    Returns:
+        An (object to keep alive, address, length) tuple, or None if the input doesn't
+        support the buffer protocol
+    """
+    try:
+        view = memoryview(file_input)
+    except TypeError:
+        return None
+
+    buffer = PyBuffer()
+    try:
+        pythonapi.PyObject_GetBuffer(file_input, byref(buffer), PYBUF_SIMPLE)
+    except BufferError:
+        # Exporters refuse simple requests for buffers that aren't contiguous
+        return as_memory(view.tobytes())
+    export = BufferExport(buffer)
+    return export, buffer.buf, buffer.len
+
+
 def find_fastfec_lib():
     """
     Scans for the fastfec shared library and returns the path of the found library
@@ -300,3 +387,53 @@ def provide_line_callback(queue, filing_id_included, should_parse_date):
                 )
 
     return line_callback
+
+
+def column_array(column, num_rows):
+    """
+    Copies a column of a column table (see columns.h) out of the library's memory
+
+    Float columns become float64 arrays and date columns datetime64 arrays. String columns
+    become pyarrow-backed string arrays built straight from the column's buffers if pyarrow
+    is installed, or object arrays of str otherwise.
+    """
+    import numpy  # pylint: disable=import-outside-toplevel
+
+    if column.type == b"f":
+        return numpy.ctypeslib.as_array(cast(column.values, POINTER(c_double)), (num_rows,)).copy()
+    if column.type == b"d":
+        days = numpy.ctypeslib.as_array(cast(column.values, POINTER(c_int64)), (num_rows,)).copy()
+        return days.view("datetime64[D]")
+
+    # Row i of a string column spans offsets i to i + 1 of its data
+    offsets = numpy.ctypeslib.as_array(cast(column.values, POINTER(c_int64)), (num_rows + 1,)).copy()
+    data = string_at(column.data, column.data_length) if column.data_length > 0 else b""
+    try:
+        import pandas  # pylint: disable=import-outside-toplevel
+        import pyarrow  # pylint: disable=import-outside-toplevel
+    except ImportError:
+        strings = numpy.empty(num_rows, dtype=object)
+        strings[:] = [data[start:end].decode("utf8") for start, end in zip(offsets[:-1].tolist(), offsets[1:].tolist())]
+        return strings
+    strings = pyarrow.LargeStringArray.from_buffers(num_rows, pyarrow.py_buffer(offsets), pyarrow.py_buffer(data))
+    return pandas.array(strings, dtype=pandas.StringDtype("pyarrow"))
+
+
+def column_table_frames(tables):
+    """
+    Copies every table of column tables (see columns.h) into a dictionary of pandas DataFrames,
+    keyed by form type (and variant, e.g. "SA11AI.2", past the first)
+    """
+    import pandas  # pylint: disable=import-outside-toplevel
+
+    frames = {}
+    for i in range(tables.num_tables):
+        table = tables.tables[i]
+        name = table.name.decode("utf8") + (f".{table.variant}" if table.variant > 1 else "")
+        frames[name] = pandas.DataFrame(
+            {
+                table.columns[j].name.decode("utf8"): column_array(table.columns[j], table.num_rows)
+                for j in range(table.num_columns)
+            }
+        )
+    return frames
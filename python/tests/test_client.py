@@ -1,7 +1,20 @@
 import datetime
+import mmap
+import multiprocessing
 import os
+import pathlib
 
-from fastfec import FastFEC
+import pytest
+
+from fastfec import FastFEC, client, parse_many
+from fastfec.client import _parse_in_worker
+
+
+def _parse_or_crash(path, output_directory, include_filing_id):
+    # Stands in for the worker's parse, taking down the worker for filings named crash.fec
+    if os.path.basename(path) == "crash.fec":
+        os._exit(1)
+    return _parse_in_worker(path, output_directory, include_filing_id)
 
 
 def test_filing_1550126_line_callback(filing_1550126):
@@ -51,6 +64,63 @@ def test_filing_1550126_line_callback(filing_1550126):
             assert disbursement_data["payee_street_1"] == "1111 Lake Ter"
 
 
+def test_filing_1550126_direct_inputs(filing_1550126):
+    """
+    Test that parsing from a path or an in-memory buffer, which bypass the Python
+    read callback, gives the same results as parsing from a stream.
+    """
+    with FastFEC() as fastfec:
+        with open(filing_1550126, "rb") as filing:
+            expected = list(fastfec.parse(filing))
+            filing.seek(0)
+            contents = filing.read()
+
+        assert list(fastfec.parse(filing_1550126)) == expected
+        assert list(fastfec.parse(pathlib.Path(filing_1550126))) == expected
+        assert list(fastfec.parse(contents)) == expected
+        assert list(fastfec.parse(bytearray(contents))) == expected
+        assert list(fastfec.parse(memoryview(contents))) == expected
+        with open(filing_1550126, "rb") as filing:
+            with mmap.mmap(filing.fileno(), 0, access=mmap.ACCESS_READ) as mapped:
+                assert list(fastfec.parse(mapped)) == expected
+
+
+def test_filing_1550548_parse_as_files_from_path(tmpdir, filing_1550548):
+    """
+    Test that the FastFEC `parse_as_files` method reads a path directly and that
+    a missing path raises an error.
+    """
+    with FastFEC() as fastfec:
+        assert fastfec.parse_as_files(filing_1550548, tmpdir) == 1
+        with pytest.raises(FileNotFoundError):
+            fastfec.parse_as_files(os.path.join(tmpdir, "missing.fec"), tmpdir)
+
+    with open(os.path.join(tmpdir, "SA11AI.csv")) as filing:
+        assert len(filing.readlines()) == 77
+
+
+def test_memory_stats_and_limit(tmpdir, filing_1550548):
+    """
+    Test that the library's memory use is tracked and that a parse which
+    needs more memory than the limit fails instead of aborting.
+    """
+    with FastFEC() as fastfec:
+        assert fastfec.parse_as_files(filing_1550548, tmpdir) == 1
+        stats = fastfec.memory_stats()
+        assert stats["allocations"] > 0
+        assert stats["bytes_peak"] >= stats["bytes_live"] > 0
+        assert stats["failures"] == 0
+
+    with FastFEC(memory_limit=1024) as fastfec:
+        with pytest.raises(MemoryError):
+            fastfec.parse_as_files(filing_1550548, tmpdir)
+
+    # Enough to start parsing but not to buffer every output file
+    with FastFEC(memory_limit=3 * 1024 * 1024) as fastfec:
+        assert fastfec.parse_as_files(filing_1550548, os.path.join(tmpdir, "limited")) == 0
+        assert fastfec.memory_stats()["failures"] > 0
+
+
 def test_filing_1550548_parse_as_files(tmpdir, filing_1550548):
     """
     Test that the FastFEC `parse_as_files` method outputs the correct files
@@ -123,3 +193,144 @@ def test_filing_with_invalid_version_does_not_exit_1(tmpdir, filing_invalid_vers
     with open(filing_invalid_version, "rb") as filing:
         with FastFEC() as fastfec:
             assert fastfec.parse_as_files(filing, tmpdir) != 1
+
+
+def test_parse_many(tmpdir, filing_1550126, filing_1550548, filing_invalid_version):
+    """
+    Test that `parse_many` parses filings in parallel into per-filing output directories,
+    reporting failures per filing without affecting the others.
+    """
+    missing = os.path.join(tmpdir, "missing.fec")
+    # A filing with the same file name as another would share its output directory
+    duplicate = os.path.join(tmpdir, "copy", "1550548.fec")
+    os.makedirs(os.path.dirname(duplicate))
+    with open(filing_1550126, "rb") as source, open(duplicate, "wb") as copy:
+        copy.write(source.read())
+    paths = [filing_1550126, filing_1550548, filing_invalid_version, missing, duplicate]
+    results = {result.path: result for result in parse_many(paths, tmpdir, workers=2, include_filing_id=True)}
+
+    assert len(results) == 5
+    assert results[duplicate].status == 0
+    assert "1550548" in results[duplicate].error
+    assert results[filing_1550126].status == 1
+    assert results[filing_1550548].status == 1
+    assert results[filing_invalid_version].status != 1
+    assert results[missing].status == 0
+    assert "FileNotFoundError" in results[missing].error
+
+    assert results[filing_1550548].output_directory == os.path.join(tmpdir, "1550548")
+    with open(os.path.join(tmpdir, "1550548", "SA11AI.csv")) as filing:
+        lines = filing.readlines()
+        assert len(lines) == 77
+        assert lines[0].startswith("filing_id,")
+        assert lines[1].startswith("1550548,")
+
+
+@pytest.mark.skipif(multiprocessing.get_start_method() != "fork", reason="workers must inherit the patched parse")
+def test_parse_many_worker_crash(tmpdir, monkeypatch, filing_1550126, filing_1550548, filing_invalid_version):
+    """
+    Test that a filing that crashes its worker fails alone, with the filings that were in
+    flight alongside it parsed again on a fresh pool.
+    """
+    monkeypatch.setattr(client, "_parse_in_worker", _parse_or_crash)
+    crash = os.path.join(tmpdir, "crash.fec")
+    with open(filing_1550126, "rb") as source, open(crash, "wb") as copy:
+        copy.write(source.read())
+    paths = [filing_1550126, crash, filing_1550548, filing_invalid_version]
+    results = {result.path: result for result in parse_many(paths, tmpdir, workers=2)}
+
+    assert len(results) == 4
+    assert results[crash].status == 0
+    assert "BrokenProcessPool" in results[crash].error
+    assert results[filing_1550126].status == 1
+    assert results[filing_1550548].status == 1
+    assert results[filing_invalid_version].status != 1
+    assert results[filing_invalid_version].error == "Parsing FEC failed"
+    assert os.path.exists(os.path.join(tmpdir, "1550548", "SA11AI.csv"))
+
+
+def test_filing_1550548_parse_as_files_filtered(tmpdir, filing_1550548):
+    """
+    Test that the FastFEC `parse_as_files` method only outputs the
+    form types and columns that are selected.
+    """
+    with FastFEC() as fastfec:
+        assert (
+            fastfec.parse_as_files(
+                filing_1550548,
+                tmpdir,
+                include_forms=["SA", "SB2"],
+                exclude_forms=["SB23"],
+                columns={"SA": ["form_type", "transaction_id", "contribution_amount"]},
+            )
+            == 1
+        )
+
+    assert sorted(os.listdir(tmpdir)) == ["SA11AI.csv", "SB21B.csv", "header.csv"]
+
+    with open(os.path.join(tmpdir, "SA11AI.csv")) as filing:
+        lines = filing.readlines()
+        assert len(lines) == 77
+        assert lines[0] == "form_type,transaction_id,contribution_amount\n"
+        assert all(len(line.split(",")) == 3 for line in lines)
+
+    with open(os.path.join(tmpdir, "SB21B.csv")) as filing:
+        assert len(filing.readlines()) == 8
+
+
+def test_filing_1550126_line_callback_filtered(filing_1550126):
+    """
+    Test that the FastFEC line-by-line callback only yields the
+    form types and columns that are selected.
+    """
+    with FastFEC() as fastfec:
+        parsed = list(
+            fastfec.parse(
+                filing_1550126, include_forms=["sa"], columns={"SA": ["contribution_amount", "contribution_date"]}
+            )
+        )
+
+    # The header is always parsed
+    assert parsed[0][0] == "header"
+    assert len(parsed) > 1
+    for form, data in parsed[1:]:
+        assert form.startswith("SA")
+        assert sorted(data) == ["contribution_amount", "contribution_date"]
+
+
+def test_filing_1550126_parse_to_frames(filing_1550126):
+    """
+    Test that parsing into DataFrames gives the rows of the line-by-line callback,
+    as typed columns per form type.
+    """
+    pytest.importorskip("pandas")
+    import numpy  # pylint: disable=import-outside-toplevel
+
+    with FastFEC() as fastfec:
+        parsed = list(fastfec.parse(filing_1550126))
+        frames = fastfec.parse_to_frames(filing_1550126, include_filing_id="1550126")
+
+    # Frames are named like the files the rows would be written to (e.g. SC/10 as SC-10)
+    forms = [form.replace("/", "-") for form, _ in parsed]
+    assert list(frames) == list(dict.fromkeys(forms))
+    for form, frame in frames.items():
+        assert len(frame) == forms.count(form)
+
+    contributions = frames["SA11AI"]
+    assert list(contributions.columns)[0] == "filing_id"
+    assert contributions["filing_id"][0] == "1550126"
+    assert contributions["contributor_last_name"][0] == "barbariniweil"
+    assert contributions["contribution_amount"].dtype == numpy.float64
+    assert contributions["contribution_amount"][0] == 1000.0
+    assert contributions["contribution_date"][0] == numpy.datetime64("2021-08-05")
+    assert contributions["reference_code"][0] == ""
+
+    summary = frames["F3A"]
+    assert summary["election_date"].isna()[0]
+    assert summary["col_b_total_disbursements"][0] == 9229.09
+
+    with FastFEC() as fastfec:
+        frames = fastfec.parse_to_frames(filing_1550126, include_forms=["SB"], columns={"SB": ["expenditure_amount"]})
+    assert list(frames["SB17"].columns) == ["expenditure_amount"]
+    expenditures = [data["expenditure_amount"] for form, data in parsed if form == "SB17"]
+    assert frames["SB17"]["expenditure_amount"].tolist() == expenditures
@@ -59,6 +59,26 @@ def with_comment(comment, text):
     return f"{comment}{text}"
 
 
+def unify_columns(versions):
+    """Unites the columns of each version of a form type into one schema
+
+    Columns are matched by name (the nth column with a name in one version
+    matches the nth column with the name in another), and are ordered as
+    they first appear going through the versions in order.
+    """
+    unified = []
+    seen = set()
+    for columns in versions:
+        occurrences = {}
+        for column in columns:
+            occurrences[column] = occurrences.get(column, 0) + 1
+            key = (column, occurrences[column])
+            if key not in seen:
+                seen.add(key)
+                unified.append(column)
+    return unified
+
+
 type_enum = {
     "float": "f",
     "date": "d",
@@ -83,6 +103,16 @@ if __name__ == "__main__":
             )
     header_table = generate_c_array("headers", 3, headers)
 
+    unified_headers = []
+    for form_type in mappings_json:
+        unified_headers.append(
+            [
+                form_type,
+                list_to_csv(unify_columns(mappings_json[form_type].values())),
+            ]
+        )
+    unified_header_table = generate_c_array("unifiedHeaders", 2, unified_headers)
+
     types = []
     for form_type in types_json:
         for version in types_json[form_type]:
@@ -115,6 +145,14 @@ if __name__ == "__main__":
         header_table,
     )
     result += "\n"
+    result += with_comment(
+        "Unified header names of each form type across all versions\n"
+        + "The first column is a regex matching the form type (as in the mapping above)\n"
+        + "The last column is a CSV of the header values of every version, where the\n"
+        + "nth column with a name in each version is the nth column with the name here",
+        unified_header_table,
+    )
+    result += "\n"
     result += with_comment(
         "Mapping of FEC filing version, form type, and column name to type\n"
         + "The first three columns are the version, form type, and column name\n"
@@ -0,0 +1,88 @@
+"""
+A client for `fastfec serve`, for trying out and testing the server locally.
+
+Sends a parse request to the server listening on a Unix domain socket and prints its JSON
+response. The filing is either parsed by the server from a path, or streamed to it from a file
+or stdin.
+
+    python scripts/serve_client.py /tmp/fastfec.sock 13360 --path 13360.fec
+    curl https://docquery.fec.gov/dcdev/posted/13360.fec | python scripts/serve_client.py /tmp/fastfec.sock 13360
+"""
+
+import argparse
+import json
+import os
+import socket
+import sys
+
+CHUNK_SIZE = 65536
+
+
+def request(socket_path, filing_id, output=None, path=None, stream=None, **options):
+    """Sends a parse request and returns the response as a dict
+
+    If path is set, the server opens the filing itself; otherwise the filing is streamed from the
+    stream file object. The remaining options (include_filing_id, warn, pipeline) are sent as
+    request headers when set.
+    """
+    headers = [f"filing_id {filing_id}"]
+    if output is not None:
+        headers.append(f"output {output}")
+    if path is not None:
+        headers.append(f"path {os.path.abspath(path)}")
+    for key, value in options.items():
+        if value:
+            headers.append(f"{key} 1")
+
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+        client.connect(socket_path)
+        client.sendall(("\n".join(headers) + "\n\n").encode("utf8"))
+        if path is None and stream is not None:
+            while True:
+                chunk = stream.read(CHUNK_SIZE)
+                if not chunk:
+                    break
+                client.sendall(chunk)
+        # Ending the request's input tells the server the filing is complete
+        client.shutdown(socket.SHUT_WR)
+
+        response = b""
+        while True:
+            chunk = client.recv(CHUNK_SIZE)
+            if not chunk:
+                break
+            response += chunk
+    return json.loads(response)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Send a filing to a running `fastfec serve`")
+    parser.add_argument("socket", help="the server's socket path")
+    parser.add_argument("filing_id", help="the filing ID")
+    parser.add_argument("file", nargs="?", help="a filing to stream (default: stdin)")
+    parser.add_argument("--path", help="have the server read the filing from this path instead")
+    parser.add_argument("--output", help="the output directory (default: the server's output/)")
+    parser.add_argument("--include-filing-id", action="store_true")
+    parser.add_argument("--warn", action="store_true")
+    parser.add_argument("--pipeline", action="store_true")
+    args = parser.parse_args()
+
+    options = {
+        "include_filing_id": args.include_filing_id,
+        "warn": args.warn,
+        "pipeline": args.pipeline,
+    }
+    if args.path is not None:
+        response = request(args.socket, args.filing_id, args.output, path=args.path, **options)
+    elif args.file is not None:
+        with open(args.file, "rb") as stream:
+            response = request(args.socket, args.filing_id, args.output, stream=stream, **options)
+    else:
+        response = request(args.socket, args.filing_id, args.output, stream=sys.stdin.buffer, **options)
+
+    print(json.dumps(response, indent=2))
+    sys.exit(0 if response["status"] == "ok" else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+#include "allocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Each allocation is preceded by a header holding its size (so live
+// bytes can be tracked without help from the host). The header is
+// padded to keep allocations aligned for any type.
+#define ALLOCATION_HEADER 16
+
+void *defaultAllocate(void *state, size_t size)
+{
+  (void)state;
+  return malloc(size);
+}
+
+void *defaultReallocate(void *state, void *ptr, size_t size)
+{
+  (void)state;
+  return realloc(ptr, size);
+}
+
+void defaultFree(void *state, void *ptr)
+{
+  (void)state;
+  free(ptr);
+}
+
+ALLOCATOR *newAllocator(AllocateFunction allocate, ReallocateFunction reallocate, FreeFunction release, void *state)
+{
+  ALLOCATOR *allocator = (ALLOCATOR *)malloc(sizeof(ALLOCATOR));
+  allocator->allocate = allocate != NULL ? allocate : defaultAllocate;
+  allocator->reallocate = reallocate != NULL ? reallocate : defaultReallocate;
+  allocator->free = release != NULL ? release : defaultFree;
+  allocator->state = state;
+  allocator->limit = 0;
+  allocator->stats.bytesLive = 0;
+  allocator->stats.bytesPeak = 0;
+  allocator->stats.allocations = 0;
+  allocator->stats.reallocations = 0;
+  allocator->stats.frees = 0;
+  allocator->stats.failures = 0;
+  return allocator;
+}
+
+void setAllocatorLimit(ALLOCATOR *allocator, size_t limit)
+{
+  allocator->limit = limit;
+}
+
+void getAllocatorStats(ALLOCATOR *allocator, ALLOCATOR_STATS *stats)
+{
+  *stats = allocator->stats;
+}
+
+void freeAllocator(ALLOCATOR *allocator)
+{
+  free(allocator);
+}
+
+// Return whether growing the live bytes by the given amount stays
+// within the limit, counting a failure if it doesn't
+int withinLimit(ALLOCATOR *allocator, size_t growth)
+{
+  if ((allocator->limit != 0) && (allocator->stats.bytesLive + growth > allocator->limit))
+  {
+    allocator->stats.failures++;
+    return 0;
+  }
+  return 1;
+}
+
+void countLive(ALLOCATOR *allocator, size_t added, size_t removed)
+{
+  allocator->stats.bytesLive += added;
+  allocator->stats.bytesLive -= removed;
+  if (allocator->stats.bytesLive > allocator->stats.bytesPeak)
+  {
+    allocator->stats.bytesPeak = allocator->stats.bytesLive;
+  }
+}
+
+void *allocatorMalloc(ALLOCATOR *allocator, size_t size)
+{
+  if (allocator == NULL)
+  {
+    return malloc(size);
+  }
+  allocator->stats.allocations++;
+  if (!withinLimit(allocator, size))
+  {
+    return NULL;
+  }
+  char *block = (char *)allocator->allocate(allocator->state, size + ALLOCATION_HEADER);
+  if (block == NULL)
+  {
+    allocator->stats.failures++;
+    return NULL;
+  }
+  *(size_t *)block = size;
+  countLive(allocator, size, 0);
+  return block + ALLOCATION_HEADER;
+}
+
+void *allocatorRealloc(ALLOCATOR *allocator, void *ptr, size_t size)
+{
+  if (allocator == NULL)
+  {
+    return realloc(ptr, size);
+  }
+  if (ptr == NULL)
+  {
+    return allocatorMalloc(allocator, size);
+  }
+  allocator->stats.reallocations++;
+  char *block = (char *)ptr - ALLOCATION_HEADER;
+  size_t oldSize = *(size_t *)block;
+  if ((size > oldSize) && !withinLimit(allocator, size - oldSize))
+  {
+    return NULL;
+  }
+  block = (char *)allocator->reallocate(allocator->state, block, size + ALLOCATION_HEADER);
+  if (block == NULL)
+  {
+    allocator->stats.failures++;
+    return NULL;
+  }
+  *(size_t *)block = size;
+  countLive(allocator, size, oldSize);
+  return block + ALLOCATION_HEADER;
+}
+
+void allocatorFree(ALLOCATOR *allocator, void *ptr)
+{
+  if (allocator == NULL)
+  {
+    free(ptr);
+    return;
+  }
+  if (ptr == NULL)
+  {
+    return;
+  }
+  allocator->stats.frees++;
+  char *block = (char *)ptr - ALLOCATION_HEADER;
+  countLive(allocator, 0, *(size_t *)block);
+  allocator->free(allocator->state, block);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include "export.h"
+
+// Functions an embedding host can supply to allocate the library's
+// memory (each receives the allocator's state). They follow the
+// semantics of malloc, realloc and free.
+typedef void *(*AllocateFunction)(void *state, size_t size);
+typedef void *(*ReallocateFunction)(void *state, void *ptr, size_t size);
+typedef void (*FreeFunction)(void *state, void *ptr);
+
+struct allocator_stats
+{
+  size_t bytesLive;     // bytes currently allocated
+  size_t bytesPeak;     // the most bytes allocated at once
+  size_t allocations;   // calls to allocate
+  size_t reallocations; // calls to reallocate
+  size_t frees;         // calls to free
+  size_t failures;      // allocations refused by the limit or the host
+};
+typedef struct allocator_stats ALLOCATOR_STATS;
+
+struct allocator
+{
+  AllocateFunction allocate;
+  ReallocateFunction reallocate;
+  FreeFunction free;
+  void *state;
+
+  // The most bytes that can be allocated at once (0 for no limit)
+  size_t limit;
+
+  ALLOCATOR_STATS stats;
+};
+typedef struct allocator ALLOCATOR;
+
+// Create an allocator that routes through the given functions, or
+// through the C library's if they're NULL. The allocator must outlive
+// every context that uses it, and isn't synchronized, so contexts
+// parsing on different threads need their own.
+EXPORT ALLOCATOR *newAllocator(AllocateFunction allocate, ReallocateFunction reallocate, FreeFunction release, void *state);
+
+// Make allocations fail once the given number of bytes are live
+EXPORT void setAllocatorLimit(ALLOCATOR *allocator, size_t limit);
+
+EXPORT void getAllocatorStats(ALLOCATOR *allocator, ALLOCATOR_STATS *stats);
+
+EXPORT void freeAllocator(ALLOCATOR *allocator);
+
+// Allocate, reallocate or free memory through the allocator. A NULL
+// allocator uses the C library directly, without statistics. Failed
+// allocations return NULL.
+void *allocatorMalloc(ALLOCATOR *allocator, size_t size);
+
+void *allocatorRealloc(ALLOCATOR *allocator, void *ptr, size_t size);
+
+void allocatorFree(ALLOCATOR *allocator, void *ptr);
@@ -0,0 +1,102 @@
+#include "arena.h"
+#include <string.h>
+
+// Allocations are aligned to this many bytes
+#define ARENA_ALIGNMENT 16
+
+ARENA *newArena(size_t chunkSize, ALLOCATOR *allocator)
+{
+  ARENA *arena = (ARENA *)allocatorMalloc(allocator, sizeof(ARENA));
+  if (arena == NULL)
+  {
+    return NULL;
+  }
+  arena->allocator = allocator;
+  arena->chunks = NULL;
+  arena->chunkSize = chunkSize;
+  arena->allocations = 0;
+  arena->mallocs = 0;
+  arena->bytes = 0;
+  return arena;
+}
+
+void *arenaAlloc(ARENA *arena, size_t size)
+{
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+  ARENA_CHUNK *chunk = arena->chunks;
+  if ((chunk == NULL) || (chunk->size - chunk->used < size))
+  {
+    // Start a new chunk (a dedicated one if the allocation is too big
+    // to share)
+    size_t chunkSize = size > arena->chunkSize ? size : arena->chunkSize;
+    chunk = (ARENA_CHUNK *)allocatorMalloc(arena->allocator, sizeof(ARENA_CHUNK) + ARENA_ALIGNMENT + chunkSize);
+    if (chunk == NULL)
+    {
+      return NULL;
+    }
+    chunk->size = chunkSize;
+    // Start the data on an aligned address
+    chunk->used = (ARENA_ALIGNMENT - ((size_t)chunk->data % ARENA_ALIGNMENT)) % ARENA_ALIGNMENT;
+    chunk->size += chunk->used;
+    arena->mallocs++;
+    if ((arena->chunks != NULL) && (size > arena->chunkSize))
+    {
+      // Keep bump allocating from the current chunk
+      chunk->next = arena->chunks->next;
+      arena->chunks->next = chunk;
+    }
+    else
+    {
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+  }
+  void *allocation = chunk->data + chunk->used;
+  chunk->used += size;
+  arena->allocations++;
+  arena->bytes += size;
+  return allocation;
+}
+
+char *arenaStrndup(ARENA *arena, const char *str, size_t length)
+{
+  char *copy = (char *)arenaAlloc(arena, length + 1);
+  if (copy == NULL)
+  {
+    return NULL;
+  }
+  memcpy(copy, str, length);
+  copy[length] = 0;
+  return copy;
+}
+
+char *arenaStrdup(ARENA *arena, const char *str)
+{
+  return arenaStrndup(arena, str, strlen(str));
+}
+
+void *arenaGrow(ARENA *arena, void *old, size_t oldSize, size_t newSize)
+{
+  void *allocation = arenaAlloc(arena, newSize);
+  if ((allocation != NULL) && (old != NULL))
+  {
+    memcpy(allocation, old, oldSize < newSize ? oldSize : newSize);
+  }
+  return allocation;
+}
+
+void freeArena(ARENA *arena)
+{
+  if (arena == NULL)
+  {
+    return;
+  }
+  ARENA_CHUNK *chunk = arena->chunks;
+  while (chunk != NULL)
+  {
+    ARENA_CHUNK *next = chunk->next;
+    allocatorFree(arena->allocator, chunk);
+    chunk = next;
+  }
+  allocatorFree(arena->allocator, arena);
+}
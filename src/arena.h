@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include "allocator.h"
+
+// A bump allocator for allocations that live as long as their context
+// (e.g. form type mappings and output file names). Memory is carved out
+// of large chunks and only released all at once when the arena is
+// freed.
+struct arena_chunk
+{
+  struct arena_chunk *next;
+  size_t size;
+  size_t used;
+  char data[];
+};
+typedef struct arena_chunk ARENA_CHUNK;
+
+struct arena
+{
+  ARENA_CHUNK *chunks; // the current chunk, followed by earlier ones
+  size_t chunkSize;
+  ALLOCATOR *allocator; // where chunks come from
+
+  // Statistics
+  size_t allocations; // calls to arenaAlloc
+  size_t mallocs;     // chunks allocated from the allocator
+  size_t bytes;       // bytes handed out
+};
+typedef struct arena ARENA;
+
+ARENA *newArena(size_t chunkSize, ALLOCATOR *allocator);
+
+// Allocate size bytes (aligned for any type) that live until the arena
+// is freed. Return NULL if memory is exhausted.
+void *arenaAlloc(ARENA *arena, size_t size);
+
+// Copy the first length characters of str into the arena, null
+// terminated
+char *arenaStrndup(ARENA *arena, const char *str, size_t length);
+
+char *arenaStrdup(ARENA *arena, const char *str);
+
+// Move an allocation of oldSize bytes to a new one of newSize bytes.
+// The old allocation isn't reclaimed, so arrays should grow
+// geometrically.
+void *arenaGrow(ARENA *arena, void *old, size_t oldSize, size_t newSize);
+
+void freeArena(ARENA *arena);
@@ -1,21 +1,479 @@
 #include "buffer.h"
+#include "cpu.h"
 #include <string.h>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+#if !defined(_WIN32) && !defined(__wasm__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define BUFFER_MMAP
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#define BUFFER_THREADS
+#endif
 
-BUFFER *newBuffer(int bufferSize, BufferRead bufferRead)
+// The largest window of in-memory input exposed to the line reader at
+// once (buffer positions are ints)
+#define MEMORY_WINDOW (1 << 30)
+
+int findByteScalar(const char *str, int length, char c)
+{
+  const char *found = memchr(str, c, length);
+  return found != NULL ? (int)(found - str) : -1;
+}
+
+#ifdef CPU_X86
+__attribute__((target("sse2"))) int findByteSse2(const char *str, int length, char c)
+{
+  __m128i needle = _mm_set1_epi8(c);
+  int i = 0;
+  for (; i + 16 <= length; i += 16)
+  {
+    int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + i)), needle));
+    if (matches != 0)
+    {
+      return i + __builtin_ctz(matches);
+    }
+  }
+  for (; i < length; i++)
+  {
+    if (str[i] == c)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+__attribute__((target("avx2"))) int findByteAvx2(const char *str, int length, char c)
 {
-  BUFFER *buffer = malloc(sizeof(BUFFER));
+  __m256i needle = _mm256_set1_epi8(c);
+  int i = 0;
+  for (; i + 32 <= length; i += 32)
+  {
+    unsigned int matches = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + i)), needle));
+    if (matches != 0)
+    {
+      return i + __builtin_ctz(matches);
+    }
+  }
+  // Finish with 128-bit and scalar steps here rather than calling the
+  // SSE2 kernel, which would mix in non-VEX instructions
+  if (i + 16 <= length)
+  {
+    int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + i)), _mm256_castsi256_si128(needle)));
+    if (matches != 0)
+    {
+      return i + __builtin_ctz(matches);
+    }
+    i += 16;
+  }
+  for (; i < length; i++)
+  {
+    if (str[i] == c)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+__attribute__((target("avx512f,avx512bw"))) int findByteAvx512(const char *str, int length, char c)
+{
+  __m512i needle = _mm512_set1_epi8(c);
+  int i = 0;
+  for (; i < length; i += 64)
+  {
+    // Masked loads don't touch the bytes past the end of the input
+    __mmask64 valid = length - i >= 64 ? ~0ULL : (1ULL << (length - i)) - 1;
+    __m512i block = _mm512_maskz_loadu_epi8(valid, str + i);
+    __mmask64 matches = _mm512_mask_cmpeq_epi8_mask(valid, block, needle);
+    if (matches != 0)
+    {
+      return i + __builtin_ctzll(matches);
+    }
+  }
+  return -1;
+}
+#endif
+
+FindByteKernel findByteKernel(int level)
+{
+#ifdef CPU_X86
+  switch (level)
+  {
+  case CPU_LEVEL_AVX512:
+    return findByteAvx512;
+  case CPU_LEVEL_AVX2:
+    return findByteAvx2;
+  case CPU_LEVEL_SSE2:
+    return findByteSse2;
+  }
+#endif
+  return findByteScalar;
+}
+
+// The kernel is picked on the first call, which replaces this one
+int findByteFirstCall(const char *str, int length, char c);
+static FindByteKernel findByteSelected = findByteFirstCall;
+
+int findByteFirstCall(const char *str, int length, char c)
+{
+  // Racing threads all select the same kernel
+  FindByteKernel kernel = findByteKernel(cpuLevel());
+  __atomic_store_n(&findByteSelected, kernel, __ATOMIC_RELAXED);
+  return kernel(str, length, c);
+}
+
+int findByte(const char *str, int length, char c)
+{
+  return __atomic_load_n(&findByteSelected, __ATOMIC_RELAXED)(str, length, c);
+}
+
+BUFFER *newBuffer(int bufferSize, BufferRead bufferRead, ALLOCATOR *allocator)
+{
+  BUFFER *buffer = allocatorMalloc(allocator, sizeof(BUFFER));
+  if (buffer == NULL)
+  {
+    return NULL;
+  }
+  buffer->allocator = allocator;
   buffer->bufferSize = bufferSize;
   buffer->bufferPos = 0;
-  buffer->buffer = malloc(bufferSize);
+  buffer->buffer = allocatorMalloc(allocator, bufferSize);
+  if (buffer->buffer == NULL)
+  {
+    allocatorFree(allocator, buffer);
+    return NULL;
+  }
   buffer->streamStarted = 0;
   buffer->bufferRead = bufferRead;
+  buffer->memory = NULL;
+  buffer->memoryLength = 0;
+  buffer->memoryPosition = 0;
+  buffer->mapped = 0;
+  buffer->readAhead = NULL;
+  buffer->hash = NULL;
   return buffer;
 }
 
+#ifdef BUFFER_THREADS
+struct read_ahead
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // signalled when a slot is filled or released
+
+  // The input's file descriptor, and a pipe that's written to wake the
+  // thread while it waits for input
+  int fd;
+  int wake[2];
+
+  char **slots;
+  int *lengths;
+  int numSlots;
+  int slotSize;
+  int head;    // the next slot to fill
+  int tail;    // the next slot to consume
+  int filled;  // slots filled and not yet released
+  int holding; // whether the consumer holds the tail slot
+  int done;    // whether the input is exhausted
+  int stop;    // whether the consumer has gone away
+};
+
+// Read what input is available into a slot, waiting for it (or for
+// the thread to be woken) first. Returns the number of bytes read, or 0
+// at the end of the input, on an error or once woken.
+int readAheadInput(READ_AHEAD *readAhead, char *slot)
+{
+  struct pollfd fds[2] = {{readAhead->fd, POLLIN, 0}, {readAhead->wake[0], POLLIN, 0}};
+  while (1)
+  {
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return 0;
+    }
+    if (fds[1].revents != 0)
+    {
+      return 0;
+    }
+    ssize_t bytesRead = read(readAhead->fd, slot, readAhead->slotSize);
+    if ((bytesRead < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+    {
+      continue;
+    }
+    return bytesRead > 0 ? (int)bytesRead : 0;
+  }
+}
+
+// Fill slots until the input is exhausted or the consumer stops
+void *readAheadThread(void *arg)
+{
+  READ_AHEAD *readAhead = (READ_AHEAD *)arg;
+  pthread_mutex_lock(&readAhead->lock);
+  while (1)
+  {
+    while ((readAhead->filled == readAhead->numSlots) && !readAhead->stop)
+    {
+      pthread_cond_wait(&readAhead->changed, &readAhead->lock);
+    }
+    if (readAhead->stop)
+    {
+      break;
+    }
+    int head = readAhead->head;
+    pthread_mutex_unlock(&readAhead->lock);
+
+    int bytesRead = readAheadInput(readAhead, readAhead->slots[head]);
+
+    pthread_mutex_lock(&readAhead->lock);
+    if (bytesRead <= 0)
+    {
+      readAhead->done = 1;
+      pthread_cond_broadcast(&readAhead->changed);
+      break;
+    }
+    readAhead->lengths[head] = bytesRead;
+    readAhead->head = (head + 1) % readAhead->numSlots;
+    readAhead->filled++;
+    pthread_cond_broadcast(&readAhead->changed);
+  }
+  pthread_mutex_unlock(&readAhead->lock);
+  return NULL;
+}
+
+void freeReadAhead(READ_AHEAD *readAhead, ALLOCATOR *allocator)
+{
+  pthread_cond_destroy(&readAhead->changed);
+  pthread_mutex_destroy(&readAhead->lock);
+  for (int i = 0; i < 2; i++)
+  {
+    if (readAhead->wake[i] >= 0)
+    {
+      close(readAhead->wake[i]);
+    }
+  }
+  if (readAhead->slots != NULL)
+  {
+    for (int i = 0; i < readAhead->numSlots; i++)
+    {
+      allocatorFree(allocator, readAhead->slots[i]);
+    }
+  }
+  allocatorFree(allocator, readAhead->slots);
+  allocatorFree(allocator, readAhead->lengths);
+  allocatorFree(allocator, readAhead);
+}
+
+// Set the stop flag and wake the read ahead thread (and the consumer)
+// wherever they wait
+void wakeReadAhead(READ_AHEAD *readAhead)
+{
+  pthread_mutex_lock(&readAhead->lock);
+  if (!readAhead->stop)
+  {
+    readAhead->stop = 1;
+    // (a byte in the pipe ends the thread's wait for input)
+    char byte = 0;
+    while ((write(readAhead->wake[1], &byte, 1) < 0) && (errno == EINTR))
+    {
+    }
+  }
+  pthread_cond_broadcast(&readAhead->changed);
+  pthread_mutex_unlock(&readAhead->lock);
+}
+
+// Stop the read ahead thread and free its slots. The thread is woken
+// rather than cancelled, so it never waits on input that will never be
+// parsed (e.g. a pipe that's still open after a summary parse).
+void stopReadAhead(READ_AHEAD *readAhead, ALLOCATOR *allocator)
+{
+  wakeReadAhead(readAhead);
+  pthread_join(readAhead->thread, NULL);
+  freeReadAhead(readAhead, allocator);
+}
+
+// Release the slot being consumed and wait for the next one. Returns
+// the number of bytes in it, or 0 at the end of the input.
+int nextReadAheadSlot(BUFFER *buffer)
+{
+  READ_AHEAD *readAhead = buffer->readAhead;
+  pthread_mutex_lock(&readAhead->lock);
+  if (readAhead->holding)
+  {
+    readAhead->holding = 0;
+    readAhead->tail = (readAhead->tail + 1) % readAhead->numSlots;
+    readAhead->filled--;
+    pthread_cond_broadcast(&readAhead->changed);
+  }
+  while ((readAhead->filled == 0) && !readAhead->done && !readAhead->stop)
+  {
+    pthread_cond_wait(&readAhead->changed, &readAhead->lock);
+  }
+  int bytesRead = 0;
+  if ((readAhead->filled > 0) && !readAhead->stop)
+  {
+    readAhead->holding = 1;
+    buffer->buffer = readAhead->slots[readAhead->tail];
+    bytesRead = readAhead->lengths[readAhead->tail];
+  }
+  pthread_mutex_unlock(&readAhead->lock);
+  return bytesRead;
+}
+#endif
+
+void interruptReadAhead(BUFFER *buffer)
+{
+#ifdef BUFFER_THREADS
+  if (buffer->readAhead != NULL)
+  {
+    wakeReadAhead(buffer->readAhead);
+  }
+#else
+  (void)buffer;
+#endif
+}
+
+int startReadAhead(BUFFER *buffer, int slots, int slotSize, FILE *file)
+{
+#ifdef BUFFER_THREADS
+  // (only input read by readBuffer, whose descriptor can be waited on)
+  if ((buffer->memory != NULL) || (buffer->readAhead != NULL) || (slots < 2) || (slotSize <= 0) ||
+      (buffer->bufferRead != (BufferRead)(&readBuffer)) || (file == NULL) || (fileno(file) < 0))
+  {
+    return 0;
+  }
+  READ_AHEAD *readAhead = (READ_AHEAD *)allocatorMalloc(buffer->allocator, sizeof(READ_AHEAD));
+  if (readAhead == NULL)
+  {
+    return 0;
+  }
+  readAhead->slots = (char **)allocatorMalloc(buffer->allocator, sizeof(char *) * slots);
+  readAhead->lengths = (int *)allocatorMalloc(buffer->allocator, sizeof(int) * slots);
+  readAhead->numSlots = 0;
+  if ((readAhead->slots != NULL) && (readAhead->lengths != NULL))
+  {
+    while ((readAhead->numSlots < slots) && ((readAhead->slots[readAhead->numSlots] = allocatorMalloc(buffer->allocator, slotSize)) != NULL))
+    {
+      readAhead->numSlots++;
+    }
+  }
+  pthread_mutex_init(&readAhead->lock, NULL);
+  pthread_cond_init(&readAhead->changed, NULL);
+  readAhead->fd = fileno(file);
+  if (pipe(readAhead->wake) != 0)
+  {
+    readAhead->wake[0] = -1;
+    readAhead->wake[1] = -1;
+  }
+  readAhead->slotSize = slotSize;
+  readAhead->head = 0;
+  readAhead->tail = 0;
+  readAhead->filled = 0;
+  readAhead->holding = 0;
+  readAhead->done = 0;
+  readAhead->stop = 0;
+  if ((readAhead->numSlots < slots) || (readAhead->wake[0] < 0) || (pthread_create(&readAhead->thread, NULL, readAheadThread, readAhead) != 0))
+  {
+    freeReadAhead(readAhead, buffer->allocator);
+    return 0;
+  }
+
+  // The buffer points into the slots from now on, so its own storage is
+  // no longer needed
+  allocatorFree(buffer->allocator, buffer->buffer);
+  buffer->buffer = NULL;
+  buffer->bufferSize = 0;
+  buffer->bufferPos = 0;
+  buffer->readAhead = readAhead;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
 void freeBuffer(BUFFER *buffer)
 {
-  free(buffer->buffer);
-  free(buffer);
+  if (buffer == NULL)
+  {
+    return;
+  }
+#ifdef BUFFER_THREADS
+  if (buffer->readAhead != NULL)
+  {
+    // The buffer points into the read ahead slots
+    stopReadAhead(buffer->readAhead, buffer->allocator);
+  }
+  else
+#endif
+  if (buffer->memory == NULL)
+  {
+    allocatorFree(buffer->allocator, buffer->buffer);
+  }
+#ifdef BUFFER_MMAP
+  if (buffer->mapped)
+  {
+    munmap(buffer->memory, buffer->memoryLength);
+  }
+#endif
+  allocatorFree(buffer->allocator, buffer);
+}
+
+void setBufferMemory(BUFFER *buffer, char *memory, size_t length)
+{
+#ifdef BUFFER_THREADS
+  if (buffer->readAhead != NULL)
+  {
+    // Reading ahead is pointless for input that's already in memory
+    stopReadAhead(buffer->readAhead, buffer->allocator);
+    buffer->readAhead = NULL;
+  }
+  else
+#endif
+  if (buffer->memory == NULL)
+  {
+    // The buffer will point into the memory, so its own storage
+    // is no longer needed
+    allocatorFree(buffer->allocator, buffer->buffer);
+  }
+  buffer->buffer = NULL;
+  buffer->bufferSize = 0;
+  buffer->bufferPos = 0;
+  buffer->streamStarted = 0;
+  buffer->memory = memory;
+  buffer->memoryLength = length;
+  buffer->memoryPosition = 0;
+}
+
+int mapBufferFile(BUFFER *buffer, FILE *file)
+{
+#ifdef BUFFER_MMAP
+  int fd = fileno(file);
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+  {
+    // Only non-empty regular files can be mapped
+    return 0;
+  }
+  void *memory = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (memory == MAP_FAILED)
+  {
+    return 0;
+  }
+  madvise(memory, info.st_size, MADV_SEQUENTIAL);
+  setBufferMemory(buffer, (char *)memory, info.st_size);
+  buffer->mapped = 1;
+  return 1;
+#else
+  return 0;
+#endif
 }
 
 size_t readBuffer(char *buffer, int want, FILE *file)
@@ -27,69 +485,134 @@ size_t fillBuffer(BUFFER *buffer, void *data)
 {
   // Fill the buffer
   buffer->bufferPos = 0;
-  int bytesRead = buffer->bufferRead(buffer->buffer, buffer->bufferSize, data);
+  if (buffer->memory != NULL)
+  {
+    // Point the buffer at the next window of memory (no copying)
+    size_t remaining = buffer->memoryLength - buffer->memoryPosition;
+    int bytesRead = remaining > MEMORY_WINDOW ? MEMORY_WINDOW : (int)remaining;
+    buffer->buffer = buffer->memory + buffer->memoryPosition;
+    buffer->memoryPosition += bytesRead;
+    buffer->bufferSize = bytesRead;
+    return bytesRead;
+  }
+  int bytesRead;
+#ifdef BUFFER_THREADS
+  if (buffer->readAhead != NULL)
+  {
+    bytesRead = nextReadAheadSlot(buffer);
+  }
+  else
+#endif
+  {
+    bytesRead = buffer->bufferRead(buffer->buffer, buffer->bufferSize, data);
+  }
   buffer->bufferSize = bytesRead;
+  if (buffer->hash != NULL)
+  {
+    // Hash the input in the same pass that reads it
+    updateHash(buffer->hash, buffer->buffer, bytesRead);
+    buffer->hash->ended = bytesRead == 0;
+  }
   return bytesRead;
 }
 
 int readLine(BUFFER *buffer, STRING *string, void *data)
 {
-  int eof = 0;
   // Start stream if necessary
   if (!buffer->streamStarted)
   {
-    if (fillBuffer(buffer, data) == 0)
-    {
-      // Check for eof
-      eof = 1;
-    }
+    fillBuffer(buffer, data);
     buffer->streamStarted = 1;
   }
 
-  // Read through the buffer character by character to fill a line.
+  // Copy the buffer up to the end of the line, refilling it until the
+  // newline is found
   int n = 0;
-  int stringStart = 0;
-  int start = buffer->bufferPos;
   while (1)
   {
     if (buffer->bufferPos >= buffer->bufferSize)
     {
-      // Flush memcpy to string buffer
-      memcpy(string->str + stringStart, buffer->buffer + start, buffer->bufferPos - start);
-      stringStart += buffer->bufferPos - start;
-
       // Buffer needs to be refilled
       if (fillBuffer(buffer, data) == 0)
       {
         // End of file
-        eof = 1;
+        break;
       }
-      start = buffer->bufferPos;
     }
-    char c = eof ? '\0' : buffer->buffer[buffer->bufferPos];
-    buffer->bufferPos++;
-    // Set the string
-    while (n + 2 > string->n)
+
+    char *start = buffer->buffer + buffer->bufferPos;
+    int available = buffer->bufferSize - buffer->bufferPos;
+    int newline = findByte(start, available, '\n');
+    int count = newline != -1 ? newline + 1 : available;
+    while ((size_t)(n + count + 1) > string->n)
     {
       // Ensure the string is large enough
-      growString(string);
+      if (!growString(string))
+      {
+        return -1;
+      }
     }
-    int end = c == '\n';
-    if (end)
+    memcpy(string->str + n, start, count);
+    n += count;
+    buffer->bufferPos += count;
+
+    if (newline != -1)
     {
-      n++;
+      break;
     }
-    if (end || eof)
+  }
+  string->str[n] = '\0';
+  return n;
+}
+
+int scanLine(BUFFER *buffer, STRING *prefix, int prefixLength, void *data)
+{
+  // Start stream if necessary
+  if (!buffer->streamStarted)
+  {
+    fillBuffer(buffer, data);
+    buffer->streamStarted = 1;
+  }
+  if (!growStringTo(prefix, prefixLength + 1))
+  {
+    return -1;
+  }
+
+  int length = 0;
+  int copied = 0;
+  while (1)
+  {
+    if (buffer->bufferPos >= buffer->bufferSize)
+    {
+      // Buffer needs to be refilled
+      if (fillBuffer(buffer, data) == 0)
+      {
+        // End of file
+        break;
+      }
+    }
+
+    // Find the end of the line in what's left of the buffer
+    char *start = buffer->buffer + buffer->bufferPos;
+    int available = buffer->bufferSize - buffer->bufferPos;
+    int newline = findByte(start, available, '\n');
+    int n = newline != -1 ? newline + 1 : available;
+
+    // Only copy the start of the line
+    if (copied < prefixLength)
     {
-      string->str[n] = '\0';
+      int toCopy = n < prefixLength - copied ? n : prefixLength - copied;
+      memcpy(prefix->str + copied, start, toCopy);
+      copied += toCopy;
     }
-    n++;
+    length += n;
+    buffer->bufferPos += n;
 
-    if (end || eof)
+    if (newline != -1)
     {
-      memcpy(string->str + stringStart, buffer->buffer + start, buffer->bufferPos - start - 1 + (end ? 1 : 0));
       break;
     }
   }
-  return n - 1;
+  prefix->str[copied] = 0;
+  return length;
 }
@@ -1,8 +1,12 @@
 #pragma once
 #include "memory.h"
+#include "hash.h"
 
 typedef size_t (*BufferRead)(char *buffer, int want, void *data);
 
+// Input read ahead on a separate thread (see startReadAhead)
+typedef struct read_ahead READ_AHEAD;
+
 struct buffer
 {
   char *buffer;
@@ -10,15 +14,76 @@ struct buffer
   int bufferPos;
   int streamStarted;
   BufferRead bufferRead;
+
+  // In-memory input that is read in place instead of through
+  // bufferRead (NULL when streaming)
+  char *memory;
+  size_t memoryLength;
+  size_t memoryPosition;
+  // Whether memory is a file mapping that must be unmapped
+  int mapped;
+
+  // Input being read ahead (NULL when reading on demand)
+  READ_AHEAD *readAhead;
+
+  // Hash of the streamed input read so far (NULL if not hashing). Input
+  // in memory isn't hashed as it's read, as it can be hashed directly.
+  HASH_STATE *hash;
+
+  ALLOCATOR *allocator;
 };
 typedef struct buffer BUFFER;
 
-BUFFER *newBuffer(int bufferSize, BufferRead bufferRead);
+// Return the index of the first c in the length bytes of str, or -1 if
+// there isn't one. Runs the best kernel for the processor (see cpu.h).
+int findByte(const char *str, int length, char c);
+
+typedef int (*FindByteKernel)(const char *str, int length, char c);
+
+// The findByte kernel for a cpu level
+FindByteKernel findByteKernel(int level);
+
+BUFFER *newBuffer(int bufferSize, BufferRead bufferRead, ALLOCATOR *allocator);
 
 size_t readBuffer(char *buffer, int want, FILE *file);
 
 size_t fillBuffer(BUFFER *buffer, void *data);
 
+// Read input in place from a block of memory rather than through the
+// buffer's read function. The memory must outlive the buffer.
+void setBufferMemory(BUFFER *buffer, char *memory, size_t length);
+
+// Try to memory map an open file as the buffer's input. Returns 1 if
+// successful, or 0 if the file can't be mapped (e.g. it's a pipe or
+// mapping is unsupported on the platform), in which case the buffer
+// is left unchanged.
+int mapBufferFile(BUFFER *buffer, FILE *file);
+
+// Read the input ahead on a separate thread into a ring of slots
+// buffers of slotSize bytes each, so reading overlaps with parsing.
+// Only input read from a file by readBuffer is read ahead: the thread
+// reads the file's descriptor directly (so the file must not have been
+// read from yet, and must stay open until the buffer is freed), waiting
+// for input in a way that stopping it can interrupt. Returns 1 if the
+// thread was started, or 0 if the input is in memory or read by another
+// function, threads are unsupported on the platform or memory ran out,
+// in which case the buffer is left unchanged.
+int startReadAhead(BUFFER *buffer, int slots, int slotSize, FILE *file);
+
+// Make reads of input being read ahead return the end of the input from
+// now on, including a read already waiting for input (e.g. on another
+// thread). Does nothing if the input isn't read ahead.
+void interruptReadAhead(BUFFER *buffer);
+
+// Read the next line (including its newline) into string. Return the
+// length of the line, 0 if there are no lines left, or -1 if the
+// string couldn't be grown to hold the line.
 int readLine(BUFFER *buffer, STRING *string, void *data);
 
+// Skip past the next line without copying all of it, copying only up to
+// prefixLength bytes from its start into prefix (null terminated).
+// Return the length of the line (including the newline), 0 if there
+// are no lines left, or -1 if prefix couldn't be grown.
+int scanLine(BUFFER *buffer, STRING *prefix, int prefixLength, void *data);
+
 void freeBuffer(BUFFER *buffer);
@@ -3,10 +3,14 @@
 #include "minunit.h"
 #include "buffer.h"
 #include "memory.h"
+#include "cpu.h"
+#if !defined(_WIN32) && !defined(__wasm__)
+#include <unistd.h>
+#endif
 
 int tests_run = 0;
 
-char contents[20] = "The cat\nand the\nhat.";
+char contents[] = "The cat\nand the\nhat.";
 int contentsPos = 0;
 
 int contentsRead(char *buffer, int want)
@@ -24,7 +28,7 @@ int contentsRead(char *buffer, int want)
 static char *testShortBuffer()
 {
   contentsPos = 0;
-  BUFFER *buffer = newBuffer(3, (BufferRead)contentsRead);
+  BUFFER *buffer = newBuffer(3, (BufferRead)contentsRead, NULL);
   STRING *s = newString(100);
 
   // Read lines
@@ -49,7 +53,7 @@ static char *testShortBuffer()
 static char *testLongBuffer()
 {
   contentsPos = 0;
-  BUFFER *buffer = newBuffer(300, (BufferRead)contentsRead);
+  BUFFER *buffer = newBuffer(300, (BufferRead)contentsRead, NULL);
   STRING *s = newString(100);
 
   // Read lines
@@ -74,7 +78,7 @@ static char *testLongBuffer()
 static char *testAlmostFileLengthBuffer()
 {
   contentsPos = 0;
-  BUFFER *buffer = newBuffer(19, (BufferRead)contentsRead);
+  BUFFER *buffer = newBuffer(19, (BufferRead)contentsRead, NULL);
   STRING *s = newString(10);
 
   // Read lines
@@ -99,7 +103,7 @@ static char *testAlmostFileLengthBuffer()
 static char *testDivisibleBuffer()
 {
   contentsPos = 0;
-  BUFFER *buffer = newBuffer(10, (BufferRead)contentsRead);
+  BUFFER *buffer = newBuffer(10, (BufferRead)contentsRead, NULL);
   STRING *s = newString(100);
 
   // Read lines
@@ -124,7 +128,7 @@ static char *testDivisibleBuffer()
 static char *testByteBuffer()
 {
   contentsPos = 0;
-  BUFFER *buffer = newBuffer(1, (BufferRead)contentsRead);
+  BUFFER *buffer = newBuffer(1, (BufferRead)contentsRead, NULL);
   STRING *s = newString(100);
 
   // Read lines
@@ -149,7 +153,7 @@ static char *testByteBuffer()
 static char *testStringExpansion()
 {
   contentsPos = 0;
-  BUFFER *buffer = newBuffer(3, (BufferRead)contentsRead);
+  BUFFER *buffer = newBuffer(3, (BufferRead)contentsRead, NULL);
   STRING *s = newString(1);
 
   // Read lines
@@ -172,6 +176,165 @@ static char *testStringExpansion()
   return 0;
 }
 
+static char *testMemoryBuffer()
+{
+  char memory[] = "The cat\nand the\nhat.";
+  BUFFER *buffer = newBuffer(3, NULL, NULL);
+  setBufferMemory(buffer, memory, strlen(memory));
+  STRING *s = newString(1);
+
+  // Read lines
+  mu_assert("Expected line length 8", readLine(buffer, s, NULL) == 8);
+  mu_assert("Expected line \"The cat\n\"", strcmp(s->str, "The cat\n") == 0);
+
+  mu_assert("Expected line length 8", readLine(buffer, s, NULL) == 8);
+  mu_assert("Expected line \"and the\n\"", strcmp(s->str, "and the\n") == 0);
+
+  mu_assert("Expected line length 4", readLine(buffer, s, NULL) == 4);
+  mu_assert("Expected line \"hat.\"", strcmp(s->str, "hat.") == 0);
+
+  mu_assert("Expected line length 0", readLine(buffer, s, NULL) == 0);
+  mu_assert("Expected line \"\"", strcmp(s->str, "") == 0);
+
+  // The memory is read in place, not modified
+  mu_assert("Expected memory to be unchanged", strcmp(memory, "The cat\nand the\nhat.") == 0);
+
+  freeBuffer(buffer);
+  freeString(s);
+
+  return 0;
+}
+
+static char *testScanLine()
+{
+  contentsPos = 0;
+  BUFFER *buffer = newBuffer(3, (BufferRead)contentsRead, NULL);
+  STRING *s = newString(1);
+
+  // Scan lines, only keeping their first few characters
+  mu_assert("Expected line length 8", scanLine(buffer, s, 5, NULL) == 8);
+  mu_assert("Expected prefix \"The c\"", strcmp(s->str, "The c") == 0);
+
+  mu_assert("Expected line length 8", scanLine(buffer, s, 100, NULL) == 8);
+  mu_assert("Expected prefix \"and the\n\"", strcmp(s->str, "and the\n") == 0);
+
+  mu_assert("Expected line length 4", scanLine(buffer, s, 0, NULL) == 4);
+  mu_assert("Expected prefix \"\"", strcmp(s->str, "") == 0);
+
+  mu_assert("Expected line length 0", scanLine(buffer, s, 5, NULL) == 0);
+  mu_assert("Expected prefix \"\"", strcmp(s->str, "") == 0);
+
+  freeBuffer(buffer);
+  freeString(s);
+
+  return 0;
+}
+
+static char *testFindByteKernels()
+{
+  // Every kernel the processor supports should find the first match at
+  // each position, including past whole blocks and in partial ones
+  char str[150];
+  for (int level = CPU_LEVEL_SCALAR; level <= detectCpuLevel(); level++)
+  {
+    FindByteKernel kernel = findByteKernel(level);
+    for (int length = 0; length <= (int)sizeof(str); length++)
+    {
+      memset(str, 'a', sizeof(str));
+      mu_assert("expected no match", kernel(str, length, '\n') == -1);
+      for (int i = length - 1; i >= 0; i--)
+      {
+        str[i] = '\n';
+        mu_assert("expected the first match", kernel(str, length, '\n') == i);
+      }
+      if (length < (int)sizeof(str))
+      {
+        // Matches past the end are ignored
+        memset(str, 'a', sizeof(str));
+        str[length] = '\n';
+        mu_assert("expected no match within the length", kernel(str, length, '\n') == -1);
+      }
+    }
+  }
+  return 0;
+}
+
+// A temporary file holding the contents, to be read from the start
+FILE *contentsFile()
+{
+  FILE *file = tmpfile();
+  fwrite(contents, 1, strlen(contents), file);
+  rewind(file);
+  return file;
+}
+
+static char *testReadAhead()
+{
+  FILE *file = contentsFile();
+  BUFFER *buffer = newBuffer(300, (BufferRead)readBuffer, NULL);
+  STRING *s = newString(4);
+
+  // Read ahead in slots smaller than a line
+  int started = startReadAhead(buffer, 2, 3, file);
+#if !defined(_WIN32) && !defined(__wasm__)
+  mu_assert("Expected reading ahead", started == 1);
+#endif
+
+  mu_assert("Expected line length 8", readLine(buffer, s, file) == 8);
+  mu_assert("Expected line \"The cat\n\"", strcmp(s->str, "The cat\n") == 0);
+
+  mu_assert("Expected line length 8", readLine(buffer, s, file) == 8);
+  mu_assert("Expected line \"and the\n\"", strcmp(s->str, "and the\n") == 0);
+
+  mu_assert("Expected line length 4", readLine(buffer, s, file) == 4);
+  mu_assert("Expected line \"hat.\"", strcmp(s->str, "hat.") == 0);
+
+  mu_assert("Expected line length 0", readLine(buffer, s, file) == 0);
+  mu_assert("Expected line length 0 again", readLine(buffer, s, file) == 0);
+
+  freeBuffer(buffer);
+  fclose(file);
+
+  // Freeing a buffer that hasn't been read stops the thread
+  file = contentsFile();
+  buffer = newBuffer(300, (BufferRead)readBuffer, NULL);
+  startReadAhead(buffer, 4, 1, file);
+  freeBuffer(buffer);
+  fclose(file);
+
+#if !defined(_WIN32) && !defined(__wasm__)
+  // Freeing a buffer stops the thread while it waits for input (here, on
+  // a pipe that's still open)
+  int fds[2];
+  mu_assert("Expected a pipe", pipe(fds) == 0);
+  file = fdopen(fds[0], "r");
+  buffer = newBuffer(300, (BufferRead)readBuffer, NULL);
+  mu_assert("Expected reading ahead of a pipe", startReadAhead(buffer, 2, 3, file) == 1);
+  mu_assert("Expected a partial line", write(fds[1], "The", 3) == 3);
+  freeBuffer(buffer);
+  fclose(file);
+  close(fds[1]);
+#endif
+
+  // Input read by another function isn't read ahead
+  contentsPos = 0;
+  buffer = newBuffer(300, (BufferRead)contentsRead, NULL);
+  mu_assert("Expected no reading ahead of a custom read", startReadAhead(buffer, 2, 3, NULL) == 0);
+  mu_assert("Expected line length 8", readLine(buffer, s, NULL) == 8);
+  freeBuffer(buffer);
+
+  // Input in memory isn't read ahead
+  file = contentsFile();
+  buffer = newBuffer(300, (BufferRead)readBuffer, NULL);
+  setBufferMemory(buffer, contents, sizeof(contents));
+  mu_assert("Expected no reading ahead of memory", startReadAhead(buffer, 2, 3, file) == 0);
+  freeBuffer(buffer);
+  fclose(file);
+  freeString(s);
+
+  return 0;
+}
+
 static char *all_tests()
 {
   mu_run_test(testShortBuffer);
@@ -180,6 +343,10 @@ static char *all_tests()
   mu_run_test(testDivisibleBuffer);
   mu_run_test(testByteBuffer);
   mu_run_test(testStringExpansion);
+  mu_run_test(testMemoryBuffer);
+  mu_run_test(testScanLine);
+  mu_run_test(testFindByteKernels);
+  mu_run_test(testReadAhead);
   return 0;
 }
 
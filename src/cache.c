@@ -0,0 +1,248 @@
+#include "cache.h"
+#include "compat.h"
+#include "sqlite.h"
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The size of the buffer files are copied through
+#define CACHE_COPY_SIZE 65536
+
+void cacheKey(char *key, uint64_t inputHash, const char *filingId, int includeFilingId, int unified, int format)
+{
+  // The filing ID names the output directory (and fills the filing_id
+  // column if included)
+  HASH_STATE state;
+  initHash(&state, inputHash);
+  updateHash(&state, "fastfec " FASTFEC_VERSION, strlen("fastfec " FASTFEC_VERSION) + 1);
+  updateHash(&state, filingId, strlen(filingId) + 1);
+  updateHash(&state, includeFilingId ? "i" : "", includeFilingId ? 1 : 0);
+  updateHash(&state, unified ? "u" : "", unified ? 1 : 0);
+  char formatCode = (char)format;
+  updateHash(&state, &formatCode, format != FORMAT_CSV ? 1 : 0);
+  sprintf(key, "%016llx", (unsigned long long)digestHash(&state));
+}
+
+// Join path components with directory separators into a new string
+// (NULL if memory ran out)
+char *cachePath(const char *first, const char *second, const char *third)
+{
+  char *path = malloc(strlen(first) + strlen(second) + (third != NULL ? strlen(third) : 0) + 3);
+  if (path == NULL)
+  {
+    return NULL;
+  }
+  strcpy(path, first);
+  if ((path[0] != 0) && (path[strlen(path) - 1] != DIR_SEPARATOR_CHAR))
+  {
+    strcat(path, DIR_SEPARATOR);
+  }
+  strcat(path, second);
+  if (third != NULL)
+  {
+    strcat(path, DIR_SEPARATOR);
+    strcat(path, third);
+  }
+  return path;
+}
+
+// Hard link a file to a new path, replacing whatever is there, or copy
+// it where links aren't possible (e.g. across file systems). Returns 1
+// if successful.
+int linkOrCopy(const char *from, const char *to)
+{
+  remove(to);
+#ifndef _WIN32
+  if (link(from, to) == 0)
+  {
+    return 1;
+  }
+#endif
+  FILE *input = fopen(from, "rb");
+  if (input == NULL)
+  {
+    return 0;
+  }
+  FILE *output = fopen(to, "wb");
+  if (output == NULL)
+  {
+    fclose(input);
+    return 0;
+  }
+  char *buffer = malloc(CACHE_COPY_SIZE);
+  int copied = buffer != NULL;
+  size_t bytes;
+  while (copied && ((bytes = fread(buffer, 1, CACHE_COPY_SIZE, input)) > 0))
+  {
+    copied = fwrite(buffer, 1, bytes, output) == bytes;
+  }
+  copied = copied && !ferror(input);
+  free(buffer);
+  fclose(input);
+  copied = (fclose(output) == 0) && copied;
+  return copied;
+}
+
+// Link or copy every file in one directory into another, which is
+// created if needed. Returns 1 if successful.
+int linkDirectory(const char *from, const char *to)
+{
+  DIR *dir = opendir(from);
+  if ((dir == NULL) || (mkdir_p(to) != 0))
+  {
+    if (dir != NULL)
+    {
+      closedir(dir);
+    }
+    return 0;
+  }
+  int linked = 1;
+  struct dirent *entry;
+  while (linked && ((entry = readdir(dir)) != NULL))
+  {
+    if (entry->d_name[0] == '.')
+    {
+      continue;
+    }
+    char *source = cachePath(from, entry->d_name, NULL);
+    char *destination = cachePath(to, entry->d_name, NULL);
+    linked = (source != NULL) && (destination != NULL) && linkOrCopy(source, destination);
+    free(source);
+    free(destination);
+  }
+  closedir(dir);
+  return linked;
+}
+
+// Remove a directory of files
+void removeDirectory(const char *path)
+{
+  DIR *dir = opendir(path);
+  if (dir != NULL)
+  {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+      if (entry->d_name[0] == '.')
+      {
+        continue;
+      }
+      char *file = cachePath(path, entry->d_name, NULL);
+      if (file != NULL)
+      {
+        remove(file);
+        free(file);
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(path);
+}
+
+int restoreFromCache(const char *cacheDirectory, const char *key, const char *outputDirectory, const char *filingId)
+{
+  char *entry = cachePath(cacheDirectory, key, NULL);
+  char *output = cachePath(outputDirectory, filingId, NULL);
+  struct stat info;
+  int restored = (entry != NULL) && (output != NULL) && (stat(entry, &info) == 0) && linkDirectory(entry, output);
+  free(entry);
+  free(output);
+  return restored;
+}
+
+char **writtenFileNames(WRITE_CONTEXT *context, int *numFiles)
+{
+  // (with the database rows were inserted into last, if there is one)
+  int numDatabases = context->database != NULL ? 1 : 0;
+  char **names = (char **)calloc(context->nfiles + numDatabases > 0 ? context->nfiles + numDatabases : 1, sizeof(char *));
+  if (names == NULL)
+  {
+    return NULL;
+  }
+  for (int i = 0; i < context->nfiles; i++)
+  {
+    names[i] = malloc(strlen(context->filenames[i]) + strlen(context->extensions[i]) + 1);
+    if (names[i] == NULL)
+    {
+      freeWrittenFileNames(names, i);
+      return NULL;
+    }
+    strcpy(names[i], context->filenames[i]);
+    normalize_filename(names[i]);
+    strcat(names[i], context->extensions[i]);
+  }
+  if (numDatabases > 0)
+  {
+    names[context->nfiles] = malloc(strlen(SQLITE_DATABASE) + strlen(sqliteExtension) + 1);
+    if (names[context->nfiles] == NULL)
+    {
+      freeWrittenFileNames(names, context->nfiles);
+      return NULL;
+    }
+    strcpy(names[context->nfiles], SQLITE_DATABASE);
+    strcat(names[context->nfiles], sqliteExtension);
+  }
+  *numFiles = context->nfiles + numDatabases;
+  return names;
+}
+
+void freeWrittenFileNames(char **names, int numFiles)
+{
+  for (int i = 0; i < numFiles; i++)
+  {
+    free(names[i]);
+  }
+  free(names);
+}
+
+int storeInCache(const char *cacheDirectory, const char *key, const char *outputDirectory, const char *filingId, char **names, int numFiles)
+{
+  char *entry = cachePath(cacheDirectory, key, NULL);
+  if (entry == NULL)
+  {
+    return 0;
+  }
+  struct stat info;
+  if (stat(entry, &info) == 0)
+  {
+    free(entry);
+    return 1;
+  }
+
+  // Fill a temporary entry, then move it into place
+  char suffix[32];
+  sprintf(suffix, ".tmp%ld", (long)getpid());
+  char *temporary = malloc(strlen(entry) + strlen(suffix) + 1);
+  if (temporary == NULL)
+  {
+    free(entry);
+    return 0;
+  }
+  strcpy(temporary, entry);
+  strcat(temporary, suffix);
+  removeDirectory(temporary);
+  int stored = (mkdir_p(cacheDirectory) == 0) && (mkdir_p(temporary) == 0);
+  for (int i = 0; stored && (i < numFiles); i++)
+  {
+    char *source = cachePath(outputDirectory, filingId, names[i]);
+    char *destination = cachePath(temporary, names[i], NULL);
+    stored = (source != NULL) && (destination != NULL) && linkOrCopy(source, destination);
+    free(source);
+    free(destination);
+  }
+  if (stored && (rename(temporary, entry) != 0))
+  {
+    // Another parse of the same input may have saved it first
+    stored = stat(entry, &info) == 0;
+    removeDirectory(temporary);
+  }
+  else if (!stored)
+  {
+    removeDirectory(temporary);
+  }
+  free(temporary);
+  free(entry);
+  return stored;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "fec.h"
+
+// The version the cache keys of parses are tied to
+#ifndef FASTFEC_VERSION
+#define FASTFEC_VERSION "unknown"
+#endif
+
+// The length of a cache key (in hex digits)
+#define CACHE_KEY_LENGTH 16
+
+// Write the cache key of a parse into key (which must hold
+// CACHE_KEY_LENGTH + 1 characters): the hash of the input combined with
+// the FastFEC version and the options that change the output
+void cacheKey(char *key, uint64_t inputHash, const char *filingId, int includeFilingId, int unified, int format);
+
+// If the cache directory has the outputs of a parse with the key, hard
+// link (or copy, where linking isn't possible) them into the filing's
+// output directory. Returns 1 if so, 0 if the outputs have to be parsed.
+int restoreFromCache(const char *cacheDirectory, const char *key, const char *outputDirectory, const char *filingId);
+
+// The names of the files a parse wrote within its filing's output
+// directory (as named on disk). Returns NULL if memory ran out.
+char **writtenFileNames(WRITE_CONTEXT *context, int *numFiles);
+
+void freeWrittenFileNames(char **names, int numFiles);
+
+// Save the outputs of a parse (the named files in the filing's output
+// directory) in the cache directory under the key. Entries appear
+// atomically, so concurrent parses never see partial ones. Returns 1 if
+// the outputs were saved (or already were).
+int storeInCache(const char *cacheDirectory, const char *key, const char *outputDirectory, const char *filingId, char **names, int numFiles);
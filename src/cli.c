@@ -1,5 +1,6 @@
 #include "cli.h"
 #include "compat.h"
+#include "sqlite.h"
 
 const char *FLAG_FILING_ID = "--include-filing-id";
 const char FLAG_FILING_ID_SHORT = 'i';
@@ -11,6 +12,91 @@ const char *FLAG_DISABLE_STDIN = "--no-stdin";
 const char FLAG_DISABLE_STDIN_SHORT = 'x';
 const char *FLAG_URL = "--print-url";
 const char FLAG_URL_SHORT = 'p';
+const char *FLAG_SUMMARY = "--summary";
+const char FLAG_SUMMARY_SHORT = 'm';
+const char *FLAG_COUNT = "--count";
+const char FLAG_COUNT_SHORT = 'c';
+const char *FLAG_READ_AHEAD = "--read-ahead";
+const char FLAG_READ_AHEAD_SHORT = 'r';
+const char *FLAG_BUFFER_SIZE = "--buffer-size=";
+const char *FLAG_PIPELINE = "--pipeline";
+const char FLAG_PIPELINE_SHORT = 't';
+const char *FLAG_UNIFIED = "--unified";
+const char FLAG_UNIFIED_SHORT = 'u';
+const char *FLAG_FORMAT = "--format=";
+const char *FLAG_CACHE = "--cache=";
+const char *OUTPUT_STDOUT = "-";
+const char *COMMAND_SERVE = "serve";
+const char *COMMAND_WATCH = "watch";
+const char *COMMAND_COMBINE = "combine";
+const char *FLAG_ROTATE_SIZE = "--rotate-size=";
+const char *FLAG_WORKERS = "--workers=";
+
+// Parse a size such as 65536, 64k, 4m or 2g into bytes. Returns 0 if
+// the size is invalid.
+long long parseSize(const char *size)
+{
+  char *end;
+  long long bytes = strtoll(size, &end, 10);
+  long long unit = 1;
+  if ((*end == 'k') || (*end == 'K'))
+  {
+    unit = 1024;
+    end++;
+  }
+  else if ((*end == 'm') || (*end == 'M'))
+  {
+    unit = 1024 * 1024;
+    end++;
+  }
+  else if ((*end == 'g') || (*end == 'G'))
+  {
+    unit = 1024 * 1024 * 1024;
+    end++;
+  }
+  // (up to a terabyte)
+  if ((end == size) || (*end != 0) || (bytes <= 0) || (bytes > (1LL << 40) / unit))
+  {
+    return 0;
+  }
+  return bytes * unit;
+}
+
+// Parse a buffer size such as 65536, 64k or 4m into bytes. Returns 0 if
+// the size is invalid.
+int parseBufferSize(const char *size)
+{
+  long long bytes = parseSize(size);
+  // Buffer positions are ints
+  if (bytes > (1 << 30))
+  {
+    return 0;
+  }
+  return (int)bytes;
+}
+
+// Parse the name of an output format (see setFecFormat). Returns -1 if
+// it isn't one (or this build can't write it).
+int parseFormat(const char *name)
+{
+  if (strcmp(name, "csv") == 0)
+  {
+    return FORMAT_CSV;
+  }
+  if (strcmp(name, "pgcopy") == 0)
+  {
+    return FORMAT_PGCOPY;
+  }
+  if (strcmp(name, "ndjson") == 0)
+  {
+    return FORMAT_NDJSON;
+  }
+  if ((strcmp(name, "sqlite") == 0) && sqliteSupported())
+  {
+    return FORMAT_SQLITE;
+  }
+  return -1;
+}
 
 CLI_CONTEXT *newCliContext()
 {
@@ -20,12 +106,191 @@ CLI_CONTEXT *newCliContext()
   ctx->silent = 0;
   ctx->warn = 0;
   ctx->printUrl = 0;
+  ctx->summary = 0;
+  ctx->count = 0;
+  ctx->readAhead = 0;
+  ctx->bufferSize = 0;
+  ctx->pipeline = 0;
+  ctx->unified = 0;
+  ctx->format = FORMAT_CSV;
+  ctx->toStdout = 0;
+  ctx->cacheDirectory = NULL;
+  ctx->serve = 0;
+  ctx->socketPath = NULL;
+  ctx->watch = 0;
+  ctx->watchDirectory = NULL;
+  ctx->combine = 0;
+  ctx->combinePaths = NULL;
+  ctx->numCombinePaths = 0;
+  ctx->rotateSize = 0;
+  ctx->workers = SERVE_DEFAULT_WORKERS;
   ctx->shouldPrintUsage = 0;
   ctx->shouldPrintSpecifyFilingId = 0;
   ctx->shouldPrintUrlOnly = 0;
+  ctx->name = NULL;
+  ctx->outputDirectory = NULL;
+  ctx->fecId = NULL;
+  ctx->fecName = NULL;
+  ctx->fecUrl = NULL;
+  ctx->fecBackupUrl = NULL;
+  ctx->filingIdOnly = NULL;
+  ctx->extractNumber = NULL;
   return ctx;
 }
 
+// Parse the flags of the serve, watch and combine commands (the watch
+// and combine commands also take the parse flags --include-filing-id
+// and --warn, and the combine command --unified, --format and
+// --rotate-size).
+// Returns the index of the first argument after them, or 0 if they're
+// invalid.
+int parseCommandFlags(CLI_CONTEXT *ctx, int argc, char *argv[], int parseFlags)
+{
+  int i = 2;
+  for (; (i < argc) && (argv[i][0] == '-'); i++)
+  {
+    if (strcmp(argv[i], FLAG_SILENT) == 0)
+    {
+      ctx->silent = 1;
+    }
+    else if (parseFlags && (strcmp(argv[i], FLAG_FILING_ID) == 0))
+    {
+      ctx->includeFilingId = 1;
+    }
+    else if (parseFlags && (strcmp(argv[i], FLAG_WARN) == 0))
+    {
+      ctx->warn = 1;
+    }
+    else if (strncmp(argv[i], FLAG_WORKERS, strlen(FLAG_WORKERS)) == 0)
+    {
+      char *end;
+      long workers = strtol(argv[i] + strlen(FLAG_WORKERS), &end, 10);
+      if ((*end != 0) || (workers < 1) || (workers > SERVE_MAX_WORKERS))
+      {
+        return 0;
+      }
+      ctx->workers = (int)workers;
+    }
+    else if (ctx->combine && (strcmp(argv[i], FLAG_UNIFIED) == 0))
+    {
+      ctx->unified = 1;
+    }
+    else if (ctx->combine && (strncmp(argv[i], FLAG_FORMAT, strlen(FLAG_FORMAT)) == 0))
+    {
+      ctx->format = parseFormat(argv[i] + strlen(FLAG_FORMAT));
+      if (ctx->format < 0)
+      {
+        return 0;
+      }
+    }
+    else if (ctx->combine && (strncmp(argv[i], FLAG_ROTATE_SIZE, strlen(FLAG_ROTATE_SIZE)) == 0))
+    {
+      ctx->rotateSize = parseSize(argv[i] + strlen(FLAG_ROTATE_SIZE));
+      if (ctx->rotateSize == 0)
+      {
+        return 0;
+      }
+    }
+    else if ((argv[i][1] != '-') && (argv[i][1] != 0))
+    {
+      // Flags in short form
+      for (int j = 1; argv[i][j] != 0; j++)
+      {
+        if (argv[i][j] == FLAG_SILENT_SHORT)
+        {
+          ctx->silent = 1;
+        }
+        else if (parseFlags && (argv[i][j] == FLAG_FILING_ID_SHORT))
+        {
+          ctx->includeFilingId = 1;
+        }
+        else if (parseFlags && (argv[i][j] == FLAG_WARN_SHORT))
+        {
+          ctx->warn = 1;
+        }
+        else if (ctx->combine && (argv[i][j] == FLAG_UNIFIED_SHORT))
+        {
+          ctx->unified = 1;
+        }
+        else
+        {
+          return 0;
+        }
+      }
+    }
+    else
+    {
+      return 0;
+    }
+  }
+  // A database is one file, so it can't be rotated
+  if ((ctx->format == FORMAT_SQLITE) && (ctx->rotateSize > 0))
+  {
+    return 0;
+  }
+  return i;
+}
+
+// Parse the arguments of the serve command: its flags, then the path
+// of the socket to listen on
+void parseServeArgs(CLI_CONTEXT *ctx, int argc, char *argv[])
+{
+  ctx->serve = 1;
+  int i = parseCommandFlags(ctx, argc, argv, 0);
+  // Exactly one socket path
+  if ((i == 0) || (i != argc - 1))
+  {
+    ctx->shouldPrintUsage = 1;
+    return;
+  }
+  ctx->socketPath = argv[i];
+}
+
+// Set the output directory, ensuring it ends with a trailing slash
+void setOutputDirectory(CLI_CONTEXT *ctx, const char *outputDirectory)
+{
+  size_t length = strlen(outputDirectory);
+  ctx->outputDirectory = malloc(length + 2);
+  strcpy(ctx->outputDirectory, outputDirectory);
+  if ((length == 0) || (outputDirectory[length - 1] != DIR_SEPARATOR_CHAR))
+  {
+    strcat(ctx->outputDirectory, DIR_SEPARATOR);
+  }
+}
+
+// Parse the arguments of the watch command: its flags, then the
+// directory to watch and optionally the output directory
+void parseWatchArgs(CLI_CONTEXT *ctx, int argc, char *argv[])
+{
+  ctx->watch = 1;
+  int i = parseCommandFlags(ctx, argc, argv, 1);
+  if ((i == 0) || (i >= argc) || (i < argc - 2))
+  {
+    ctx->shouldPrintUsage = 1;
+    return;
+  }
+  ctx->watchDirectory = argv[i];
+  setOutputDirectory(ctx, i + 1 < argc ? argv[i + 1] : "output");
+}
+
+// Parse the arguments of the combine command: its flags, then the
+// output directory and the filings to parse (if not read from stdin)
+void parseCombineArgs(CLI_CONTEXT *ctx, int argc, char *argv[])
+{
+  ctx->combine = 1;
+  int i = parseCommandFlags(ctx, argc, argv, 1);
+  if ((i == 0) || (i >= argc))
+  {
+    ctx->shouldPrintUsage = 1;
+    return;
+  }
+  // Combined rows always say which filing they're from
+  ctx->includeFilingId = 1;
+  setOutputDirectory(ctx, argv[i]);
+  ctx->combinePaths = argv + i + 1;
+  ctx->numCombinePaths = argc - i - 1;
+}
+
 void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
 {
   ctx->piped = isPiped;
@@ -39,6 +304,22 @@ void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
     return;
   }
 
+  if (strcmp(argv[1], COMMAND_SERVE) == 0)
+  {
+    parseServeArgs(ctx, argc, argv);
+    return;
+  }
+  if (strcmp(argv[1], COMMAND_WATCH) == 0)
+  {
+    parseWatchArgs(ctx, argc, argv);
+    return;
+  }
+  if (strcmp(argv[1], COMMAND_COMBINE) == 0)
+  {
+    parseCombineArgs(ctx, argc, argv);
+    return;
+  }
+
   // Regexes and constants for filename handling
   const char *error;
   int errorOffset;
@@ -83,6 +364,61 @@ void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
       ctx->printUrl = 1;
       flagOffset++;
     }
+    else if (strcmp(argv[1 + flagOffset], FLAG_SUMMARY) == 0)
+    {
+      ctx->summary = 1;
+      flagOffset++;
+    }
+    else if (strcmp(argv[1 + flagOffset], FLAG_COUNT) == 0)
+    {
+      ctx->count = 1;
+      flagOffset++;
+    }
+    else if (strcmp(argv[1 + flagOffset], FLAG_READ_AHEAD) == 0)
+    {
+      ctx->readAhead = 1;
+      flagOffset++;
+    }
+    else if (strncmp(argv[1 + flagOffset], FLAG_CACHE, strlen(FLAG_CACHE)) == 0)
+    {
+      ctx->cacheDirectory = argv[1 + flagOffset] + strlen(FLAG_CACHE);
+      if (ctx->cacheDirectory[0] == 0)
+      {
+        ctx->shouldPrintUsage = 1;
+        return;
+      }
+      flagOffset++;
+    }
+    else if (strcmp(argv[1 + flagOffset], FLAG_PIPELINE) == 0)
+    {
+      ctx->pipeline = 1;
+      flagOffset++;
+    }
+    else if (strcmp(argv[1 + flagOffset], FLAG_UNIFIED) == 0)
+    {
+      ctx->unified = 1;
+      flagOffset++;
+    }
+    else if (strncmp(argv[1 + flagOffset], FLAG_FORMAT, strlen(FLAG_FORMAT)) == 0)
+    {
+      ctx->format = parseFormat(argv[1 + flagOffset] + strlen(FLAG_FORMAT));
+      if (ctx->format < 0)
+      {
+        ctx->shouldPrintUsage = 1;
+        return;
+      }
+      flagOffset++;
+    }
+    else if (strncmp(argv[1 + flagOffset], FLAG_BUFFER_SIZE, strlen(FLAG_BUFFER_SIZE)) == 0)
+    {
+      ctx->bufferSize = parseBufferSize(argv[1 + flagOffset] + strlen(FLAG_BUFFER_SIZE));
+      if (ctx->bufferSize == 0)
+      {
+        ctx->shouldPrintUsage = 1;
+        return;
+      }
+      flagOffset++;
+    }
     else
     {
       // Try to extract flags in short form
@@ -114,6 +450,31 @@ void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
           ctx->printUrl = 1;
           matched = 1;
         }
+        else if (argv[1 + flagOffset][i] == FLAG_SUMMARY_SHORT)
+        {
+          ctx->summary = 1;
+          matched = 1;
+        }
+        else if (argv[1 + flagOffset][i] == FLAG_COUNT_SHORT)
+        {
+          ctx->count = 1;
+          matched = 1;
+        }
+        else if (argv[1 + flagOffset][i] == FLAG_READ_AHEAD_SHORT)
+        {
+          ctx->readAhead = 1;
+          matched = 1;
+        }
+        else if (argv[1 + flagOffset][i] == FLAG_PIPELINE_SHORT)
+        {
+          ctx->pipeline = 1;
+          matched = 1;
+        }
+        else if (argv[1 + flagOffset][i] == FLAG_UNIFIED_SHORT)
+        {
+          ctx->unified = 1;
+          matched = 1;
+        }
         else
         {
           ctx->shouldPrintUsage = 1;
@@ -133,6 +494,13 @@ void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
     }
   }
 
+  // Summary and count modes can't be combined
+  if (ctx->summary && ctx->count)
+  {
+    ctx->shouldPrintUsage = 1;
+    return;
+  }
+
   // Set the name
   if (flagOffset + 1 >= argc)
   {
@@ -147,7 +515,18 @@ void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
   strcpy(ctx->outputDirectory, "output" DIR_SEPARATOR);
   char *fecExtension = ".fec";
   // Rewrite output directory if set in cli
-  if (argc > 2 + flagOffset)
+  if ((argc > 2 + flagOffset) && (strcmp(argv[2 + flagOffset], OUTPUT_STDOUT) == 0))
+  {
+    // NDJSON rows are one stream, so they can be written to stdout
+    // (which isn't a place outputs can be cached)
+    if ((ctx->format != FORMAT_NDJSON) || (ctx->cacheDirectory != NULL))
+    {
+      ctx->shouldPrintUsage = 1;
+      return;
+    }
+    ctx->toStdout = 1;
+  }
+  else if (argc > 2 + flagOffset)
   {
     ctx->outputDirectory = realloc(ctx->outputDirectory, strlen(argv[2 + flagOffset]) + 1);
     strcpy(ctx->outputDirectory, argv[2 + flagOffset]);
@@ -226,7 +605,7 @@ void parseArgs(CLI_CONTEXT *ctx, int isPiped, int argc, char *argv[])
   if (ctx->printUrl)
   {
     // Handle printing URL
-    if (ctx->piped || ctx->includeFilingId || ctx->silent || ctx->warn)
+    if (ctx->piped || ctx->includeFilingId || ctx->silent || ctx->warn || ctx->summary || ctx->count)
     {
       ctx->shouldPrintUrlOnly = 1;
       return;
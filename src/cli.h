@@ -2,6 +2,9 @@
 
 #include "encoding.h"
 #include "fec.h"
+#include "serve.h"
+#include "watch.h"
+#include "combine.h"
 #include <stdlib.h>
 #include "pcre/pcre.h"
 #include <string.h>
@@ -21,6 +24,45 @@ struct cli_context
   int warn;
   // Whether to print URLs from docquery instead of running commands
   int printUrl;
+  // Whether to print the header and summary records as JSON instead
+  // of writing output files
+  int summary;
+  // Whether to print row and byte counts per form type as JSON instead
+  // of writing output files
+  int count;
+  // Whether to read the input ahead on a separate thread
+  int readAhead;
+  // The size of each input buffer in bytes (0 for the default)
+  int bufferSize;
+  // Whether to read, parse and write on separate threads
+  int pipeline;
+  // Whether to write each form type in one schema across FEC versions
+  int unified;
+  // The format output files are written in (see setFecFormat)
+  int format;
+  // Whether to write the output to stdout (an output directory of -)
+  // rather than to files
+  int toStdout;
+  // Where outputs are cached by the hash of their input (NULL to not
+  // cache them)
+  const char *cacheDirectory;
+  // Whether to serve parse requests instead of parsing a filing, the
+  // socket to serve them on and how many to serve at once
+  int serve;
+  const char *socketPath;
+  int workers;
+  // Whether to parse filings as they're written to a directory instead
+  // of parsing a filing, and the directory to watch
+  int watch;
+  const char *watchDirectory;
+  // Whether to parse many filings into combined output instead of
+  // parsing a filing, the filings to parse (none to read their paths
+  // from stdin) and the size combined files are rotated at (0 to never
+  // rotate them)
+  int combine;
+  char **combinePaths;
+  int numCombinePaths;
+  long long rotateSize;
   // Whether usage should be printed
   int shouldPrintUsage;
   // Whether usage should be clarified with specifying a filing id manually
@@ -61,4 +103,23 @@ extern const char FLAG_WARN_SHORT;
 extern const char *FLAG_DISABLE_STDIN;
 extern const char FLAG_DISABLE_STDIN_SHORT;
 extern const char *FLAG_URL;
-extern const char FLAG_URL_SHORT;
\ No newline at end of file
+extern const char FLAG_URL_SHORT;
+extern const char *FLAG_SUMMARY;
+extern const char FLAG_SUMMARY_SHORT;
+extern const char *FLAG_COUNT;
+extern const char FLAG_COUNT_SHORT;
+extern const char *FLAG_READ_AHEAD;
+extern const char FLAG_READ_AHEAD_SHORT;
+extern const char *FLAG_BUFFER_SIZE;
+extern const char *FLAG_PIPELINE;
+extern const char FLAG_PIPELINE_SHORT;
+extern const char *FLAG_UNIFIED;
+extern const char FLAG_UNIFIED_SHORT;
+extern const char *FLAG_FORMAT;
+extern const char *FLAG_CACHE;
+extern const char *OUTPUT_STDOUT;
+extern const char *COMMAND_SERVE;
+extern const char *COMMAND_WATCH;
+extern const char *COMMAND_COMBINE;
+extern const char *FLAG_ROTATE_SIZE;
+extern const char *FLAG_WORKERS;
\ No newline at end of file
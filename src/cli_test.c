@@ -1,4 +1,6 @@
 #include "cli.h"
+#include "compat.h"
+#include "sqlite.h"
 #include "minunit.h"
 
 int tests_run = 0;
@@ -154,6 +156,321 @@ static char *testCliPipedNoStdin()
   return 0;
 }
 
+static char *testCliSummary()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "-m", "--silent", "1550126.fec"};
+  const int argc = sizeof(argv) / sizeof(argv[0]);
+  parseArgs(cli, 0, argc, argv);
+
+  mu_assert("Expected summary", cli->summary == 1);
+  mu_assert("Expected silent", cli->silent == 1);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+  mu_assert("Expect id to be 1550126", strcmp(cli->fecId, "1550126") == 0);
+
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliCount()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "-cx", "1550126.fec"};
+  const int argc = sizeof(argv) / sizeof(argv[0]);
+  parseArgs(cli, 1, argc, argv);
+
+  mu_assert("Expected count", cli->count == 1);
+  mu_assert("Expected no piped", cli->piped == 0);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  // Can't be combined with summary mode
+  cli = newCliContext();
+  const char *argvSummary[] = {"fastfec", "--count", "--summary", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argvSummary) / sizeof(argvSummary[0]), argvSummary);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliReadAhead()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "-rs", "--buffer-size=4m", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argv) / sizeof(argv[0]), argv);
+
+  mu_assert("Expected read ahead", cli->readAhead == 1);
+  mu_assert("Expected a 4 MiB buffer size", cli->bufferSize == 4 * 1024 * 1024);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  // Buffer sizes must be valid
+  cli = newCliContext();
+  const char *argvInvalid[] = {"fastfec", "--buffer-size=lots", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argvInvalid) / sizeof(argvInvalid[0]), argvInvalid);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliUnified()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "13360.fec"};
+  const int argc = sizeof(argv) / sizeof(argv[0]);
+  parseArgs(cli, 0, argc, argv);
+
+  mu_assert("Expected no unified", cli->unified == 0);
+
+  freeCliContext(cli);
+
+  // Short flags can be combined
+  cli = newCliContext();
+  const char *argvUnified[] = {"fastfec", "-iu", "13360.fec"};
+  parseArgs(cli, 0, sizeof(argvUnified) / sizeof(argvUnified[0]), argvUnified);
+  mu_assert("Expected include filing id", cli->includeFilingId == 1);
+  mu_assert("Expected unified", cli->unified == 1);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliFormat()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "--format=pgcopy", "13360.fec"};
+  const int argc = sizeof(argv) / sizeof(argv[0]);
+  parseArgs(cli, 0, argc, argv);
+
+  mu_assert("Expected binary COPY", cli->format == FORMAT_PGCOPY);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  // CSV by default
+  cli = newCliContext();
+  const char *argvDefault[] = {"fastfec", "13360.fec"};
+  parseArgs(cli, 0, sizeof(argvDefault) / sizeof(argvDefault[0]), argvDefault);
+  mu_assert("Expected CSV", cli->format == FORMAT_CSV);
+  freeCliContext(cli);
+
+  // NDJSON rows can be written to stdout, but other formats can't
+  cli = newCliContext();
+  const char *argvStdout[] = {"fastfec", "--format=ndjson", "13360.fec", "-"};
+  parseArgs(cli, 0, sizeof(argvStdout) / sizeof(argvStdout[0]), argvStdout);
+  mu_assert("Expected NDJSON", cli->format == FORMAT_NDJSON);
+  mu_assert("Expected output to stdout", cli->toStdout == 1);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+  freeCliContext(cli);
+
+  cli = newCliContext();
+  const char *argvCsvStdout[] = {"fastfec", "13360.fec", "-"};
+  parseArgs(cli, 0, sizeof(argvCsvStdout) / sizeof(argvCsvStdout[0]), argvCsvStdout);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  // SQLite output is only a format in builds with SQLite
+  cli = newCliContext();
+  const char *argvSqlite[] = {"fastfec", "--format=sqlite", "13360.fec"};
+  parseArgs(cli, 0, sizeof(argvSqlite) / sizeof(argvSqlite[0]), argvSqlite);
+  mu_assert("Expected SQLite where supported", sqliteSupported() ? (cli->format == FORMAT_SQLITE) && (cli->shouldPrintUsage == 0) : cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  cli = newCliContext();
+  const char *argvInvalidFormat[] = {"fastfec", "--format=xml", "13360.fec"};
+  parseArgs(cli, 0, sizeof(argvInvalidFormat) / sizeof(argvInvalidFormat[0]), argvInvalidFormat);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliPipeline()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "--pipeline", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argv) / sizeof(argv[0]), argv);
+
+  mu_assert("Expected pipeline", cli->pipeline == 1);
+  mu_assert("Expected no read ahead", cli->readAhead == 0);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  cli = newCliContext();
+  const char *argvShort[] = {"fastfec", "-tr", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argvShort) / sizeof(argvShort[0]), argvShort);
+  mu_assert("Expected pipeline", cli->pipeline == 1);
+  mu_assert("Expected read ahead", cli->readAhead == 1);
+
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliServe()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "serve", "--workers=8", "-s", "/tmp/fastfec.sock"};
+  parseArgs(cli, 1, sizeof(argv) / sizeof(argv[0]), argv);
+
+  mu_assert("Expected serve", cli->serve == 1);
+  mu_assert("Expected the socket path", strcmp(cli->socketPath, "/tmp/fastfec.sock") == 0);
+  mu_assert("Expected 8 workers", cli->workers == 8);
+  mu_assert("Expected silent", cli->silent == 1);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  // The socket path is required and worker counts must be valid
+  cli = newCliContext();
+  const char *argvNoSocket[] = {"fastfec", "serve"};
+  parseArgs(cli, 0, sizeof(argvNoSocket) / sizeof(argvNoSocket[0]), argvNoSocket);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  cli = newCliContext();
+  const char *argvWorkers[] = {"fastfec", "serve", "--workers=0", "/tmp/fastfec.sock"};
+  parseArgs(cli, 0, sizeof(argvWorkers) / sizeof(argvWorkers[0]), argvWorkers);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliWatch()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "watch", "-is", "--workers=2", "spool", "csv"};
+  parseArgs(cli, 1, sizeof(argv) / sizeof(argv[0]), argv);
+
+  mu_assert("Expected watch", cli->watch == 1);
+  mu_assert("Expected the watched directory", strcmp(cli->watchDirectory, "spool") == 0);
+  mu_assert("Expected the output directory", strcmp(cli->outputDirectory, "csv" DIR_SEPARATOR) == 0);
+  mu_assert("Expected 2 workers", cli->workers == 2);
+  mu_assert("Expected include filing id", cli->includeFilingId == 1);
+  mu_assert("Expected silent", cli->silent == 1);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  // The output directory defaults to output
+  cli = newCliContext();
+  const char *argvDefault[] = {"fastfec", "watch", "spool"};
+  parseArgs(cli, 0, sizeof(argvDefault) / sizeof(argvDefault[0]), argvDefault);
+  mu_assert("Expected the default output directory", strcmp(cli->outputDirectory, "output" DIR_SEPARATOR) == 0);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+  freeCliContext(cli);
+
+  // Parse flags only apply to watching
+  cli = newCliContext();
+  const char *argvServe[] = {"fastfec", "serve", "-i", "/tmp/fastfec.sock"};
+  parseArgs(cli, 0, sizeof(argvServe) / sizeof(argvServe[0]), argvServe);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliCombine()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "combine", "--rotate-size=2g", "-s", "csv", "1.fec", "2.fec"};
+  parseArgs(cli, 1, sizeof(argv) / sizeof(argv[0]), argv);
+
+  mu_assert("Expected combine", cli->combine == 1);
+  mu_assert("Expected the output directory", strcmp(cli->outputDirectory, "csv" DIR_SEPARATOR) == 0);
+  mu_assert("Expected 2 filings", cli->numCombinePaths == 2);
+  mu_assert("Expected the first filing", strcmp(cli->combinePaths[0], "1.fec") == 0);
+  mu_assert("Expected the rotate size", cli->rotateSize == 2LL * 1024 * 1024 * 1024);
+  mu_assert("Expected include filing id", cli->includeFilingId == 1);
+  mu_assert("Expected silent", cli->silent == 1);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  // Filings can be read from stdin
+  cli = newCliContext();
+  const char *argvStdin[] = {"fastfec", "combine", "csv"};
+  parseArgs(cli, 1, sizeof(argvStdin) / sizeof(argvStdin[0]), argvStdin);
+  mu_assert("Expected no filings", cli->numCombinePaths == 0);
+  mu_assert("Expected no rotation", cli->rotateSize == 0);
+  mu_assert("Expected no unified", cli->unified == 0);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+  freeCliContext(cli);
+
+  // Form types can be combined in one schema across versions
+  cli = newCliContext();
+  const char *argvUnified[] = {"fastfec", "combine", "-u", "--format=pgcopy", "csv"};
+  parseArgs(cli, 1, sizeof(argvUnified) / sizeof(argvUnified[0]), argvUnified);
+  mu_assert("Expected unified", cli->unified == 1);
+  mu_assert("Expected binary COPY", cli->format == FORMAT_PGCOPY);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+  freeCliContext(cli);
+
+  // Rotate sizes must be valid, and only apply to combining
+  cli = newCliContext();
+  const char *argvInvalid[] = {"fastfec", "combine", "--rotate-size=big", "csv"};
+  parseArgs(cli, 1, sizeof(argvInvalid) / sizeof(argvInvalid[0]), argvInvalid);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  cli = newCliContext();
+  const char *argvWatch[] = {"fastfec", "watch", "--rotate-size=1m", "spool"};
+  parseArgs(cli, 1, sizeof(argvWatch) / sizeof(argvWatch[0]), argvWatch);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  // A database can't be rotated
+  cli = newCliContext();
+  const char *argvRotateSqlite[] = {"fastfec", "combine", "--format=sqlite", "--rotate-size=1m", "combined", "1.fec"};
+  parseArgs(cli, 1, sizeof(argvRotateSqlite) / sizeof(argvRotateSqlite[0]), argvRotateSqlite);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+  freeCliContext(cli);
+
+  return 0;
+}
+
+static char *testCliCache()
+{
+  CLI_CONTEXT *cli = newCliContext();
+
+  const char *argv[] = {"fastfec", "--cache=fastfec_cache", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argv) / sizeof(argv[0]), argv);
+
+  mu_assert("Expected the cache directory", strcmp(cli->cacheDirectory, "fastfec_cache") == 0);
+  mu_assert("Expected no print usage", cli->shouldPrintUsage == 0);
+
+  freeCliContext(cli);
+
+  cli = newCliContext();
+  const char *argvEmpty[] = {"fastfec", "--cache=", "1550126.fec"};
+  parseArgs(cli, 0, sizeof(argvEmpty) / sizeof(argvEmpty[0]), argvEmpty);
+  mu_assert("Expected print usage", cli->shouldPrintUsage == 1);
+
+  freeCliContext(cli);
+
+  return 0;
+}
+
 static char *all_tests()
 {
   mu_run_test(testCliIncludeFilingId);
@@ -164,6 +481,16 @@ static char *all_tests()
   mu_run_test(testCliShowSpecifyFilingId);
   mu_run_test(testCliSilentWarnPipedIncludeFilingId);
   mu_run_test(testCliPipedNoStdin);
+  mu_run_test(testCliSummary);
+  mu_run_test(testCliCount);
+  mu_run_test(testCliReadAhead);
+  mu_run_test(testCliUnified);
+  mu_run_test(testCliFormat);
+  mu_run_test(testCliPipeline);
+  mu_run_test(testCliServe);
+  mu_run_test(testCliWatch);
+  mu_run_test(testCliCache);
+  mu_run_test(testCliCombine);
   return 0;
 }
 
@@ -0,0 +1,203 @@
+#include "columns.h"
+#include "csv.h"
+#include "pgcopy.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The rows and string bytes room is first made for in each table
+#define COLUMN_INITIAL_ROWS 64
+#define COLUMN_INITIAL_DATA 1024
+
+// The days from 1970-01-01 (NumPy's date epoch) to 2000-01-01 (that of
+// pgCopyDate)
+#define COLUMN_DATE_OFFSET 10957
+
+COLUMN_TABLES *newColumnTables(ALLOCATOR *allocator)
+{
+  COLUMN_TABLES *tables = (COLUMN_TABLES *)allocatorMalloc(allocator, sizeof(COLUMN_TABLES));
+  if (tables == NULL)
+  {
+    return NULL;
+  }
+  initTableList(&tables->list, sizeof(COLUMN_TABLE), allocator);
+  return tables;
+}
+
+void freeColumns(COLUMN_TABLES *tables, COLUMN_TABLE *table)
+{
+  for (int i = 0; i < table->numColumns; i++)
+  {
+    allocatorFree(tables->list.allocator, table->columns[i].name);
+    allocatorFree(tables->list.allocator, table->columns[i].values);
+    allocatorFree(tables->list.allocator, table->columns[i].data);
+  }
+  allocatorFree(tables->list.allocator, table->columns);
+}
+
+void freeColumnTables(COLUMN_TABLES *tables)
+{
+  if (tables == NULL)
+  {
+    return;
+  }
+  for (int i = 0; i < tables->list.numTables; i++)
+  {
+    freeColumns(tables, (COLUMN_TABLE *)tableAt(&tables->list, i));
+  }
+  freeTableList(&tables->list);
+  allocatorFree(tables->list.allocator, tables);
+}
+
+// Add a column to a new table. Returns 1 if successful.
+int addColumn(COLUMN_TABLES *tables, COLUMN_TABLE *table, const char *name, int length, const char *suffix, char type)
+{
+  ALLOCATOR *allocator = tables->list.allocator;
+  COLUMN *column = &table->columns[table->numColumns++];
+  column->name = (char *)allocatorMalloc(allocator, length + strlen(suffix) + 1);
+  if (column->name != NULL)
+  {
+    memcpy(column->name, name, length);
+    strcpy(column->name + length, suffix);
+  }
+  column->type = type;
+  column->data = NULL;
+  column->dataLength = 0;
+  column->dataCapacity = type == 's' ? COLUMN_INITIAL_DATA : 0;
+  // (string columns hold an offset past the last row)
+  column->values = allocatorMalloc(allocator, (table->rowCapacity + (type == 's' ? 1 : 0)) * 8);
+  if (type == 's')
+  {
+    column->data = (char *)allocatorMalloc(allocator, column->dataCapacity);
+    if (column->values != NULL)
+    {
+      ((int64_t *)column->values)[0] = 0;
+    }
+  }
+  return (column->name != NULL) && (column->values != NULL) && ((type != 's') || (column->data != NULL));
+}
+
+// Add the columns of the header row (preceded by a filing_id column if
+// included) to a new table. Returns 1 if successful.
+int addColumns(COLUMN_TABLES *tables, COLUMN_TABLE *table, const char *header, const char *types, int includeFilingId)
+{
+  int numColumns = includeFilingId ? 2 : 1;
+  for (const char *comma = strchr(header, ','); comma != NULL; comma = strchr(comma + 1, ','))
+  {
+    numColumns++;
+  }
+  table->rowCapacity = COLUMN_INITIAL_ROWS;
+  table->columns = (COLUMN *)allocatorMalloc(tables->list.allocator, numColumns * sizeof(COLUMN));
+  if (table->columns == NULL)
+  {
+    return 0;
+  }
+  if (includeFilingId && !addColumn(tables, table, "filing_id", strlen("filing_id"), "", 's'))
+  {
+    return 0;
+  }
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, header, types);
+  while (nextHeaderColumn(&column))
+  {
+    if (!addColumn(tables, table, column.name, column.length, column.suffix, column.type))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int selectColumnTable(COLUMN_TABLES *tables, const char *name, const char *header, const char *types, int includeFilingId)
+{
+  int created;
+  COLUMN_TABLE *table = (COLUMN_TABLE *)selectTable(&tables->list, name, header, &created);
+  if ((table != NULL) && created && !addColumns(tables, table, header, types, includeFilingId))
+  {
+    freeColumns(tables, table);
+    discardTable(&tables->list);
+    return 0;
+  }
+  return table != NULL;
+}
+
+int startColumnRow(COLUMN_TABLES *tables)
+{
+  COLUMN_TABLE *table = (COLUMN_TABLE *)tables->list.table;
+  if (table == NULL)
+  {
+    return 0;
+  }
+  if (table->numRows == table->rowCapacity)
+  {
+    int64_t capacity = table->rowCapacity * 2;
+    for (int i = 0; i < table->numColumns; i++)
+    {
+      COLUMN *column = &table->columns[i];
+      void *values = allocatorRealloc(tables->list.allocator, column->values, (capacity + (column->type == 's' ? 1 : 0)) * 8);
+      if (values == NULL)
+      {
+        return 0;
+      }
+      column->values = values;
+    }
+    table->rowCapacity = capacity;
+  }
+  for (int i = 0; i < table->numColumns; i++)
+  {
+    // Drop the values of a row that couldn't be finished
+    COLUMN *column = &table->columns[i];
+    if (column->type == 's')
+    {
+      column->dataLength = ((int64_t *)column->values)[table->numRows];
+    }
+  }
+  return 1;
+}
+
+int setColumnValue(COLUMN_TABLES *tables, int column, const char *str, int length)
+{
+  COLUMN_TABLE *table = (COLUMN_TABLE *)tables->list.table;
+  if ((table == NULL) || (column >= table->numColumns))
+  {
+    return 1;
+  }
+  COLUMN *target = &table->columns[column];
+  int64_t row = table->numRows;
+  if (target->type == 'f')
+  {
+    double value;
+    ((double *)target->values)[row] = parseNumberField(str, length, &value) ? value : NAN;
+    return 1;
+  }
+  if (target->type == 'd')
+  {
+    int32_t days;
+    ((int64_t *)target->values)[row] = pgCopyDate(str, length, &days) ? (int64_t)days + COLUMN_DATE_OFFSET : COLUMN_NULL_DATE;
+    return 1;
+  }
+  if (target->dataLength + length > target->dataCapacity)
+  {
+    int64_t capacity = target->dataCapacity * 2;
+    while (target->dataLength + length > capacity)
+    {
+      capacity *= 2;
+    }
+    char *data = (char *)allocatorRealloc(tables->list.allocator, target->data, capacity);
+    if (data == NULL)
+    {
+      return 0;
+    }
+    target->data = data;
+    target->dataCapacity = capacity;
+  }
+  memcpy(target->data + target->dataLength, str, length);
+  target->dataLength += length;
+  ((int64_t *)target->values)[row + 1] = target->dataLength;
+  return 1;
+}
+
+void endColumnRow(COLUMN_TABLES *tables)
+{
+  ((COLUMN_TABLE *)tables->list.table)->numRows++;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include "export.h"
+#include "allocator.h"
+#include "tables.h"
+
+// Columnar output: rows are accumulated in memory as typed columns (one
+// table per form type), so they can be handed over an array at a time
+// (e.g. to NumPy) rather than a row at a time.
+
+// The value of a date column where the field is empty or not a date
+// (NumPy's NaT)
+#define COLUMN_NULL_DATE INT64_MIN
+
+// A column of a table, of a column type: 's', 'd' or 'f'. Float columns
+// hold a double per row (NaN where the field is empty or not a number),
+// date columns an int64_t per row counting days since 1970-01-01, and
+// string columns the bytes of every row's value in data, with the
+// int64_t offsets of the values in values (one more than the rows: row
+// i spans offsets i to i + 1).
+struct column
+{
+  char *name;
+  char type;
+  void *values;
+  char *data;
+  int64_t dataLength;
+  int64_t dataCapacity;
+};
+typedef struct column COLUMN;
+
+// The rows of a form type with one header row (see TABLE_KEY). Repeated
+// column names are numbered from the second, e.g. name_2.
+struct column_table
+{
+  TABLE_KEY key;
+  COLUMN *columns;
+  int numColumns;
+  int64_t numRows;
+  int64_t rowCapacity;
+};
+typedef struct column_table COLUMN_TABLE;
+
+// Tables in the order they were first written to
+struct column_tables
+{
+  TABLE_LIST list;
+};
+typedef struct column_tables COLUMN_TABLES;
+
+// Create tables to accumulate rows into (see setFecColumns). Returns
+// NULL if memory runs out.
+EXPORT COLUMN_TABLES *newColumnTables(ALLOCATOR *allocator);
+
+EXPORT void freeColumnTables(COLUMN_TABLES *tables);
+
+// Select the table rows with the header row are added to, creating it
+// the first time, with the columns of the header row of the types (NULL
+// if they're all strings), preceded by a filing_id column if included.
+// Returns 1 if successful, 0 if memory ran out.
+int selectColumnTable(COLUMN_TABLES *tables, const char *name, const char *header, const char *types, int includeFilingId);
+
+// Start a row of the selected table, then set each of its columns (from
+// 0) in turn and end it. Returns 1 if successful, 0 if memory ran out
+// (in which case the row is dropped).
+int startColumnRow(COLUMN_TABLES *tables);
+
+int setColumnValue(COLUMN_TABLES *tables, int column, const char *str, int length);
+
+void endColumnRow(COLUMN_TABLES *tables);
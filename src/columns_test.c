@@ -0,0 +1,188 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "columns.h"
+#include "fec.h"
+
+int tests_run = 0;
+
+// Add a row of fields to the selected table
+static int addRow(COLUMN_TABLES *tables, const char **fields, int numFields)
+{
+  if (!startColumnRow(tables))
+  {
+    return 0;
+  }
+  for (int i = 0; i < numFields; i++)
+  {
+    if (!setColumnValue(tables, i, fields[i], strlen(fields[i])))
+    {
+      return 0;
+    }
+  }
+  endColumnRow(tables);
+  return 1;
+}
+
+// Whether row i of a string column holds the value
+static int stringIs(COLUMN *column, int row, const char *value)
+{
+  int64_t *offsets = (int64_t *)column->values;
+  return (offsets[row + 1] - offsets[row] == (int64_t)strlen(value)) && (memcmp(column->data + offsets[row], value, strlen(value)) == 0);
+}
+
+static char *testTables()
+{
+  COLUMN_TABLES *tables = newColumnTables(NULL);
+  mu_assert("Expected tables", tables != NULL);
+
+  const char *row[] = {"C00123", "2020-01-31", "12.50", "Smith"};
+  mu_assert("Expected a table", selectColumnTable(tables, "SA11AI", "id,date,amount,id", "sdfs", 0));
+  mu_assert("Expected a row", addRow(tables, row, 4));
+  const char *emptyRow[] = {"", "2020-02-30", "n/a", "Jones"};
+  mu_assert("Expected another row", addRow(tables, emptyRow, 4));
+
+  // Rows with another header row go to a variant of the table, and
+  // enough rows to grow it
+  mu_assert("Expected a variant table", selectColumnTable(tables, "SA11AI", "id", NULL, 1));
+  const char *variantRow[] = {"42", "C00124"};
+  for (int i = 0; i < 1000; i++)
+  {
+    mu_assert("Expected a variant row", addRow(tables, variantRow, 2));
+  }
+  mu_assert("Expected a table named like its file", selectColumnTable(tables, "text/a", "text", NULL, 0));
+  mu_assert("Expected a row", startColumnRow(tables));
+  endColumnRow(tables);
+  mu_assert("Expected the same table by its name", selectColumnTable(tables, "text/a", "text", NULL, 0) && (tables->list.table == tableAt(&tables->list, 2)));
+
+  mu_assert("Expected three tables", tables->list.numTables == 3);
+  COLUMN_TABLE *table = (COLUMN_TABLE *)tableAt(&tables->list, 0);
+  mu_assert("Expected the first table", (strcmp(table->key.name, "SA11AI") == 0) && (table->key.variant == 1) && (table->numRows == 2));
+  mu_assert("Expected repeated names to be numbered", (table->numColumns == 4) && (strcmp(table->columns[3].name, "id_2") == 0));
+  mu_assert("Expected the column types", (table->columns[1].type == 'd') && (table->columns[2].type == 'f'));
+  mu_assert("Expected strings", stringIs(&table->columns[0], 0, "C00123") && stringIs(&table->columns[0], 1, "") && stringIs(&table->columns[3], 1, "Jones"));
+  int64_t *dates = (int64_t *)table->columns[1].values;
+  mu_assert("Expected days since 1970", (dates[0] == 18292) && (dates[1] == COLUMN_NULL_DATE));
+  double *amounts = (double *)table->columns[2].values;
+  mu_assert("Expected numbers", (amounts[0] == 12.5) && isnan(amounts[1]));
+
+  table = (COLUMN_TABLE *)tableAt(&tables->list, 1);
+  mu_assert("Expected the variant", (strcmp(table->key.name, "SA11AI") == 0) && (table->key.variant == 2) && (table->numRows == 1000));
+  mu_assert("Expected the filing id column", (strcmp(table->columns[0].name, "filing_id") == 0) && stringIs(&table->columns[0], 999, "42") && stringIs(&table->columns[1], 999, "C00124"));
+  table = (COLUMN_TABLE *)tableAt(&tables->list, 2);
+  mu_assert("Expected the file name", (strcmp(table->key.name, "text-a") == 0) && (table->key.variant == 1));
+
+  freeColumnTables(tables);
+  return 0;
+}
+
+static char *testAllocatorLimit()
+{
+  ALLOCATOR *allocator = newAllocator(NULL, NULL, NULL, NULL);
+  COLUMN_TABLES *tables = newColumnTables(allocator);
+  mu_assert("Expected a table", selectColumnTable(tables, "SA11AI", "id,name", NULL, 0));
+  setAllocatorLimit(allocator, allocator->stats.bytesLive + 4096);
+
+  // Rows that run out of memory are dropped
+  char name[1000];
+  memset(name, 'x', sizeof(name) - 1);
+  name[sizeof(name) - 1] = 0;
+  const char *row[] = {"1", name};
+  int added = 0;
+  while (addRow(tables, row, 2))
+  {
+    added++;
+  }
+  COLUMN_TABLE *table = (COLUMN_TABLE *)tableAt(&tables->list, 0);
+  mu_assert("Expected rows until memory ran out", (added > 0) && (table->numRows == added));
+  setAllocatorLimit(allocator, 0);
+  const char *shortRow[] = {"2", "y"};
+  mu_assert("Expected a row once there's memory", addRow(tables, shortRow, 2));
+  mu_assert("Expected the dropped row's values to be dropped", stringIs(&table->columns[1], added, "y") && stringIs(&table->columns[0], added, "2"));
+
+  freeColumnTables(tables);
+  mu_assert("Expected every allocation to be freed", allocator->stats.bytesLive == 0);
+  freeAllocator(allocator);
+  return 0;
+}
+
+static char *testParse()
+{
+  const char *filing = "HDR\x1c"
+                       "FEC\x1c"
+                       "8.3\x1c"
+                       "FECfile\x1c"
+                       "8.3.0\x1c\x1c\n"
+                       "SA11AI\x1c"
+                       "C00123456\x1c"
+                       "SA11AI.1\x1c\x1c\x1cIND\x1c\x1cSmith\x1cJo\x1c\x1c\x1c\x1c"
+                       "1 Main\x1c\x1cTown\x1cST\x1c"
+                       "12345\x1cP2022\x1c\x1c"
+                       "20210105\x1c"
+                       "1.005\x1c"
+                       "200.00\n"
+                       "SB23\x1c"
+                       "C00123456\x1c"
+                       "SB23.1\x1c\x1c\x1c"
+                       "CAN\x1c"
+                       "Doe \"for\" Congress, Inc\n";
+
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(NULL);
+  FEC_CONTEXT *ctx = newFecContext(persistentMemory, NULL, 64, NULL, 64, NULL, 0, NULL, "7", NULL, 1, 1, 0, NULL);
+  COLUMN_TABLES *tables = newColumnTables(NULL);
+  mu_assert("Expected columns", setFecColumns(ctx, tables));
+  setFecInputMemory(ctx, (char *)filing, strlen(filing));
+  mu_assert("Expected a parse", parseFec(ctx));
+  freeFecContext(ctx);
+
+  mu_assert("Expected a table per form type", (tables->list.numTables == 3) && (strcmp(((COLUMN_TABLE *)tableAt(&tables->list, 0))->key.name, "header") == 0));
+  COLUMN_TABLE *receipts = (COLUMN_TABLE *)tableAt(&tables->list, 1);
+  mu_assert("Expected the receipt", (strcmp(receipts->key.name, "SA11AI") == 0) && (receipts->numRows == 1));
+  mu_assert("Expected the filing id", stringIs(&receipts->columns[0], 0, "7"));
+  for (int i = 0; i < receipts->numColumns; i++)
+  {
+    COLUMN *column = &receipts->columns[i];
+    if (strcmp(column->name, "contribution_date") == 0)
+    {
+      mu_assert("Expected the date", (column->type == 'd') && (((int64_t *)column->values)[0] == 18632));
+    }
+    if (strcmp(column->name, "contribution_amount") == 0)
+    {
+      // (at its full precision)
+      mu_assert("Expected the amount", (column->type == 'f') && (((double *)column->values)[0] == 1.005));
+    }
+  }
+  COLUMN_TABLE *disbursements = (COLUMN_TABLE *)tableAt(&tables->list, 2);
+  mu_assert("Expected the disbursement", (strcmp(disbursements->key.name, "SB23") == 0) && (disbursements->numRows == 1));
+  mu_assert("Expected unescaped strings", stringIs(&disbursements->columns[7], 0, "Doe \"for\" Congress, Inc"));
+
+  freeColumnTables(tables);
+  freePersistentMemoryContext(persistentMemory);
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testTables);
+  mu_run_test(testAllocatorLimit);
+  mu_run_test(testParse);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nColumn table tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
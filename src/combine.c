@@ -0,0 +1,100 @@
+#include "combine.h"
+#include "compat.h"
+#include "watch.h"
+#include <string.h>
+
+// The size of the input and output buffers
+#define COMBINE_BUFFER_SIZE 65536
+// The longest path read from standard input
+#define COMBINE_MAX_PATH 4096
+
+// Parse a filing into the combined output. Returns the parse result.
+int combineFiling(PERSISTENT_MEMORY_CONTEXT *persistentMemory, WRITE_CONTEXT *output, char *outputDirectory, const char *path, int unified, int format, int warn)
+{
+  const char *name = strrchr(path, DIR_SEPARATOR_CHAR);
+  char *filingId = fileFilingId(name != NULL ? name + 1 : path);
+  FEC_CONTEXT *fec = NULL;
+  if (filingId != NULL)
+  {
+    fec = newFecContext(persistentMemory, ((BufferRead)(&readBuffer)), COMBINE_BUFFER_SIZE, NULL, COMBINE_BUFFER_SIZE, NULL, 1, NULL, filingId, outputDirectory, 1, 1, warn, NULL);
+  }
+  int result = 0;
+  if (fec != NULL)
+  {
+    setFecWriteContext(fec, output);
+  }
+  if ((fec == NULL) || !setFecUnified(fec, unified) || !setFecFormat(fec, format))
+  {
+    fprintf(stderr, "Out of memory parsing %s\n", path);
+  }
+  else if (!setFecInputPath(fec, path))
+  {
+    fprintf(stderr, "Couldn't open file: %s\n", path);
+  }
+  else
+  {
+    result = parseFec(fec);
+    if (!result)
+    {
+      fprintf(stderr, "Failed to parse %s\n", path);
+    }
+  }
+  if (fec != NULL)
+  {
+    freeFecContext(fec);
+  }
+  free(filingId);
+  return result;
+}
+
+int combineFilings(char *outputDirectory, char **paths, int numPaths, long long rotateSize, int unified, int format, int silent, int warn)
+{
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(NULL);
+  WRITE_CONTEXT *output = persistentMemory != NULL ? newWriteContext(outputDirectory, "", 1, COMBINE_BUFFER_SIZE, NULL, NULL, NULL) : NULL;
+  if (output == NULL)
+  {
+    fprintf(stderr, "Out of memory combining filings\n");
+    if (persistentMemory != NULL)
+    {
+      freePersistentMemoryContext(persistentMemory);
+    }
+    return 1;
+  }
+  setCombinedOutput(output, rotateSize);
+
+  int parsed = 0;
+  int failed = 0;
+  if (numPaths > 0)
+  {
+    for (int i = 0; i < numPaths; i++)
+    {
+      int result = combineFiling(persistentMemory, output, outputDirectory, paths[i], unified, format, warn);
+      parsed += result;
+      failed += !result;
+    }
+  }
+  else
+  {
+    char path[COMBINE_MAX_PATH];
+    while (fgets(path, sizeof(path), stdin) != NULL)
+    {
+      path[strcspn(path, "\r\n")] = 0;
+      if (path[0] == 0)
+      {
+        continue;
+      }
+      int result = combineFiling(persistentMemory, output, outputDirectory, path, unified, format, warn);
+      parsed += result;
+      failed += !result;
+    }
+  }
+
+  // Flush and close the combined files
+  freeWriteContext(output);
+  freePersistentMemoryContext(persistentMemory);
+  if (!silent)
+  {
+    printf("Combined %d filings into %s (%d failed)\n", parsed, outputDirectory, failed);
+  }
+  return failed > 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "fec.h"
+
+// Parse many filings into combined output in outputDirectory (see
+// setCombinedOutput): the rows of each form type across all of the
+// filings go to one file, with a filing_id column, and files are rotated
+// once they reach rotateSize bytes (0 to never rotate them). The filings
+// are the files at paths, or if there are none, the files named on each
+// line of standard input. The filing ID of each is the number its file
+// name ends with (see fileFilingId). If unified is set, each form type
+// is written in its unified schema (see setFecUnified), so filings of
+// different versions share files. The files are written in the format
+// (see setFecFormat). The outputs of earlier runs in the
+// directory are replaced. Filings that fail to parse are reported, but
+// any rows they wrote before failing are kept. Returns the exit status.
+int combineFilings(char *outputDirectory, char **paths, int numPaths, long long rotateSize, int unified, int format, int silent, int warn);
@@ -0,0 +1,71 @@
+#include "count.h"
+#include <string.h>
+
+FORM_COUNTS *newFormCounts(ALLOCATOR *allocator)
+{
+  FORM_COUNTS *counts = (FORM_COUNTS *)allocatorMalloc(allocator, sizeof(FORM_COUNTS));
+  if (counts == NULL)
+  {
+    return NULL;
+  }
+  counts->counts = NULL;
+  counts->numCounts = 0;
+  counts->lastIndex = -1;
+  counts->allocator = allocator;
+  return counts;
+}
+
+void freeFormCounts(FORM_COUNTS *counts)
+{
+  for (int i = 0; i < counts->numCounts; i++)
+  {
+    allocatorFree(counts->allocator, counts->counts[i].formType);
+  }
+  allocatorFree(counts->allocator, counts->counts);
+  allocatorFree(counts->allocator, counts);
+}
+
+int formCountMatches(FORM_COUNTS *counts, int index, const char *formType, int length)
+{
+  char *existing = counts->counts[index].formType;
+  return (strncmp(existing, formType, length) == 0) && (existing[length] == 0);
+}
+
+int formCountIndex(FORM_COUNTS *counts, const char *formType, int length)
+{
+  if ((counts->lastIndex >= 0) && formCountMatches(counts, counts->lastIndex, formType, length))
+  {
+    return counts->lastIndex;
+  }
+  for (int i = 0; i < counts->numCounts; i++)
+  {
+    if (formCountMatches(counts, i, formType, length))
+    {
+      counts->lastIndex = i;
+      return i;
+    }
+  }
+
+  // New form type
+  char *formTypeCopy = (char *)allocatorMalloc(counts->allocator, length + 1);
+  if (formTypeCopy == NULL)
+  {
+    return -1;
+  }
+  FORM_COUNT *grown = (FORM_COUNT *)allocatorRealloc(counts->allocator, counts->counts, sizeof(FORM_COUNT) * (counts->numCounts + 1));
+  if (grown == NULL)
+  {
+    allocatorFree(counts->allocator, formTypeCopy);
+    return -1;
+  }
+  counts->counts = grown;
+  FORM_COUNT *count = &counts->counts[counts->numCounts];
+  count->formType = formTypeCopy;
+  memcpy(count->formType, formType, length);
+  count->formType[length] = 0;
+  count->rows = 0;
+  count->bytes = 0;
+  counts->lastIndex = counts->numCounts;
+  counts->numCounts++;
+  return counts->lastIndex;
+}
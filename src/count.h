@@ -0,0 +1,38 @@
+#pragma once
+
+#include "export.h"
+#include "allocator.h"
+
+// The number of rows and bytes of a form type in a filing
+struct form_count
+{
+  char *formType;
+  long long rows;
+  long long bytes;
+};
+typedef struct form_count FORM_COUNT;
+
+// Row and byte counts for each form type in a filing, in the order the
+// form types were first encountered
+struct form_counts
+{
+  FORM_COUNT *counts;
+  int numCounts;
+  // The index of the last form type looked up (consecutive rows
+  // usually share a form type)
+  int lastIndex;
+  // Where the counts' memory comes from (NULL for the C library's)
+  ALLOCATOR *allocator;
+};
+typedef struct form_counts FORM_COUNTS;
+
+// Create counts allocated with the allocator (or the C library's if
+// it's NULL). Returns NULL if memory ran out.
+EXPORT FORM_COUNTS *newFormCounts(ALLOCATOR *allocator);
+
+EXPORT void freeFormCounts(FORM_COUNTS *counts);
+
+// Return the index of the count for the form type, adding
+// an empty count if it hasn't been encountered yet. Returns -1 if
+// memory ran out adding it.
+int formCountIndex(FORM_COUNTS *counts, const char *formType, int length);
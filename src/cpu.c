@@ -0,0 +1,74 @@
+#include "cpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *levelNames[] = {"scalar", "sse2", "avx2", "avx512"};
+
+int detectCpuLevel()
+{
+#ifdef CPU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw"))
+  {
+    return CPU_LEVEL_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return CPU_LEVEL_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2"))
+  {
+    return CPU_LEVEL_SSE2;
+  }
+#endif
+  return CPU_LEVEL_SCALAR;
+}
+
+int parseCpuLevel(const char *name)
+{
+  for (int i = 0; i < (int)(sizeof(levelNames) / sizeof(levelNames[0])); i++)
+  {
+    if (strcmp(name, levelNames[i]) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char *cpuLevelName(int level)
+{
+  return levelNames[level];
+}
+
+int cpuLevel()
+{
+  // Detected on first use. Racing threads all compute the same value.
+  static int level = -1;
+  int known = __atomic_load_n(&level, __ATOMIC_RELAXED);
+  if (known == -1)
+  {
+    int detected = detectCpuLevel();
+    const char *forced = getenv("FASTFEC_SIMD");
+    if (forced != NULL && forced[0] != 0)
+    {
+      int parsed = parseCpuLevel(forced);
+      if (parsed == -1)
+      {
+        fprintf(stderr, "Unknown FASTFEC_SIMD level \"%s\"; using %s\n", forced, levelNames[detected]);
+      }
+      else if (parsed > detected)
+      {
+        fprintf(stderr, "FASTFEC_SIMD level %s isn't supported by this processor; using %s\n", forced, levelNames[detected]);
+      }
+      else
+      {
+        detected = parsed;
+      }
+    }
+    __atomic_store_n(&level, detected, __ATOMIC_RELAXED);
+    known = detected;
+  }
+  return known;
+}
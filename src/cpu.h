@@ -0,0 +1,29 @@
+#pragma once
+
+// Levels of vector instructions the kernels can be specialized for, in
+// increasing order. Each level implies the ones below it.
+#define CPU_LEVEL_SCALAR 0
+#define CPU_LEVEL_SSE2 1
+#define CPU_LEVEL_AVX2 2
+#define CPU_LEVEL_AVX512 3
+
+// Vector kernels are compiled for x86 with per-function target
+// attributes, so a single binary carries every level regardless of the
+// flags it was built with
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_X86
+#endif
+
+// The level of vector instructions supported by the processor. This is
+// detected once, and can be lowered by setting the FASTFEC_SIMD
+// environment variable to one of "scalar", "sse2", "avx2" or "avx512"
+// (e.g. to test a kernel on a host that supports a higher level).
+int cpuLevel();
+
+// The highest level the processor supports, ignoring FASTFEC_SIMD
+int detectCpuLevel();
+
+// Return the level with the given name, or -1 if the name isn't known
+int parseCpuLevel(const char *name);
+
+const char *cpuLevelName(int level);
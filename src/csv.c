@@ -2,6 +2,14 @@
 #include "memory.h"
 #include "csv.h"
 #include "writer.h"
+#include "buffer.h"
+#include "cpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
 
 void processFieldChar(char c, FIELD_INFO *info)
 {
@@ -62,6 +70,19 @@ void readAscii28Field(PARSE_CONTEXT *parseContext)
   stripQuotes(parseContext);
 }
 
+void readPlainAscii28Field(PARSE_CONTEXT *parseContext)
+{
+  char *str = parseContext->line->str;
+  int position = parseContext->position;
+  parseContext->start = position;
+  while (str[position] != 0 && str[position] != 28 && str[position] != '\n')
+  {
+    position++;
+  }
+  parseContext->position = position;
+  parseContext->end = position;
+}
+
 void readCsvSubfield(PARSE_CONTEXT *parseContext)
 {
   char c = parseContext->line->str[parseContext->position];
@@ -140,6 +161,186 @@ void advanceField(PARSE_CONTEXT *context)
   context->position++;
 }
 
+void writeDoubledQuotes(WRITE_CONTEXT *context, char *filename, const char *extension, char *str, int length)
+{
+  char *end = str + length;
+  while (str < end)
+  {
+    int index = findByte(str, end - str, '"');
+    if (index == -1)
+    {
+      // No quotes left
+      writeN(context, filename, extension, str, end - str);
+      return;
+    }
+    // Write everything up to and including the quote, then double it
+    char *quote = str + index;
+    writeN(context, filename, extension, str, quote - str + 1);
+    writeChar(context, filename, extension, '"');
+    str = quote + 1;
+  }
+}
+
+void replaceByteScalar(char *str, int length, char from, char to)
+{
+  for (int i = 0; i < length; i++)
+  {
+    str[i] = str[i] == from ? to : str[i];
+  }
+}
+
+#ifdef CPU_X86
+__attribute__((target("sse2"))) void replaceByteSse2(char *str, int length, char from, char to)
+{
+  __m128i fromBytes = _mm_set1_epi8(from);
+  __m128i toBytes = _mm_set1_epi8(to);
+  int i = 0;
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+    __m128i matches = _mm_cmpeq_epi8(block, fromBytes);
+    block = _mm_or_si128(_mm_andnot_si128(matches, block), _mm_and_si128(matches, toBytes));
+    _mm_storeu_si128((__m128i *)(str + i), block);
+  }
+  replaceByteScalar(str + i, length - i, from, to);
+}
+
+__attribute__((target("avx2"))) void replaceByteAvx2(char *str, int length, char from, char to)
+{
+  __m256i fromBytes = _mm256_set1_epi8(from);
+  __m256i toBytes = _mm256_set1_epi8(to);
+  int i = 0;
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+    block = _mm256_blendv_epi8(block, toBytes, _mm256_cmpeq_epi8(block, fromBytes));
+    _mm256_storeu_si256((__m256i *)(str + i), block);
+  }
+  // Finish here rather than calling the SSE2 kernel, which would mix in
+  // non-VEX instructions
+  if (i + 16 <= length)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+    block = _mm_blendv_epi8(block, _mm256_castsi256_si128(toBytes), _mm_cmpeq_epi8(block, _mm256_castsi256_si128(fromBytes)));
+    _mm_storeu_si128((__m128i *)(str + i), block);
+    i += 16;
+  }
+  replaceByteScalar(str + i, length - i, from, to);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void replaceByteAvx512(char *str, int length, char from, char to)
+{
+  __m512i fromBytes = _mm512_set1_epi8(from);
+  __m512i toBytes = _mm512_set1_epi8(to);
+  for (int i = 0; i < length; i += 64)
+  {
+    // Masked loads and stores don't touch the bytes past the end
+    __mmask64 valid = length - i >= 64 ? ~0ULL : (1ULL << (length - i)) - 1;
+    __m512i block = _mm512_maskz_loadu_epi8(valid, str + i);
+    __mmask64 matches = _mm512_mask_cmpeq_epi8_mask(valid, block, fromBytes);
+    _mm512_mask_storeu_epi8(str + i, matches, toBytes);
+  }
+}
+#endif
+
+ReplaceByteKernel replaceByteKernel(int level)
+{
+#ifdef CPU_X86
+  switch (level)
+  {
+  case CPU_LEVEL_AVX512:
+    return replaceByteAvx512;
+  case CPU_LEVEL_AVX2:
+    return replaceByteAvx2;
+  case CPU_LEVEL_SSE2:
+    return replaceByteSse2;
+  }
+#endif
+  return replaceByteScalar;
+}
+
+// The kernel is picked on the first call, which replaces this one
+void replaceByteFirstCall(char *str, int length, char from, char to);
+static ReplaceByteKernel replaceByteSelected = replaceByteFirstCall;
+
+void replaceByteFirstCall(char *str, int length, char from, char to)
+{
+  // Racing threads all select the same kernel
+  ReplaceByteKernel kernel = replaceByteKernel(cpuLevel());
+  __atomic_store_n(&replaceByteSelected, kernel, __ATOMIC_RELAXED);
+  kernel(str, length, from, to);
+}
+
+void replaceByte(char *str, int length, char from, char to)
+{
+  __atomic_load_n(&replaceByteSelected, __ATOMIC_RELAXED)(str, length, from, to);
+}
+
+int headerNameOccurrence(const char *header, const char *name, int length)
+{
+  int occurrence = 1;
+  for (const char *earlier = header; earlier < name;)
+  {
+    const char *earlierEnd = strchr(earlier, ',');
+    if (earlierEnd == NULL)
+    {
+      // (name is past the last column)
+      break;
+    }
+    occurrence += (earlierEnd - earlier == length) && (memcmp(earlier, name, length) == 0);
+    earlier = earlierEnd + 1;
+  }
+  return occurrence;
+}
+
+void startHeaderColumns(HEADER_COLUMN *column, const char *header, const char *types)
+{
+  column->header = header;
+  column->types = types;
+  column->numTypes = types != NULL ? strlen(types) : 0;
+  column->next = header;
+  column->index = -1;
+}
+
+int nextHeaderColumn(HEADER_COLUMN *column)
+{
+  if (column->next == NULL)
+  {
+    return 0;
+  }
+  // Header names are never quoted, so they can be split on commas
+  const char *end = strchr(column->next, ',');
+  column->index++;
+  column->name = column->next;
+  column->length = end == NULL ? (int)strlen(column->name) : (int)(end - column->name);
+  column->type = column->index < column->numTypes ? column->types[column->index] : 's';
+  column->occurrence = headerNameOccurrence(column->header, column->name, column->length);
+  column->suffix[0] = 0;
+  if (column->occurrence > 1)
+  {
+    sprintf(column->suffix, "_%d", column->occurrence);
+  }
+  column->next = end == NULL ? NULL : end + 1;
+  return 1;
+}
+
+// Room for the fields that are numbers
+#define NUMBER_FIELD_CAPACITY 64
+
+int parseNumberField(const char *str, int length, double *value)
+{
+  if ((length == 0) || (length >= NUMBER_FIELD_CAPACITY))
+  {
+    return 0;
+  }
+  char number[NUMBER_FIELD_CAPACITY];
+  memcpy(number, str, length);
+  number[length] = 0;
+  char *end;
+  *value = strtod(number, &end);
+  return end == number + length;
+}
+
 void writeField(WRITE_CONTEXT *context, char *filename, const char *extension, STRING *line, int start, int end, FIELD_INFO *info)
 {
   int escaped = (info->num_commas > 0) || (info->num_quotes > 0);
@@ -157,21 +358,7 @@ void writeField(WRITE_CONTEXT *context, char *filename, const char *extension, S
   }
   else
   {
-    // Copy string in char-by-char
-    for (int i = start; i < end; i++)
-    {
-      char c = line->str[i];
-      if (c == '"')
-      {
-        // Double quotes
-        writeString(context, filename, extension, "\"\"");
-      }
-      else
-      {
-        // Normal character
-        writeChar(context, filename, extension, c);
-      }
-    }
+    writeDoubledQuotes(context, filename, extension, line->str + start, end - start);
   }
   if (escaped)
   {
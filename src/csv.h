@@ -34,6 +34,11 @@ static inline int endOfField(char c);
 // then return the field contents inside the quotes.
 void readAscii28Field(PARSE_CONTEXT *parseContext);
 
+// Read a field delimited by the character with the ascii code 28 from
+// a line with no quotes or commas, so there's nothing to count in the
+// field info or strip
+void readPlainAscii28Field(PARSE_CONTEXT *parseContext);
+
 // Read a CSV field in-place, modifying line and returning start and
 // end positions of the unescaped field. Since CSV fields are always
 // longer escaped than not, this will always work in-place.
@@ -42,6 +47,54 @@ void readCsvField(PARSE_CONTEXT *parseContext);
 // Advance past the delimeter and increase the column index
 void advanceField(PARSE_CONTEXT *parseContext);
 
+// Write the characters with each quote doubled (escaped for the inside
+// of a quoted CSV field). Runs between quotes are written in bulk.
+void writeDoubledQuotes(WRITE_CONTEXT *context, char *filename, const char *extension, char *str, int length);
+
+// Replace each from byte in the length bytes of str with to, in place.
+// Runs the best kernel for the processor (see cpu.h).
+void replaceByte(char *str, int length, char from, char to);
+
+typedef void (*ReplaceByteKernel)(char *str, int length, char from, char to);
+
+// The replaceByte kernel for a cpu level
+ReplaceByteKernel replaceByteKernel(int level);
+
+// Count which occurrence of its name the column of a header row starting
+// at name is (1 for the first column with the name, 2 for the next...).
+// Header names are never quoted, so the header row is split on commas.
+int headerNameOccurrence(const char *header, const char *name, int length);
+
+// A column of a header row, as iterated over by nextHeaderColumn: its
+// name, its type ('s' for columns past the end of the types) and the
+// occurrence of its name, with the suffix repeated names are numbered
+// with from the second (e.g. "_2", or "" for the first).
+struct header_column
+{
+  const char *header;
+  const char *types;
+  int numTypes;
+  const char *next;
+  int index;
+  const char *name;
+  int length;
+  char type;
+  int occurrence;
+  char suffix[16];
+};
+typedef struct header_column HEADER_COLUMN;
+
+// Iterate over the columns of a header row with the types (NULL if
+// they're all strings): start, then call nextHeaderColumn for each
+// column until it returns 0.
+void startHeaderColumns(HEADER_COLUMN *column, const char *header, const char *types);
+
+int nextHeaderColumn(HEADER_COLUMN *column);
+
+// Convert a whole field to a number. Returns 0 if it's empty or isn't
+// one.
+int parseNumberField(const char *str, int length, double *value);
+
 void writeField(WRITE_CONTEXT *context, char *filename, const char *extension, STRING *line, int start, int end, FIELD_INFO *info);
 
 int isWhitespaceChar(char c);
@@ -3,6 +3,7 @@
 #include "minunit.h"
 #include "memory.h"
 #include "csv.h"
+#include "cpu.h"
 
 int tests_run = 0;
 
@@ -176,6 +177,28 @@ static char *testAscii28Reading()
   return 0;
 }
 
+static char *testPlainAscii28Reading()
+{
+  PARSE_CONTEXT parseContext;
+  FIELD_INFO fieldInfo;
+
+  // Fields end at the delimeter, newline or end of line
+  STRING *line = fromString("abc\x1c\x1c de\n");
+  initParseContextWithLine(&parseContext, &fieldInfo, line);
+  readPlainAscii28Field(&parseContext);
+  mu_assert("error, first field should span 0-3", parseContext.start == 0 && parseContext.end == 3);
+  advanceField(&parseContext);
+  readPlainAscii28Field(&parseContext);
+  mu_assert("error, second field should be empty", parseContext.start == 4 && parseContext.end == 4);
+  advanceField(&parseContext);
+  readPlainAscii28Field(&parseContext);
+  mu_assert("error, third field should span 5-8", parseContext.start == 5 && parseContext.end == 8);
+  mu_assert("error, position should be at the newline", parseContext.line->str[parseContext.position] == '\n');
+
+  freeString(line);
+  return 0;
+}
+
 static char *testStripWhitespace()
 {
   PARSE_CONTEXT parseContext;
@@ -200,11 +223,62 @@ static char *testStripWhitespace()
   return 0;
 }
 
+static char *testQuoteEscaping()
+{
+  WRITE_CONTEXT context;
+  STRING *output = newString(4);
+
+  initializeLocalWriteContext(&context, output);
+  writeDoubledQuotes(&context, NULL, NULL, "no quotes", 9);
+  mu_assert("expected unchanged text", strcmp(output->str, "no quotes") == 0);
+
+  initializeLocalWriteContext(&context, output);
+  writeDoubledQuotes(&context, NULL, NULL, "\"a\" \"\"b\"", 9);
+  mu_assert("expected doubled quotes", strcmp(output->str, "\"\"a\"\" \"\"\"\"b\"\"") == 0);
+
+  // Fields with quotes are quoted and escaped
+  STRING *line = fromString("x,say \"hi\",y");
+  FIELD_INFO fieldInfo = {.num_commas = 0, .num_quotes = 2};
+  initializeLocalWriteContext(&context, output);
+  writeField(&context, NULL, NULL, line, 2, 10, &fieldInfo);
+  mu_assert("expected escaped field", strcmp(output->str, "\"say \"\"hi\"\"\"") == 0);
+
+  freeString(line);
+  freeString(output);
+  return 0;
+}
+
+static char *testReplaceByteKernels()
+{
+  // Every kernel the processor supports should replace exactly the
+  // matching bytes within the length
+  char str[150];
+  char expected[150];
+  for (int level = CPU_LEVEL_SCALAR; level <= detectCpuLevel(); level++)
+  {
+    ReplaceByteKernel kernel = replaceByteKernel(level);
+    for (int length = 0; length <= (int)sizeof(str); length++)
+    {
+      for (int i = 0; i < (int)sizeof(str); i++)
+      {
+        str[i] = i % 5 == 0 ? 28 : 'a' + i % 26;
+        expected[i] = i % 5 == 0 && i < length ? ',' : str[i];
+      }
+      kernel(str, length, 28, ',');
+      mu_assert("expected delimeters to be replaced", memcmp(str, expected, sizeof(str)) == 0);
+    }
+  }
+  return 0;
+}
+
 static char *all_tests()
 {
   mu_run_test(testCsvReading);
   mu_run_test(testAscii28Reading);
+  mu_run_test(testPlainAscii28Reading);
   mu_run_test(testStripWhitespace);
+  mu_run_test(testQuoteEscaping);
+  mu_run_test(testReplaceByteKernels);
   return 0;
 }
 
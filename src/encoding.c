@@ -1,6 +1,10 @@
 
 #include "encoding.h"
+#include "cpu.h"
 #include <stdint.h>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
 
 // UTF-8 decoder notice
 // Copyright (c) 2008-2009 Bjoern Hoehrmann <bjoern@hoehrmann.de>
@@ -30,6 +34,7 @@ void collectLineInfo(STRING *line, LINE_INFO *info)
 {
   // Initialize info
   info->ascii28 = 0;
+  info->quotesOrCommas = 0;
   info->asciiOnly = 1;
   info->validUtf8 = 1;
   info->length = 0;
@@ -51,6 +56,11 @@ void collectLineInfo(STRING *line, LINE_INFO *info)
       // Has char 28 (separator)
       info->ascii28 = 1;
     }
+    if ((c == '"') || (c == ','))
+    {
+      // Has characters that need escaping in CSV output
+      info->quotesOrCommas = 1;
+    }
     if (c > 127)
     {
       // Not ascii only anymore
@@ -68,15 +78,15 @@ void collectLineInfo(STRING *line, LINE_INFO *info)
 }
 
 // Adapted from https://stackoverflow.com/a/4059934
-// Ensure the output buffer is twice as long as the input
-int iso_8859_1_to_utf_8(STRING *in, STRING *output)
+// Transcode ISO-8859-1 to UTF-8 one byte at a time. Return the length
+// of the output. The output must be at least twice as long as the
+// input (plus a null terminator).
+int iso_8859_1_to_utf_8_scalar(const char *in, int length, char *output)
 {
-  growStringTo(output, in->n * 2 + 1);
-
-  uint8_t *line = (uint8_t *)in->str;
-  uint8_t *out = (uint8_t *)output->str;
-  int length = 0;
-  while (*line)
+  const uint8_t *line = (const uint8_t *)in;
+  const uint8_t *end = line + length;
+  uint8_t *out = (uint8_t *)output;
+  while (line < end)
   {
     if (*line < 128)
     {
@@ -85,12 +95,202 @@ int iso_8859_1_to_utf_8(STRING *in, STRING *output)
     else
     {
       *out++ = 0xc2 + (*line > 0xbf), *out++ = (*line++ & 0x3f) + 0x80;
-      length += 2;
     }
   }
+  *out = 0;
+  return out - (uint8_t *)output;
+}
+
+// Output slack so that blocks can be stored whole past the end of the
+// transcoded output
+#define TRANSCODE_SLACK 16
+
+#ifdef CPU_X86
+// For each pattern of high bytes in a group of 4 input bytes, the
+// shuffle that packs the group's (lead, continuation) byte pairs into
+// its UTF-8 output, dropping the continuations of ASCII bytes
+static const uint8_t groupShuffles[16][16] = {
+    {0, 2, 4, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 4, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 3, 4, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 4, 5, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 4, 5, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 3, 4, 5, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 5, 6, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 4, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 4, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 3, 4, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 2, 3, 4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+    {0, 1, 2, 3, 4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+};
+static const uint8_t groupLengths[16] = {4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
+
+// Expand a 16 byte block with high bytes (given by the highBytes mask)
+// to UTF-8 with shuffles, 4 input bytes at a time. Return the length of
+// the output.
+static inline __attribute__((target("ssse3"))) int expandBlock(__m128i block, int highBytes, char *out)
+{
+  // Lead bytes: ASCII bytes pass through, high bytes become 0xc2 or
+  // 0xc3 (for bytes of 0xc0 and up)
+  __m128i high = _mm_cmplt_epi8(block, _mm_setzero_si128());
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8((char)0xbf)), high);
+  __m128i lead = _mm_or_si128(_mm_andnot_si128(high, block), _mm_and_si128(high, _mm_sub_epi8(_mm_set1_epi8((char)0xc2), upper)));
+  // Continuation bytes: the low 6 bits of the byte
+  __m128i continuation = _mm_or_si128(_mm_and_si128(block, _mm_set1_epi8(0x3f)), _mm_set1_epi8((char)0x80));
+  __m128i pairs[2] = {_mm_unpacklo_epi8(lead, continuation), _mm_unpackhi_epi8(lead, continuation)};
+  int length = 0;
+  for (int group = 0; group < 4; group++)
+  {
+    __m128i groupPairs = (group & 1) ? _mm_srli_si128(pairs[group >> 1], 8) : pairs[group >> 1];
+    int pattern = (highBytes >> (group * 4)) & 0xf;
+    _mm_storel_epi64((__m128i *)(out + length), _mm_shuffle_epi8(groupPairs, _mm_loadu_si128((const __m128i *)groupShuffles[pattern])));
+    length += groupLengths[pattern];
+  }
   return length;
 }
 
+// Transcode 16 bytes at a time, copying blocks of ASCII whole. Blocks
+// with high bytes are transcoded one byte at a time.
+__attribute__((target("sse2"))) int iso_8859_1_to_utf_8_sse2(const char *in, int length, char *output)
+{
+  const char *end = in + length;
+  char *out = output;
+  while (end - in >= 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)in);
+    if (_mm_movemask_epi8(block) == 0)
+    {
+      // All ASCII
+      _mm_storeu_si128((__m128i *)out, block);
+      out += 16;
+    }
+    else
+    {
+      out += iso_8859_1_to_utf_8_scalar(in, 16, out);
+    }
+    in += 16;
+  }
+  out += iso_8859_1_to_utf_8_scalar(in, end - in, out);
+  return out - output;
+}
+
+// Transcode 32 bytes at a time, copying blocks of ASCII whole. Halves
+// with high bytes are expanded with shuffles.
+__attribute__((target("avx2"))) int iso_8859_1_to_utf_8_avx2(const char *in, int length, char *output)
+{
+  const char *end = in + length;
+  char *out = output;
+  while (end - in >= 32)
+  {
+    __m256i block = _mm256_loadu_si256((const __m256i *)in);
+    unsigned int highBytes = _mm256_movemask_epi8(block);
+    if (highBytes == 0)
+    {
+      // All ASCII
+      _mm256_storeu_si256((__m256i *)out, block);
+      out += 32;
+    }
+    else
+    {
+      out += expandBlock(_mm256_castsi256_si128(block), highBytes & 0xffff, out);
+      out += expandBlock(_mm256_extracti128_si256(block, 1), highBytes >> 16, out);
+    }
+    in += 32;
+  }
+  // Clear the upper halves of the registers before the scalar transcoder,
+  // which may be compiled with non-VEX instructions
+  _mm256_zeroupper();
+  if (end - in >= 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)in);
+    out += expandBlock(block, _mm_movemask_epi8(block), out);
+    in += 16;
+  }
+  out += iso_8859_1_to_utf_8_scalar(in, end - in, out);
+  return out - output;
+}
+
+// Transcode 64 bytes at a time, copying blocks of ASCII whole. Blocks
+// with high bytes are expanded 16 bytes at a time with shuffles.
+__attribute__((target("avx512f,avx512bw"))) int iso_8859_1_to_utf_8_avx512(const char *in, int length, char *output)
+{
+  const char *end = in + length;
+  char *out = output;
+  while (end - in >= 64)
+  {
+    __m512i block = _mm512_loadu_si512((const void *)in);
+    if (_mm512_movepi8_mask(block) == 0)
+    {
+      // All ASCII
+      _mm512_storeu_si512((void *)out, block);
+      in += 64;
+      out += 64;
+      continue;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+      __m128i quarter = _mm_loadu_si128((const __m128i *)in);
+      out += expandBlock(quarter, _mm_movemask_epi8(quarter), out);
+      in += 16;
+    }
+  }
+  _mm256_zeroupper();
+  while (end - in >= 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)in);
+    out += expandBlock(block, _mm_movemask_epi8(block), out);
+    in += 16;
+  }
+  out += iso_8859_1_to_utf_8_scalar(in, end - in, out);
+  return out - output;
+}
+#endif
+
+TranscodeKernel transcodeKernel(int level)
+{
+#ifdef CPU_X86
+  switch (level)
+  {
+  case CPU_LEVEL_AVX512:
+    return iso_8859_1_to_utf_8_avx512;
+  case CPU_LEVEL_AVX2:
+    return iso_8859_1_to_utf_8_avx2;
+  case CPU_LEVEL_SSE2:
+    return iso_8859_1_to_utf_8_sse2;
+  }
+#endif
+  return iso_8859_1_to_utf_8_scalar;
+}
+
+// The kernel is picked on the first call, which replaces this one
+int transcodeFirstCall(const char *in, int length, char *output);
+static TranscodeKernel transcodeSelected = transcodeFirstCall;
+
+int transcodeFirstCall(const char *in, int length, char *output)
+{
+  // Racing threads all select the same kernel
+  TranscodeKernel kernel = transcodeKernel(cpuLevel());
+  __atomic_store_n(&transcodeSelected, kernel, __ATOMIC_RELAXED);
+  return kernel(in, length, output);
+}
+
+// Transcode an ISO-8859-1 line of the given length to UTF-8, growing
+// the output only if it can't hold the result. Return the length of
+// the output.
+int iso_8859_1_to_utf_8(STRING *in, int length, STRING *output)
+{
+  if (!growStringTo(output, (size_t)length * 2 + 1 + TRANSCODE_SLACK))
+  {
+    output->str[0] = 0;
+    return 0;
+  }
+  return __atomic_load_n(&transcodeSelected, __ATOMIC_RELAXED)(in->str, length, output->str);
+}
+
 int decodeLine(LINE_INFO *info, STRING *in, STRING *output)
 {
   // Check line info
@@ -98,12 +298,16 @@ int decodeLine(LINE_INFO *info, STRING *in, STRING *output)
 
   if (!info->validUtf8)
   {
-    return iso_8859_1_to_utf_8(in, output);
+    return iso_8859_1_to_utf_8(in, info->length, output);
   }
   else
   {
     // Copy memory buffer over
-    copyString(in, output);
+    if (!copyString(in, output))
+    {
+      output->str[0] = 0;
+      return 0;
+    }
     return info->length;
   }
 }
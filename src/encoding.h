@@ -6,9 +6,10 @@
 
 struct lineInfo
 {
-  int ascii28;   // default false
-  int asciiOnly; // default true
-  int validUtf8; // default true
+  int ascii28;        // default false
+  int quotesOrCommas; // default false
+  int asciiOnly;      // default true
+  int validUtf8;      // default true
   int length;
 };
 typedef struct lineInfo LINE_INFO;
@@ -17,6 +18,22 @@ typedef struct lineInfo LINE_INFO;
 // and getting the line info for each character
 void collectLineInfo(STRING *line, LINE_INFO *info);
 
+// Transcode ISO-8859-1 characters to UTF-8 one byte at a time (the
+// reference for the vectorized transcoder). Return the length of the
+// output, which must be at least twice the length plus one.
+int iso_8859_1_to_utf_8_scalar(const char *in, int length, char *output);
+
+typedef int (*TranscodeKernel)(const char *in, int length, char *output);
+
+// The ISO-8859-1 to UTF-8 transcoder for a cpu level (see cpu.h). The
+// output must have room for 16 bytes more than twice the length.
+TranscodeKernel transcodeKernel(int level);
+
+// Transcode an ISO-8859-1 line of the given length to UTF-8, growing
+// the output only if it can't hold the result. Return the length of
+// the output.
+int iso_8859_1_to_utf_8(STRING *in, int length, STRING *output);
+
 // Ensure the passed in line is encoded in UTF-8 by transforming
 // it to UTF-8 if necessary. The only other possible encodings
 // are ASCII (no transformation necessary) and ISO-8859-1.
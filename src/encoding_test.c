@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "memory.h"
+#include "encoding.h"
+#include "cpu.h"
+
+int tests_run = 0;
+
+static char *testTranscoding()
+{
+  STRING *in = fromString("caf\xe9 \xc0 la cr\xe8me\n");
+  STRING *out = newString(1);
+  int length = iso_8859_1_to_utf_8(in, strlen(in->str), out);
+  mu_assert("expected utf-8 output", strcmp(out->str, "caf\xc3\xa9 \xc3\x80 la cr\xc3\xa8me\n") == 0);
+  mu_assert("expected output length to count every byte", length == (int)strlen(out->str));
+
+  LINE_INFO info;
+  mu_assert("expected decoded length", decodeLine(&info, in, out) == length);
+  mu_assert("expected invalid utf-8 to be decoded", strcmp(out->str, "caf\xc3\xa9 \xc3\x80 la cr\xc3\xa8me\n") == 0);
+
+  freeString(in);
+  freeString(out);
+  return 0;
+}
+
+static char *testTranscodingMatchesScalar()
+{
+  // Compare against the scalar transcoder across lengths (to cover
+  // partial blocks) and mixes of ASCII and high bytes
+  STRING *in = newString(300);
+  STRING *out = newString(1);
+  char expected[601];
+  unsigned int seed = 1;
+  for (int length = 0; length < 300; length++)
+  {
+    for (int density = 0; density <= 4; density++)
+    {
+      for (int i = 0; i < length; i++)
+      {
+        seed = seed * 1103515245 + 12345;
+        int byte = (seed >> 16) & 0xff;
+        if ((int)((seed >> 8) & 3) >= density)
+        {
+          // ASCII (skipping the null terminator)
+          byte = (byte & 0x7f) | 1;
+        }
+        else
+        {
+          byte |= 0x80;
+        }
+        in->str[i] = (char)byte;
+      }
+      in->str[length] = 0;
+
+      int expectedLength = iso_8859_1_to_utf_8_scalar(in->str, length, expected);
+      int actualLength = iso_8859_1_to_utf_8(in, length, out);
+      mu_assert("expected transcoded lengths to match", actualLength == expectedLength);
+      mu_assert("expected transcoded output to match", memcmp(out->str, expected, expectedLength + 1) == 0);
+    }
+  }
+
+  freeString(in);
+  freeString(out);
+  return 0;
+}
+
+static char *testTranscodingKernels()
+{
+  // Every kernel the processor supports should match the scalar one
+  char in[200];
+  char expected[2 * 200 + 1];
+  char actual[2 * 200 + 1 + 16];
+  for (int i = 0; i < (int)sizeof(in); i++)
+  {
+    // A run of ASCII long enough for whole blocks, then mixed bytes
+    in[i] = (char)(i >= 100 && i % 3 == 0 ? 0x80 + i : 'a' + i % 26);
+  }
+  for (int level = CPU_LEVEL_SCALAR; level <= detectCpuLevel(); level++)
+  {
+    TranscodeKernel kernel = transcodeKernel(level);
+    for (int start = 0; start < (int)sizeof(in); start += 7)
+    {
+      for (int length = 0; start + length <= (int)sizeof(in); length++)
+      {
+        int expectedLength = iso_8859_1_to_utf_8_scalar(in + start, length, expected);
+        mu_assert("expected kernel length to match", kernel(in + start, length, actual) == expectedLength);
+        mu_assert("expected kernel output to match", memcmp(actual, expected, expectedLength + 1) == 0);
+      }
+    }
+  }
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testTranscoding);
+  mu_run_test(testTranscodingMatchesScalar);
+  mu_run_test(testTranscodingKernels);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nEncoding tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
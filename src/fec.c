@@ -4,7 +4,17 @@
 #include "csv.h"
 #include "mappings.h"
 #include "buffer.h"
+#include "pgcopy.h"
+#include "json.h"
+#include "sqlite.h"
 #include <string.h>
+#include <strings.h>
+
+// Mappings for the form types of a typical filing fit in a few chunks
+#define FEC_ARENA_CHUNK_SIZE 16384
+// The slots a pipelined parse reads a file ahead into, if it isn't
+// already read in place or ahead
+#define PIPELINE_READ_AHEAD_SLOTS 4
 
 char *HEADER = "header";
 char *SCHEDULE_COUNTS = "SCHEDULE_COUNTS_";
@@ -14,13 +24,50 @@ char *FEC = "FEC";
 char *COMMA_FEC_VERSIONS[] = {"1", "2", "3", "5"};
 int NUM_COMMA_FEC_VERSIONS = sizeof(COMMA_FEC_VERSIONS) / sizeof(char *);
 
-FEC_CONTEXT *newFecContext(PERSISTENT_MEMORY_CONTEXT *persistentMemory, BufferRead bufferRead, int inputBufferSize, CustomWriteFunction customWriteFunction, int outputBufferSize, CustomLineFunction customLineFunction, int writeToFile, void *file, char *filingId, char *outputDirectory, int includeFilingId, int silent, int warn)
+// Forget the mappings of every form type seen so far (they stay in the
+// arena, so their form types stay valid for the writer). Form types seen
+// again get new ids.
+void forgetFormMappings(FEC_CONTEXT *ctx)
+{
+  memset(ctx->mappings, 0, sizeof(ctx->mappings));
+  ctx->mapping = NULL;
+  ctx->formType = NULL;
+}
+
+// The bucket a form type's mapping is interned in (FNV-1a)
+int formMappingBucket(const char *formType, int length)
 {
-  FEC_CONTEXT *ctx = (FEC_CONTEXT *)malloc(sizeof(FEC_CONTEXT));
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < length; i++)
+  {
+    hash = (hash ^ (unsigned char)formType[i]) * 16777619u;
+  }
+  return hash & (FORM_MAPPING_BUCKETS - 1);
+}
+
+FEC_CONTEXT *newFecContext(PERSISTENT_MEMORY_CONTEXT *persistentMemory, BufferRead bufferRead, int inputBufferSize, CustomWriteFunction customWriteFunction, int outputBufferSize, CustomLineFunction customLineFunction, int writeToFile, void *file, char *filingId, char *outputDirectory, int includeFilingId, int silent, int warn, ALLOCATOR *allocator)
+{
+  if (allocator == NULL)
+  {
+    allocator = persistentMemory->allocator;
+  }
+  FEC_CONTEXT *ctx = (FEC_CONTEXT *)allocatorMalloc(allocator, sizeof(FEC_CONTEXT));
+  if (ctx == NULL)
+  {
+    fprintf(stderr, "Out of memory creating a parsing context\n");
+    return NULL;
+  }
+  ctx->allocator = allocator;
+  ctx->allocationFailures = 0;
+  ctx->outOfMemory = 0;
+  ctx->outputFailed = 0;
+  ctx->arena = newArena(FEC_ARENA_CHUNK_SIZE, allocator);
   ctx->persistentMemory = persistentMemory;
-  ctx->buffer = newBuffer(inputBufferSize, bufferRead);
+  ctx->buffer = newBuffer(inputBufferSize, bufferRead, allocator);
   ctx->file = file;
-  ctx->writeContext = newWriteContext(outputDirectory, filingId, writeToFile, outputBufferSize, customWriteFunction, customLineFunction);
+  ctx->ownsFile = 0;
+  ctx->ownsWriteContext = 1;
+  ctx->writeContext = newWriteContext(outputDirectory, filingId, writeToFile, outputBufferSize, customWriteFunction, customLineFunction, allocator);
   ctx->filingId = filingId;
   ctx->version = 0;
   ctx->versionLength = 0;
@@ -28,14 +75,45 @@ FEC_CONTEXT *newFecContext(PERSISTENT_MEMORY_CONTEXT *persistentMemory, BufferRe
   ctx->summary = 0;
   ctx->f99Text = 0;
   ctx->currentLineHasAscii28 = 0;
+  ctx->currentLineHasQuotesOrCommas = 0;
   ctx->currentLineLength = 0;
-  ctx->formType = NULL;
+  forgetFormMappings(ctx);
+  ctx->nextFormTypeId = 0;
   ctx->numFields = 0;
   ctx->headers = NULL;
   ctx->types = NULL;
+  ctx->columnMask = NULL;
+  ctx->selectedHeaders = NULL;
+  ctx->selectedTypes = NULL;
+  ctx->filter = NULL;
+  ctx->format = FORMAT_CSV;
+  ctx->columns = NULL;
+  ctx->extension = csvExtension;
+  ctx->unified = 0;
+  ctx->capturedRow = NULL;
+  memset(&ctx->rowWriteContext, 0, sizeof(WRITE_CONTEXT));
+  ctx->rowOutput = NULL;
+  ctx->rowHeader = NULL;
+  ctx->rowTypes = NULL;
+  ctx->rowSources = NULL;
+  ctx->rowColumns = 0;
+  ctx->columnBounds = NULL;
+  ctx->columnBoundsCapacity = 0;
+  ctx->capturedColumns = 0;
+  ctx->usePipeline = 0;
+  ctx->pipeline = NULL;
+  ctx->inputHash = NULL;
   ctx->includeFilingId = includeFilingId;
   ctx->silent = silent;
   ctx->warn = warn;
+  ctx->f99TextStart = NULL;
+  ctx->f99TextEnd = NULL;
+  if ((ctx->arena == NULL) || (ctx->buffer == NULL) || (ctx->writeContext == NULL))
+  {
+    fprintf(stderr, "Out of memory creating a parsing context\n");
+    freeFecContext(ctx);
+    return NULL;
+  }
 
   // Compile regexes
   const char *error;
@@ -59,27 +137,199 @@ FEC_CONTEXT *newFecContext(PERSISTENT_MEMORY_CONTEXT *persistentMemory, BufferRe
 
 void freeFecContext(FEC_CONTEXT *ctx)
 {
+  if (ctx->rowOutput != NULL)
+  {
+    // A row was left captured
+    ctx->writeContext = ctx->rowOutput;
+  }
+  if (ctx->capturedRow != NULL)
+  {
+    freeString(ctx->capturedRow);
+  }
+  if (ctx->pipeline != NULL)
+  {
+    stopLinePipeline(ctx->pipeline);
+  }
   freeBuffer(ctx->buffer);
-  if (ctx->version)
+  if (ctx->ownsFile)
   {
-    free(ctx->version);
+    fclose((FILE *)ctx->file);
   }
   if (ctx->f99Text)
   {
-    free(ctx->f99Text);
+    allocatorFree(ctx->allocator, ctx->f99Text);
   }
-  if (ctx->formType != NULL)
+  if (ctx->f99TextStart != NULL)
   {
-    free(ctx->formType);
+    pcre_free(ctx->f99TextStart);
+    pcre_free(ctx->f99TextEnd);
   }
-  if (ctx->types != NULL)
+  if (ctx->ownsWriteContext)
   {
-    free(ctx->types);
+    freeWriteContext(ctx->writeContext);
   }
-  pcre_free(ctx->f99TextStart);
-  pcre_free(ctx->f99TextEnd);
-  freeWriteContext(ctx->writeContext);
-  free(ctx);
+  if (ctx->inputHash != NULL)
+  {
+    allocatorFree(ctx->allocator, ctx->inputHash);
+  }
+  freeArena(ctx->arena);
+  allocatorFree(ctx->allocator, ctx);
+}
+
+int setFecInputPath(FEC_CONTEXT *ctx, const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    return 0;
+  }
+  if (ctx->ownsFile)
+  {
+    fclose((FILE *)ctx->file);
+  }
+  ctx->file = file;
+  ctx->ownsFile = 1;
+
+  // Prefer mapping the file into memory, falling back to reading it
+  if (!mapBufferFile(ctx->buffer, file))
+  {
+    ctx->buffer->bufferRead = (BufferRead)(&readBuffer);
+  }
+  return 1;
+}
+
+void setFecInputMemory(FEC_CONTEXT *ctx, char *memory, size_t length)
+{
+  setBufferMemory(ctx->buffer, memory, length);
+}
+
+int setFecReadAhead(FEC_CONTEXT *ctx, int slots, int slotSize)
+{
+  return startReadAhead(ctx->buffer, slots, slotSize, ctx->file);
+}
+
+int setFecHashing(FEC_CONTEXT *ctx)
+{
+  if (ctx->inputHash == NULL)
+  {
+    ctx->inputHash = (HASH_STATE *)allocatorMalloc(ctx->allocator, sizeof(HASH_STATE));
+    if (ctx->inputHash == NULL)
+    {
+      return 0;
+    }
+    initHash(ctx->inputHash, 0);
+    ctx->buffer->hash = ctx->inputHash;
+  }
+  return 1;
+}
+
+int fecInputHash(FEC_CONTEXT *ctx, uint64_t *hash)
+{
+  if (ctx->buffer->memory != NULL)
+  {
+    *hash = hashBytes(ctx->buffer->memory, ctx->buffer->memoryLength, 0);
+    return 1;
+  }
+  if ((ctx->inputHash != NULL) && ctx->inputHash->ended)
+  {
+    *hash = digestHash(ctx->inputHash);
+    return 1;
+  }
+  return 0;
+}
+
+void setFecPipeline(FEC_CONTEXT *ctx, int pipeline)
+{
+  ctx->usePipeline = pipeline;
+}
+
+void setFecWriteContext(FEC_CONTEXT *ctx, WRITE_CONTEXT *writeContext)
+{
+  if (ctx->ownsWriteContext)
+  {
+    freeWriteContext(ctx->writeContext);
+  }
+  ctx->writeContext = writeContext;
+  ctx->ownsWriteContext = 0;
+  // Form type ids are this parse's own
+  forgetFileIds(writeContext);
+}
+
+// Allocate the buffer rows are captured in (see endRow). Returns 0 if
+// memory ran out.
+int allocateCapturedRow(FEC_CONTEXT *ctx)
+{
+  if (ctx->capturedRow == NULL)
+  {
+    ctx->capturedRow = newAllocatedString(ctx->allocator, DEFAULT_STRING_SIZE);
+  }
+  return ctx->capturedRow != NULL;
+}
+
+int setFecUnified(FEC_CONTEXT *ctx, int unified)
+{
+  if (unified && !allocateCapturedRow(ctx))
+  {
+    return 0;
+  }
+  ctx->unified = unified;
+  return 1;
+}
+
+int setFecFormat(FEC_CONTEXT *ctx, int format)
+{
+  if ((format != FORMAT_CSV) && (format != FORMAT_PGCOPY) && (format != FORMAT_NDJSON) && (format != FORMAT_SQLITE))
+  {
+    return 0;
+  }
+  if ((format == FORMAT_SQLITE) && (!sqliteSupported() || !ctx->writeContext->writeToFile))
+  {
+    return 0;
+  }
+  if ((format != FORMAT_CSV) && (ctx->writeContext->useCustomLine || !allocateCapturedRow(ctx)))
+  {
+    return 0;
+  }
+  ctx->format = format;
+  ctx->extension = csvExtension;
+  if (format == FORMAT_PGCOPY)
+  {
+    ctx->extension = pgcopyExtension;
+    setBinaryFiles(ctx->writeContext, pgcopyExtension, PGCOPY_TRAILER, PGCOPY_TRAILER_LENGTH);
+  }
+  else if (format == FORMAT_NDJSON)
+  {
+    ctx->extension = ndjsonExtension;
+  }
+  else if (format == FORMAT_SQLITE)
+  {
+    ctx->extension = sqliteExtension;
+  }
+  return 1;
+}
+
+int setFecColumns(FEC_CONTEXT *ctx, COLUMN_TABLES *tables)
+{
+  if (ctx->writeContext->useCustomLine || !allocateCapturedRow(ctx))
+  {
+    return 0;
+  }
+  ctx->format = FORMAT_COLUMNS;
+  ctx->extension = csvExtension;
+  ctx->columns = tables;
+  return 1;
+}
+
+void setFecFilter(FEC_CONTEXT *ctx, FILTER *filter)
+{
+  ctx->filter = filter;
+  // Column selections are computed with the mappings, so forget them
+  forgetFormMappings(ctx);
+}
+
+void setFecSummary(FEC_CONTEXT *ctx, int summary)
+{
+  ctx->summary = summary;
 }
 
 int isParseDone(PARSE_CONTEXT *parseContext)
@@ -89,24 +339,190 @@ int isParseDone(PARSE_CONTEXT *parseContext)
   return (c == 0) || (c == '\n');
 }
 
-int lookupMappings(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext, int formStart, int formEnd)
+// Compute which columns of the form type are written from the filter's
+// column selection, if it has one for the form type
+void selectColumns(FEC_CONTEXT *ctx, FORM_MAPPING *mapping)
 {
-  if ((ctx->formType != NULL) && (strncmp(ctx->formType, parseContext->line->str + formStart, formEnd - formStart) == 0))
+  mapping->columnMask = NULL;
+  mapping->selectedHeaders = NULL;
+  mapping->selectedTypes = NULL;
+  if (ctx->filter == NULL)
+  {
+    return;
+  }
+  COLUMN_SELECTION *selection = filterColumnSelection(ctx->filter, mapping->formType, mapping->formTypeLength);
+  if (selection == NULL)
+  {
+    return;
+  }
+
+  char *columnMask = arenaAlloc(ctx->arena, mapping->numFields);
+  mapping->selectedHeaders = arenaAlloc(ctx->arena, strlen(mapping->headers) + 1);
+  mapping->selectedTypes = arenaAlloc(ctx->arena, mapping->numFields + 1);
+  if ((columnMask == NULL) || (mapping->selectedHeaders == NULL) || (mapping->selectedTypes == NULL))
+  {
+    // Out of memory; the parse stops after this line
+    ctx->outOfMemory = 1;
+    return;
+  }
+  mapping->columnMask = columnMask;
+  int headersLength = 0;
+  int numSelected = 0;
+
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, mapping->headers, mapping->types);
+  while ((column.index + 1 < mapping->numFields) && nextHeaderColumn(&column))
+  {
+    mapping->columnMask[column.index] = columnSelected(selection, column.name, column.length);
+    if (mapping->columnMask[column.index])
+    {
+      if (numSelected > 0)
+      {
+        mapping->selectedHeaders[headersLength++] = ',';
+      }
+      memcpy(mapping->selectedHeaders + headersLength, column.name, column.length);
+      headersLength += column.length;
+      mapping->selectedTypes[numSelected++] = column.type;
+    }
+  }
+  mapping->selectedHeaders[headersLength] = 0;
+  mapping->selectedTypes[numSelected] = 0;
+}
+
+// Return whether the column at the specified index is written
+// for the current form type
+int isColumnWritten(FEC_CONTEXT *ctx, int columnIndex)
+{
+  if (ctx->columnMask == NULL)
   {
-    // Type mappings are unchanged from before; can return early
     return 1;
   }
+  return columnIndex < ctx->numFields && ctx->columnMask[columnIndex];
+}
 
-  // Clear last form type information if present
-  if (ctx->formType != NULL)
+// Return the types of the columns written for the current form type
+char *writtenTypes(FEC_CONTEXT *ctx)
+{
+  if ((ctx->mapping != NULL) && (ctx->mapping->unifiedSources != NULL))
   {
-    free(ctx->formType);
+    return ctx->mapping->unifiedTypes;
   }
-  // Set last form type to store it for later
-  ctx->formType = malloc(formEnd - formStart + 1);
-  strncpy(ctx->formType, parseContext->line->str + formStart, formEnd - formStart);
-  ctx->formType[formEnd - formStart] = 0;
+  return ctx->columnMask != NULL ? ctx->selectedTypes : ctx->types;
+}
 
+// The type of a column of a form type in the filing's version: the code
+// of the first type mapping that matches, or s (string) if none do
+char columnType(FEC_CONTEXT *ctx, const char *formType, int length, const char *name, int nameLength)
+{
+  for (int j = 0; j < numTypes; j++)
+  {
+    // Try to match the type regex to version
+    if (pcre_exec(ctx->persistentMemory->typeVersions[j], NULL, ctx->version, ctx->versionLength, 0, 0, NULL, 0) >= 0)
+    {
+      // Try to match type regex to form type
+      if (pcre_exec(ctx->persistentMemory->typeFormTypes[j], NULL, formType, length, 0, 0, NULL, 0) >= 0)
+      {
+        // Try to match type regex to header
+        if (pcre_exec(ctx->persistentMemory->typeHeaders[j], NULL, name, nameLength, 0, 0, NULL, 0) >= 0)
+        {
+          return types[j][3][0];
+        }
+      }
+    }
+  }
+  return 's';
+}
+
+// Split a header row into its names. Returns the number of names.
+int splitHeaderNames(const char *headerRow, const char **names, int *lengths)
+{
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, headerRow, NULL);
+  while (nextHeaderColumn(&column))
+  {
+    names[column.index] = column.name;
+    lengths[column.index] = column.length;
+  }
+  return column.index + 1;
+}
+
+// Count the columns of a header row
+int countHeaderNames(const char *headerRow)
+{
+  int count = 1;
+  for (; *headerRow != 0; headerRow++)
+  {
+    count += *headerRow == ',';
+  }
+  return count;
+}
+
+// Compute the unified schema of a form type, given the regex its mapping
+// matched the form type with (see setFecUnified)
+void unifyColumns(FEC_CONTEXT *ctx, FORM_MAPPING *mapping, const char *formTypeRegex)
+{
+  const char *unified = NULL;
+  for (int i = 0; i < numUnifiedHeaders; i++)
+  {
+    if (strcmp(unifiedHeaders[i][0], formTypeRegex) == 0)
+    {
+      unified = unifiedHeaders[i][1];
+      break;
+    }
+  }
+  if (unified == NULL)
+  {
+    return;
+  }
+
+  int numUnified = countHeaderNames(unified);
+  const char **names = (const char **)arenaAlloc(ctx->arena, sizeof(char *) * (numUnified + mapping->numFields));
+  int *lengths = (int *)arenaAlloc(ctx->arena, sizeof(int) * (numUnified + mapping->numFields));
+  int *sources = (int *)arenaAlloc(ctx->arena, sizeof(int) * numUnified);
+  char *unifiedTypes = arenaAlloc(ctx->arena, numUnified + 1);
+  if ((names == NULL) || (lengths == NULL) || (sources == NULL) || (unifiedTypes == NULL))
+  {
+    // Out of memory; the parse stops after this line
+    ctx->outOfMemory = 1;
+    return;
+  }
+  splitHeaderNames(unified, names, lengths);
+  const char **lineNames = names + numUnified;
+  int *lineLengths = lengths + numUnified;
+  int numLineNames = splitHeaderNames(mapping->headers, lineNames, lineLengths);
+
+  // The nth column with a name in the unified schema is the nth column
+  // with the name in the line
+  for (int u = 0; u < numUnified; u++)
+  {
+    int occurrence = 0;
+    for (int v = 0; v < u; v++)
+    {
+      occurrence += (lengths[v] == lengths[u]) && (memcmp(names[v], names[u], lengths[u]) == 0);
+    }
+    sources[u] = -1;
+    for (int i = 0; i < numLineNames; i++)
+    {
+      if ((lineLengths[i] == lengths[u]) && (memcmp(lineNames[i], names[u], lengths[u]) == 0) && (occurrence-- == 0))
+      {
+        sources[u] = i;
+        break;
+      }
+    }
+    unifiedTypes[u] = sources[u] >= 0 ? mapping->types[sources[u]] : columnType(ctx, mapping->formType, mapping->formTypeLength, names[u], lengths[u]);
+  }
+  unifiedTypes[numUnified] = 0;
+
+  mapping->unifiedHeaders = (char *)unified;
+  mapping->unifiedTypes = unifiedTypes;
+  mapping->unifiedSources = sources;
+  mapping->numUnifiedFields = numUnified;
+}
+
+// Compute the mappings of a form type (the first time it's seen).
+// Return NULL if the version and form type have no mappings.
+FORM_MAPPING *newFormMapping(FEC_CONTEXT *ctx, const char *formType, int length)
+{
   // Grab the field mapping given the form version
   for (int i = 0; i < numHeaders; i++)
   {
@@ -114,21 +530,30 @@ int lookupMappings(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext, int formStart,
     if (pcre_exec(ctx->persistentMemory->headerVersions[i], NULL, ctx->version, ctx->versionLength, 0, 0, NULL, 0) >= 0)
     {
       // Match! Test regex against form type
-      if (pcre_exec(ctx->persistentMemory->headerFormTypes[i], NULL, parseContext->line->str + formStart, formEnd - formStart, 0, 0, NULL, 0) >= 0)
+      if (pcre_exec(ctx->persistentMemory->headerFormTypes[i], NULL, formType, length, 0, 0, NULL, 0) >= 0)
       {
         // Matched form type
-        ctx->headers = (char *)(headers[i][2]);
-        STRING *headersCsv = fromString(ctx->headers);
-        if (ctx->types != NULL)
+        FORM_MAPPING *mapping = (FORM_MAPPING *)arenaAlloc(ctx->arena, sizeof(FORM_MAPPING));
+        size_t headersLength = strlen(headers[i][2]);
+        char *columnTypes = arenaAlloc(ctx->arena, headersLength + 1); // at least as big as it needs to be
+        char *formTypeCopy = arenaStrndup(ctx->arena, formType, length);
+        // Header names are never quoted, so the header row can be read
+        // in place from a copy
+        STRING headersCsv = {arenaStrndup(ctx->arena, headers[i][2], headersLength), headersLength + 1, NULL};
+        if ((mapping == NULL) || (columnTypes == NULL) || (formTypeCopy == NULL) || (headersCsv.str == NULL))
         {
-          free(ctx->types);
+          ctx->outOfMemory = 1;
+          return NULL;
         }
-        ctx->numFields = 0;
-        ctx->types = malloc(strlen(ctx->headers) + 1); // at least as big as it needs to be
+        mapping->id = ctx->nextFormTypeId++;
+        mapping->formType = formTypeCopy;
+        mapping->formTypeLength = length;
+        mapping->headers = (char *)(headers[i][2]);
+        mapping->types = columnTypes;
 
         // Initialize a parse context for reading each header field
         PARSE_CONTEXT headerFields;
-        headerFields.line = headersCsv;
+        headerFields.line = &headersCsv;
         headerFields.fieldInfo = NULL;
         headerFields.position = 0;
         headerFields.start = 0;
@@ -141,32 +566,7 @@ int lookupMappings(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext, int formStart,
           readCsvField(&headerFields);
 
           // Match type info
-          int matched = 0;
-          for (int j = 0; j < numTypes; j++)
-          {
-            // Try to match the type regex to version
-            if (pcre_exec(ctx->persistentMemory->typeVersions[j], NULL, ctx->version, ctx->versionLength, 0, 0, NULL, 0) >= 0)
-            {
-              // Try to match type regex to form type
-              if (pcre_exec(ctx->persistentMemory->typeFormTypes[j], NULL, parseContext->line->str + formStart, formEnd - formStart, 0, 0, NULL, 0) >= 0)
-              {
-                // Try to match type regex to header
-                if (pcre_exec(ctx->persistentMemory->typeHeaders[j], NULL, headerFields.line->str + headerFields.start, headerFields.end - headerFields.start, 0, 0, NULL, 0) >= 0)
-                {
-                  // Match! Print out type information
-                  ctx->types[headerFields.columnIndex] = types[j][3][0];
-                  matched = 1;
-                  break;
-                }
-              }
-            }
-          }
-
-          if (!matched)
-          {
-            // Unmatched type — default to 's' for string type
-            ctx->types[headerFields.columnIndex] = 's';
-          }
+          mapping->types[headerFields.columnIndex] = columnType(ctx, formType, length, headerFields.line->str + headerFields.start, headerFields.end - headerFields.start);
 
           if (isParseDone(&headerFields))
           {
@@ -176,25 +576,155 @@ int lookupMappings(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext, int formStart,
         }
 
         // Add null terminator
-        ctx->types[headerFields.columnIndex + 1] = 0;
-        ctx->numFields = headerFields.columnIndex + 1;
+        mapping->types[headerFields.columnIndex + 1] = 0;
+        mapping->numFields = headerFields.columnIndex + 1;
+
+        selectColumns(ctx, mapping);
+        mapping->unifiedHeaders = NULL;
+        mapping->unifiedTypes = NULL;
+        mapping->unifiedSources = NULL;
+        mapping->numUnifiedFields = 0;
+        mapping->jsonKeys = NULL;
+        mapping->jsonKeyEnds = NULL;
+        if (ctx->unified && (mapping->columnMask == NULL))
+        {
+          unifyColumns(ctx, mapping, headers[i][1]);
+        }
+
+        // Remember the mapping for the rest of the filing
+        int bucket = formMappingBucket(formType, length);
+        mapping->next = ctx->mappings[bucket];
+        ctx->mappings[bucket] = mapping;
+        return mapping;
+      }
+    }
+  }
 
-        // Free up unnecessary line memory
-        freeString(headersCsv);
+  return NULL;
+}
+
+// Return the mappings already computed for a form type, or NULL
+FORM_MAPPING *findFormMapping(FEC_CONTEXT *ctx, const char *formType, int length)
+{
+  for (FORM_MAPPING *mapping = ctx->mappings[formMappingBucket(formType, length)]; mapping != NULL; mapping = mapping->next)
+  {
+    if ((mapping->formTypeLength == length) && (memcmp(mapping->formType, formType, length) == 0))
+    {
+      return mapping;
+    }
+  }
+  return NULL;
+}
+
+int lookupMappings(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext, int formStart, int formEnd)
+{
+  const char *formType = parseContext->line->str + formStart;
+  int length = formEnd - formStart;
+  if ((ctx->mapping != NULL) && (ctx->mapping->formTypeLength == length) && (memcmp(ctx->formType, formType, length) == 0))
+  {
+    // Type mappings are unchanged from before; can return early
+    return 1;
+  }
 
-        // Done; return
-        return 1;
+  // Reuse the mappings if the form type has been seen before (so rows
+  // don't allocate once every form type in the filing is known)
+  FORM_MAPPING *mapping = findFormMapping(ctx, formType, length);
+  if (mapping == NULL)
+  {
+    mapping = newFormMapping(ctx, formType, length);
+    if (mapping == NULL)
+    {
+      if (ctx->outOfMemory)
+      {
+        return 0;
       }
+      // Unmatched — error
+      fprintf(stderr, "Error: Unmatched for version %s and form type %.*s\n", ctx->version, length, formType);
+      return 0;
     }
   }
 
-  // Unmatched — error
-  fprintf(stderr, "Error: Unmatched for version %s and form type %s\n", ctx->version, ctx->formType);
-  return 0;
+  ctx->mapping = mapping;
+  ctx->formType = mapping->formType;
+  ctx->headers = mapping->headers;
+  ctx->types = mapping->types;
+  ctx->numFields = mapping->numFields;
+  ctx->columnMask = mapping->columnMask;
+  ctx->selectedHeaders = mapping->selectedHeaders;
+  ctx->selectedTypes = mapping->selectedTypes;
+  return 1;
+}
+
+// Whether the row being written is captured field by field: as the
+// values of its columns, with no delimeters or escaping (see beginRow)
+static inline int capturingFields(FEC_CONTEXT *ctx)
+{
+  return (ctx->rowOutput != NULL) && (ctx->format != FORMAT_CSV);
+}
+
+// Make room for the bounds of the columns of a captured row. Returns 0
+// (stopping the parse after this line) if memory ran out.
+int growColumnBounds(FEC_CONTEXT *ctx, int columns)
+{
+  if (columns <= ctx->columnBoundsCapacity)
+  {
+    return 1;
+  }
+  int capacity = ctx->columnBoundsCapacity * 2 > columns ? ctx->columnBoundsCapacity * 2 : columns;
+  int *bounds = (int *)arenaAlloc(ctx->arena, sizeof(int) * 2 * capacity);
+  if (bounds == NULL)
+  {
+    ctx->outOfMemory = 1;
+    return 0;
+  }
+  if (ctx->capturedColumns > 0)
+  {
+    memcpy(bounds, ctx->columnBounds, sizeof(int) * 2 * ctx->capturedColumns);
+  }
+  ctx->columnBounds = bounds;
+  ctx->columnBoundsCapacity = capacity;
+  return 1;
+}
+
+// Mark where the next column of a row captured field by field starts
+// (ending the column before it)
+void markCapturedColumn(FEC_CONTEXT *ctx)
+{
+  if (!growColumnBounds(ctx, ctx->capturedColumns + 1))
+  {
+    return;
+  }
+  int position = ctx->rowWriteContext.localBufferPosition;
+  if (ctx->capturedColumns > 0)
+  {
+    ctx->columnBounds[ctx->capturedColumns * 2 - 1] = position;
+  }
+  ctx->columnBounds[ctx->capturedColumns * 2] = position;
+  ctx->capturedColumns++;
+}
+
+// Start writing a column of a row: after a delimeter if delimit is set,
+// or for rows captured field by field, by marking where it starts
+void startColumn(FEC_CONTEXT *ctx, char *filename, int delimit)
+{
+  if (capturingFields(ctx))
+  {
+    markCapturedColumn(ctx);
+  }
+  else if (delimit)
+  {
+    writeDelimeter(ctx->writeContext, filename, csvExtension);
+  }
 }
 
 void writeSubstrToWriter(FEC_CONTEXT *ctx, WRITE_CONTEXT *writeContext, char *filename, const char *extension, int start, int end, FIELD_INFO *field)
 {
+  if (capturingFields(ctx))
+  {
+    // (the value as is)
+    writeN(writeContext, filename, extension, ctx->persistentMemory->line->str + start, end - start);
+    return;
+  }
   writeField(writeContext, filename, extension, ctx->persistentMemory->line, start, end, field);
 }
 
@@ -205,20 +735,7 @@ void writeSubstr(FEC_CONTEXT *ctx, char *filename, const char *extension, int st
 
 void writeQuotedCsvField(FEC_CONTEXT *ctx, char *filename, const char *extension, char *line, int length)
 {
-  for (int i = 0; i < length; i++)
-  {
-    char c = line[i];
-    if (c == '"')
-    {
-      // Write two quotes since the field is quoted
-      writeChar(ctx->writeContext, filename, extension, '"');
-      writeChar(ctx->writeContext, filename, extension, '"');
-    }
-    else
-    {
-      writeChar(ctx->writeContext, filename, extension, c);
-    }
-  }
+  writeDoubledQuotes(ctx->writeContext, filename, extension, line, length);
 }
 
 // Write a date field by separating the output with dashes
@@ -247,6 +764,59 @@ void writeDateField(FEC_CONTEXT *ctx, char *filename, const char *extension, int
   writeSubstrToWriter(ctx, ctx->writeContext, filename, extension, start + 6, start + 8, field);
 }
 
+// Return whether a number is written as a plain decimal (as JSON
+// writes numbers, without an exponent), which every output format reads
+// exactly as written
+int isPlainDecimal(const char *str, int length)
+{
+  int i = (length > 0) && (str[0] == '-');
+  int digitsStart = i;
+  while ((i < length) && (str[i] >= '0') && (str[i] <= '9'))
+  {
+    i++;
+  }
+  if ((i == digitsStart) || ((str[digitsStart] == '0') && (i - digitsStart > 1)))
+  {
+    return 0;
+  }
+  if ((i < length) && (str[i] == '.'))
+  {
+    int fractionStart = ++i;
+    while ((i < length) && (str[i] >= '0') && (str[i] <= '9'))
+    {
+      i++;
+    }
+    if (i == fractionStart)
+    {
+      return 0;
+    }
+  }
+  return i == length;
+}
+
+// Write the value of a float field of a row captured field by field at
+// its full precision: as written if it's a plain decimal, otherwise in
+// the fewest digits that read back as the value
+void writeCapturedFloat(FEC_CONTEXT *ctx, char *filename, const char *extension, int start, int end, double value)
+{
+  char *str = ctx->persistentMemory->line->str + start;
+  if (isPlainDecimal(str, end - start))
+  {
+    writeN(ctx->writeContext, filename, extension, str, end - start);
+    return;
+  }
+  char number[32];
+  for (int precision = 15; precision <= 17; precision++)
+  {
+    snprintf(number, sizeof(number), "%.*g", precision, value);
+    if (strtod(number, NULL) == value)
+    {
+      break;
+    }
+  }
+  writeString(ctx->writeContext, filename, extension, number);
+}
+
 void writeFloatField(FEC_CONTEXT *ctx, char *filename, const char *extension, int start, int end, FIELD_INFO *field)
 {
   char *doubleStr;
@@ -265,30 +835,104 @@ void writeFloatField(FEC_CONTEXT *ctx, char *filename, const char *extension, in
   }
 
   // Write the value
+  if (capturingFields(ctx))
+  {
+    writeCapturedFloat(ctx, filename, extension, start, end, value);
+    return;
+  }
   writeDouble(ctx->writeContext, filename, extension, value);
 }
 
-// Grab a line from the input file.
+// Read a line from the input file into
+// ctx->persistentMemory->rawLine without decoding it.
 // Return 0 if there are no lines left.
-// If there is a line, decode it into
-// ctx->persistentMemory->line.
-int grabLine(FEC_CONTEXT *ctx)
+int grabRawLine(FEC_CONTEXT *ctx)
 {
   int bytesRead = readLine(ctx->buffer, ctx->persistentMemory->rawLine, ctx->file);
-  if (bytesRead <= 0)
+  if (bytesRead < 0)
   {
-    return 0;
+    // The line couldn't be held in memory; stop as if at the end
+    ctx->outOfMemory = 1;
   }
+  return bytesRead > 0;
+}
+
+// Return whether an allocation has failed since the parse started
+int allocationFailed(FEC_CONTEXT *ctx)
+{
+  return ctx->outOfMemory || ((ctx->allocator != NULL) && (ctx->allocator->stats.failures > ctx->allocationFailures));
+}
 
-  // Decode the line
+// Return whether the parse has to stop: memory ran out or the output
+// couldn't be written
+int parseStopped(FEC_CONTEXT *ctx)
+{
+  return allocationFailed(ctx) || ctx->outputFailed;
+}
+
+// Decode the raw line into ctx->persistentMemory->line
+void decodeRawLine(FEC_CONTEXT *ctx)
+{
   LINE_INFO info;
   ctx->currentLineLength = decodeLine(&info, ctx->persistentMemory->rawLine, ctx->persistentMemory->line);
   // Store whether the current line has ascii separators
   // (determines whether we use CSV or ascii28 split line parsing)
   ctx->currentLineHasAscii28 = info.ascii28;
+  ctx->currentLineHasQuotesOrCommas = info.quotesOrCommas;
+}
+
+// Grab a line from the input file.
+// Return 0 if there are no lines left.
+// If there is a line, decode it into
+// ctx->persistentMemory->line.
+int grabLine(FEC_CONTEXT *ctx)
+{
+  if (ctx->pipeline != NULL)
+  {
+    // The line was already read and decoded on the pipeline's thread
+    LINE_INFO info;
+    int result = nextPipelineLine(ctx->pipeline, ctx->persistentMemory->line, &info);
+    if (result < 0)
+    {
+      ctx->outOfMemory = 1;
+      return 0;
+    }
+    ctx->currentLineLength = info.length;
+    ctx->currentLineHasAscii28 = info.ascii28;
+    ctx->currentLineHasQuotesOrCommas = info.quotesOrCommas;
+    return result;
+  }
+  if (!grabRawLine(ctx))
+  {
+    return 0;
+  }
+  decodeRawLine(ctx);
   return 1;
 }
 
+// Locate the form type (the first field) of a line without decoding or
+// unescaping it. Return the length of the form type and set start to
+// its position.
+int rawFormType(STRING *line, int *start)
+{
+  const char *str = line->str;
+  int i = 0;
+  while ((str[i] == ' ') || (str[i] == '\t') || (str[i] == '"'))
+  {
+    i++;
+  }
+  *start = i;
+  while ((str[i] != 0) && (str[i] != 28) && (str[i] != ',') && (str[i] != '"') && (str[i] != '\n') && (str[i] != '\r'))
+  {
+    i++;
+  }
+  while ((i > *start) && ((str[i - 1] == ' ') || (str[i - 1] == '\t')))
+  {
+    i--;
+  }
+  return i - *start;
+}
+
 char lowercaseTable[256] = {
     0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
     16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
@@ -431,243 +1075,672 @@ void startHeaderRow(FEC_CONTEXT *ctx, char *filename, const char *extension)
   // Write the filing ID header, if includeFilingId is specified
   if (ctx->includeFilingId)
   {
-    writeString(ctx->writeContext, filename, extension, "filing_id");
-    writeDelimeter(ctx->writeContext, filename, extension);
+    writeString(ctx->writeContext, filename, extension, "filing_id");
+    writeDelimeter(ctx->writeContext, filename, extension);
+  }
+}
+
+void startDataRow(FEC_CONTEXT *ctx, char *filename, const char *extension)
+{
+  // Write the filing ID value, if includeFilingId is specified
+  if (ctx->includeFilingId)
+  {
+    writeString(ctx->writeContext, filename, extension, ctx->filingId);
+    writeDelimeter(ctx->writeContext, filename, extension);
+  }
+}
+
+// Parse F99 text from a filing, writing the text to the specified
+// file in escaped CSV form (or as is, if the row is captured field by
+// field) if successful (and write is set, otherwise the text is
+// skipped). If delimit is set, the text is preceded by a delimeter.
+// Returns 1 if successful, 0 otherwise.
+int parseF99Text(FEC_CONTEXT *ctx, char *filename, int write, int delimit)
+{
+  int f99Mode = 0;
+  int first = 1;
+  int fields = capturingFields(ctx);
+
+  while (1)
+  {
+    // Load the current line
+    if (grabLine(ctx) == 0)
+    {
+      // End of file
+      return 1;
+    }
+
+    if (f99Mode)
+    {
+      // See if we have reached the end boundary
+      if (pcre_exec(ctx->f99TextEnd, NULL, ctx->persistentMemory->line->str, ctx->currentLineLength, 0, 0, NULL, 0) >= 0)
+      {
+        f99Mode = 0;
+        break;
+      }
+
+      // Otherwise, write f99 information as a CSV field
+      if (!write)
+      {
+        continue;
+      }
+      if (first)
+      {
+        // Write the delimeter at the beginning and a quote character
+        // (the csv field will always be escaped so we can stream write
+        // without having to calculate whether it's escaped later).
+        startColumn(ctx, filename, delimit);
+        if (!fields)
+        {
+          writeChar(ctx->writeContext, filename, csvExtension, '"');
+        }
+        first = 0;
+      }
+
+      if (fields)
+      {
+        writeN(ctx->writeContext, filename, csvExtension, ctx->persistentMemory->line->str, ctx->currentLineLength);
+        continue;
+      }
+      writeQuotedCsvField(ctx, filename, csvExtension, ctx->persistentMemory->line->str, ctx->currentLineLength);
+      continue;
+    }
+
+    // See if line begins with f99 text boundary by first seeing if it starts with "["
+    if (lineMightStartWithF99(ctx))
+    {
+      // Now, execute the proper regex (we don't want to do this for every line, as it's slow)
+      if (pcre_exec(ctx->f99TextStart, NULL, ctx->persistentMemory->line->str, ctx->currentLineLength, 0, 0, NULL, 0) >= 0)
+      {
+        // Set f99 mode
+        f99Mode = 1;
+        continue;
+      }
+      else
+      {
+        // Invalid f99 text
+        return 0;
+      }
+    }
+    else if (lineContainsNonwhitespace(ctx))
+    {
+      // The line should only contain non-whitespace that starts
+      // f99 text
+      return 0;
+    }
+  }
+  // Successful extraction, end the quote delimiter
+  if (write && !fields)
+  {
+    writeChar(ctx->writeContext, filename, csvExtension, '"');
+  }
+  return 1;
+}
+
+// Skip a line that is filtered out, along with any F99 text that
+// follows it. Return 2 if the next line has already been grabbed,
+// or 1 otherwise (matching parseLine).
+int skipLine(FEC_CONTEXT *ctx, const char *formType, int length)
+{
+  if ((length >= 3) && (strncasecmp(formType, "f99", 3) == 0))
+  {
+    return parseF99Text(ctx, NULL, 0, 0) ? 1 : 2;
+  }
+  return 1;
+}
+
+// Select the file rows with the header row are written to, by the form
+// type's id if the file is named after it (or the one stream of NDJSON
+// rows). Return 1 if the file is newly opened, 0 if not, or -1 if memory
+// ran out.
+int selectOutputFile(FEC_CONTEXT *ctx, char *filename, char *header)
+{
+  if (ctx->format == FORMAT_NDJSON)
+  {
+    return ctx->writeContext->combined ? getCombinedFile(ctx->writeContext, -1, NDJSON_ROWS, ctx->extension, "") : getFile(ctx->writeContext, NDJSON_ROWS, ctx->extension);
+  }
+  int id = filename == ctx->formType ? ctx->mapping->id : -1;
+  if (ctx->writeContext->combined)
+  {
+    return getCombinedFile(ctx->writeContext, id, filename, ctx->extension, header);
+  }
+  return id >= 0 ? getFileById(ctx->writeContext, id, filename, ctx->extension) : getFile(ctx->writeContext, filename, ctx->extension);
+}
+
+// Select the table of the database rows with the header row are
+// inserted into, first opening the database if it isn't yet. Stops the
+// parse if either fails.
+void selectRowTable(FEC_CONTEXT *ctx, char *filename, char *header, char *types)
+{
+  WRITE_CONTEXT *output = ctx->writeContext;
+  if (output->database == NULL)
+  {
+    char *path = outputPath(output, SQLITE_DATABASE, ctx->extension, 1, 1);
+    output->database = path != NULL ? openSqliteOutput(path, output->allocator) : NULL;
+  }
+  if ((output->database == NULL) || !selectSqliteTable(output->database, filename, header, types, ctx->includeFilingId))
+  {
+    ctx->outputFailed = 1;
+  }
+}
+
+// Select the file a row is written to, first starting it if it is newly
+// opened: in CSV with the header row, or for binary COPY with its
+// signature (declaring its table in the schema, unless it's a further
+// part of a combined file). NDJSON rows need no start, and SQLite rows
+// and those accumulated in columns select a table instead. The header
+// row has columns of the types (NULL if they're all strings).
+void selectRowFile(FEC_CONTEXT *ctx, char *filename, char *header, char *types)
+{
+  if (ctx->format == FORMAT_COLUMNS)
+  {
+    if (!selectColumnTable(ctx->columns, filename, header, types, ctx->includeFilingId))
+    {
+      ctx->outOfMemory = 1;
+    }
+    return;
+  }
+  if (ctx->format == FORMAT_SQLITE)
+  {
+    selectRowTable(ctx, filename, header, types);
+    return;
+  }
+  if ((selectOutputFile(ctx, filename, header) != 1) || (ctx->format == FORMAT_NDJSON))
+  {
+    return;
+  }
+  if (ctx->format == FORMAT_PGCOPY)
+  {
+    WRITE_CONTEXT *output = ctx->writeContext;
+    if (!output->combined || (output->parts[output->lastIndex] == 1))
+    {
+      writePgCopyTable(output, PGCOPY_SCHEMA, sqlExtension, filename, output->combined ? output->variants[output->lastIndex] : 1, header, types, ctx->includeFilingId);
+      // Writing the schema selected its file
+      selectOutputFile(ctx, filename, header);
+    }
+    writePgCopyHeader(output, filename, ctx->extension);
+    return;
+  }
+  startHeaderRow(ctx, filename, csvExtension);
+  writeString(ctx->writeContext, filename, csvExtension, header);
+  writeNewline(ctx->writeContext, filename, csvExtension);
+  endLine(ctx->writeContext, types);
+}
+
+// Start writing the data of a row to the selected file, which has the
+// columns of the header row (of the types, NULL if they're all strings).
+// Rows that are reordered (taking the columns of the line given by
+// sources, -1 for none) or not written as CSV are captured to be written
+// out as the row ends (see endRow): those not written as CSV field by
+// field, so they're encoded straight from the values parsed.
+void beginRow(FEC_CONTEXT *ctx, char *filename, char *header, char *types, int *sources)
+{
+  if (ctx->format == FORMAT_CSV)
+  {
+    startDataRow(ctx, filename, csvExtension);
+    if (sources == NULL)
+    {
+      return;
+    }
+  }
+  ctx->rowHeader = header;
+  ctx->rowTypes = types;
+  ctx->rowSources = sources;
+  ctx->rowColumns = types != NULL ? (int)strlen(types) : countHeaderNames(header);
+  ctx->capturedColumns = 0;
+  initializeLocalWriteContext(&ctx->rowWriteContext, ctx->capturedRow);
+  ctx->rowOutput = ctx->writeContext;
+  ctx->writeContext = &ctx->rowWriteContext;
+}
+
+// Write the start of a row (and the header row, if this is the first
+// row written to the file): the filing id, if included, and the form
+// type, if it is written. Return whether anything after the filing id
+// was written (to know whether a delimeter is needed).
+int startRow(FEC_CONTEXT *ctx, char *filename)
+{
+  FORM_MAPPING *mapping = ctx->mapping;
+  int unified = (mapping != NULL) && (mapping->unifiedSources != NULL);
+  if (ctx->rowOutput != NULL)
+  {
+    // Drop a row that was started but never ended
+    ctx->writeContext = ctx->rowOutput;
+    ctx->rowOutput = NULL;
+  }
+  char *header = unified ? mapping->unifiedHeaders : ctx->columnMask != NULL ? ctx->selectedHeaders : ctx->headers;
+  selectRowFile(ctx, filename, header, writtenTypes(ctx));
+
+  // Write form type
+  beginRow(ctx, filename, header, writtenTypes(ctx), unified ? mapping->unifiedSources : NULL);
+  if (isColumnWritten(ctx, 0))
+  {
+    startColumn(ctx, filename, 0);
+    writeString(ctx->writeContext, filename, csvExtension, ctx->formType);
+    return 1;
+  }
+  return 0;
+}
+
+// Find where each column of a row captured as CSV starts and ends, up
+// to maxColumns of them. Returns the number of columns.
+int splitCapturedRow(FEC_CONTEXT *ctx, int maxColumns)
+{
+  if (!growColumnBounds(ctx, maxColumns))
+  {
+    return 0;
+  }
+  int *bounds = ctx->columnBounds;
+  char *row = ctx->capturedRow->str;
+  int length = ctx->rowWriteContext.localBufferPosition;
+  int numColumns = 0;
+
+  // Delimeters within quotes are part of the column (doubled quotes
+  // toggle twice)
+  int start = 0;
+  int quoted = 0;
+  for (int i = 0; (i <= length) && (numColumns < maxColumns); i++)
+  {
+    if ((i == length) || ((row[i] == ',') && !quoted))
+    {
+      bounds[numColumns * 2] = start;
+      bounds[numColumns * 2 + 1] = i;
+      numColumns++;
+      start = i + 1;
+    }
+    else if (row[i] == '"')
+    {
+      quoted = !quoted;
+    }
+  }
+  return numColumns;
+}
+
+// Capture the fields of a line of CSV (of the length) into a row
+// captured field by field (e.g. header values buffered as they're read)
+void captureCsvFields(FEC_CONTEXT *ctx, char *filename, STRING *line, int length)
+{
+  FIELD_INFO fieldInfo = {.num_commas = 0, .num_quotes = 0};
+  PARSE_CONTEXT fields = {.line = line, .fieldInfo = &fieldInfo, .position = 0, .start = 0, .end = 0, .columnIndex = 0};
+  while (1)
+  {
+    readCsvField(&fields);
+    markCapturedColumn(ctx);
+    writeN(ctx->writeContext, filename, csvExtension, line->str + fields.start, fields.end - fields.start);
+    if ((fields.position >= length) || (line->str[fields.position] != ','))
+    {
+      break;
+    }
+    advanceField(&fields);
+  }
+}
+
+// End the last column of a row captured field by field. Returns the
+// number of columns.
+int endCapturedColumns(FEC_CONTEXT *ctx)
+{
+  if (ctx->capturedColumns > 0)
+  {
+    ctx->columnBounds[ctx->capturedColumns * 2 - 1] = ctx->rowWriteContext.localBufferPosition;
+  }
+  return ctx->capturedColumns;
+}
+
+// Write the key of a column of the header row in NDJSON objects (with
+// the comma before it and the colon after it)
+void writeJsonKey(WRITE_CONTEXT *context, char *filename, const char *extension, HEADER_COLUMN *column)
+{
+  writeString(context, filename, extension, ",\"");
+  writeJsonEscaped(context, filename, extension, column->name, column->length);
+  writeString(context, filename, extension, column->suffix);
+  writeString(context, filename, extension, "\":");
+}
+
+// Encode the keys of the columns of the row being written once for its
+// form type (see FORM_MAPPING). Returns 0 if memory ran out.
+int encodeJsonKeys(FEC_CONTEXT *ctx, FORM_MAPPING *mapping)
+{
+  STRING *encoded = newAllocatedString(ctx->allocator, DEFAULT_STRING_SIZE);
+  int *keyEnds = (int *)arenaAlloc(ctx->arena, sizeof(int) * (ctx->rowColumns > 0 ? ctx->rowColumns : 1));
+  if ((encoded == NULL) || (keyEnds == NULL))
+  {
+    if (encoded != NULL)
+    {
+      freeString(encoded);
+    }
+    return 0;
+  }
+  WRITE_CONTEXT keys;
+  initializeLocalWriteContext(&keys, encoded);
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, ctx->rowHeader, NULL);
+  for (int i = 0; i < ctx->rowColumns; i++)
+  {
+    if (nextHeaderColumn(&column))
+    {
+      writeJsonKey(&keys, NULL, NULL, &column);
+    }
+    keyEnds[i] = keys.localBufferPosition;
+  }
+  mapping->jsonKeys = arenaStrndup(ctx->arena, encoded->str, keys.localBufferPosition);
+  mapping->jsonKeyEnds = keyEnds;
+  freeString(encoded);
+  return mapping->jsonKeys != NULL;
+}
+
+// Write a captured row, by its columns, as a line of NDJSON
+void writeNdjsonRow(FEC_CONTEXT *ctx, char *filename, int numColumns)
+{
+  WRITE_CONTEXT *output = ctx->writeContext;
+  const char *extension = ctx->extension;
+  char *row = ctx->capturedRow->str;
+  int *bounds = ctx->columnBounds;
+
+  // Rows named after their form type have its keys, encoded once
+  FORM_MAPPING *mapping = filename == ctx->formType ? ctx->mapping : NULL;
+  if ((mapping != NULL) && (mapping->jsonKeys == NULL) && !encodeJsonKeys(ctx, mapping))
+  {
+    // Out of memory; the parse stops after this line
+    ctx->outOfMemory = 1;
+    return;
+  }
+
+  writeString(output, NDJSON_ROWS, extension, "{\"form\":");
+  writeJsonString(output, NDJSON_ROWS, extension, filename, strlen(filename));
+  if (ctx->includeFilingId)
+  {
+    writeString(output, NDJSON_ROWS, extension, ",\"filing_id\":");
+    writeJsonString(output, NDJSON_ROWS, extension, ctx->filingId, strlen(ctx->filingId));
+  }
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, ctx->rowHeader, NULL);
+  for (int i = 0; i < ctx->rowColumns; i++)
+  {
+    if (mapping != NULL)
+    {
+      int keyStart = i > 0 ? mapping->jsonKeyEnds[i - 1] : 0;
+      writeN(output, NDJSON_ROWS, extension, mapping->jsonKeys + keyStart, mapping->jsonKeyEnds[i] - keyStart);
+    }
+    else if (nextHeaderColumn(&column))
+    {
+      writeJsonKey(output, NDJSON_ROWS, extension, &column);
+    }
+    int source = ctx->rowSources != NULL ? ctx->rowSources[i] : i;
+    int present = (source >= 0) && (source < numColumns);
+    char type = ctx->rowTypes != NULL ? ctx->rowTypes[i] : 's';
+    writeJsonValue(output, NDJSON_ROWS, extension, present ? row + bounds[source * 2] : row, present ? bounds[source * 2 + 1] - bounds[source * 2] : 0, type);
+  }
+  writeString(output, NDJSON_ROWS, extension, "}\n");
+}
+
+// Insert the captured row into the selected table of the database
+void insertSqliteRowFields(FEC_CONTEXT *ctx, int numColumns)
+{
+  SQLITE_OUTPUT *database = ctx->writeContext->database;
+  if ((database == NULL) || ctx->outputFailed)
+  {
+    return;
+  }
+  char *row = ctx->capturedRow->str;
+  int *bounds = ctx->columnBounds;
+  int column = 0;
+  if (ctx->includeFilingId)
+  {
+    bindSqliteValue(database, column++, ctx->filingId, strlen(ctx->filingId), 's');
+  }
+  for (int i = 0; i < ctx->rowColumns; i++)
+  {
+    int source = ctx->rowSources != NULL ? ctx->rowSources[i] : i;
+    int present = (source >= 0) && (source < numColumns);
+    char type = ctx->rowTypes != NULL ? ctx->rowTypes[i] : 's';
+    bindSqliteValue(database, column++, present ? row + bounds[source * 2] : row, present ? bounds[source * 2 + 1] - bounds[source * 2] : 0, type);
+  }
+  if (!insertSqliteRow(database))
+  {
+    ctx->outputFailed = 1;
   }
 }
 
-void startDataRow(FEC_CONTEXT *ctx, char *filename, const char *extension)
+// Add the captured row to the selected column table
+void addColumnRow(FEC_CONTEXT *ctx, int numColumns)
 {
-  // Write the filing ID value, if includeFilingId is specified
-  if (ctx->includeFilingId)
+  COLUMN_TABLES *tables = ctx->columns;
+  if ((tables->list.table == NULL) || !startColumnRow(tables))
   {
-    writeString(ctx->writeContext, filename, extension, ctx->filingId);
-    writeDelimeter(ctx->writeContext, filename, extension);
+    ctx->outOfMemory = 1;
+    return;
   }
+  char *row = ctx->capturedRow->str;
+  int *bounds = ctx->columnBounds;
+  int column = 0;
+  int added = !ctx->includeFilingId || setColumnValue(tables, column++, ctx->filingId, strlen(ctx->filingId));
+  for (int i = 0; added && (i < ctx->rowColumns); i++)
+  {
+    int source = ctx->rowSources != NULL ? ctx->rowSources[i] : i;
+    int present = (source >= 0) && (source < numColumns);
+    added = setColumnValue(tables, column++, present ? row + bounds[source * 2] : row, present ? bounds[source * 2 + 1] - bounds[source * 2] : 0);
+  }
+  if (!added)
+  {
+    ctx->outOfMemory = 1;
+    return;
+  }
+  endColumnRow(tables);
 }
 
-// Parse F99 text from a filing, writing the text to the specified
-// file in escaped CSV form if successful. Returns 1 if successful,
-// 0 otherwise.
-int parseF99Text(FEC_CONTEXT *ctx, char *filename)
+// Write a captured row to the output: reordered if it has sources, and
+// encoded in the output format
+void writeCapturedRow(FEC_CONTEXT *ctx, char *filename)
 {
-  int f99Mode = 0;
-  int first = 1;
+  WRITE_CONTEXT *output = ctx->writeContext;
+  int binary = ctx->format == FORMAT_PGCOPY;
+  int numColumns = ctx->format == FORMAT_CSV ? splitCapturedRow(ctx, ctx->rowSources != NULL ? ctx->numFields : ctx->rowColumns) : endCapturedColumns(ctx);
+  char *row = ctx->capturedRow->str;
+  int *bounds = ctx->columnBounds;
+  if (ctx->format == FORMAT_NDJSON)
+  {
+    writeNdjsonRow(ctx, filename, numColumns);
+    return;
+  }
+  if (ctx->format == FORMAT_SQLITE)
+  {
+    insertSqliteRowFields(ctx, numColumns);
+    return;
+  }
+  if (ctx->format == FORMAT_COLUMNS)
+  {
+    addColumnRow(ctx, numColumns);
+    return;
+  }
 
-  while (1)
+  if (binary)
   {
-    // Load the current line
-    if (grabLine(ctx) == 0)
+    writePgCopyTuple(output, filename, ctx->extension, ctx->rowColumns + (ctx->includeFilingId ? 1 : 0));
+    if (ctx->includeFilingId)
     {
-      // End of file
-      return 1;
+      writePgCopyField(output, filename, ctx->extension, ctx->filingId, strlen(ctx->filingId), 's');
     }
-
-    if (f99Mode)
+  }
+  for (int i = 0; i < ctx->rowColumns; i++)
+  {
+    int source = ctx->rowSources != NULL ? ctx->rowSources[i] : i;
+    int present = (source >= 0) && (source < numColumns);
+    char *value = present ? row + bounds[source * 2] : row;
+    int length = present ? bounds[source * 2 + 1] - bounds[source * 2] : 0;
+    if (binary)
     {
-      // See if we have reached the end boundary
-      if (pcre_exec(ctx->f99TextEnd, NULL, ctx->persistentMemory->line->str, ctx->currentLineLength, 0, 0, NULL, 0) >= 0)
-      {
-        f99Mode = 0;
-        break;
-      }
-
-      // Otherwise, write f99 information as a CSV field
-      if (first)
+      char type = ctx->rowTypes != NULL ? ctx->rowTypes[i] : 's';
+      if (!writePgCopyField(output, filename, ctx->extension, value, length, type) && ctx->warn)
       {
-        // Write the delimeter at the beginning and a quote character
-        // (the csv field will always be escaped so we can stream write
-        // without having to calculate whether it's escaped later).
-        writeDelimeter(ctx->writeContext, filename, csvExtension);
-        writeChar(ctx->writeContext, filename, csvExtension, '"');
-        first = 0;
+        fprintf(stderr, "Warning: Could not convert %s field to %s, writing NULL: %.*s\n", ctx->formType, type == 'd' ? "a date" : "a number", length, value);
       }
-
-      writeQuotedCsvField(ctx, filename, csvExtension, ctx->persistentMemory->line->str, ctx->currentLineLength);
       continue;
     }
-
-    // See if line begins with f99 text boundary by first seeing if it starts with "["
-    if (lineMightStartWithF99(ctx))
-    {
-      // Now, execute the proper regex (we don't want to do this for every line, as it's slow)
-      if (pcre_exec(ctx->f99TextStart, NULL, ctx->persistentMemory->line->str, ctx->currentLineLength, 0, 0, NULL, 0) >= 0)
-      {
-        // Set f99 mode
-        f99Mode = 1;
-        continue;
-      }
-      else
-      {
-        // Invalid f99 text
-        return 0;
-      }
-    }
-    else if (lineContainsNonwhitespace(ctx))
+    if (i > 0)
     {
-      // The line should only contain non-whitespace that starts
-      // f99 text
-      return 0;
+      writeDelimeter(output, filename, csvExtension);
     }
+    writeN(output, filename, csvExtension, value, length);
   }
-  // Successful extraction, end the quote delimiter
-  writeChar(ctx->writeContext, filename, csvExtension, '"');
-  return 1;
 }
 
-// Parse a line from a filing, using FEC and form version
-// information to map fields to headers and types.
-// Return 1 if successful, or 0 if the line is not fully
-// specified. Return 2 if there was a warning but it was
-// still successful and the next line has already been grabbed.
-// Return 3 if we encountered a mappings error.
-int parseLine(FEC_CONTEXT *ctx, char *filename, int headerRow)
+// End a row, writing it out if it was captured
+void endRow(FEC_CONTEXT *ctx, char *filename)
 {
-  // Parse fields
-  PARSE_CONTEXT parseContext;
-  FIELD_INFO fieldInfo;
-  initParseContext(ctx, &parseContext, &fieldInfo);
+  if (ctx->rowOutput != NULL)
+  {
+    ctx->writeContext = ctx->rowOutput;
+    ctx->rowOutput = NULL;
+    writeCapturedRow(ctx, filename);
+  }
+  if (ctx->format == FORMAT_CSV)
+  {
+    writeNewline(ctx->writeContext, filename, csvExtension);
+  }
+  endLine(ctx->writeContext, writtenTypes(ctx));
+}
 
-  // Log the indices on the line where the form version is specified
-  int formStart;
-  int formEnd;
+// Return whether the rest of the current line (after the form type)
+// can be written in bulk by writeSimpleLine: it's written as CSV, it's
+// ascii28 delimited with no fields that need escaping, it has at least
+// two fields, and every column is written
+int isSimpleLine(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext)
+{
+  char *next = parseContext->line->str + parseContext->position;
+  // Warnings for unexpected columns are only logged field by field
+  return (ctx->format == FORMAT_CSV) && ctx->currentLineHasAscii28 && !ctx->currentLineHasQuotesOrCommas && (ctx->columnMask == NULL) && !ctx->warn && (next[0] == 28) && (next[1] != '\n') && (next[1] != 0);
+}
 
-  // Iterate through fields
-  while (!isParseDone(&parseContext))
+// Write the rest of a simple line (see isSimpleLine), starting at the
+// delimeter after the form type. Runs of string columns are written
+// as-is with their delimeters translated to commas; only date and
+// float columns are converted field by field. Return the final column
+// index as the field by field parse would (the number of delimeters).
+int writeSimpleLine(FEC_CONTEXT *ctx, char *filename, int position)
+{
+  char *str = ctx->persistentMemory->line->str;
+  char *newline = strchr(str + position, '\n');
+  int lineEnd = newline != NULL ? (int)(newline - str) : position + (int)strlen(str + position);
+
+  // Translate the delimeters in bulk. The line has no commas, so from
+  // here on commas mark the field boundaries.
+  replaceByte(str + position, lineEnd - position, 28, ',');
+
+  FIELD_INFO fieldInfo = {.num_commas = 0, .num_quotes = 0};
+  int columnIndex = 0;
+  int runStart = position; // start of the run of unwritten string columns
+  int fieldEnd = position;
+  while (fieldEnd < lineEnd)
   {
-    readField(ctx, &parseContext);
-    if (parseContext.columnIndex == 0)
+    // Move past the delimeter
+    columnIndex++;
+    int fieldStart = fieldEnd + 1;
+    if (fieldStart >= lineEnd)
     {
-      // Set the form version to the first column
-      // (with whitespace removed)
-      stripWhitespace(&parseContext);
-      formStart = parseContext.start;
-      formEnd = parseContext.end;
-      if (!lookupMappings(ctx, &parseContext, formStart, formEnd))
-      {
-        return 3;
-      }
-
-      // Set filename if null to form type
-      if (filename == NULL)
-      {
-        filename = ctx->formType;
-      }
+      // A delimeter at the very end of the line doesn't start a field
+      break;
     }
-    else
-    {
-      // If column index is 1, then there are at least two columns
-      // and the line is fully specified, so write header/line info
-      if (parseContext.columnIndex == 1)
-      {
-        // Write header if necessary
-        if (getFile(ctx->writeContext, filename, csvExtension) == 1)
-        {
-          // File is newly opened, write headers
-          startHeaderRow(ctx, filename, csvExtension);
-          writeString(ctx->writeContext, filename, csvExtension, ctx->headers);
-          writeNewline(ctx->writeContext, filename, csvExtension);
-          endLine(ctx->writeContext, ctx->types);
-        }
-
-        // Write form type
-        startDataRow(ctx, filename, csvExtension);
-        writeString(ctx->writeContext, filename, csvExtension, ctx->formType);
-      }
-
-      // Write delimeter
-      writeDelimeter(ctx->writeContext, filename, csvExtension);
-
-      // Get the type of the current field and write accordingly
-      char type;
-      if (parseContext.columnIndex < ctx->numFields)
-      {
-        // Ensure the column index is in bounds
-        type = ctx->types[parseContext.columnIndex];
-      }
-      else
-      {
-        // Warning: column exceeding row length
-        if (ctx->warn)
-        {
-          fprintf(stderr, "Unexpected column in %s (%d): ", ctx->formType, parseContext.columnIndex);
-          for (int i = parseContext.start; i < parseContext.end; i++)
-          {
-            fprintf(stderr, "%c", ctx->persistentMemory->line->str[i]);
-          }
-          fprintf(stderr, "\n");
-        }
-        // Default to string type
-        type = 's';
-      }
+    int delimeter = findByte(str + fieldStart, lineEnd - fieldStart, ',');
+    fieldEnd = delimeter != -1 ? fieldStart + delimeter : lineEnd;
 
-      // Iterate possible types
-      if (type == 's')
-      {
-        // String
-        writeSubstr(ctx, filename, csvExtension, parseContext.start, parseContext.end, parseContext.fieldInfo);
-      }
-      else if (type == 'd')
-      {
-        // Date
-        writeDateField(ctx, filename, csvExtension, parseContext.start, parseContext.end, parseContext.fieldInfo);
-      }
-      else if (type == 'f')
-      {
-        // Float
-        writeFloatField(ctx, filename, csvExtension, parseContext.start, parseContext.end, parseContext.fieldInfo);
-      }
-      else
-      {
-        // Unknown type
-        fprintf(stderr, "Unknown type (%c) in %s\n", type, ctx->formType);
-        exit(1);
-      }
+    char type = columnIndex < ctx->numFields ? ctx->types[columnIndex] : 's';
+    if (type == 's')
+    {
+      continue;
     }
 
-    if (isParseDone(&parseContext))
+    // Write the run of string columns up to the field (including
+    // its delimeter), then the converted field
+    writeN(ctx->writeContext, filename, csvExtension, str + runStart, fieldStart - runStart);
+    if (type == 'd')
     {
-      break;
+      writeDateField(ctx, filename, csvExtension, fieldStart, fieldEnd, &fieldInfo);
+    }
+    else if (type == 'f')
+    {
+      writeFloatField(ctx, filename, csvExtension, fieldStart, fieldEnd, &fieldInfo);
+    }
+    else
+    {
+      // Unknown type
+      fprintf(stderr, "Unknown type (%c) in %s\n", type, ctx->formType);
+      exit(1);
     }
-    advanceField(&parseContext);
+    runStart = fieldEnd;
   }
 
-  if (parseContext.columnIndex < 2)
+  // Write the remaining run (without a trailing delimeter)
+  int runEnd = fieldEnd < lineEnd ? fieldEnd : lineEnd;
+  writeN(ctx->writeContext, filename, csvExtension, str + runStart, runEnd - runStart);
+  return columnIndex;
+}
+
+// Read an ascii28 delimited field. Quotes and commas only need to be
+// counted (and quotes stripped) if the line has any.
+static inline void readAscii28LineField(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext)
+{
+  parseContext->fieldInfo->num_quotes = 0;
+  parseContext->fieldInfo->num_commas = 0;
+  if (ctx->currentLineHasQuotesOrCommas)
   {
-    // Fewer than two fields? The line isn't fully specified
-    return 0;
+    readAscii28Field(parseContext);
   }
-
-  if (parseContext.columnIndex + 1 != ctx->numFields && !headerRow)
+  else
   {
-    // Try to read F99 text
-    if (!parseF99Text(ctx, filename))
-    {
-      if (ctx->warn)
-      {
-        fprintf(stderr, "Warning: mismatched number of fields (%d vs %d) (%s)\nLine: %s\n", parseContext.columnIndex + 1, ctx->numFields, ctx->formType, parseContext.line->str);
-      }
-      // 2 indicates we won't grab the line again
-      writeNewline(ctx->writeContext, filename, csvExtension);
-      endLine(ctx->writeContext, ctx->types);
-      return 2;
-    }
+    readPlainAscii28Field(parseContext);
   }
+}
 
-  // Parsing successful
-  writeNewline(ctx->writeContext, filename, csvExtension);
-  endLine(ctx->writeContext, ctx->types);
-  return 1;
+static inline void readCsvLineField(FEC_CONTEXT *ctx, PARSE_CONTEXT *parseContext)
+{
+  (void)ctx; // (READ_FIELD takes the context, which CSV fields don't need)
+  parseContext->fieldInfo->num_quotes = 0;
+  parseContext->fieldInfo->num_commas = 0;
+  readCsvField(parseContext);
+}
+
+// Parse an ascii28 delimited line
+#define PARSE_LINE_NAME parseAscii28Line
+#define PARSE_ASCII28 1
+#define READ_FIELD readAscii28LineField
+#include "parse_line_template.h"
+
+// Parse a comma delimited line
+#define PARSE_LINE_NAME parseCsvLine
+#define PARSE_ASCII28 0
+#define READ_FIELD readCsvLineField
+#include "parse_line_template.h"
+
+// Parse a line from a filing, using FEC and form version
+// information to map fields to headers and types.
+// Return 1 if successful, or 0 if the line is not fully
+// specified. Return 2 if there was a warning but it was
+// still successful and the next line has already been grabbed.
+// Return 3 if we encountered a mappings error.
+int parseLine(FEC_CONTEXT *ctx, char *filename, int headerRow)
+{
+  // Each kind of line has its own parse loop, so the ascii28 loop
+  // doesn't carry the CSV quote handling
+  if (ctx->currentLineHasAscii28)
+  {
+    return parseAscii28Line(ctx, filename, headerRow);
+  }
+  return parseCsvLine(ctx, filename, headerRow);
 }
 
 // Set the FEC context version based on a substring of the current line
 void setVersion(FEC_CONTEXT *ctx, int start, int end)
 {
-  ctx->version = malloc(end - start + 1);
-  strncpy(ctx->version, ctx->persistentMemory->line->str + start, end - start);
-  // Add null terminator
-  ctx->version[end - start] = 0;
+  ctx->version = arenaStrndup(ctx->arena, ctx->persistentMemory->line->str + start, end - start);
   ctx->versionLength = end - start;
+  if (ctx->version == NULL)
+  {
+    // Out of memory; the parse stops after the header
+    ctx->outOfMemory = 1;
+    ctx->version = "";
+    ctx->versionLength = 0;
+  }
+  // Mappings depend on the version
+  forgetFormMappings(ctx);
 
   // Calculate whether to use ascii28 or not based on version
   char *dot = strchr(ctx->version, '.');
@@ -696,11 +1769,18 @@ int parseHeader(FEC_CONTEXT *ctx)
   if (lineStartsWithLegacyHeader(ctx))
   {
     // Parse legacy header
-    startHeaderRow(ctx, HEADER, csvExtension);
     int scheduleCounts = 0; // init scheduleCounts to be false
     int firstField = 1;
 
-    // Use a local buffer to store header values
+    // Use local buffers to store header keys (the header row, written
+    // if the file is new) and values
+    STRING *keys = newAllocatedString(ctx->allocator, DEFAULT_STRING_SIZE);
+    if (keys == NULL)
+    {
+      return 0;
+    }
+    WRITE_CONTEXT keyWriteContext;
+    initializeLocalWriteContext(&keyWriteContext, keys);
     WRITE_CONTEXT bufferWriteContext;
     initializeLocalWriteContext(&bufferWriteContext, ctx->persistentMemory->bufferLine);
 
@@ -752,7 +1832,7 @@ int parseHeader(FEC_CONTEXT *ctx)
         // Write commas as needed (only before fields that aren't first)
         if (!firstField)
         {
-          writeDelimeter(ctx->writeContext, HEADER, csvExtension);
+          writeDelimeter(&keyWriteContext, NULL, NULL);
           writeDelimeter(&bufferWriteContext, NULL, NULL);
         }
         firstField = 0;
@@ -760,7 +1840,7 @@ int parseHeader(FEC_CONTEXT *ctx)
         // Write schedule counts prefix if set
         if (scheduleCounts)
         {
-          writeString(ctx->writeContext, HEADER, csvExtension, SCHEDULE_COUNTS);
+          writeString(&keyWriteContext, NULL, NULL, SCHEDULE_COUNTS);
         }
 
         // If we match the FEC version column, set the version
@@ -770,17 +1850,23 @@ int parseHeader(FEC_CONTEXT *ctx)
         }
 
         // Write the key/value pair
-        writeSubstr(ctx, HEADER, csvExtension, keyStart, keyEnd, &headerField);
+        writeSubstrToWriter(ctx, &keyWriteContext, NULL, NULL, keyStart, keyEnd, &headerField);
         // Write the value to a buffer to be written later
         writeSubstrToWriter(ctx, &bufferWriteContext, NULL, NULL, valueStart, valueEnd, &valueField);
       }
     }
-    writeNewline(ctx->writeContext, HEADER, csvExtension);
-    endLine(ctx->writeContext, ctx->types);
-    startDataRow(ctx, HEADER, csvExtension); // output the filing id if we have it
-    writeString(ctx->writeContext, HEADER, csvExtension, bufferWriteContext.localBuffer->str);
-    writeNewline(ctx->writeContext, HEADER, csvExtension); // end with newline
-    endLine(ctx->writeContext, ctx->types);
+    selectRowFile(ctx, HEADER, keys->str, NULL);
+    beginRow(ctx, HEADER, keys->str, NULL, NULL); // output the filing id if we have it
+    if (capturingFields(ctx))
+    {
+      captureCsvFields(ctx, HEADER, bufferWriteContext.localBuffer, bufferWriteContext.localBufferPosition);
+    }
+    else
+    {
+      writeString(ctx->writeContext, HEADER, csvExtension, bufferWriteContext.localBuffer->str);
+    }
+    endRow(ctx, HEADER);
+    freeString(keys);
   }
   else
   {
@@ -839,6 +1925,13 @@ int parseHeader(FEC_CONTEXT *ctx)
 int parseFec(FEC_CONTEXT *ctx)
 {
   int skipGrabLine = 0;
+  ctx->allocationFailures = ctx->allocator != NULL ? ctx->allocator->stats.failures : 0;
+
+  if (ctx->usePipeline && !ctx->summary && (ctx->filter == NULL) && (ctx->buffer->memory == NULL))
+  {
+    // The pipeline only reads input it can interrupt
+    startReadAhead(ctx->buffer, PIPELINE_READ_AHEAD_SLOTS, ctx->buffer->bufferSize, ctx->file);
+  }
 
   if (grabLine(ctx) == 0)
   {
@@ -846,26 +1939,190 @@ int parseFec(FEC_CONTEXT *ctx)
   }
 
   // Parse the header
-  if (!parseHeader(ctx))
+  if (!parseHeader(ctx) || parseStopped(ctx))
   {
     return 0;
   }
 
+  if (ctx->usePipeline && !ctx->summary && (ctx->filter == NULL))
+  {
+    // Lines are only read ahead past the header, as the header may
+    // change how they're parsed. Without threads, lines are read on
+    // demand.
+    ctx->pipeline = startLinePipeline(ctx->buffer, ctx->file);
+    if ((ctx->pipeline != NULL) && !ctx->writeContext->combined)
+    {
+      // (combined output, which can be rotated mid-parse, is written
+      // out as it fills)
+      startOutputStage(ctx->writeContext);
+    }
+  }
+
   // Loop through parsing the entire file, line by
   // line.
   while (1)
   {
-    // Load the current line
-    if (!skipGrabLine && grabLine(ctx) == 0)
+    if (ctx->pipeline != NULL)
+    {
+      // Lines come decoded from the pipeline
+      if (!skipGrabLine && grabLine(ctx) == 0)
+      {
+        break;
+      }
+      skipGrabLine = parseLine(ctx, NULL, 0) == 2;
+      if (parseStopped(ctx))
+      {
+        break;
+      }
+      continue;
+    }
+
+    // Load the current line (without decoding it yet)
+    if (!skipGrabLine && grabRawLine(ctx) == 0)
     {
       // End of file
       break;
     }
 
+    if (ctx->summary || (ctx->filter != NULL))
+    {
+      int formStart;
+      int formLength = rawFormType(ctx->persistentMemory->rawLine, &formStart);
+      char *formType = ctx->persistentMemory->rawLine->str + formStart;
+
+      // In summary mode, stop at the first line after the header
+      // that isn't a form (F3, F3X, etc.) record, which will be the
+      // start of the itemizations
+      if (ctx->summary && (formLength > 0) && (formType[0] != 'F') && (formType[0] != 'f'))
+      {
+        break;
+      }
+
+      // Skip lines that are filtered out before spending
+      // any time decoding them
+      if ((ctx->filter != NULL) && !filterIncludesFormType(ctx->filter, formType, formLength))
+      {
+        skipGrabLine = skipLine(ctx, formType, formLength) == 2;
+        continue;
+      }
+    }
+    if (!skipGrabLine)
+    {
+      decodeRawLine(ctx);
+    }
+
     // Parse the line and write its parsed output
     // to CSV files depending on version/form type
     skipGrabLine = parseLine(ctx, NULL, 0) == 2;
+
+    if (parseStopped(ctx))
+    {
+      break;
+    }
   }
 
+  if (ctx->pipeline != NULL)
+  {
+    stopLinePipeline(ctx->pipeline);
+    ctx->pipeline = NULL;
+  }
+
+  if (allocationFailed(ctx))
+  {
+    fprintf(stderr, "Parsing stopped: out of memory\n");
+    return 0;
+  }
+  if (ctx->outputFailed)
+  {
+    fprintf(stderr, "Parsing stopped: the output couldn't be written\n");
+    return 0;
+  }
   return 1;
 }
+
+// How much of each line to look at when counting (enough to hold any
+// form type)
+#define COUNT_PREFIX_LENGTH 64
+
+int countFec(FEC_CONTEXT *ctx, FORM_COUNTS *counts)
+{
+  STRING *prefix = ctx->persistentMemory->rawLine;
+  int lineLength;
+  int first = 1;
+  int legacyHeader = 0;
+  int f99Text = 0;
+  int current = -1; // the count that the current line belongs to
+
+  while ((lineLength = scanLine(ctx->buffer, prefix, COUNT_PREFIX_LENGTH, ctx->file)) > 0)
+  {
+    char *str = prefix->str;
+    int i = 0;
+    while (isWhitespaceChar(str[i]))
+    {
+      i++;
+    }
+
+    if (first)
+    {
+      // The first line is always the header, which may span multiple
+      // lines if it's a legacy header
+      first = 0;
+      current = formCountIndex(counts, HEADER, strlen(HEADER));
+      if (current < 0)
+      {
+        break;
+      }
+      counts->counts[current].rows++;
+      counts->counts[current].bytes += lineLength;
+      legacyHeader = strncmp(str + i, "/*", 2) == 0;
+      continue;
+    }
+
+    if (legacyHeader)
+    {
+      // Until the line starts with "/*" again, the header continues
+      counts->counts[current].bytes += lineLength;
+      legacyHeader = strncmp(str + i, "/*", 2) != 0;
+      continue;
+    }
+
+    if (f99Text)
+    {
+      // F99 text continues until the end boundary
+      counts->counts[current].bytes += lineLength;
+      f99Text = strncasecmp(str + i, "[END", 4) != 0;
+      continue;
+    }
+    if (strncasecmp(str + i, "[BEGIN", 6) == 0)
+    {
+      f99Text = 1;
+      counts->counts[current].bytes += lineLength;
+      continue;
+    }
+
+    int formStart;
+    int formLength = rawFormType(prefix, &formStart);
+    if (formLength == 0)
+    {
+      // Blank lines belong to the preceding form
+      counts->counts[current].bytes += lineLength;
+      continue;
+    }
+    current = formCountIndex(counts, str + formStart, formLength);
+    if (current < 0)
+    {
+      break;
+    }
+    counts->counts[current].rows++;
+    counts->counts[current].bytes += lineLength;
+  }
+
+  if (!first && (current < 0))
+  {
+    // Out of memory; the counts are incomplete
+    fprintf(stderr, "Out of memory counting forms\n");
+    ctx->outOfMemory = 1;
+    return 0;
+  }
+  return !first;
+}
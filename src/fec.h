@@ -5,26 +5,82 @@
 #include "memory.h"
 #include "writer.h"
 #include "buffer.h"
+#include "filter.h"
+#include "count.h"
+#include "columns.h"
+#include "arena.h"
+#include "allocator.h"
+#include "pipeline.h"
+
+// The number of hash buckets form mappings are interned in
+#define FORM_MAPPING_BUCKETS 64
+
+// Output formats (see setFecFormat)
+#define FORMAT_CSV 0
+#define FORMAT_PGCOPY 1
+#define FORMAT_NDJSON 2
+#define FORMAT_SQLITE 3
+#define FORMAT_COLUMNS 4 // (see setFecColumns)
+
+// The header and type mappings of a form type, computed the first time
+// the form type is seen in a filing and reused after that
+struct form_mapping
+{
+  // The interned form type: its id is unique within the context (even
+  // across versions) and is what output is routed by
+  int id;
+  char *formType;
+  int formTypeLength;
+  char *headers; // pointer to static CSV header row info
+  char *types;
+  int numFields;
+
+  // Column projection (NULL if all columns are written)
+  char *columnMask;
+  char *selectedHeaders;
+  char *selectedTypes;
+
+  // Unified schema (see setFecUnified; NULL if rows are written as
+  // they are): the header row and types of the form type's columns
+  // across all versions, and the column of the line written to each
+  // of them (-1 for columns this version doesn't have)
+  char *unifiedHeaders;
+  char *unifiedTypes;
+  int *unifiedSources;
+  int numUnifiedFields;
+
+  // The keys of the columns of NDJSON rows, each with the comma before
+  // it and the colon after it, ending at jsonKeyEnds (NULL until the
+  // first row is written as NDJSON)
+  char *jsonKeys;
+  int *jsonKeyEnds;
+
+  struct form_mapping *next; // next mapping in the same bucket
+};
+typedef struct form_mapping FORM_MAPPING;
 
 struct fec_context
 {
   // A way to pull lines
   BUFFER *buffer;
   void *file;
+  int ownsFile; // whether file was opened by the library
 
   // A way to write lines
   WRITE_CONTEXT *writeContext;
+  int ownsWriteContext; // whether writeContext is freed with the context
 
   char *filingId;
   char *version; // default null
   int versionLength;
   int useAscii28;
-  int summary; // default false
+  int summary; // default false; only parse the header and summary records
   char *f99Text;
 
   // Supporting line information
   PERSISTENT_MEMORY_CONTEXT *persistentMemory;
   int currentLineHasAscii28;
+  int currentLineHasQuotesOrCommas;
   int currentLineLength;
 
   // Flags
@@ -32,11 +88,76 @@ struct fec_context
   int silent;
   int warn;
 
-  // Parse cache
+  // Whether to read and write on separate threads while parsing, and
+  // the running line pipeline (NULL when lines are read on demand)
+  int usePipeline;
+  LINE_PIPELINE *pipeline;
+
+  // Hash of the streamed input (NULL if not hashing)
+  HASH_STATE *inputHash;
+
+  // Which lines and columns to parse (NULL to parse everything)
+  FILTER *filter;
+
+  // The output format (see setFecFormat) and the extension of the files
+  // rows are written to
+  int format;
+  const char *extension;
+
+  // The tables rows are accumulated in with FORMAT_COLUMNS
+  COLUMN_TABLES *columns;
+
+  // Whether rows are written in their form type's unified schema
+  int unified;
+
+  // Rows that are reordered (into a unified schema) or encoded (in a
+  // format other than CSV) are captured into the row writer, then
+  // written to the output (rowOutput, NULL when not capturing) as the
+  // row ends. CSV rows are captured as CSV; encoded rows field by field,
+  // as the values of their columns (see markCapturedColumn). The output
+  // row has rowColumns columns of rowTypes (NULL if they're all strings)
+  // named by rowHeader, taken from the columns of the captured row given
+  // by rowSources (NULL if in order).
+  STRING *capturedRow;
+  WRITE_CONTEXT rowWriteContext;
+  WRITE_CONTEXT *rowOutput;
+  char *rowHeader;
+  char *rowTypes;
+  int *rowSources;
+  int rowColumns;
+  // Where each column of the captured row starts and ends, and the
+  // number of columns captured field by field so far
+  int *columnBounds;
+  int columnBoundsCapacity;
+  int capturedColumns;
+
+  // Where the context's memory comes from (NULL for the C library's)
+  ALLOCATOR *allocator;
+  size_t allocationFailures; // failures before the parse started
+  int outOfMemory;           // whether memory ran out mid-parse
+  int outputFailed;          // whether the output couldn't be written
+
+  // Per-filing allocations (the version and form mappings), released
+  // when the context is freed
+  ARENA *arena;
+
+  // Mappings of every form type seen so far, hashed by form type, the
+  // current one and the id the next new one gets
+  FORM_MAPPING *mappings[FORM_MAPPING_BUCKETS];
+  FORM_MAPPING *mapping;
+  int nextFormTypeId;
+
+  // Parse cache (copied from the current mapping)
   char *formType;
   int numFields;
   char *headers; // pointer to static CSV header row info
-  char *types;   // dynamically allocated string where each char indicates types
+  char *types;   // string where each char indicates types
+
+  // Column projection for the current form type (NULL if all columns
+  // are written)
+  char *columnMask;       // whether each column is written
+  char *selectedHeaders;  // CSV header row of the written columns
+  char *selectedTypes;    // types of the written columns
 
   // Special regex
   pcre *f99TextStart;
@@ -44,8 +165,112 @@ struct fec_context
 };
 typedef struct fec_context FEC_CONTEXT;
 
-EXPORT FEC_CONTEXT *newFecContext(PERSISTENT_MEMORY_CONTEXT *persistentMemory, BufferRead bufferRead, int inputBufferSize, CustomWriteFunction customWriteFunction, int outputBufferSize, CustomLineFunction customLineFunction, int writeToFile, void *file, char *filingId, char *outputDirectory, int includeFilingId, int silent, int warn);
+// Create a context for parsing a filing. Allocations go through the
+// allocator, or the persistent memory's allocator if it's NULL. Returns
+// NULL if memory runs out.
+EXPORT FEC_CONTEXT *newFecContext(PERSISTENT_MEMORY_CONTEXT *persistentMemory, BufferRead bufferRead, int inputBufferSize, CustomWriteFunction customWriteFunction, int outputBufferSize, CustomLineFunction customLineFunction, int writeToFile, void *file, char *filingId, char *outputDirectory, int includeFilingId, int silent, int warn, ALLOCATOR *allocator);
 
 EXPORT void freeFecContext(FEC_CONTEXT *context);
 
+// Read the filing directly from a path on disk instead of through the
+// context's read function. The file is memory mapped where possible
+// and closed when the context is freed. Returns 1 if the file could be
+// opened, 0 otherwise.
+EXPORT int setFecInputPath(FEC_CONTEXT *ctx, const char *path);
+
+// Parse the filing in place from a block of memory instead of through
+// the context's read function. The memory must outlive the context.
+EXPORT void setFecInputMemory(FEC_CONTEXT *ctx, char *memory, size_t length);
+
+// Read the filing ahead on a separate thread, into a ring of slots
+// buffers of slotSize bytes, so that waiting on the input (e.g. a pipe
+// from a download) overlaps with parsing. Only a file read by the
+// library's own read function is read ahead, and it must not have been
+// read from yet; the thread waits for input in a way that freeing the
+// context interrupts. Call after setting the input; input that's read
+// in place isn't read ahead. Returns 1 if reading ahead, 0 otherwise
+// (in which case the input is read on demand as usual).
+EXPORT int setFecReadAhead(FEC_CONTEXT *ctx, int slots, int slotSize);
+
+// Parse in a pipeline of three threads: one reads and decodes lines,
+// one (the calling thread) parses them and one writes the output. Rows
+// are written in the same order and form as a serial parse. The custom
+// write function, if any, is called from the writing thread. Filtered
+// and summary parses are always serial, as is input read by a custom
+// read function (a file read by the library is read ahead for the
+// pipeline if it isn't in memory).
+EXPORT void setFecPipeline(FEC_CONTEXT *ctx, int pipeline);
+
+// Hash the input (with XXH64) in the same pass that reads it, so its
+// hash is known once it's been read to the end. Returns 0 if memory ran
+// out.
+EXPORT int setFecHashing(FEC_CONTEXT *ctx);
+
+// Get the XXH64 hash of the whole input. Input in memory (including
+// mapped files) is hashed directly, so its hash is available before
+// parsing. Other input is hashed as it's read (see setFecHashing), so
+// its hash is available once it's been read to the end. Returns 1 if
+// the hash was set, 0 if it isn't available.
+EXPORT int fecInputHash(FEC_CONTEXT *ctx, uint64_t *hash);
+
+// Write the output to a write context shared with other parses (e.g.
+// combined output, see setCombinedOutput) instead of the context's own.
+// The write context isn't freed with the context.
+EXPORT void setFecWriteContext(FEC_CONTEXT *ctx, WRITE_CONTEXT *writeContext);
+
+// Write the rows of each form type in one schema across all FEC
+// versions (the union of the columns of every version, in the order of
+// unifiedHeaders in mappings_generated.h), leaving the columns a version
+// doesn't have empty, so the output of filings of different versions
+// can be loaded together. Columns of a line past those of its version
+// are dropped. Form types with a column selection (see setFecFilter) are
+// written as selected. Returns 1 if successful, 0 if memory ran out.
+EXPORT int setFecUnified(FEC_CONTEXT *ctx, int unified);
+
+// Write the output in a format other than CSV (FORMAT_CSV). With
+// FORMAT_PGCOPY, each form type is written as a PostgreSQL binary COPY
+// file, {form type}.pgcopy, to be loaded with COPY ... FROM ... WITH
+// (FORMAT binary), and its table is declared in schema.sql: string
+// columns are text, date columns date and float columns numeric. Empty
+// values are NULL, as are dates and numbers that can't be converted.
+// Rows have exactly the columns of their file (columns of a line past
+// them are dropped, and missing ones are NULL). With FORMAT_NDJSON,
+// every row is written to one stream, rows.ndjson, as a line holding a
+// JSON object: the form type the row would be written under ("form"),
+// the filing id if included, then each column keyed by its name
+// (repeated names are numbered from the second, e.g. name_2). Float
+// columns are numbers, and empty values null. With FORMAT_SQLITE (if
+// built with SQLite, see sqlite.h), rows are inserted into the database
+// fec.sqlite, in a table per form type declared like those of
+// FORMAT_PGCOPY (but with float columns REAL and dates TEXT). Call after
+// setting the write context. Returns 1 if successful, or 0 if the format
+// isn't supported (other formats can't be written to a custom line
+// function, and SQLite only to files) or memory ran out.
+EXPORT int setFecFormat(FEC_CONTEXT *ctx, int format);
+
+// Accumulate the rows in the tables as typed columns (see columns.h)
+// instead of writing them. The tables must outlive the parse. Returns 1
+// if successful, or 0 if rows are written to a custom line function or
+// memory ran out.
+EXPORT int setFecColumns(FEC_CONTEXT *ctx, COLUMN_TABLES *tables);
+
+// Only parse the lines and columns specified by the filter. The filter
+// must outlive the context.
+EXPORT void setFecFilter(FEC_CONTEXT *ctx, FILTER *filter);
+
+// Only parse the header and the form records that directly follow it
+// (e.g. the F3X report summary), stopping before any itemizations are
+// read.
+EXPORT void setFecSummary(FEC_CONTEXT *ctx, int summary);
+
+// Parse the filing. Return 1 if successful, or 0 if the filing is
+// empty, its header can't be parsed or memory ran out.
 EXPORT int parseFec(FEC_CONTEXT *ctx);
+
+// Count the rows and bytes of each form type in the filing without
+// parsing it. Only the first field of each line is looked at: lines
+// aren't transcoded, mapped or written. The header is counted under
+// "header" and F99 text is counted towards the bytes of the form that
+// precedes it. Returns 0 if the filing is empty or memory ran out, 1
+// otherwise.
+EXPORT int countFec(FEC_CONTEXT *ctx, FORM_COUNTS *counts);
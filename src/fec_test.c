@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "fec.h"
+
+int tests_run = 0;
+
+int rowsWritten = 0;
+
+void countRow(char *filename, char *line, char *types)
+{
+  // Count itemizations (not header rows)
+  if ((strcmp(filename, "header") != 0) && (strncmp(line, filename, strlen(filename)) == 0))
+  {
+    rowsWritten++;
+  }
+}
+
+const char *filingHeader = "HDR\x1c"
+                           "FEC\x1c"
+                           "8.3\x1c"
+                           "FECfile\x1c"
+                           "8.3.0\x1c\x1c\n";
+const char *receiptRow = "SA11AI\x1c"
+                         "C00123456\x1c"
+                         "SA11AI.1\x1c\x1c\x1cIND\x1c\x1cSmith\x1cJo\x1c\x1c\x1c\x1c"
+                         "1 Main\x1c\x1cTown\x1cST\x1c"
+                         "12345\x1cP2022\x1c\x1c"
+                         "20210105\x1c"
+                         "100.50\x1c"
+                         "200.00\n";
+const char *disbursementRow = "SB23\x1c"
+                              "C00123456\x1c"
+                              "SB23.1\x1c\x1c\x1c"
+                              "CAN\x1c"
+                              "Doe for Congress\n";
+
+// Parse a filing with the given number of itemizations (alternating
+// between two form types), through the line pipeline or not, setting
+// the number of context allocations and the number of those that went
+// to the system allocator
+void parseItemizations(PERSISTENT_MEMORY_CONTEXT *persistentMemory, int rows, int pipeline, size_t *allocations, size_t *mallocs)
+{
+  size_t length = strlen(filingHeader) + (rows / 2 + 1) * (strlen(receiptRow) + strlen(disbursementRow));
+  char *filing = malloc(length + 1);
+  strcpy(filing, filingHeader);
+  for (int i = 0; i < rows; i++)
+  {
+    strcat(filing, i % 2 == 0 ? receiptRow : disbursementRow);
+  }
+
+  FEC_CONTEXT *ctx = newFecContext(persistentMemory, NULL, 64, NULL, 64, countRow, 0, NULL, "1", NULL, 0, 1, 0, NULL);
+  setFecInputMemory(ctx, filing, strlen(filing));
+  setFecPipeline(ctx, pipeline);
+  rowsWritten = 0;
+  parseFec(ctx);
+  *allocations = ctx->arena->allocations + ctx->writeContext->arena->allocations;
+  *mallocs = ctx->arena->mallocs + ctx->writeContext->arena->mallocs;
+  freeFecContext(ctx);
+  free(filing);
+}
+
+static char *testRowsDontAllocate()
+{
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(NULL);
+  size_t fewAllocations, fewMallocs, manyAllocations, manyMallocs;
+
+  parseItemizations(persistentMemory, 2, 0, &fewAllocations, &fewMallocs);
+  mu_assert("expected both rows to be written", rowsWritten == 2);
+  parseItemizations(persistentMemory, 1000, 0, &manyAllocations, &manyMallocs);
+  mu_assert("expected every row to be written", rowsWritten == 1000);
+
+  // Once both form types have been seen, rows reuse their mappings
+  // and output files
+  mu_assert("expected allocations not to grow with rows", manyAllocations == fewAllocations);
+  mu_assert("expected mallocs not to grow with rows", manyMallocs == fewMallocs);
+
+  freePersistentMemoryContext(persistentMemory);
+  return 0;
+}
+
+static char *testArena()
+{
+  ARENA *arena = newArena(64, NULL);
+  char *a = arenaStrdup(arena, "abc");
+  char *b = arenaStrndup(arena, "defgh", 2);
+  mu_assert("expected copies", strcmp(a, "abc") == 0 && strcmp(b, "de") == 0);
+  mu_assert("expected one chunk", arena->mallocs == 1);
+  mu_assert("expected aligned allocations", ((size_t)b % 16) == 0);
+
+  // Allocations bigger than a chunk get their own, and the current
+  // chunk keeps being used
+  char *big = arenaAlloc(arena, 1000);
+  memset(big, 'x', 1000);
+  char *c = arenaStrdup(arena, "ghi");
+  mu_assert("expected a dedicated chunk", arena->mallocs == 2);
+  mu_assert("expected small allocations to share a chunk", c - b == 16);
+
+  char *grown = arenaGrow(arena, a, 4, 100);
+  mu_assert("expected grown allocation to be copied", strcmp(grown, "abc") == 0);
+  mu_assert("expected allocations to be counted", arena->allocations == 5);
+
+  freeArena(arena);
+  return 0;
+}
+
+static char *testAllocator()
+{
+  ALLOCATOR *allocator = newAllocator(NULL, NULL, NULL, NULL);
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(allocator);
+  size_t allocations, mallocs;
+  parseItemizations(persistentMemory, 10, 0, &allocations, &mallocs);
+
+  // Everything the context allocated went through the allocator and
+  // was returned to it
+  ALLOCATOR_STATS stats;
+  getAllocatorStats(allocator, &stats);
+  size_t persistentBytes = stats.bytesLive;
+  mu_assert("expected the persistent memory to be live", persistentBytes > 0);
+  mu_assert("expected the parse to have peaked higher", stats.bytesPeak > persistentBytes);
+  mu_assert("expected no failures", stats.failures == 0);
+
+  freePersistentMemoryContext(persistentMemory);
+  getAllocatorStats(allocator, &stats);
+  mu_assert("expected no live bytes", stats.bytesLive == 0);
+  mu_assert("expected every allocation to be freed", stats.allocations == stats.frees);
+
+  freeAllocator(allocator);
+  return 0;
+}
+
+static char *testPipelineAllocator()
+{
+  ALLOCATOR *allocator = newAllocator(NULL, NULL, NULL, NULL);
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(allocator);
+  size_t allocations, mallocs;
+  parseItemizations(persistentMemory, 5000, 1, &allocations, &mallocs);
+  mu_assert("expected every row to be written", rowsWritten == 5000);
+
+  // The pipeline's memory went through the allocator too
+  mu_assert("expected no failures", allocator->stats.failures == 0);
+  freePersistentMemoryContext(persistentMemory);
+  mu_assert("expected no live bytes", allocator->stats.bytesLive == 0);
+  mu_assert("expected every allocation to be freed", allocator->stats.allocations == allocator->stats.frees);
+
+  freeAllocator(allocator);
+  return 0;
+}
+
+static char *testAllocatorLimit()
+{
+  ALLOCATOR *allocator = newAllocator(NULL, NULL, NULL, NULL);
+
+  // A row too long to fit within the limit
+  size_t rowLength = 1000000;
+  char *filing = malloc(strlen(filingHeader) + rowLength + 2);
+  strcpy(filing, filingHeader);
+  size_t headerLength = strlen(filing);
+  memset(filing + headerLength, 'x', rowLength);
+  strcpy(filing + headerLength + rowLength, "\n");
+
+  // (the pipeline's thread grows its lines through the allocator too)
+  for (int pipeline = 0; pipeline < 2; pipeline++)
+  {
+    PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(allocator);
+    FEC_CONTEXT *ctx = newFecContext(persistentMemory, NULL, 64, NULL, 64, countRow, 0, NULL, "1", NULL, 0, 1, 0, NULL);
+    setFecInputMemory(ctx, filing, strlen(filing));
+    setFecPipeline(ctx, pipeline);
+    allocator->stats.failures = 0;
+    allocator->stats.bytesPeak = allocator->stats.bytesLive;
+    // (room for the pipeline's batches, but not for the row)
+    setAllocatorLimit(allocator, allocator->stats.bytesLive + 800000);
+    mu_assert("expected the parse to fail", parseFec(ctx) == 0);
+    mu_assert("expected a failure to be counted", allocator->stats.failures > 0);
+    mu_assert("expected the limit to hold", allocator->stats.bytesPeak <= allocator->limit);
+    freeFecContext(ctx);
+
+    // The row fits without the limit
+    setAllocatorLimit(allocator, 0);
+    ctx = newFecContext(persistentMemory, NULL, 64, NULL, 64, countRow, 0, NULL, "1", NULL, 0, 1, 0, NULL);
+    setFecInputMemory(ctx, filing, strlen(filing));
+    setFecPipeline(ctx, pipeline);
+    mu_assert("expected the parse to succeed", parseFec(ctx) == 1);
+    freeFecContext(ctx);
+    freePersistentMemoryContext(persistentMemory);
+  }
+
+  mu_assert("expected no live bytes", allocator->stats.bytesLive == 0);
+  freeAllocator(allocator);
+  free(filing);
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testArena);
+  mu_run_test(testRowsDontAllocate);
+  mu_run_test(testAllocator);
+  mu_run_test(testPipelineAllocator);
+  mu_run_test(testAllocatorLimit);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nFEC tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
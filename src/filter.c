@@ -0,0 +1,196 @@
+#include "filter.h"
+#include <string.h>
+#include <strings.h>
+
+char *copyPrefix(ALLOCATOR *allocator, const char *str, int length)
+{
+  char *copy = (char *)allocatorMalloc(allocator, length + 1);
+  if (copy == NULL)
+  {
+    return NULL;
+  }
+  memcpy(copy, str, length);
+  copy[length] = 0;
+  return copy;
+}
+
+// Append a copy of the prefix, returning 0 if memory ran out
+int appendPrefix(ALLOCATOR *allocator, char ***prefixes, int *numPrefixes, const char *prefix, int length)
+{
+  char *copy = copyPrefix(allocator, prefix, length);
+  if (copy == NULL)
+  {
+    return 0;
+  }
+  char **grown = (char **)allocatorRealloc(allocator, *prefixes, sizeof(char *) * (*numPrefixes + 1));
+  if (grown == NULL)
+  {
+    allocatorFree(allocator, copy);
+    return 0;
+  }
+  grown[*numPrefixes] = copy;
+  *prefixes = grown;
+  (*numPrefixes)++;
+  return 1;
+}
+
+// Return the length of the prefix if str starts with it
+// (case-insensitively), or -1 otherwise
+int matchPrefix(const char *prefix, const char *str, int length)
+{
+  int prefixLength = strlen(prefix);
+  if (prefixLength > length || strncasecmp(prefix, str, prefixLength) != 0)
+  {
+    return -1;
+  }
+  return prefixLength;
+}
+
+FILTER *newFilter(ALLOCATOR *allocator)
+{
+  FILTER *filter = (FILTER *)allocatorMalloc(allocator, sizeof(FILTER));
+  if (filter == NULL)
+  {
+    return NULL;
+  }
+  filter->includeFormTypes = NULL;
+  filter->numIncludeFormTypes = 0;
+  filter->excludeFormTypes = NULL;
+  filter->numExcludeFormTypes = 0;
+  filter->columnSelections = NULL;
+  filter->numColumnSelections = 0;
+  filter->allocator = allocator;
+  return filter;
+}
+
+void freeColumnSelection(FILTER *filter, COLUMN_SELECTION *selection)
+{
+  for (int j = 0; j < selection->numColumns; j++)
+  {
+    allocatorFree(filter->allocator, selection->columns[j]);
+  }
+  allocatorFree(filter->allocator, selection->columns);
+  allocatorFree(filter->allocator, selection->formTypePrefix);
+}
+
+void freeFilter(FILTER *filter)
+{
+  for (int i = 0; i < filter->numIncludeFormTypes; i++)
+  {
+    allocatorFree(filter->allocator, filter->includeFormTypes[i]);
+  }
+  for (int i = 0; i < filter->numExcludeFormTypes; i++)
+  {
+    allocatorFree(filter->allocator, filter->excludeFormTypes[i]);
+  }
+  for (int i = 0; i < filter->numColumnSelections; i++)
+  {
+    freeColumnSelection(filter, &filter->columnSelections[i]);
+  }
+  allocatorFree(filter->allocator, filter->includeFormTypes);
+  allocatorFree(filter->allocator, filter->excludeFormTypes);
+  allocatorFree(filter->allocator, filter->columnSelections);
+  allocatorFree(filter->allocator, filter);
+}
+
+int filterIncludeFormType(FILTER *filter, const char *prefix)
+{
+  return appendPrefix(filter->allocator, &filter->includeFormTypes, &filter->numIncludeFormTypes, prefix, strlen(prefix));
+}
+
+int filterExcludeFormType(FILTER *filter, const char *prefix)
+{
+  return appendPrefix(filter->allocator, &filter->excludeFormTypes, &filter->numExcludeFormTypes, prefix, strlen(prefix));
+}
+
+int filterSelectColumns(FILTER *filter, const char *formTypePrefix, const char *columns)
+{
+  COLUMN_SELECTION selection;
+  selection.formTypePrefix = copyPrefix(filter->allocator, formTypePrefix, strlen(formTypePrefix));
+  selection.columns = NULL;
+  selection.numColumns = 0;
+  int ok = selection.formTypePrefix != NULL;
+
+  // Split the columns on commas
+  const char *start = columns;
+  while (ok)
+  {
+    const char *end = strchr(start, ',');
+    int length = end == NULL ? (int)strlen(start) : (int)(end - start);
+    if (length > 0)
+    {
+      ok = appendPrefix(filter->allocator, &selection.columns, &selection.numColumns, start, length);
+    }
+    if (end == NULL)
+    {
+      break;
+    }
+    start = end + 1;
+  }
+
+  COLUMN_SELECTION *selections = NULL;
+  if (ok)
+  {
+    selections = (COLUMN_SELECTION *)allocatorRealloc(filter->allocator, filter->columnSelections, sizeof(COLUMN_SELECTION) * (filter->numColumnSelections + 1));
+  }
+  if (selections == NULL)
+  {
+    freeColumnSelection(filter, &selection);
+    return 0;
+  }
+  filter->columnSelections = selections;
+  filter->columnSelections[filter->numColumnSelections] = selection;
+  filter->numColumnSelections++;
+  return 1;
+}
+
+int filterIncludesFormType(FILTER *filter, const char *formType, int length)
+{
+  for (int i = 0; i < filter->numExcludeFormTypes; i++)
+  {
+    if (matchPrefix(filter->excludeFormTypes[i], formType, length) >= 0)
+    {
+      return 0;
+    }
+  }
+  if (filter->numIncludeFormTypes == 0)
+  {
+    return 1;
+  }
+  for (int i = 0; i < filter->numIncludeFormTypes; i++)
+  {
+    if (matchPrefix(filter->includeFormTypes[i], formType, length) >= 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+COLUMN_SELECTION *filterColumnSelection(FILTER *filter, const char *formType, int length)
+{
+  COLUMN_SELECTION *best = NULL;
+  int bestLength = -1;
+  for (int i = 0; i < filter->numColumnSelections; i++)
+  {
+    int prefixLength = matchPrefix(filter->columnSelections[i].formTypePrefix, formType, length);
+    if (prefixLength > bestLength)
+    {
+      best = &filter->columnSelections[i];
+      bestLength = prefixLength;
+    }
+  }
+  return best;
+}
+
+int columnSelected(COLUMN_SELECTION *selection, const char *column, int length)
+{
+  for (int i = 0; i < selection->numColumns; i++)
+  {
+    if ((int)strlen(selection->columns[i]) == length && strncasecmp(selection->columns[i], column, length) == 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
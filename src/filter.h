@@ -0,0 +1,62 @@
+#pragma once
+
+#include "export.h"
+#include "allocator.h"
+
+// Columns to output for form types starting with a prefix
+struct column_selection
+{
+  char *formTypePrefix;
+  char **columns;
+  int numColumns;
+};
+typedef struct column_selection COLUMN_SELECTION;
+
+// A specification of which lines (by form type prefix) and which
+// columns of those lines (by header name) should be parsed and written.
+// Form type prefixes and column names are matched case-insensitively.
+struct filter
+{
+  // If any prefixes are included, only matching form types are parsed
+  char **includeFormTypes;
+  int numIncludeFormTypes;
+  // Form types matching any excluded prefix are never parsed
+  char **excludeFormTypes;
+  int numExcludeFormTypes;
+  COLUMN_SELECTION *columnSelections;
+  int numColumnSelections;
+  // Where the filter's memory comes from (NULL for the C library's)
+  ALLOCATOR *allocator;
+};
+typedef struct filter FILTER;
+
+// Create a filter allocated with the allocator (or the C library's if
+// it's NULL). Returns NULL if memory ran out.
+EXPORT FILTER *newFilter(ALLOCATOR *allocator);
+
+EXPORT void freeFilter(FILTER *filter);
+
+// Only parse lines whose form type starts with the prefix (can be
+// called multiple times to include multiple prefixes). Like the other
+// filter functions, returns 1, or 0 if memory ran out (leaving the
+// filter as it was).
+EXPORT int filterIncludeFormType(FILTER *filter, const char *prefix);
+
+// Skip lines whose form type starts with the prefix
+EXPORT int filterExcludeFormType(FILTER *filter, const char *prefix);
+
+// Only write the specified comma-separated columns for form types
+// starting with the prefix. If multiple prefixes match a form type,
+// the longest one is used.
+EXPORT int filterSelectColumns(FILTER *filter, const char *formTypePrefix, const char *columns);
+
+// Return whether lines with the given form type should be parsed
+int filterIncludesFormType(FILTER *filter, const char *formType, int length);
+
+// Return the column selection for the given form type, or NULL if
+// all of its columns should be written
+COLUMN_SELECTION *filterColumnSelection(FILTER *filter, const char *formType, int length);
+
+// Return whether the column selection includes the column with the
+// given header name
+int columnSelected(COLUMN_SELECTION *selection, const char *column, int length);
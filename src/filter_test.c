@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "filter.h"
+
+int tests_run = 0;
+
+static char *testFormTypeFiltering()
+{
+  // Everything is included by default
+  FILTER *filter = newFilter(NULL);
+  mu_assert("SA11AI should be included", filterIncludesFormType(filter, "SA11AI", 6));
+
+  // Included prefixes
+  filterIncludeFormType(filter, "SA");
+  filterIncludeFormType(filter, "sb2");
+  mu_assert("SA11AI should be included", filterIncludesFormType(filter, "SA11AI", 6));
+  mu_assert("SB21B should be included", filterIncludesFormType(filter, "SB21B", 5));
+  mu_assert("SB23 should be included", filterIncludesFormType(filter, "SB23", 4));
+  mu_assert("SB17 should be excluded", !filterIncludesFormType(filter, "SB17", 4));
+  mu_assert("F3X should be excluded", !filterIncludesFormType(filter, "F3X", 3));
+  // Only the specified length of the form type is matched
+  mu_assert("S should be excluded", !filterIncludesFormType(filter, "SA11AI", 1));
+
+  // Excluded prefixes take precedence
+  filterExcludeFormType(filter, "SB23");
+  mu_assert("SB23 should be excluded", !filterIncludesFormType(filter, "SB23", 4));
+  mu_assert("SB21B should still be included", filterIncludesFormType(filter, "SB21B", 5));
+
+  freeFilter(filter);
+  return 0;
+}
+
+static char *testColumnSelection()
+{
+  FILTER *filter = newFilter(NULL);
+  filterSelectColumns(filter, "S", "form_type");
+  filterSelectColumns(filter, "SA", "form_type,,Contribution_Amount");
+  mu_assert("F3X should have no selection", filterColumnSelection(filter, "F3X", 3) == NULL);
+
+  // The longest matching prefix is used
+  COLUMN_SELECTION *selection = filterColumnSelection(filter, "SA11AI", 6);
+  mu_assert("SA11AI should have a selection", selection != NULL);
+  mu_assert("SA11AI should use the SA selection", strcmp(selection->formTypePrefix, "SA") == 0);
+  mu_assert("empty column names should be skipped", selection->numColumns == 2);
+  mu_assert("form_type should be selected", columnSelected(selection, "form_type", 9));
+  mu_assert("contribution_amount should be selected", columnSelected(selection, "contribution_amount", 19));
+  mu_assert("contribution_date should not be selected", !columnSelected(selection, "contribution_date", 17));
+  mu_assert("prefixes of columns should not be selected", !columnSelected(selection, "form", 4));
+
+  selection = filterColumnSelection(filter, "SB23", 4);
+  mu_assert("SB23 should use the S selection", strcmp(selection->formTypePrefix, "S") == 0);
+
+  freeFilter(filter);
+  return 0;
+}
+
+static char *testAllocatorLimit()
+{
+  ALLOCATOR *allocator = newAllocator(NULL, NULL, NULL, NULL);
+  FILTER *filter = newFilter(allocator);
+  mu_assert("Expected a filter", filter != NULL);
+  mu_assert("Expected a selection", filterSelectColumns(filter, "SA", "form_type"));
+  setAllocatorLimit(allocator, allocator->stats.bytesLive + 16);
+
+  // Selections that run out of memory leave the filter as it was
+  mu_assert("Expected the selection to run out of memory", !filterSelectColumns(filter, "SB", "form_type,expenditure_amount"));
+  mu_assert("Expected the prefix to run out of memory", !filterIncludeFormType(filter, "SA11AI_and_a_long_suffix"));
+  mu_assert("Expected only the first selection", (filter->numColumnSelections == 1) && (filter->numIncludeFormTypes == 0));
+  mu_assert("SB23 should have no selection", filterColumnSelection(filter, "SB23", 4) == NULL);
+  setAllocatorLimit(allocator, 0);
+  mu_assert("Expected a selection once there's memory", filterSelectColumns(filter, "SB", "form_type"));
+
+  freeFilter(filter);
+  mu_assert("Expected every allocation to be freed", allocator->stats.bytesLive == 0);
+  freeAllocator(allocator);
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testFormTypeFiltering);
+  mu_run_test(testColumnSelection);
+  mu_run_test(testAllocatorLimit);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nFilter tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
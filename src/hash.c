@@ -0,0 +1,155 @@
+#include "hash.h"
+#include <string.h>
+
+// XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t rotateLeft(uint64_t value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Read little endian words regardless of alignment or host byte order
+static uint64_t read64(const unsigned char *bytes)
+{
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--)
+  {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+static uint32_t read32(const unsigned char *bytes)
+{
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t round64(uint64_t lane, uint64_t input)
+{
+  lane += input * PRIME2;
+  lane = rotateLeft(lane, 31);
+  return lane * PRIME1;
+}
+
+static uint64_t mergeRound(uint64_t hash, uint64_t lane)
+{
+  hash ^= round64(0, lane);
+  return hash * PRIME1 + PRIME4;
+}
+
+// Consume a 32 byte stripe
+static void hashStripe(uint64_t *lanes, const unsigned char *stripe)
+{
+  lanes[0] = round64(lanes[0], read64(stripe));
+  lanes[1] = round64(lanes[1], read64(stripe + 8));
+  lanes[2] = round64(lanes[2], read64(stripe + 16));
+  lanes[3] = round64(lanes[3], read64(stripe + 24));
+}
+
+void initHash(HASH_STATE *state, uint64_t seed)
+{
+  state->totalLength = 0;
+  state->lanes[0] = seed + PRIME1 + PRIME2;
+  state->lanes[1] = seed + PRIME2;
+  state->lanes[2] = seed;
+  state->lanes[3] = seed - PRIME1;
+  state->pendingLength = 0;
+  state->seed = seed;
+  state->ended = 0;
+}
+
+void updateHash(HASH_STATE *state, const void *input, size_t length)
+{
+  const unsigned char *bytes = (const unsigned char *)input;
+  state->totalLength += length;
+
+  if (state->pendingLength + length < 32)
+  {
+    memcpy(state->pending + state->pendingLength, bytes, length);
+    state->pendingLength += (int)length;
+    return;
+  }
+  if (state->pendingLength > 0)
+  {
+    // Complete the pending stripe
+    size_t fill = 32 - state->pendingLength;
+    memcpy(state->pending + state->pendingLength, bytes, fill);
+    hashStripe(state->lanes, state->pending);
+    bytes += fill;
+    length -= fill;
+    state->pendingLength = 0;
+  }
+  while (length >= 32)
+  {
+    hashStripe(state->lanes, bytes);
+    bytes += 32;
+    length -= 32;
+  }
+  memcpy(state->pending, bytes, length);
+  state->pendingLength = (int)length;
+}
+
+uint64_t digestHash(const HASH_STATE *state)
+{
+  uint64_t hash;
+  if (state->totalLength >= 32)
+  {
+    const uint64_t *lanes = state->lanes;
+    hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    hash = mergeRound(hash, lanes[0]);
+    hash = mergeRound(hash, lanes[1]);
+    hash = mergeRound(hash, lanes[2]);
+    hash = mergeRound(hash, lanes[3]);
+  }
+  else
+  {
+    hash = state->seed + PRIME5;
+  }
+  hash += state->totalLength;
+
+  // Mix in the bytes that don't fill a stripe
+  const unsigned char *bytes = state->pending;
+  int remaining = state->pendingLength;
+  while (remaining >= 8)
+  {
+    hash ^= round64(0, read64(bytes));
+    hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+    bytes += 8;
+    remaining -= 8;
+  }
+  if (remaining >= 4)
+  {
+    hash ^= (uint64_t)read32(bytes) * PRIME1;
+    hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+    bytes += 4;
+    remaining -= 4;
+  }
+  while (remaining > 0)
+  {
+    hash ^= (*bytes) * PRIME5;
+    hash = rotateLeft(hash, 11) * PRIME1;
+    bytes++;
+    remaining--;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+uint64_t hashBytes(const void *input, size_t length, uint64_t seed)
+{
+  HASH_STATE state;
+  initHash(&state, seed);
+  updateHash(&state, input, length);
+  return digestHash(&state);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A 64-bit XXH64 hash computed incrementally, so input can be hashed as
+// it's read. Digests match the reference XXH64 for the same bytes and
+// seed however the bytes are split across updates.
+struct hash_state
+{
+  uint64_t totalLength;
+  uint64_t lanes[4];
+  unsigned char pending[32]; // bytes not yet filling a stripe
+  int pendingLength;
+  uint64_t seed;
+  int ended; // whether the hashed input has been read to its end
+};
+typedef struct hash_state HASH_STATE;
+
+void initHash(HASH_STATE *state, uint64_t seed);
+
+void updateHash(HASH_STATE *state, const void *input, size_t length);
+
+// The hash of the bytes so far (the state can still be updated)
+uint64_t digestHash(const HASH_STATE *state);
+
+// Hash a block of bytes in one go
+uint64_t hashBytes(const void *input, size_t length, uint64_t seed);
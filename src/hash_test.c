@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "hash.h"
+#include "buffer.h"
+#include "memory.h"
+
+int tests_run = 0;
+
+static char *testReferenceHashes()
+{
+  // Reference XXH64 digests
+  mu_assert("Expected the hash of \"\"", hashBytes("", 0, 0) == 0xEF46DB3751D8E999ULL);
+  mu_assert("Expected the hash of \"a\"", hashBytes("a", 1, 0) == 0xD24EC4F1A98C6E5BULL);
+  mu_assert("Expected the hash of \"abc\"", hashBytes("abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+  const char *sentence = "Nobody inspects the spammish repetition";
+  mu_assert("Expected the hash of a sentence", hashBytes(sentence, strlen(sentence), 0) == 0xFBCEA83C8A378BF1ULL);
+  mu_assert("Expected seeds to change the hash", hashBytes("abc", 3, 1) != hashBytes("abc", 3, 0));
+
+  return 0;
+}
+
+static char *testIncrementalHashes()
+{
+  char input[300];
+  for (int i = 0; i < (int)sizeof(input); i++)
+  {
+    input[i] = (char)(i * 31 + 7);
+  }
+
+  // However the input is split, the hash is the same
+  for (int length = 0; length <= (int)sizeof(input); length += 37)
+  {
+    uint64_t expected = hashBytes(input, length, 5);
+    for (int split = 1; split <= 65; split += 8)
+    {
+      HASH_STATE state;
+      initHash(&state, 5);
+      for (int i = 0; i < length; i += split)
+      {
+        updateHash(&state, input + i, i + split > length ? length - i : split);
+      }
+      mu_assert("Expected incremental hashes to match", digestHash(&state) == expected);
+    }
+  }
+
+  return 0;
+}
+
+const char *contents = "first line\nsecond line\nthird line, which is longer than a stripe\n";
+int contentsPos = 0;
+
+int contentsRead(char *buffer, int want)
+{
+  int remaining = strlen(contents) - contentsPos;
+  if (remaining < want)
+  {
+    want = remaining;
+  }
+  memcpy(buffer, contents + contentsPos, want);
+  contentsPos += want;
+  return want;
+}
+
+static char *testBufferHashing()
+{
+  contentsPos = 0;
+  BUFFER *buffer = newBuffer(5, (BufferRead)contentsRead, NULL);
+  STRING *s = newString(10);
+  HASH_STATE state;
+  initHash(&state, 0);
+  buffer->hash = &state;
+
+  // Input is hashed as lines are read
+  readLine(buffer, s, NULL);
+  mu_assert("Expected the input not to be read to the end", !state.ended);
+  while (readLine(buffer, s, NULL) > 0)
+  {
+  }
+  mu_assert("Expected the input to be read to the end", state.ended);
+  mu_assert("Expected the hash of the input", digestHash(&state) == hashBytes(contents, strlen(contents), 0));
+
+  freeBuffer(buffer);
+  freeString(s);
+
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testReferenceHashes);
+  mu_run_test(testIncrementalHashes);
+  mu_run_test(testBufferHashing);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nHash tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,297 @@
+#include "json.h"
+#include "csv.h"
+#include "cpu.h"
+#include <string.h>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+const char *HEX_DIGITS = "0123456789abcdef";
+
+char *NDJSON_ROWS = "rows";
+
+static inline int needsJsonEscape(unsigned char c)
+{
+  return (c < 0x20) || (c == '"') || (c == '\\');
+}
+
+int findJsonEscapeScalar(const char *str, int length)
+{
+  for (int i = 0; i < length; i++)
+  {
+    if (needsJsonEscape(str[i]))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+#ifdef CPU_X86
+__attribute__((target("sse2"))) int findJsonEscapeSse2(const char *str, int length)
+{
+  // Control characters are the bytes no greater than 0x1f (unsigned)
+  __m128i control = _mm_set1_epi8(0x1f);
+  __m128i quote = _mm_set1_epi8('"');
+  __m128i backslash = _mm_set1_epi8('\\');
+  int i = 0;
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+    __m128i escapes = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(block, control), control), _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)));
+    int matches = _mm_movemask_epi8(escapes);
+    if (matches != 0)
+    {
+      return i + __builtin_ctz(matches);
+    }
+  }
+  int found = findJsonEscapeScalar(str + i, length - i);
+  return found >= 0 ? i + found : -1;
+}
+
+__attribute__((target("avx2"))) int findJsonEscapeAvx2(const char *str, int length)
+{
+  __m256i control = _mm256_set1_epi8(0x1f);
+  __m256i quote = _mm256_set1_epi8('"');
+  __m256i backslash = _mm256_set1_epi8('\\');
+  int i = 0;
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+    __m256i escapes = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(block, control), control), _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)));
+    unsigned int matches = _mm256_movemask_epi8(escapes);
+    if (matches != 0)
+    {
+      return i + __builtin_ctz(matches);
+    }
+  }
+  int found = findJsonEscapeScalar(str + i, length - i);
+  return found >= 0 ? i + found : -1;
+}
+
+__attribute__((target("avx512f,avx512bw"))) int findJsonEscapeAvx512(const char *str, int length)
+{
+  __m512i control = _mm512_set1_epi8(0x1f);
+  __m512i quote = _mm512_set1_epi8('"');
+  __m512i backslash = _mm512_set1_epi8('\\');
+  for (int i = 0; i < length; i += 64)
+  {
+    // Masked loads don't touch the bytes past the end of the input
+    __mmask64 valid = length - i >= 64 ? ~0ULL : (1ULL << (length - i)) - 1;
+    __m512i block = _mm512_maskz_loadu_epi8(valid, str + i);
+    __mmask64 matches = _mm512_mask_cmple_epu8_mask(valid, block, control) | _mm512_mask_cmpeq_epi8_mask(valid, block, quote) | _mm512_mask_cmpeq_epi8_mask(valid, block, backslash);
+    if (matches != 0)
+    {
+      return i + __builtin_ctzll(matches);
+    }
+  }
+  return -1;
+}
+#endif
+
+FindJsonEscapeKernel findJsonEscapeKernel(int level)
+{
+#ifdef CPU_X86
+  switch (level)
+  {
+  case CPU_LEVEL_AVX512:
+    return findJsonEscapeAvx512;
+  case CPU_LEVEL_AVX2:
+    return findJsonEscapeAvx2;
+  case CPU_LEVEL_SSE2:
+    return findJsonEscapeSse2;
+  }
+#endif
+  return findJsonEscapeScalar;
+}
+
+// The kernel is picked on the first call, which replaces this one
+int findJsonEscapeFirstCall(const char *str, int length);
+static FindJsonEscapeKernel findJsonEscapeSelected = findJsonEscapeFirstCall;
+
+int findJsonEscapeFirstCall(const char *str, int length)
+{
+  // Racing threads all select the same kernel
+  FindJsonEscapeKernel kernel = findJsonEscapeKernel(cpuLevel());
+  __atomic_store_n(&findJsonEscapeSelected, kernel, __ATOMIC_RELAXED);
+  return kernel(str, length);
+}
+
+int findJsonEscape(const char *str, int length)
+{
+  return __atomic_load_n(&findJsonEscapeSelected, __ATOMIC_RELAXED)(str, length);
+}
+
+void writeJsonEscaped(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length)
+{
+  const char *end = str + length;
+  while (str < end)
+  {
+    int index = findJsonEscape(str, end - str);
+    if (index == -1)
+    {
+      // Nothing left to escape
+      writeN(context, filename, extension, (char *)str, end - str);
+      return;
+    }
+    // Write the run of characters that don't need escaping, then the
+    // escaped character
+    writeN(context, filename, extension, (char *)str, index);
+    unsigned char c = str[index];
+    str += index + 1;
+
+    if ((c == '"') || (c == '\\'))
+    {
+      char escaped[] = {'\\', c};
+      writeN(context, filename, extension, escaped, 2);
+    }
+    else if (c == '\n')
+    {
+      writeString(context, filename, extension, "\\n");
+    }
+    else if (c == '\r')
+    {
+      writeString(context, filename, extension, "\\r");
+    }
+    else if (c == '\t')
+    {
+      writeString(context, filename, extension, "\\t");
+    }
+    else
+    {
+      char escaped[] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0xf]};
+      writeN(context, filename, extension, escaped, 6);
+    }
+  }
+}
+
+void writeJsonString(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length)
+{
+  writeChar(context, filename, extension, '"');
+  writeJsonEscaped(context, filename, extension, str, length);
+  writeChar(context, filename, extension, '"');
+}
+
+int isDigit(char c)
+{
+  return (c >= '0') && (c <= '9');
+}
+
+// Return whether the characters form a number in JSON's grammar
+int isJsonNumber(const char *str, int length)
+{
+  int i = 0;
+  if ((i < length) && (str[i] == '-'))
+  {
+    i++;
+  }
+  // Integer part (no leading zeros)
+  if ((i < length) && (str[i] == '0'))
+  {
+    i++;
+  }
+  else if ((i < length) && isDigit(str[i]))
+  {
+    while ((i < length) && isDigit(str[i]))
+    {
+      i++;
+    }
+  }
+  else
+  {
+    return 0;
+  }
+  // Fraction
+  if ((i < length) && (str[i] == '.'))
+  {
+    i++;
+    if (!((i < length) && isDigit(str[i])))
+    {
+      return 0;
+    }
+    while ((i < length) && isDigit(str[i]))
+    {
+      i++;
+    }
+  }
+  // Exponent
+  if ((i < length) && ((str[i] == 'e') || (str[i] == 'E')))
+  {
+    i++;
+    if ((i < length) && ((str[i] == '+') || (str[i] == '-')))
+    {
+      i++;
+    }
+    if (!((i < length) && isDigit(str[i])))
+    {
+      return 0;
+    }
+    while ((i < length) && isDigit(str[i]))
+    {
+      i++;
+    }
+  }
+  return i == length;
+}
+
+void writeJsonValue(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length, char type)
+{
+  if (length == 0)
+  {
+    writeString(context, filename, extension, "null");
+  }
+  else if ((type == 'f') && isJsonNumber(str, length))
+  {
+    writeN(context, filename, extension, (char *)str, length);
+  }
+  else
+  {
+    writeJsonString(context, filename, extension, str, length);
+  }
+}
+
+// Read the next field of an outputted CSV line, returning 0 if there
+// are no fields left
+int readJsonCsvField(PARSE_CONTEXT *parseContext, int first)
+{
+  char c = parseContext->line->str[parseContext->position];
+  if (!first)
+  {
+    if (c != ',')
+    {
+      return 0;
+    }
+    advanceField(parseContext);
+  }
+  else if ((c == 0) || (c == '\n'))
+  {
+    return 0;
+  }
+  readCsvField(parseContext);
+  return 1;
+}
+
+void writeJsonObject(WRITE_CONTEXT *context, char *filename, const char *extension, STRING *headers, STRING *line, char *types)
+{
+  FIELD_INFO headerInfo = {.num_commas = 0, .num_quotes = 0};
+  PARSE_CONTEXT headerContext = {.line = headers, .fieldInfo = &headerInfo, .position = 0, .start = 0, .end = 0, .columnIndex = 0};
+  FIELD_INFO lineInfo = {.num_commas = 0, .num_quotes = 0};
+  PARSE_CONTEXT lineContext = {.line = line, .fieldInfo = &lineInfo, .position = 0, .start = 0, .end = 0, .columnIndex = 0};
+  int numTypes = types != NULL ? strlen(types) : 0;
+
+  writeChar(context, filename, extension, '{');
+  int first = 1;
+  while (readJsonCsvField(&headerContext, first) && readJsonCsvField(&lineContext, first))
+  {
+    if (!first)
+    {
+      writeChar(context, filename, extension, ',');
+    }
+    writeJsonString(context, filename, extension, headers->str + headerContext.start, headerContext.end - headerContext.start);
+    writeChar(context, filename, extension, ':');
+    char type = lineContext.columnIndex < numTypes ? types[lineContext.columnIndex] : 's';
+    writeJsonValue(context, filename, extension, line->str + lineContext.start, lineContext.end - lineContext.start, type);
+    first = 0;
+  }
+  writeChar(context, filename, extension, '}');
+}
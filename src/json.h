@@ -0,0 +1,37 @@
+#pragma once
+
+#include "memory.h"
+#include "writer.h"
+
+static const char ndjsonExtension[] = ".ndjson";
+
+// The name of the file NDJSON rows are written to (see setFecFormat)
+extern char *NDJSON_ROWS;
+
+// Return the index of the first character in the length bytes of str
+// that has to be escaped in a JSON string (a quote, a backslash or a
+// control character), or -1 if there isn't one. Runs the best kernel for
+// the processor (see cpu.h).
+int findJsonEscape(const char *str, int length);
+
+typedef int (*FindJsonEscapeKernel)(const char *str, int length);
+
+// The findJsonEscape kernel for a cpu level
+FindJsonEscapeKernel findJsonEscapeKernel(int level);
+
+// Write the characters escaped for the inside of a JSON string. Runs
+// between escaped characters are written in bulk.
+void writeJsonEscaped(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length);
+
+// Write the characters as a quoted JSON string, escaping them as needed
+void writeJsonString(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length);
+
+// Write a field as a JSON value of the specified type ('s', 'd' or 'f').
+// Empty fields are written as null and float fields as numbers when
+// they are valid JSON numbers; everything else is written as a string.
+void writeJsonValue(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length, char type);
+
+// Write an outputted CSV line as a JSON object keyed by the columns
+// of the CSV header row (types may be NULL if every column is a
+// string). Both lines are unescaped in place.
+void writeJsonObject(WRITE_CONTEXT *context, char *filename, const char *extension, STRING *headers, STRING *line, char *types);
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "memory.h"
+#include "writer.h"
+#include "json.h"
+#include "cpu.h"
+
+int tests_run = 0;
+
+static char *testJsonString()
+{
+  WRITE_CONTEXT context;
+  STRING *output = newString(8);
+  initializeLocalWriteContext(&context, output);
+
+  writeJsonString(&context, NULL, NULL, "abc", 3);
+  mu_assert("plain strings should be quoted", strcmp(output->str, "\"abc\"") == 0);
+
+  initializeLocalWriteContext(&context, output);
+  writeJsonString(&context, NULL, NULL, "a\"b\\c\nd\x1c", 8);
+  mu_assert("special characters should be escaped", strcmp(output->str, "\"a\\\"b\\\\c\\nd\\u001c\"") == 0);
+
+  initializeLocalWriteContext(&context, output);
+  writeJsonString(&context, NULL, NULL, "caf\xc3\xa9", 5);
+  mu_assert("utf-8 should be unchanged", strcmp(output->str, "\"caf\xc3\xa9\"") == 0);
+
+  freeString(output);
+  return 0;
+}
+
+static char *testFindJsonEscapeKernels()
+{
+  // Every kernel the processor supports should find the first character
+  // to escape at each position, including past whole blocks and in
+  // partial ones
+  const char escapes[] = {'"', '\\', '\n', 0, 0x1f};
+  char str[150];
+  for (int level = CPU_LEVEL_SCALAR; level <= detectCpuLevel(); level++)
+  {
+    FindJsonEscapeKernel kernel = findJsonEscapeKernel(level);
+    for (int length = 0; length <= (int)sizeof(str); length++)
+    {
+      // (spaces and bytes past ascii don't need escaping)
+      for (int i = 0; i < (int)sizeof(str); i++)
+      {
+        str[i] = i % 3 == 0 ? ' ' : i % 3 == 1 ? 'a' : (char)0xe9;
+      }
+      mu_assert("expected no escape", kernel(str, length) == -1);
+      for (int i = length - 1; i >= 0; i--)
+      {
+        str[i] = escapes[i % sizeof(escapes)];
+        mu_assert("expected the first escape", kernel(str, length) == i);
+      }
+      if (length < (int)sizeof(str))
+      {
+        // Escapes past the end are ignored
+        memset(str, 'a', sizeof(str));
+        str[length] = '"';
+        mu_assert("expected no escape within the length", kernel(str, length) == -1);
+      }
+    }
+  }
+  return 0;
+}
+
+static char *testJsonValue()
+{
+  WRITE_CONTEXT context;
+  STRING *output = newString(8);
+
+  initializeLocalWriteContext(&context, output);
+  writeJsonValue(&context, NULL, NULL, "", 0, 'f');
+  mu_assert("empty values should be null", strcmp(output->str, "null") == 0);
+
+  initializeLocalWriteContext(&context, output);
+  writeJsonValue(&context, NULL, NULL, "-12.50", 6, 'f');
+  mu_assert("floats should be numbers", strcmp(output->str, "-12.50") == 0);
+
+  initializeLocalWriteContext(&context, output);
+  writeJsonValue(&context, NULL, NULL, "12.", 3, 'f');
+  mu_assert("invalid numbers should be strings", strcmp(output->str, "\"12.\"") == 0);
+
+  initializeLocalWriteContext(&context, output);
+  writeJsonValue(&context, NULL, NULL, "123", 3, 's');
+  mu_assert("string values should be strings", strcmp(output->str, "\"123\"") == 0);
+
+  freeString(output);
+  return 0;
+}
+
+static char *testJsonObject()
+{
+  WRITE_CONTEXT context;
+  STRING *output = newString(8);
+  initializeLocalWriteContext(&context, output);
+
+  STRING *headers = fromString("form_type,name,amount,memo\n");
+  STRING *line = fromString("SA11AI,\"Doe, \"\"J\"\"\",10.00,\n");
+  writeJsonObject(&context, NULL, NULL, headers, line, "ssfs");
+  mu_assert("lines should be written as objects", strcmp(output->str, "{\"form_type\":\"SA11AI\",\"name\":\"Doe, \\\"J\\\"\",\"amount\":10.00,\"memo\":null}") == 0);
+
+  freeString(headers);
+  freeString(line);
+  freeString(output);
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testJsonString);
+  mu_run_test(testFindJsonEscapeKernels);
+  mu_run_test(testJsonValue);
+  mu_run_test(testJsonObject);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nJSON tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
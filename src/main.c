@@ -1,19 +1,49 @@
 #include "encoding.h"
 #include "fec.h"
 #include "cli.h"
+#include "json.h"
+#include "cache.h"
 #include <unistd.h>
 
 #define BUFFERSIZE 65536
+// The number of input buffers read ahead
+#define READ_AHEAD_SLOTS 4
+// Summaries only need the first few lines of a filing
+#define SUMMARY_BUFFERSIZE 4096
+
+// What a summary parse collects its lines into
+struct summary
+{
+  WRITE_CONTEXT json;
+  // The form types seen and the CSV header row of each
+  char **forms;
+  STRING **headers;
+  int numForms;
+  int numRecords;
+  // Whether memory ran out (the summary would be incomplete)
+  int outOfMemory;
+};
+typedef struct summary SUMMARY;
 
 void printUsage(char *argv[])
 {
-  fprintf(stderr, "\nUsage:\n    %s [flags] <id, file> [output directory=output] [override id]\nor: [some command] | %s [flags] <id> [output directory=output]\n", argv[0], argv[0]);
+  fprintf(stderr, "\nUsage:\n    %s [flags] <id, file> [output directory=output] [override id]\nor: [some command] | %s [flags] <id> [output directory=output]\nor: %s %s [%s<n>] [%s] <socket path>\nor: %s %s [%s<n>] [flags] <directory> [output directory=output]\nor: %s %s [%s<bytes>] [flags] <output directory> [file...]\n", argv[0], argv[0], argv[0], COMMAND_SERVE, FLAG_WORKERS, FLAG_SILENT, argv[0], COMMAND_WATCH, FLAG_WORKERS, argv[0], COMMAND_COMBINE, FLAG_ROTATE_SIZE);
   fprintf(stderr, "\nOptional flags:\n");
   fprintf(stderr, "  %s, -%c: include a filing_id column at the beginning of\n                        every output CSV\n", FLAG_FILING_ID, FLAG_FILING_ID_SHORT);
   fprintf(stderr, "  %s, -%c        : suppress all stdout messages\n\n", FLAG_SILENT, FLAG_SILENT_SHORT);
   fprintf(stderr, "  %s, -%c        : show warning messages\n\n", FLAG_WARN, FLAG_WARN_SHORT);
   fprintf(stderr, "  %s, -%c        : disable piped input\n\n", FLAG_DISABLE_STDIN, FLAG_DISABLE_STDIN_SHORT);
   fprintf(stderr, "  %s, -%c        : print URLs from docquery.fec.gov\n\n", FLAG_URL, FLAG_URL_SHORT);
+  fprintf(stderr, "  %s, -%c        : only parse the header and summary records,\n                        printing them as a JSON object\n\n", FLAG_SUMMARY, FLAG_SUMMARY_SHORT);
+  fprintf(stderr, "  %s, -%c        : only count the rows and bytes of each form type,\n                        printing them as a JSON object\n\n", FLAG_COUNT, FLAG_COUNT_SHORT);
+  fprintf(stderr, "  %s, -%c   : read the input ahead on a separate thread,\n                        overlapping reading with parsing\n\n", FLAG_READ_AHEAD, FLAG_READ_AHEAD_SHORT);
+  fprintf(stderr, "  %s, -%c     : read and decode, parse and write on separate\n                        threads\n\n", FLAG_PIPELINE, FLAG_PIPELINE_SHORT);
+  fprintf(stderr, "  %s, -%c      : (also combine) write each form type with the\n                        same columns across FEC versions\n\n", FLAG_UNIFIED, FLAG_UNIFIED_SHORT);
+  fprintf(stderr, "  %s<name>: (also combine) the format of the output files:\n                        csv (default), pgcopy (PostgreSQL binary\n                        COPY files, with their tables in schema.sql),\n                        ndjson (every row in rows.ndjson, or on\n                        stdout with an output directory of %s) or,\n                        if built with SQLite, sqlite (a table per\n                        form type in fec.sqlite)\n\n", FLAG_FORMAT, OUTPUT_STDOUT);
+  fprintf(stderr, "  %s<n>   : (serve, watch) how many filings to parse at once\n                        (default %d)\n\n", FLAG_WORKERS, SERVE_DEFAULT_WORKERS);
+  fprintf(stderr, "  %s<bytes>: (combine) start a new part of each combined\n                        file once it reaches the size, e.g. 1g\n\n", FLAG_ROTATE_SIZE);
+  fprintf(stderr, "  %s<dir>   : reuse the outputs of earlier parses of identical\n                        input from the cache directory, saving\n                        new outputs to it\n\n", FLAG_CACHE);
+  fprintf(stderr, "  %s<bytes>: the size of each input buffer, e.g. 1m\n                        (default 64k)\n\n", FLAG_BUFFER_SIZE);
 }
 
 void printUrl(CLI_CONTEXT *ctx, char *argv[])
@@ -26,6 +56,311 @@ void printUrl(CLI_CONTEXT *ctx, char *argv[])
   fprintf(stderr, "\n  curl %s | %s %s\n\n", ctx->fecUrl, argv[0], ctx->fecId);
 }
 
+// Copy a line into a new string, or NULL if memory ran out
+STRING *copySummaryLine(const char *line)
+{
+  STRING *copy = newString(strlen(line) + 1);
+  if (copy != NULL)
+  {
+    strcpy(copy->str, line);
+  }
+  return copy;
+}
+
+// Add a form type and its header row to the summary. Returns 0 if
+// memory ran out.
+int addSummaryForm(SUMMARY *summary, char *filename, char *line)
+{
+  char **forms = realloc(summary->forms, sizeof(char *) * (summary->numForms + 1));
+  if (forms == NULL)
+  {
+    return 0;
+  }
+  summary->forms = forms;
+  STRING **headers = realloc(summary->headers, sizeof(STRING *) * (summary->numForms + 1));
+  if (headers == NULL)
+  {
+    return 0;
+  }
+  summary->headers = headers;
+  char *form = malloc(strlen(filename) + 1);
+  STRING *header = copySummaryLine(line);
+  if ((form == NULL) || (header == NULL))
+  {
+    free(form);
+    if (header != NULL)
+    {
+      freeString(header);
+    }
+    return 0;
+  }
+  strcpy(form, filename);
+  summary->forms[summary->numForms] = form;
+  summary->headers[summary->numForms] = header;
+  summary->numForms++;
+  return 1;
+}
+
+// Collect each line of a summary parse into the summary JSON object
+void summaryLine(void *data, char *filename, char *line, char *types)
+{
+  SUMMARY *summary = (SUMMARY *)data;
+  if (summary->outOfMemory)
+  {
+    return;
+  }
+
+  // The first line written for each form type is its CSV header row
+  int form = 0;
+  while ((form < summary->numForms) && (strcmp(summary->forms[form], filename) != 0))
+  {
+    form++;
+  }
+  if (form == summary->numForms)
+  {
+    summary->outOfMemory = !addSummaryForm(summary, filename, line);
+    return;
+  }
+
+  // Both lines are unescaped in place, so parse copies
+  STRING *headers = copySummaryLine(summary->headers[form]->str);
+  STRING *row = copySummaryLine(line);
+  if ((headers == NULL) || (row == NULL))
+  {
+    summary->outOfMemory = 1;
+  }
+  else
+  {
+    if (strcmp(filename, "header") == 0)
+    {
+      writeString(&summary->json, NULL, NULL, ",\"header\":");
+    }
+    else
+    {
+      writeString(&summary->json, NULL, NULL, summary->numRecords == 0 ? ",\"summary\":[" : ",");
+      summary->numRecords++;
+    }
+    writeJsonObject(&summary->json, NULL, NULL, headers, row, types);
+  }
+  if (headers != NULL)
+  {
+    freeString(headers);
+  }
+  if (row != NULL)
+  {
+    freeString(row);
+  }
+}
+
+// Parse the header and summary records of a filing and print
+// them as a single line JSON object. Returns the parse result.
+int printSummary(PERSISTENT_MEMORY_CONTEXT *persistentMemory, CLI_CONTEXT *cli, FILE *handle)
+{
+  SUMMARY summary;
+  summary.forms = NULL;
+  summary.headers = NULL;
+  summary.numForms = 0;
+  summary.numRecords = 0;
+  summary.outOfMemory = 0;
+  STRING *json = newString(DEFAULT_STRING_SIZE);
+  if (json == NULL)
+  {
+    fprintf(stderr, "Out of memory summarizing the filing\n");
+    return 0;
+  }
+  initializeLocalWriteContext(&summary.json, json);
+  writeString(&summary.json, NULL, NULL, "{\"filing_id\":");
+  writeJsonString(&summary.json, NULL, NULL, cli->fecId, strlen(cli->fecId));
+
+  int fecParseResult = 0;
+  FEC_CONTEXT *fec = newFecContext(persistentMemory, ((BufferRead)(&readBuffer)), SUMMARY_BUFFERSIZE, NULL, BUFFERSIZE, NULL, 0, handle, cli->fecId, NULL, 0, 1, cli->warn, NULL);
+  if (fec == NULL)
+  {
+    // (newFecContext reported why)
+    freeString(json);
+    return 0;
+  }
+  if (setLineFunction(fec->writeContext, &summaryLine, &summary))
+  {
+    setFecSummary(fec, 1);
+    fecParseResult = parseFec(fec);
+  }
+  else
+  {
+    summary.outOfMemory = 1;
+  }
+  freeFecContext(fec);
+
+  if (summary.outOfMemory)
+  {
+    fprintf(stderr, "Out of memory summarizing the filing\n");
+    fecParseResult = 0;
+  }
+  if (fecParseResult)
+  {
+    writeString(&summary.json, NULL, NULL, summary.numRecords == 0 ? ",\"summary\":[]}" : "]}");
+    printf("%s\n", json->str);
+  }
+
+  for (int i = 0; i < summary.numForms; i++)
+  {
+    free(summary.forms[i]);
+    freeString(summary.headers[i]);
+  }
+  free(summary.forms);
+  free(summary.headers);
+  freeString(json);
+  return fecParseResult;
+}
+
+// The size of each input buffer
+int inputBufferSize(CLI_CONTEXT *cli)
+{
+  return cli->bufferSize > 0 ? cli->bufferSize : BUFFERSIZE;
+}
+
+// Count the rows and bytes of each form type in a filing and print
+// them as a single line JSON object. Returns the count result.
+int printCounts(PERSISTENT_MEMORY_CONTEXT *persistentMemory, CLI_CONTEXT *cli, FILE *handle)
+{
+  FEC_CONTEXT *fec = newFecContext(persistentMemory, ((BufferRead)(&readBuffer)), inputBufferSize(cli), NULL, BUFFERSIZE, NULL, 0, handle, cli->fecId, NULL, 0, 1, cli->warn, NULL);
+  if (fec == NULL)
+  {
+    return 0;
+  }
+  FORM_COUNTS *counts = newFormCounts(persistentMemory->allocator);
+  if (counts == NULL)
+  {
+    fprintf(stderr, "Out of memory counting forms\n");
+    freeFecContext(fec);
+    return 0;
+  }
+  // Read files in place where possible
+  if ((cli->piped || !mapBufferFile(fec->buffer, handle)) && cli->readAhead)
+  {
+    setFecReadAhead(fec, READ_AHEAD_SLOTS, inputBufferSize(cli));
+  }
+  int fecCountResult = countFec(fec, counts);
+  freeFecContext(fec);
+
+  if (fecCountResult)
+  {
+    WRITE_CONTEXT json;
+    initializeLocalWriteContext(&json, newString(DEFAULT_STRING_SIZE));
+    long long rows = 0;
+    long long bytes = 0;
+    char number[32];
+    writeString(&json, NULL, NULL, "{\"filing_id\":");
+    writeJsonString(&json, NULL, NULL, cli->fecId, strlen(cli->fecId));
+    writeString(&json, NULL, NULL, ",\"forms\":{");
+    for (int i = 0; i < counts->numCounts; i++)
+    {
+      FORM_COUNT *count = &counts->counts[i];
+      if (i > 0)
+      {
+        writeChar(&json, NULL, NULL, ',');
+      }
+      writeJsonString(&json, NULL, NULL, count->formType, strlen(count->formType));
+      sprintf(number, ":{\"rows\":%lld,", count->rows);
+      writeString(&json, NULL, NULL, number);
+      sprintf(number, "\"bytes\":%lld}", count->bytes);
+      writeString(&json, NULL, NULL, number);
+      rows += count->rows;
+      bytes += count->bytes;
+    }
+    sprintf(number, "},\"rows\":%lld,", rows);
+    writeString(&json, NULL, NULL, number);
+    sprintf(number, "\"bytes\":%lld}", bytes);
+    writeString(&json, NULL, NULL, number);
+    printf("%s\n", json.localBuffer->str);
+    freeString(json.localBuffer);
+  }
+
+  freeFormCounts(counts);
+  return fecCountResult;
+}
+
+// Parse a filing into output files, restoring them from the cache
+// instead if it has them (and saving them to the cache otherwise).
+// Returns the parse result.
+int parseFiling(PERSISTENT_MEMORY_CONTEXT *persistentMemory, CLI_CONTEXT *cli, FILE *handle)
+{
+  // Initialize FEC context
+  FEC_CONTEXT *fec = newFecContext(persistentMemory, ((BufferRead)(&readBuffer)), inputBufferSize(cli), NULL, BUFFERSIZE, NULL, 1, handle, cli->fecId, cli->outputDirectory, cli->includeFilingId, cli->silent, cli->warn, NULL);
+  if (fec == NULL)
+  {
+    return 0;
+  }
+  if ((cli->unified && !setFecUnified(fec, 1)) || !setFecFormat(fec, cli->format))
+  {
+    fprintf(stderr, "Out of memory creating a parsing context\n");
+    freeFecContext(fec);
+    return 0;
+  }
+  if (cli->toStdout)
+  {
+    setStreamOutput(fec->writeContext, stdout);
+  }
+
+  char key[CACHE_KEY_LENGTH + 1];
+  key[0] = 0;
+  uint64_t hash;
+  if (cli->cacheDirectory != NULL)
+  {
+    // Files are mapped so they can be hashed (and looked up) before
+    // parsing. Streamed input is hashed as it's parsed, so the outputs
+    // can be saved.
+    if (!cli->piped && mapBufferFile(fec->buffer, handle) && fecInputHash(fec, &hash))
+    {
+      cacheKey(key, hash, cli->fecId, cli->includeFilingId, cli->unified, cli->format);
+      if (restoreFromCache(cli->cacheDirectory, key, cli->outputDirectory, cli->fecId))
+      {
+        if (!cli->silent)
+        {
+          printf("Restored outputs from the cache\n");
+        }
+        freeFecContext(fec);
+        return 1;
+      }
+    }
+    else
+    {
+      setFecHashing(fec);
+    }
+  }
+  if (cli->readAhead)
+  {
+    setFecReadAhead(fec, READ_AHEAD_SLOTS, inputBufferSize(cli));
+  }
+  setFecPipeline(fec, cli->pipeline);
+
+  // Parse the fec file
+  int fecParseResult = parseFec(fec);
+
+  char **names = NULL;
+  int numNames = 0;
+  if ((cli->cacheDirectory != NULL) && fecParseResult)
+  {
+    if ((key[0] == 0) && fecInputHash(fec, &hash))
+    {
+      cacheKey(key, hash, cli->fecId, cli->includeFilingId, cli->unified, cli->format);
+    }
+    names = writtenFileNames(fec->writeContext, &numNames);
+  }
+  // Flush and close the output files
+  freeFecContext(fec);
+
+  if ((key[0] != 0) && (names != NULL) && !storeInCache(cli->cacheDirectory, key, cli->outputDirectory, cli->fecId, names, numNames))
+  {
+    fprintf(stderr, "Couldn't save the outputs to the cache\n");
+  }
+  if (names != NULL)
+  {
+    freeWrittenFileNames(names, numNames);
+  }
+  return fecParseResult;
+}
+
 int main(int argc, char *argv[])
 {
   // Determine whether the input is piped
@@ -54,6 +389,30 @@ int main(int argc, char *argv[])
     exit(1);
   }
 
+  // Serve parse requests until interrupted
+  if (cli->serve)
+  {
+    int status = serveFilings(cli->socketPath, cli->workers, cli->silent);
+    freeCliContext(cli);
+    return status;
+  }
+
+  // Parse filings as they're written to a directory until interrupted
+  if (cli->watch)
+  {
+    int status = watchFilings(cli->watchDirectory, cli->outputDirectory, cli->workers, cli->includeFilingId, cli->silent, cli->warn);
+    freeCliContext(cli);
+    return status;
+  }
+
+  // Parse many filings into shared per-form-type outputs
+  if (cli->combine)
+  {
+    int status = combineFilings(cli->outputDirectory, cli->combinePaths, cli->numCombinePaths, cli->rotateSize, cli->unified, cli->format, cli->silent, cli->warn);
+    freeCliContext(cli);
+    return status;
+  }
+
   // Print docquery URLs and exit (successfully)
   if (cli->printUrl)
   {
@@ -61,6 +420,13 @@ int main(int argc, char *argv[])
     exit(0);
   }
 
+  // Summary and count modes (and output to stdout) print JSON to stdout,
+  // so no other messages
+  if (cli->summary || cli->count || cli->toStdout)
+  {
+    cli->silent = 1;
+  }
+
   // Run the program
   if (!cli->silent)
   {
@@ -90,17 +456,22 @@ int main(int argc, char *argv[])
   }
 
   // Initialize persistent memory context
-  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext();
-  // Initialize FEC context
-  FEC_CONTEXT *fec = newFecContext(persistentMemory, ((BufferRead)(&readBuffer)), BUFFERSIZE, NULL, BUFFERSIZE, NULL, 1, handle, cli->fecId, cli->outputDirectory, cli->includeFilingId, cli->silent, cli->warn);
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(NULL);
 
-  // Parse the fec file
-  int fecParseResult = parseFec(fec);
-
-  // Clear up memory
-  freeFecContext(fec);
-  freePersistentMemoryContext(persistentMemory);
-  freeCliContext(cli);
+  int fecParseResult;
+  if (cli->summary)
+  {
+    fecParseResult = printSummary(persistentMemory, cli, handle);
+  }
+  else if (cli->count)
+  {
+    fecParseResult = printCounts(persistentMemory, cli, handle);
+  }
+  else
+  {
+    fecParseResult = parseFiling(persistentMemory, cli, handle);
+  }
+  int silent = cli->silent;
 
   // Close file handles
   if (!cli->piped)
@@ -108,13 +479,17 @@ int main(int argc, char *argv[])
     fclose(handle);
   }
 
+  // Clear up memory
+  freePersistentMemoryContext(persistentMemory);
+  freeCliContext(cli);
+
   if (!fecParseResult)
   {
     fprintf(stderr, "Parsing FEC failed\n");
     return 3;
   }
 
-  if (!cli->silent)
+  if (!silent)
   {
     printf("Done; parsing successful!\n");
   }
@@ -5,3 +5,4 @@
 // Functions to operate on mappings
 static int numHeaders = sizeof(headers) / sizeof(headers[0]);
 static int numTypes = sizeof(types) / sizeof(types[0]);
+static int numUnifiedHeaders = sizeof(unifiedHeaders) / sizeof(unifiedHeaders[0]);
@@ -5,9 +5,24 @@ const size_t DEFAULT_STRING_SIZE = 256;
 
 STRING *newString(size_t size)
 {
-  STRING *s = malloc(sizeof(STRING));
-  s->str = malloc(size);
+  return newAllocatedString(NULL, size);
+}
+
+STRING *newAllocatedString(ALLOCATOR *allocator, size_t size)
+{
+  STRING *s = allocatorMalloc(allocator, sizeof(STRING));
+  if (s == NULL)
+  {
+    return NULL;
+  }
+  s->str = allocatorMalloc(allocator, size);
+  if (s->str == NULL)
+  {
+    allocatorFree(allocator, s);
+    return NULL;
+  }
   s->n = size;
+  s->allocator = allocator;
   return s;
 }
 
@@ -26,31 +41,29 @@ void setString(STRING *s, const char *str)
 
 void freeString(STRING *s)
 {
-  free(s->str);
-  free(s);
+  allocatorFree(s->allocator, s->str);
+  allocatorFree(s->allocator, s);
 }
 
 int growStringTo(STRING *str, size_t newSize)
 {
-  // Grow the size
-  if (newSize > str->n)
-  {
-    str->n = newSize;
-  }
-  else
+  if (newSize <= str->n)
   {
     // No need to reallocate
     return 1;
   }
 
   // Reallocate the space
-  str->str = realloc(str->str, str->n);
+  char *grown = allocatorRealloc(str->allocator, str->str, newSize);
 
-  // Check if the reallocation failed
-  if (str->str == 0)
+  // Check if the reallocation failed (the string is left as it was)
+  if (grown == NULL)
   {
+    fprintf(stderr, "Out of memory growing a string to %zu bytes\n", newSize);
     return 0;
   }
+  str->str = grown;
+  str->n = newSize;
   return 1;
 }
 
@@ -60,27 +73,32 @@ int growString(STRING *str)
   return growStringTo(str, str->n * 2);
 }
 
-void copyString(STRING *src, STRING *dst)
+int copyString(STRING *src, STRING *dst)
 {
   // Check if dst has enough space
-  growStringTo(dst, src->n + 1);
+  if (!growStringTo(dst, src->n + 1))
+  {
+    return 0;
+  }
   // Copy the strings
   strcpy(dst->str, src->str);
+  return 1;
 }
 
-PERSISTENT_MEMORY_CONTEXT *newPersistentMemoryContext()
+PERSISTENT_MEMORY_CONTEXT *newPersistentMemoryContext(ALLOCATOR *allocator)
 {
-  PERSISTENT_MEMORY_CONTEXT *ctx = malloc(sizeof(PERSISTENT_MEMORY_CONTEXT));
-  ctx->rawLine = newString(DEFAULT_STRING_SIZE);
-  ctx->line = newString(DEFAULT_STRING_SIZE);
-  ctx->bufferLine = newString(DEFAULT_STRING_SIZE);
+  PERSISTENT_MEMORY_CONTEXT *ctx = allocatorMalloc(allocator, sizeof(PERSISTENT_MEMORY_CONTEXT));
+  ctx->allocator = allocator;
+  ctx->rawLine = newAllocatedString(allocator, DEFAULT_STRING_SIZE);
+  ctx->line = newAllocatedString(allocator, DEFAULT_STRING_SIZE);
+  ctx->bufferLine = newAllocatedString(allocator, DEFAULT_STRING_SIZE);
 
   // Initialize all regular expressions
-  ctx->headerVersions = malloc(sizeof(pcre *) * numHeaders);
-  ctx->headerFormTypes = malloc(sizeof(pcre *) * numHeaders);
-  ctx->typeVersions = malloc(sizeof(pcre *) * numTypes);
-  ctx->typeFormTypes = malloc(sizeof(pcre *) * numTypes);
-  ctx->typeHeaders = malloc(sizeof(pcre *) * numTypes);
+  ctx->headerVersions = allocatorMalloc(allocator, sizeof(pcre *) * numHeaders);
+  ctx->headerFormTypes = allocatorMalloc(allocator, sizeof(pcre *) * numHeaders);
+  ctx->typeVersions = allocatorMalloc(allocator, sizeof(pcre *) * numTypes);
+  ctx->typeFormTypes = allocatorMalloc(allocator, sizeof(pcre *) * numTypes);
+  ctx->typeHeaders = allocatorMalloc(allocator, sizeof(pcre *) * numTypes);
 
   // Iterate and initialize all header regexes
   const char *error;
@@ -146,11 +164,11 @@ void freePersistentMemoryContext(PERSISTENT_MEMORY_CONTEXT *context)
     pcre_free(context->typeFormTypes[i]);
     pcre_free(context->typeHeaders[i]);
   }
-  free(context->headerVersions);
-  free(context->headerFormTypes);
-  free(context->typeVersions);
-  free(context->typeFormTypes);
-  free(context->typeHeaders);
+  allocatorFree(context->allocator, context->headerVersions);
+  allocatorFree(context->allocator, context->headerFormTypes);
+  allocatorFree(context->allocator, context->typeVersions);
+  allocatorFree(context->allocator, context->typeFormTypes);
+  allocatorFree(context->allocator, context->typeHeaders);
 
-  free(context);
+  allocatorFree(context->allocator, context);
 }
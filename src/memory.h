@@ -5,17 +5,21 @@
 #include "pcre/pcre.h"
 #include "export.h"
 #include "mappings.h"
+#include "allocator.h"
 
 extern const size_t DEFAULT_STRING_SIZE;
 struct string_type
 {
   char *str;
   size_t n;
+  ALLOCATOR *allocator; // NULL for the C library's
 };
 typedef struct string_type STRING;
 
 STRING *newString(size_t size);
 
+STRING *newAllocatedString(ALLOCATOR *allocator, size_t size);
+
 STRING *fromString(const char *);
 
 void setString(STRING *s, const char *str);
@@ -27,12 +31,16 @@ int growString(STRING *str);
 
 // Grow the string to the specified size.
 // If the new size is less than the old size, keep the old size.
+// Return 0 (leaving the string unchanged) if memory is exhausted.
 int growStringTo(STRING *str, size_t newSize);
 
-void copyString(STRING *src, STRING *dst);
+// Return 0 if dst couldn't be grown to fit src
+int copyString(STRING *src, STRING *dst);
 
 struct persistent_memory_context
 {
+  ALLOCATOR *allocator;
+
   STRING *rawLine;
   STRING *line;
   STRING *bufferLine;
@@ -45,6 +53,8 @@ struct persistent_memory_context
 };
 typedef struct persistent_memory_context PERSISTENT_MEMORY_CONTEXT;
 
-EXPORT PERSISTENT_MEMORY_CONTEXT *newPersistentMemoryContext();
+// Create the memory shared by parses. Allocations go through the
+// allocator (or the C library's if it's NULL).
+EXPORT PERSISTENT_MEMORY_CONTEXT *newPersistentMemoryContext(ALLOCATOR *allocator);
 
 EXPORT void freePersistentMemoryContext(PERSISTENT_MEMORY_CONTEXT *context);
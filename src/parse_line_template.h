@@ -0,0 +1,161 @@
+// Template for a parseLine loop specialized for one kind of delimiter
+// (see parseLine in fec.c). Define the following before including:
+//
+//   PARSE_LINE_NAME: the name of the generated function
+//   PARSE_ASCII28: 1 if lines are ascii28 delimited, 0 for CSV
+//   READ_FIELD(ctx, parseContext): read the next field of the line
+//
+// It has no include guard since it is included once per specialization.
+
+int PARSE_LINE_NAME(FEC_CONTEXT *ctx, char *filename, int headerRow)
+{
+  // Parse fields
+  PARSE_CONTEXT parseContext;
+  FIELD_INFO fieldInfo;
+  initParseContext(ctx, &parseContext, &fieldInfo);
+
+  // Log the indices on the line where the form version is specified
+  int formStart;
+  int formEnd;
+
+  // Whether any column has been written on the row yet (to know
+  // whether a delimeter is needed)
+  int rowStarted = 0;
+
+  // Iterate through fields
+  while (!isParseDone(&parseContext))
+  {
+    READ_FIELD(ctx, &parseContext);
+    if (parseContext.columnIndex == 0)
+    {
+      // Set the form version to the first column
+      // (with whitespace removed)
+      stripWhitespace(&parseContext);
+      formStart = parseContext.start;
+      formEnd = parseContext.end;
+
+      // Skip the line if it's filtered out
+      if (!headerRow && (ctx->filter != NULL) && !filterIncludesFormType(ctx->filter, parseContext.line->str + formStart, formEnd - formStart))
+      {
+        return skipLine(ctx, parseContext.line->str + formStart, formEnd - formStart);
+      }
+
+      if (!lookupMappings(ctx, &parseContext, formStart, formEnd))
+      {
+        return 3;
+      }
+
+      // Set filename if null to form type
+      if (filename == NULL)
+      {
+        filename = ctx->formType;
+      }
+
+      // Write the rest of the line in bulk if it's simple enough
+      if (PARSE_ASCII28 && isSimpleLine(ctx, &parseContext))
+      {
+        startRow(ctx, filename);
+        rowStarted = 1;
+        parseContext.columnIndex = writeSimpleLine(ctx, filename, parseContext.position);
+        break;
+      }
+    }
+    else
+    {
+      // If column index is 1, then there are at least two columns
+      // and the line is fully specified, so write header/line info
+      if (parseContext.columnIndex == 1)
+      {
+        rowStarted = startRow(ctx, filename);
+      }
+
+      if (isColumnWritten(ctx, parseContext.columnIndex))
+      {
+        // Write delimeter
+        startColumn(ctx, filename, rowStarted);
+        rowStarted = 1;
+
+        // Get the type of the current field and write accordingly
+        char type;
+        if (parseContext.columnIndex < ctx->numFields)
+        {
+          // Ensure the column index is in bounds
+          type = ctx->types[parseContext.columnIndex];
+        }
+        else
+        {
+          // Warning: column exceeding row length
+          if (ctx->warn)
+          {
+            fprintf(stderr, "Unexpected column in %s (%d): ", ctx->formType, parseContext.columnIndex);
+            for (int i = parseContext.start; i < parseContext.end; i++)
+            {
+              fprintf(stderr, "%c", ctx->persistentMemory->line->str[i]);
+            }
+            fprintf(stderr, "\n");
+          }
+          // Default to string type
+          type = 's';
+        }
+
+        // Iterate possible types
+        if (type == 's')
+        {
+          // String
+          writeSubstr(ctx, filename, csvExtension, parseContext.start, parseContext.end, parseContext.fieldInfo);
+        }
+        else if (type == 'd')
+        {
+          // Date
+          writeDateField(ctx, filename, csvExtension, parseContext.start, parseContext.end, parseContext.fieldInfo);
+        }
+        else if (type == 'f')
+        {
+          // Float
+          writeFloatField(ctx, filename, csvExtension, parseContext.start, parseContext.end, parseContext.fieldInfo);
+        }
+        else
+        {
+          // Unknown type
+          fprintf(stderr, "Unknown type (%c) in %s\n", type, ctx->formType);
+          exit(1);
+        }
+      }
+    }
+
+    if (isParseDone(&parseContext))
+    {
+      break;
+    }
+    advanceField(&parseContext);
+  }
+
+  if (parseContext.columnIndex < 2)
+  {
+    // Fewer than two fields? The line isn't fully specified
+    return 0;
+  }
+
+  if (parseContext.columnIndex + 1 != ctx->numFields && !headerRow)
+  {
+    // Try to read F99 text
+    if (!parseF99Text(ctx, filename, isColumnWritten(ctx, parseContext.columnIndex + 1), rowStarted))
+    {
+      if (ctx->warn)
+      {
+        fprintf(stderr, "Warning: mismatched number of fields (%d vs %d) (%s)\nLine: %s\n", parseContext.columnIndex + 1, ctx->numFields, ctx->formType, parseContext.line->str);
+      }
+      // 2 indicates we won't grab the line again
+      endRow(ctx, filename);
+      return 2;
+    }
+  }
+
+  // Parsing successful
+  endRow(ctx, filename);
+  return 1;
+}
+
+#undef PARSE_LINE_NAME
+#undef PARSE_ASCII28
+#undef READ_FIELD
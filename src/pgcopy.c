@@ -0,0 +1,262 @@
+#include "pgcopy.h"
+#include "csv.h"
+#include <string.h>
+
+char *PGCOPY_SCHEMA = "schema";
+
+const char PGCOPY_TRAILER[] = {(char)0xff, (char)0xff};
+
+// The signature, flags and header extension length of a binary COPY file
+const char PGCOPY_HEADER[] = {'P', 'G', 'C', 'O', 'P', 'Y', '\n', (char)0xff, '\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// The signs of numeric values
+#define PGCOPY_NUMERIC_POSITIVE 0x0000
+#define PGCOPY_NUMERIC_NEGATIVE 0x4000
+
+// Room for the numeric values of fields of up to a few hundred digits
+#define PGCOPY_NUMERIC_CAPACITY 512
+
+// Write integers in network byte order
+void pgCopyInt16(WRITE_CONTEXT *context, char *filename, const char *extension, int value)
+{
+  char bytes[] = {(char)(value >> 8), (char)value};
+  writeN(context, filename, extension, bytes, 2);
+}
+
+void pgCopyInt32(WRITE_CONTEXT *context, char *filename, const char *extension, int32_t value)
+{
+  char bytes[] = {(char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value};
+  writeN(context, filename, extension, bytes, 4);
+}
+
+void writePgCopyHeader(WRITE_CONTEXT *context, char *filename, const char *extension)
+{
+  writeN(context, filename, extension, (char *)PGCOPY_HEADER, sizeof(PGCOPY_HEADER));
+}
+
+void writePgCopyTuple(WRITE_CONTEXT *context, char *filename, const char *extension, int numFields)
+{
+  pgCopyInt16(context, filename, extension, numFields);
+}
+
+int pgCopyDate(const char *str, int length, int32_t *days)
+{
+  static const int monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if ((length != 10) || (str[4] != '-') || (str[7] != '-'))
+  {
+    return 0;
+  }
+  for (int i = 0; i < length; i++)
+  {
+    if ((i != 4) && (i != 7) && ((str[i] < '0') || (str[i] > '9')))
+    {
+      return 0;
+    }
+  }
+  int year = (str[0] - '0') * 1000 + (str[1] - '0') * 100 + (str[2] - '0') * 10 + (str[3] - '0');
+  int month = (str[5] - '0') * 10 + (str[6] - '0');
+  int day = (str[8] - '0') * 10 + (str[9] - '0');
+  int leap = (year % 4 == 0) && ((year % 100 != 0) || (year % 400 == 0));
+  if ((year == 0) || (month < 1) || (month > 12) || (day < 1) || (day > monthDays[month - 1] + ((month == 2) && leap)))
+  {
+    return 0;
+  }
+
+  // Count days in eras of 400 years starting on March 1st, so leap days
+  // fall at the end of years
+  // (http://howardhinnant.github.io/date_algorithms.html#days_from_civil)
+  int y = year - (month <= 2);
+  int era = y / 400;
+  int yearOfEra = y - era * 400;
+  int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  // (0000-03-01 is 730425 days before 2000-01-01)
+  *days = era * 146097 + dayOfEra - 730425;
+  return 1;
+}
+
+// Store an integer in network byte order
+void pgCopyStoreInt16(unsigned char *bytes, int value)
+{
+  bytes[0] = (unsigned char)(value >> 8);
+  bytes[1] = (unsigned char)value;
+}
+
+int pgCopyNumeric(const char *str, int length, unsigned char *bytes, int capacity)
+{
+  int i = 0;
+  int negative = (length > 0) && (str[0] == '-');
+  if (negative || ((length > 0) && (str[0] == '+')))
+  {
+    i++;
+  }
+  int integerStart = i;
+  while ((i < length) && (str[i] >= '0') && (str[i] <= '9'))
+  {
+    i++;
+  }
+  int integerEnd = i;
+  int fractionStart = i;
+  if ((i < length) && (str[i] == '.'))
+  {
+    fractionStart = ++i;
+    while ((i < length) && (str[i] >= '0') && (str[i] <= '9'))
+    {
+      i++;
+    }
+  }
+  int fractionEnd = i;
+  if ((i != length) || ((integerEnd == integerStart) && (fractionEnd == fractionStart)))
+  {
+    return -1;
+  }
+  while ((integerStart < integerEnd) && (str[integerStart] == '0'))
+  {
+    integerStart++;
+  }
+
+  // Digits are base 10000, grouped outwards from the decimal point
+  int integerDigits = integerEnd - integerStart;
+  int integerGroups = (integerDigits + 3) / 4;
+  int scale = fractionEnd - fractionStart;
+  int fractionGroups = (scale + 3) / 4;
+  if (8 + 2 * (integerGroups + fractionGroups) > capacity)
+  {
+    return -1;
+  }
+  unsigned char *digits = bytes + 8;
+  int numDigits = 0;
+  int position = integerStart;
+  for (int group = 0; group < integerGroups; group++)
+  {
+    // The first group holds the digits left over from whole groups
+    int groupLength = group == 0 ? integerDigits - (integerGroups - 1) * 4 : 4;
+    int value = 0;
+    for (int k = 0; k < groupLength; k++)
+    {
+      value = value * 10 + (str[position++] - '0');
+    }
+    pgCopyStoreInt16(digits + 2 * numDigits++, value);
+  }
+  for (int group = 0; group < fractionGroups; group++)
+  {
+    // The last group is padded with zeros
+    int value = 0;
+    for (int k = 0; k < 4; k++)
+    {
+      position = fractionStart + group * 4 + k;
+      value = value * 10 + (position < fractionEnd ? str[position] - '0' : 0);
+    }
+    pgCopyStoreInt16(digits + 2 * numDigits++, value);
+  }
+
+  // Strip zero digits from either end (which only moves the weight)
+  int weight = integerGroups - 1;
+  int first = 0;
+  while ((first < numDigits) && (digits[2 * first] == 0) && (digits[2 * first + 1] == 0))
+  {
+    first++;
+    weight--;
+  }
+  while ((numDigits > first) && (digits[2 * (numDigits - 1)] == 0) && (digits[2 * (numDigits - 1) + 1] == 0))
+  {
+    numDigits--;
+  }
+  numDigits -= first;
+  memmove(digits, digits + 2 * first, 2 * numDigits);
+  if (numDigits == 0)
+  {
+    // Zero (never negative)
+    weight = 0;
+    negative = 0;
+  }
+
+  pgCopyStoreInt16(bytes, numDigits);
+  pgCopyStoreInt16(bytes + 2, weight);
+  pgCopyStoreInt16(bytes + 4, negative ? PGCOPY_NUMERIC_NEGATIVE : PGCOPY_NUMERIC_POSITIVE);
+  pgCopyStoreInt16(bytes + 6, scale);
+  return 8 + 2 * numDigits;
+}
+
+int writePgCopyField(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length, char type)
+{
+  if (length == 0)
+  {
+    pgCopyInt32(context, filename, extension, -1);
+    return 1;
+  }
+  if (type == 'd')
+  {
+    int32_t days;
+    if (!pgCopyDate(str, length, &days))
+    {
+      pgCopyInt32(context, filename, extension, -1);
+      return 0;
+    }
+    pgCopyInt32(context, filename, extension, 4);
+    pgCopyInt32(context, filename, extension, days);
+    return 1;
+  }
+  if (type == 'f')
+  {
+    unsigned char numeric[PGCOPY_NUMERIC_CAPACITY];
+    int numericLength = pgCopyNumeric(str, length, numeric, sizeof(numeric));
+    if (numericLength < 0)
+    {
+      pgCopyInt32(context, filename, extension, -1);
+      return 0;
+    }
+    pgCopyInt32(context, filename, extension, numericLength);
+    writeN(context, filename, extension, (char *)numeric, numericLength);
+    return 1;
+  }
+  pgCopyInt32(context, filename, extension, length);
+  writeN(context, filename, extension, (char *)str, length);
+  return 1;
+}
+
+// Write a quoted SQL identifier
+void writePgCopyIdentifier(WRITE_CONTEXT *context, char *filename, const char *extension, const char *name, int length)
+{
+  writeChar(context, filename, extension, '"');
+  // (quotes are escaped by doubling them, as in CSV)
+  writeDoubledQuotes(context, filename, extension, (char *)name, length);
+  writeChar(context, filename, extension, '"');
+}
+
+void writePgCopyTable(WRITE_CONTEXT *context, char *filename, const char *extension, const char *table, int variant, const char *header, const char *types, int includeFilingId)
+{
+  // Tables are named like their files
+  char *name = (char *)allocatorMalloc(context->allocator, strlen(table) + 16);
+  if (name == NULL)
+  {
+    return;
+  }
+  strcpy(name, table);
+  normalize_filename(name);
+  if (variant > 1)
+  {
+    sprintf(name + strlen(name), ".%d", variant);
+  }
+  writeString(context, filename, extension, "CREATE TABLE IF NOT EXISTS ");
+  writePgCopyIdentifier(context, filename, extension, name, strlen(name));
+  writeString(context, filename, extension, " (");
+  allocatorFree(context->allocator, name);
+  if (includeFilingId)
+  {
+    writeString(context, filename, extension, "\n  \"filing_id\" text");
+  }
+
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, header, types);
+  while (nextHeaderColumn(&column))
+  {
+    writeString(context, filename, extension, (column.index > 0) || includeFilingId ? ",\n  " : "\n  ");
+    writeChar(context, filename, extension, '"');
+    writeDoubledQuotes(context, filename, extension, (char *)column.name, column.length);
+    writeString(context, filename, extension, column.suffix);
+    writeChar(context, filename, extension, '"');
+    writeString(context, filename, extension, column.type == 'd' ? " date" : column.type == 'f' ? " numeric" : " text");
+  }
+  writeString(context, filename, extension, "\n);\n");
+}
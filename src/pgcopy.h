@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "writer.h"
+
+// PostgreSQL binary COPY output (see
+// https://www.postgresql.org/docs/current/sql-copy.html#id-1.9.3.55.9.4)
+
+static const char pgcopyExtension[] = ".pgcopy";
+static const char sqlExtension[] = ".sql";
+
+// The name of the file the tables of binary COPY files are declared in
+extern char *PGCOPY_SCHEMA;
+
+// The trailer that ends every binary COPY file
+extern const char PGCOPY_TRAILER[];
+#define PGCOPY_TRAILER_LENGTH 2
+
+// Write the signature and header that start a binary COPY file
+void writePgCopyHeader(WRITE_CONTEXT *context, char *filename, const char *extension);
+
+// Write the start of a tuple with the number of fields
+void writePgCopyTuple(WRITE_CONTEXT *context, char *filename, const char *extension, int numFields);
+
+// Write a field as a value of the PostgreSQL type of its column type:
+// text for 's', date for 'd' (from YYYY-MM-DD) and numeric for 'f'.
+// Empty fields are written as NULL. Returns 1 if successful, or 0 if the
+// field couldn't be converted to its type (in which case it's written as
+// NULL).
+int writePgCopyField(WRITE_CONTEXT *context, char *filename, const char *extension, const char *str, int length, char type);
+
+// Convert a YYYY-MM-DD date into the number of days since 2000-01-01
+// (PostgreSQL's date epoch). Returns 1 if successful, 0 if it isn't a
+// valid date.
+int pgCopyDate(const char *str, int length, int32_t *days);
+
+// Encode a decimal number (e.g. -1234.50) as a binary numeric value into
+// bytes. Returns the length of the value, or -1 if it isn't a decimal
+// number or doesn't fit in capacity bytes.
+int pgCopyNumeric(const char *str, int length, unsigned char *bytes, int capacity);
+
+// Write a CREATE TABLE statement declaring the table of a binary COPY
+// file: named like the file (with the variant of combined output, see
+// setCombinedOutput), with the columns of the header row (of the types,
+// or text if NULL), preceded by a filing_id column if included. Repeated
+// column names are numbered from the second, e.g. name_2.
+void writePgCopyTable(WRITE_CONTEXT *context, char *filename, const char *extension, const char *table, int variant, const char *header, const char *types, int includeFilingId);
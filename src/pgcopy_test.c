@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "pgcopy.h"
+
+int tests_run = 0;
+
+static char *testDates()
+{
+  int32_t days;
+  mu_assert("Expected the epoch", pgCopyDate("2000-01-01", 10, &days) && (days == 0));
+  mu_assert("Expected a day after the epoch", pgCopyDate("2000-01-02", 10, &days) && (days == 1));
+  mu_assert("Expected a day before the epoch", pgCopyDate("1999-12-31", 10, &days) && (days == -1));
+  mu_assert("Expected a leap day", pgCopyDate("2020-02-29", 10, &days) && (days == 7364));
+  mu_assert("Expected the Unix epoch", pgCopyDate("1970-01-01", 10, &days) && (days == -10957));
+  mu_assert("Expected no leap day in 1900", !pgCopyDate("1900-02-29", 10, &days));
+  mu_assert("Expected no 13th month", !pgCopyDate("2020-13-01", 10, &days));
+  mu_assert("Expected no 31st of April", !pgCopyDate("2020-04-31", 10, &days));
+  mu_assert("Expected no year 0", !pgCopyDate("0000-01-01", 10, &days));
+  mu_assert("Expected digits", !pgCopyDate("20x0-01-01", 10, &days));
+  mu_assert("Expected dashes", !pgCopyDate("20200101", 8, &days));
+
+  return 0;
+}
+
+// Whether a number encodes as the big endian 16 bit words of a numeric
+static int numericIs(const char *number, const int *words, int numWords)
+{
+  unsigned char bytes[64];
+  if (pgCopyNumeric(number, strlen(number), bytes, sizeof(bytes)) != numWords * 2)
+  {
+    return 0;
+  }
+  for (int i = 0; i < numWords; i++)
+  {
+    if ((bytes[i * 2] != ((words[i] >> 8) & 0xff)) || (bytes[i * 2 + 1] != (words[i] & 0xff)))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static char *testNumerics()
+{
+  // Digit count, weight, sign and scale, then base 10000 digits
+  const int cents[] = {2, 0, 0, 2, 1234, 5000};
+  mu_assert("Expected 1234.50", numericIs("1234.50", cents, 6));
+  const int large[] = {3, 2, 0x4000, 2, 12, 3456, 7890};
+  mu_assert("Expected -1234567890.00", numericIs("-1234567890.00", large, 7));
+  const int fraction[] = {1, -1, 0, 2, 500};
+  mu_assert("Expected 0.05", numericIs("0.05", fraction, 5));
+  const int zero[] = {0, 0, 0, 2};
+  mu_assert("Expected 0.00", numericIs("0.00", zero, 4));
+  mu_assert("Expected -0.00 to be 0.00", numericIs("-0.00", zero, 4));
+  const int integer[] = {1, 1, 0, 0, 1};
+  mu_assert("Expected 10000", numericIs("10000", integer, 5));
+
+  unsigned char bytes[16];
+  mu_assert("Expected a number", pgCopyNumeric("1.2.3", 5, bytes, sizeof(bytes)) == -1);
+  mu_assert("Expected digits", pgCopyNumeric("-", 1, bytes, sizeof(bytes)) == -1);
+  mu_assert("Expected the number to fit", pgCopyNumeric("12345678901234567890", 20, bytes, sizeof(bytes)) == -1);
+
+  return 0;
+}
+
+static char *testFields()
+{
+  STRING *output = newString(10);
+  WRITE_CONTEXT context;
+  initializeLocalWriteContext(&context, output);
+
+  writePgCopyTuple(&context, NULL, NULL, 4);
+  mu_assert("Expected text", writePgCopyField(&context, NULL, NULL, "ab", 2, 's'));
+  mu_assert("Expected a date", writePgCopyField(&context, NULL, NULL, "2000-01-02", 10, 'd'));
+  mu_assert("Expected empty fields to be NULL", writePgCopyField(&context, NULL, NULL, "", 0, 'f'));
+  mu_assert("Expected an invalid date", !writePgCopyField(&context, NULL, NULL, "20000102", 8, 'd'));
+  const char expected[] = {0, 4, 0, 0, 0, 2, 'a', 'b', 0, 0, 0, 4, 0, 0, 0, 1, (char)0xff, (char)0xff, (char)0xff, (char)0xff, (char)0xff, (char)0xff, (char)0xff, (char)0xff};
+  mu_assert("Expected the tuple", (context.localBufferPosition == sizeof(expected)) && (memcmp(output->str, expected, sizeof(expected)) == 0));
+
+  freeString(output);
+  return 0;
+}
+
+static char *testTables()
+{
+  STRING *output = newString(10);
+  WRITE_CONTEXT context;
+  initializeLocalWriteContext(&context, output);
+
+  writePgCopyTable(&context, NULL, NULL, "SC/10", 2, "form_type,date,amount,amount", "sdff", 1);
+  mu_assert("Expected the table", strcmp(output->str, "CREATE TABLE IF NOT EXISTS \"SC-10.2\" (\n  \"filing_id\" text,\n  \"form_type\" text,\n  \"date\" date,\n  \"amount\" numeric,\n  \"amount_2\" numeric\n);\n") == 0);
+
+  freeString(output);
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testDates);
+  mu_run_test(testNumerics);
+  mu_run_test(testFields);
+  mu_run_test(testTables);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  printf("\nPostgreSQL binary COPY tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
@@ -0,0 +1,586 @@
+#include "pipeline.h"
+#include <string.h>
+
+// Batches in flight between the reading thread and the parser
+#define PIPELINE_BATCHES 8
+// Lines per batch (enough to make handing a batch over cheap relative
+// to decoding its lines)
+#define PIPELINE_BATCH_LINES 512
+// Starting size of each batch's data (grown to fit the lines)
+#define PIPELINE_BATCH_DATA 65536
+// File buffers in flight between the parser and the writing thread
+#define OUTPUT_CHUNKS 8
+// Times a side of a ring retries before sleeping (the usual wait is
+// short)
+#define RING_SPINS 64
+
+int initRing(SPSC_RING *ring, size_t capacity, ALLOCATOR *allocator)
+{
+  ring->items = (void **)allocatorMalloc(allocator, sizeof(void *) * capacity);
+  ring->capacity = capacity;
+  ring->allocator = allocator;
+  ring->head = 0;
+  ring->tail = 0;
+#ifdef PIPELINE_THREADS
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->changed, NULL);
+  ring->waiting = 0;
+#endif
+  return ring->items != NULL;
+}
+
+void freeRing(SPSC_RING *ring)
+{
+#ifdef PIPELINE_THREADS
+  pthread_cond_destroy(&ring->changed);
+  pthread_mutex_destroy(&ring->lock);
+#endif
+  allocatorFree(ring->allocator, ring->items);
+}
+
+int ringTryPush(SPSC_RING *ring, void *item)
+{
+  size_t head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->capacity)
+  {
+    return 0;
+  }
+  ring->items[head & (ring->capacity - 1)] = item;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int ringTryPop(SPSC_RING *ring, void **item)
+{
+  size_t tail = ring->tail;
+  if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+  {
+    return 0;
+  }
+  *item = ring->items[tail & (ring->capacity - 1)];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+#ifdef PIPELINE_THREADS
+// Whether the stop flag (if there is one) is set
+int ringStopped(int *stop)
+{
+  return (stop != NULL) && __atomic_load_n(stop, __ATOMIC_ACQUIRE);
+}
+
+// Wake whichever side of the ring is asleep (e.g. after setting the
+// stop flag it's waiting with)
+void ringWake(SPSC_RING *ring)
+{
+  pthread_mutex_lock(&ring->lock);
+  pthread_cond_broadcast(&ring->changed);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+// Wake the other side after pushing or popping, if it's asleep. (The
+// fence pairs with the one in ringSleep: either the sleeping side sees
+// the push or pop, or this side sees it waiting.)
+void ringSignal(SPSC_RING *ring)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED))
+  {
+    ringWake(ring);
+  }
+}
+
+// Sleep until the ring has room for a push (or an item to pop), or
+// stop gets set
+void ringSleep(SPSC_RING *ring, int push, int *stop)
+{
+  pthread_mutex_lock(&ring->lock);
+  __atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while (!ringStopped(stop))
+  {
+    size_t used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (push ? used < ring->capacity : used > 0)
+    {
+      break;
+    }
+    pthread_cond_wait(&ring->changed, &ring->lock);
+  }
+  __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+// Push an item, waiting while the ring is full. Returns 0 without
+// pushing if stop gets set while waiting.
+int ringPush(SPSC_RING *ring, void *item, int *stop)
+{
+  int spins = 0;
+  while (!ringTryPush(ring, item))
+  {
+    if (ringStopped(stop))
+    {
+      return 0;
+    }
+    if (spins < RING_SPINS)
+    {
+      spins++;
+    }
+    else
+    {
+      ringSleep(ring, 1, stop);
+    }
+  }
+  ringSignal(ring);
+  return 1;
+}
+
+// Pop an item into item, waiting while the ring is empty. Returns 0
+// without popping if stop gets set while waiting.
+int ringPop(SPSC_RING *ring, void **item, int *stop)
+{
+  int spins = 0;
+  while (!ringTryPop(ring, item))
+  {
+    if (ringStopped(stop))
+    {
+      return 0;
+    }
+    if (spins < RING_SPINS)
+    {
+      spins++;
+    }
+    else
+    {
+      ringSleep(ring, 0, stop);
+    }
+  }
+  ringSignal(ring);
+  return 1;
+}
+
+struct line_pipeline
+{
+  pthread_t thread;
+  BUFFER *buffer;
+  void *data;
+
+  SPSC_RING full;  // batches of lines, in input order, then NULL
+  SPSC_RING empty; // batches the parser is done with
+  LINE_BATCH batches[PIPELINE_BATCHES];
+
+  // The reading thread's raw and decoded lines
+  STRING *rawLine;
+  STRING *line;
+  // Allocates the lines and the batches' data, which the reading thread
+  // grows: through the buffer's allocator, which isn't synchronized, on
+  // the parser's thread (see forwardReallocate)
+  ALLOCATOR forward;
+  int running; // whether the reading thread is running
+
+  // The reallocation the reading thread is waiting for the parser to
+  // make, while requested is set
+  pthread_mutex_t lock;
+  pthread_cond_t answered;
+  int requested;
+  void *requestPtr;
+  size_t requestSize;
+  void *requestResult;
+
+  LINE_BATCH *current; // the batch the parser is taking lines from
+  int ended;           // whether the parser has taken the last line
+  int stop;            // whether the parser has gone away
+  int failed;          // whether memory ran out reading or decoding
+};
+
+// Reallocate memory of the forwarding allocator: directly until the
+// reading thread starts (or if the memory comes from the C library),
+// otherwise by asking the parser to and waiting for it. Returns NULL if
+// memory ran out or the parser stopped first.
+void *forwardReallocate(void *state, void *ptr, size_t size)
+{
+  LINE_PIPELINE *pipeline = (LINE_PIPELINE *)state;
+  if (!pipeline->running || (pipeline->buffer->allocator == NULL))
+  {
+    return allocatorRealloc(pipeline->buffer->allocator, ptr, size);
+  }
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->requestPtr = ptr;
+  pipeline->requestSize = size;
+  pipeline->requestResult = NULL;
+  __atomic_store_n(&pipeline->requested, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&pipeline->lock);
+  // (the parser answers as it waits for lines)
+  ringWake(&pipeline->full);
+
+  pthread_mutex_lock(&pipeline->lock);
+  while (__atomic_load_n(&pipeline->requested, __ATOMIC_ACQUIRE) && !__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE))
+  {
+    pthread_cond_wait(&pipeline->answered, &pipeline->lock);
+  }
+  void *result = pipeline->requested ? NULL : pipeline->requestResult;
+  pthread_mutex_unlock(&pipeline->lock);
+  return result;
+}
+
+void *forwardAllocate(void *state, size_t size)
+{
+  return forwardReallocate(state, NULL, size);
+}
+
+// (only called while the reading thread isn't running)
+void forwardFree(void *state, void *ptr)
+{
+  LINE_PIPELINE *pipeline = (LINE_PIPELINE *)state;
+  allocatorFree(pipeline->buffer->allocator, ptr);
+}
+
+// Make the reallocation the reading thread is waiting for
+void answerRequest(LINE_PIPELINE *pipeline)
+{
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->requestResult = allocatorRealloc(pipeline->buffer->allocator, pipeline->requestPtr, pipeline->requestSize);
+  __atomic_store_n(&pipeline->requested, 0, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&pipeline->answered);
+  pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Append the decoded line to a batch. Returns 0 if memory ran out.
+int appendLine(LINE_PIPELINE *pipeline, LINE_BATCH *batch, int length, LINE_INFO *info)
+{
+  if (batch->dataLength + length + 1 > batch->dataCapacity)
+  {
+    size_t capacity = batch->dataCapacity * 2;
+    while (batch->dataLength + length + 1 > capacity)
+    {
+      capacity *= 2;
+    }
+    char *data = (char *)allocatorRealloc(&pipeline->forward, batch->data, capacity);
+    if (data == NULL)
+    {
+      return 0;
+    }
+    batch->data = data;
+    batch->dataCapacity = capacity;
+  }
+  PIPELINE_LINE *entry = &batch->lines[batch->numLines++];
+  entry->offset = batch->dataLength;
+  entry->length = length;
+  entry->ascii28 = info->ascii28;
+  entry->quotesOrCommas = info->quotesOrCommas;
+  memcpy(batch->data + batch->dataLength, pipeline->line->str, length + 1);
+  batch->dataLength += length + 1;
+  return 1;
+}
+
+// Read and decode lines into batches until the input runs out or the
+// parser stops
+void *linePipelineThread(void *arg)
+{
+  LINE_PIPELINE *pipeline = (LINE_PIPELINE *)arg;
+
+  int atEnd = 0;
+  while (!atEnd)
+  {
+    LINE_BATCH *batch;
+    if (!ringPop(&pipeline->empty, (void **)&batch, &pipeline->stop))
+    {
+      break;
+    }
+    batch->dataLength = 0;
+    batch->numLines = 0;
+    batch->next = 0;
+    while (batch->numLines < PIPELINE_BATCH_LINES)
+    {
+      int bytesRead = readLine(pipeline->buffer, pipeline->rawLine, pipeline->data);
+      if (bytesRead <= 0)
+      {
+        if (bytesRead < 0)
+        {
+          __atomic_store_n(&pipeline->failed, 1, __ATOMIC_RELEASE);
+        }
+        atEnd = 1;
+        break;
+      }
+      LINE_INFO info;
+      int length = decodeLine(&info, pipeline->rawLine, pipeline->line);
+      // (lines only decode to nothing if memory ran out)
+      if ((length == 0) || !appendLine(pipeline, batch, length, &info))
+      {
+        __atomic_store_n(&pipeline->failed, 1, __ATOMIC_RELEASE);
+        atEnd = 1;
+        break;
+      }
+    }
+    if (((batch->numLines > 0) && !ringPush(&pipeline->full, batch, &pipeline->stop)) || __atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE))
+    {
+      break;
+    }
+  }
+  // Mark the end of the input (there's always room, as the ring holds
+  // every batch)
+  ringPush(&pipeline->full, NULL, NULL);
+  return NULL;
+}
+
+// Free the pipeline once its thread has finished (or if it never
+// started)
+void freeLinePipeline(LINE_PIPELINE *pipeline)
+{
+  ALLOCATOR *allocator = pipeline->buffer->allocator;
+  pipeline->running = 0;
+  for (int i = 0; i < PIPELINE_BATCHES; i++)
+  {
+    allocatorFree(&pipeline->forward, pipeline->batches[i].data);
+    allocatorFree(allocator, pipeline->batches[i].lines);
+  }
+  if (pipeline->rawLine != NULL)
+  {
+    freeString(pipeline->rawLine);
+  }
+  if (pipeline->line != NULL)
+  {
+    freeString(pipeline->line);
+  }
+  freeRing(&pipeline->full);
+  freeRing(&pipeline->empty);
+  pthread_cond_destroy(&pipeline->answered);
+  pthread_mutex_destroy(&pipeline->lock);
+  allocatorFree(allocator, pipeline);
+}
+#endif
+
+LINE_PIPELINE *startLinePipeline(BUFFER *buffer, void *data)
+{
+#ifdef PIPELINE_THREADS
+  // (input read some other way couldn't be interrupted to stop early)
+  if ((buffer->memory == NULL) && (buffer->readAhead == NULL))
+  {
+    return NULL;
+  }
+  ALLOCATOR *allocator = buffer->allocator;
+  LINE_PIPELINE *pipeline = (LINE_PIPELINE *)allocatorMalloc(allocator, sizeof(LINE_PIPELINE));
+  if (pipeline == NULL)
+  {
+    return NULL;
+  }
+  memset(pipeline, 0, sizeof(LINE_PIPELINE));
+  pipeline->buffer = buffer;
+  pipeline->data = data;
+  pipeline->forward.allocate = forwardAllocate;
+  pipeline->forward.reallocate = forwardReallocate;
+  pipeline->forward.free = forwardFree;
+  pipeline->forward.state = pipeline;
+  pthread_mutex_init(&pipeline->lock, NULL);
+  pthread_cond_init(&pipeline->answered, NULL);
+
+  // Everything is allocated here, before the reading thread starts
+  // Room for every batch plus the end marker
+  int ok = initRing(&pipeline->full, PIPELINE_BATCHES * 2, allocator);
+  ok = initRing(&pipeline->empty, PIPELINE_BATCHES, allocator) && ok;
+  pipeline->rawLine = newAllocatedString(&pipeline->forward, DEFAULT_STRING_SIZE);
+  pipeline->line = newAllocatedString(&pipeline->forward, DEFAULT_STRING_SIZE);
+  ok = ok && (pipeline->rawLine != NULL) && (pipeline->line != NULL);
+  for (int i = 0; ok && (i < PIPELINE_BATCHES); i++)
+  {
+    LINE_BATCH *batch = &pipeline->batches[i];
+    batch->data = (char *)allocatorMalloc(&pipeline->forward, PIPELINE_BATCH_DATA);
+    batch->dataCapacity = PIPELINE_BATCH_DATA;
+    batch->lines = (PIPELINE_LINE *)allocatorMalloc(allocator, sizeof(PIPELINE_LINE) * PIPELINE_BATCH_LINES);
+    ok = (batch->data != NULL) && (batch->lines != NULL) && ringTryPush(&pipeline->empty, batch);
+  }
+  if (!ok)
+  {
+    freeLinePipeline(pipeline);
+    return NULL;
+  }
+  pipeline->running = 1;
+  if (pthread_create(&pipeline->thread, NULL, linePipelineThread, pipeline) != 0)
+  {
+    freeLinePipeline(pipeline);
+    return NULL;
+  }
+  return pipeline;
+#else
+  return NULL;
+#endif
+}
+
+int nextPipelineLine(LINE_PIPELINE *pipeline, STRING *line, LINE_INFO *info)
+{
+#ifdef PIPELINE_THREADS
+  while ((pipeline->current == NULL) || (pipeline->current->next == pipeline->current->numLines))
+  {
+    if (pipeline->ended)
+    {
+      return 0;
+    }
+    if (pipeline->current != NULL)
+    {
+      // Hand the finished batch back to be refilled
+      ringPush(&pipeline->empty, pipeline->current, NULL);
+    }
+    // Make the reallocations the reading thread asks for while waiting
+    while (!ringPop(&pipeline->full, (void **)&pipeline->current, &pipeline->requested))
+    {
+      answerRequest(pipeline);
+    }
+    if (pipeline->current == NULL)
+    {
+      pipeline->ended = 1;
+      return __atomic_load_n(&pipeline->failed, __ATOMIC_ACQUIRE) ? -1 : 0;
+    }
+  }
+
+  PIPELINE_LINE *entry = &pipeline->current->lines[pipeline->current->next++];
+  if (!growStringTo(line, entry->length + 1))
+  {
+    return -1;
+  }
+  memcpy(line->str, pipeline->current->data + entry->offset, entry->length + 1);
+  info->ascii28 = entry->ascii28;
+  info->quotesOrCommas = entry->quotesOrCommas;
+  info->length = entry->length;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void stopLinePipeline(LINE_PIPELINE *pipeline)
+{
+#ifdef PIPELINE_THREADS
+  __atomic_store_n(&pipeline->stop, 1, __ATOMIC_RELEASE);
+  // Wake the reading thread wherever it waits for the parser
+  ringWake(&pipeline->empty);
+  ringWake(&pipeline->full);
+  pthread_mutex_lock(&pipeline->lock);
+  pthread_cond_broadcast(&pipeline->answered);
+  pthread_mutex_unlock(&pipeline->lock);
+  if (!pipeline->ended)
+  {
+    // Don't wait for input that will never be parsed (e.g. a pipe
+    // that's still open after the header failed to parse)
+    interruptReadAhead(pipeline->buffer);
+  }
+  pthread_join(pipeline->thread, NULL);
+  freeLinePipeline(pipeline);
+#endif
+}
+
+#ifdef PIPELINE_THREADS
+// A file buffer queued to be written out
+struct output_chunk
+{
+  char *filename;
+  const char *extension;
+  FILE *file;
+  char *buffer;
+  int length;
+};
+typedef struct output_chunk OUTPUT_CHUNK;
+
+struct output_stage
+{
+  pthread_t thread;
+  SPSC_RING queue; // chunks to write, in order, then NULL
+  SPSC_RING free;  // chunks that have been written
+  OUTPUT_CHUNK chunks[OUTPUT_CHUNKS];
+};
+
+// Write out queued chunks until the end marker
+void *outputStageThread(void *arg)
+{
+  WRITE_CONTEXT *context = (WRITE_CONTEXT *)arg;
+  OUTPUT_STAGE *stage = context->outputStage;
+  OUTPUT_CHUNK *chunk;
+  while (ringPop(&stage->queue, (void **)&chunk, NULL) && (chunk != NULL))
+  {
+    if (context->customWriteFunction != NULL)
+    {
+      context->customWriteFunction(chunk->filename, (char *)chunk->extension, chunk->buffer, chunk->length);
+    }
+    if (context->writeToFile)
+    {
+      fwrite(chunk->buffer, 1, chunk->length, chunk->file);
+    }
+    ringPush(&stage->free, chunk, NULL);
+  }
+  return NULL;
+}
+
+void freeOutputStage(WRITE_CONTEXT *context)
+{
+  OUTPUT_STAGE *stage = context->outputStage;
+  for (int i = 0; i < OUTPUT_CHUNKS; i++)
+  {
+    allocatorFree(context->allocator, stage->chunks[i].buffer);
+  }
+  freeRing(&stage->queue);
+  freeRing(&stage->free);
+  allocatorFree(context->allocator, stage);
+  context->outputStage = NULL;
+}
+#endif
+
+int startOutputStage(WRITE_CONTEXT *context)
+{
+#ifdef PIPELINE_THREADS
+  if ((context->outputStage != NULL) || context->lineOnly)
+  {
+    return 0;
+  }
+  OUTPUT_STAGE *stage = (OUTPUT_STAGE *)allocatorMalloc(context->allocator, sizeof(OUTPUT_STAGE));
+  if (stage == NULL)
+  {
+    return 0;
+  }
+  memset(stage, 0, sizeof(OUTPUT_STAGE));
+  context->outputStage = stage;
+  // Room for every chunk plus the end marker
+  int ok = initRing(&stage->queue, OUTPUT_CHUNKS * 2, context->allocator);
+  ok = initRing(&stage->free, OUTPUT_CHUNKS, context->allocator) && ok;
+  for (int i = 0; ok && (i < OUTPUT_CHUNKS); i++)
+  {
+    // Chunks swap buffers with the files, so they're all the same size
+    stage->chunks[i].buffer = allocatorMalloc(context->allocator, context->bufferSize);
+    ok = (stage->chunks[i].buffer != NULL) && ringTryPush(&stage->free, &stage->chunks[i]);
+  }
+  if (!ok || (pthread_create(&stage->thread, NULL, outputStageThread, context) != 0))
+  {
+    freeOutputStage(context);
+    return 0;
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void queueOutput(WRITE_CONTEXT *context, char *filename, const char *extension, FILE *file, BUFFER_FILE *bufferFile)
+{
+#ifdef PIPELINE_THREADS
+  OUTPUT_STAGE *stage = context->outputStage;
+  OUTPUT_CHUNK *chunk;
+  ringPop(&stage->free, (void **)&chunk, NULL);
+  chunk->filename = filename;
+  chunk->extension = extension;
+  chunk->file = file;
+  chunk->length = bufferFile->bufferPos;
+
+  // The chunk takes the full buffer and the file takes the chunk's
+  char *buffer = chunk->buffer;
+  chunk->buffer = bufferFile->buffer;
+  bufferFile->buffer = buffer;
+  bufferFile->bufferPos = 0;
+  ringPush(&stage->queue, chunk, NULL);
+#endif
+}
+
+void stopOutputStage(WRITE_CONTEXT *context)
+{
+#ifdef PIPELINE_THREADS
+  ringPush(&context->outputStage->queue, NULL, NULL);
+  pthread_join(context->outputStage->thread, NULL);
+  freeOutputStage(context);
+#endif
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include "buffer.h"
+#include "encoding.h"
+#include "writer.h"
+#if !defined(_WIN32) && !defined(__wasm__)
+#include <pthread.h>
+#define PIPELINE_THREADS
+#endif
+
+// A lock-free single producer, single consumer queue of pointers. The
+// producer and consumer indices are on separate cache lines so the two
+// threads don't contend for them. A side that has to wait spins briefly,
+// then sleeps until the other side signals it.
+struct spsc_ring
+{
+  void **items;
+  size_t capacity; // a power of two
+  ALLOCATOR *allocator;
+  char padHead[64];
+  size_t head; // the next item to push (written by the producer)
+  char padTail[64];
+  size_t tail; // the next item to pop (written by the consumer)
+  char padEnd[64];
+#ifdef PIPELINE_THREADS
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // signalled when a waiting side can go on
+  int waiting;            // whether a side is (about to be) asleep
+#endif
+};
+typedef struct spsc_ring SPSC_RING;
+
+// Initialize a ring holding up to capacity (a power of two) items,
+// allocated with the allocator. Returns 0 if memory ran out.
+int initRing(SPSC_RING *ring, size_t capacity, ALLOCATOR *allocator);
+
+void freeRing(SPSC_RING *ring);
+
+// Push an item, returning 0 if the ring is full (without waking the
+// consumer, so only for filling a ring before it's shared)
+int ringTryPush(SPSC_RING *ring, void *item);
+
+// Pop an item into item, returning 0 if the ring is empty
+int ringTryPop(SPSC_RING *ring, void **item);
+
+// A decoded line in a batch
+struct pipeline_line
+{
+  size_t offset; // where the line starts in the batch's data
+  int length;
+  int ascii28;
+  int quotesOrCommas;
+};
+typedef struct pipeline_line PIPELINE_LINE;
+
+// Consecutive lines of the input, decoded and packed together
+struct line_batch
+{
+  char *data;
+  size_t dataLength;
+  size_t dataCapacity;
+  PIPELINE_LINE *lines;
+  int numLines;
+  int next; // the next line the parser takes
+};
+typedef struct line_batch LINE_BATCH;
+
+// Reads and decodes lines on a separate thread, handing them to the
+// parser in batches (in order) through a ring. Emptied batches go back
+// to the reading thread through a second ring.
+typedef struct line_pipeline LINE_PIPELINE;
+
+// Start reading and decoding the rest of the buffer's input on a
+// separate thread, with data passed to its read function. Only input in
+// memory or read ahead is pipelined, so that stopping the pipeline
+// never waits on input. The buffer must not be read from any other way
+// until the pipeline is stopped.
+// The pipeline's memory comes from the buffer's allocator, which is
+// only called on this thread: lines and batches the reading thread
+// outgrows are regrown here, as the parser waits for lines. Returns
+// NULL if the input is read on demand, threads are unsupported on the
+// platform or memory ran out.
+LINE_PIPELINE *startLinePipeline(BUFFER *buffer, void *data);
+
+// Copy the next line into line, setting its info. Returns 1 if there
+// was a line, 0 if there are no lines left, or -1 if memory ran out
+// (reading or copying the line).
+int nextPipelineLine(LINE_PIPELINE *pipeline, STRING *line, LINE_INFO *info);
+
+// Stop reading (without waiting for the rest of the input) and free
+// the pipeline
+void stopLinePipeline(LINE_PIPELINE *pipeline);
+
+// Hand the write context's full file buffers to a separate thread that
+// writes them out (in order), so formatting overlaps with writing. The
+// custom write function, if any, is called from that thread. Returns 0
+// if threads are unsupported on the platform or memory ran out, in
+// which case buffers are written out as usual.
+int startOutputStage(WRITE_CONTEXT *context);
+
+// Queue a file buffer to be written out, giving the file an empty
+// buffer in its place
+void queueOutput(WRITE_CONTEXT *context, char *filename, const char *extension, FILE *file, BUFFER_FILE *bufferFile);
+
+// Wait for all queued output to be written, then free the stage
+void stopOutputStage(WRITE_CONTEXT *context);
@@ -0,0 +1,457 @@
+#include "serve.h"
+#include "compat.h"
+#include "json.h"
+#include <string.h>
+#if !defined(_WIN32) && !defined(__wasm__)
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SERVE_SOCKETS
+#endif
+
+// The size of the input and output buffers of each parse
+#define SERVE_BUFFER_SIZE 65536
+// The longest request header line
+#define SERVE_MAX_LINE 4096
+// How many connections can wait to be accepted
+#define SERVE_BACKLOG 64
+
+#ifdef SERVE_SOCKETS
+
+struct serve_request
+{
+  char *filingId;
+  char *outputDirectory; // ends with a directory separator
+  char *path;            // NULL if the filing is streamed
+  int includeFilingId;
+  int warn;
+  int pipeline;
+};
+typedef struct serve_request SERVE_REQUEST;
+
+struct serve_worker
+{
+  pthread_t thread;
+  int listener;
+  int *stopping;
+  // Reused by every parse the worker serves
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory;
+};
+typedef struct serve_worker SERVE_WORKER;
+
+void freeServeRequest(SERVE_REQUEST *request)
+{
+  free(request->filingId);
+  free(request->outputDirectory);
+  free(request->path);
+}
+
+// Replace a request field with a copy of value, adding a trailing
+// directory separator if separator is set. Returns 0 if memory ran out.
+int setRequestField(char **field, const char *value, int separator)
+{
+  size_t length = strlen(value);
+  int addSeparator = separator && ((length == 0) || (value[length - 1] != DIR_SEPARATOR_CHAR));
+  char *copy = malloc(length + addSeparator + 1);
+  if (copy == NULL)
+  {
+    return 0;
+  }
+  strcpy(copy, value);
+  if (addSeparator)
+  {
+    strcat(copy, DIR_SEPARATOR);
+  }
+  free(*field);
+  *field = copy;
+  return 1;
+}
+
+// Read a request's header lines. Returns NULL if successful, or why
+// the request is invalid.
+const char *readServeRequest(FILE *stream, SERVE_REQUEST *request)
+{
+  char line[SERVE_MAX_LINE];
+  while (1)
+  {
+    if (fgets(line, sizeof(line), stream) == NULL)
+    {
+      return "The request ended before its header did";
+    }
+    size_t length = strlen(line);
+    if ((length == sizeof(line) - 1) && (line[length - 1] != '\n'))
+    {
+      return "A request header line is too long";
+    }
+    while ((length > 0) && ((line[length - 1] == '\n') || (line[length - 1] == '\r')))
+    {
+      line[--length] = 0;
+    }
+    if (length == 0)
+    {
+      // The end of the header
+      break;
+    }
+
+    char *value = strchr(line, ' ');
+    if (value == NULL)
+    {
+      return "A request header line has no value";
+    }
+    *value++ = 0;
+    int set = 1;
+    if (strcmp(line, "filing_id") == 0)
+    {
+      set = setRequestField(&request->filingId, value, 0);
+    }
+    else if (strcmp(line, "output") == 0)
+    {
+      set = setRequestField(&request->outputDirectory, value, 1);
+    }
+    else if (strcmp(line, "path") == 0)
+    {
+      set = setRequestField(&request->path, value, 0);
+    }
+    else if (strcmp(line, "include_filing_id") == 0)
+    {
+      request->includeFilingId = strcmp(value, "0") != 0;
+    }
+    else if (strcmp(line, "warn") == 0)
+    {
+      request->warn = strcmp(value, "0") != 0;
+    }
+    else if (strcmp(line, "pipeline") == 0)
+    {
+      request->pipeline = strcmp(value, "0") != 0;
+    }
+    else
+    {
+      return "Unknown request header";
+    }
+    if (!set)
+    {
+      return "Out of memory";
+    }
+  }
+
+  if ((request->filingId == NULL) || (request->filingId[0] == 0))
+  {
+    return "The request has no filing_id";
+  }
+  if ((request->outputDirectory == NULL) && !setRequestField(&request->outputDirectory, "output", 1))
+  {
+    return "Out of memory";
+  }
+  return NULL;
+}
+
+// Parse the filing of a request, writing a successful response to
+// json. Returns NULL if successful, or why the parse failed.
+const char *parseServeRequest(SERVE_WORKER *worker, SERVE_REQUEST *request, FILE *stream, WRITE_CONTEXT *json)
+{
+  FEC_CONTEXT *fec = newFecContext(worker->persistentMemory, ((BufferRead)(&readBuffer)), SERVE_BUFFER_SIZE, NULL, SERVE_BUFFER_SIZE, NULL, 1, stream, request->filingId, request->outputDirectory, request->includeFilingId, 1, request->warn, NULL);
+  if (fec == NULL)
+  {
+    return "Out of memory";
+  }
+  if ((request->path != NULL) && !setFecInputPath(fec, request->path))
+  {
+    freeFecContext(fec);
+    return "Couldn't open the filing";
+  }
+  setFecPipeline(fec, request->pipeline);
+  if (!parseFec(fec))
+  {
+    freeFecContext(fec);
+    return "Couldn't parse the filing";
+  }
+
+  // List the files written, named the way the writer names them
+  writeString(json, NULL, NULL, "{\"status\":\"ok\",\"filing_id\":");
+  writeJsonString(json, NULL, NULL, request->filingId, strlen(request->filingId));
+  writeString(json, NULL, NULL, ",\"output\":");
+  size_t directoryLength = strlen(request->outputDirectory) + strlen(request->filingId) + 1;
+  char *directory = malloc(directoryLength + 1);
+  if (directory == NULL)
+  {
+    freeFecContext(fec);
+    return "Out of memory";
+  }
+  sprintf(directory, "%s%s%s", request->outputDirectory, request->filingId, DIR_SEPARATOR);
+  writeJsonString(json, NULL, NULL, directory, directoryLength);
+  writeString(json, NULL, NULL, ",\"files\":[");
+  WRITE_CONTEXT *output = fec->writeContext;
+  for (int i = 0; i < output->nfiles; i++)
+  {
+    char *path = malloc(directoryLength + strlen(output->filenames[i]) + strlen(output->extensions[i]) + 1);
+    if (path == NULL)
+    {
+      free(directory);
+      freeFecContext(fec);
+      return "Out of memory";
+    }
+    strcpy(path, directory);
+    strcat(path, output->filenames[i]);
+    normalize_filename(path + directoryLength);
+    strcat(path, output->extensions[i]);
+    if (i > 0)
+    {
+      writeChar(json, NULL, NULL, ',');
+    }
+    writeJsonString(json, NULL, NULL, path, strlen(path));
+    free(path);
+  }
+  writeString(json, NULL, NULL, "]}\n");
+  free(directory);
+
+  // Flush and close the files before responding
+  freeFecContext(fec);
+  return NULL;
+}
+
+// Send the whole response, giving up if the client has gone away
+void sendResponse(int client, WRITE_CONTEXT *json)
+{
+  const char *response = json->localBuffer->str;
+  size_t remaining = strlen(response);
+  while (remaining > 0)
+  {
+    ssize_t sent = write(client, response, remaining);
+    if (sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (sent <= 0)
+    {
+      return;
+    }
+    response += sent;
+    remaining -= sent;
+  }
+}
+
+void serveRequest(SERVE_WORKER *worker, int client)
+{
+  FILE *stream = fdopen(client, "rb");
+  STRING *response = newString(DEFAULT_STRING_SIZE);
+  if ((stream == NULL) || (response == NULL))
+  {
+    fprintf(stderr, "Out of memory serving a request\n");
+    if (response != NULL)
+    {
+      freeString(response);
+    }
+    if (stream != NULL)
+    {
+      fclose(stream);
+    }
+    else
+    {
+      close(client);
+    }
+    return;
+  }
+
+  SERVE_REQUEST request = {NULL, NULL, NULL, 0, 0, 0};
+  WRITE_CONTEXT json;
+  initializeLocalWriteContext(&json, response);
+  const char *error = readServeRequest(stream, &request);
+  if (error == NULL)
+  {
+    error = parseServeRequest(worker, &request, stream, &json);
+  }
+  if (error != NULL)
+  {
+    initializeLocalWriteContext(&json, response);
+    writeString(&json, NULL, NULL, "{\"status\":\"error\",\"filing_id\":");
+    if (request.filingId != NULL)
+    {
+      writeJsonString(&json, NULL, NULL, request.filingId, strlen(request.filingId));
+    }
+    else
+    {
+      writeString(&json, NULL, NULL, "null");
+    }
+    writeString(&json, NULL, NULL, ",\"error\":");
+    writeJsonString(&json, NULL, NULL, error, strlen(error));
+    writeString(&json, NULL, NULL, "}\n");
+  }
+  sendResponse(client, &json);
+  // Read what's left of the request before closing, so that a client
+  // still streaming a filing that failed gets the response instead of
+  // a reset connection
+  shutdown(client, SHUT_WR);
+  char discard[SERVE_MAX_LINE];
+  while (fread(discard, 1, sizeof(discard), stream) > 0)
+  {
+  }
+
+  freeServeRequest(&request);
+  freeString(response);
+  fclose(stream);
+}
+
+void *serveWorker(void *data)
+{
+  SERVE_WORKER *worker = (SERVE_WORKER *)data;
+  while (1)
+  {
+    int client = accept(worker->listener, NULL, NULL);
+    if (__atomic_load_n(worker->stopping, __ATOMIC_ACQUIRE))
+    {
+      if (client >= 0)
+      {
+        close(client);
+      }
+      break;
+    }
+    if (client < 0)
+    {
+      if ((errno == EINTR) || (errno == ECONNABORTED))
+      {
+        continue;
+      }
+      fprintf(stderr, "Couldn't accept a connection: %s\n", strerror(errno));
+      break;
+    }
+    serveRequest(worker, client);
+  }
+  return NULL;
+}
+
+// Stop the started workers once they finish their current requests
+void stopWorkers(SERVE_WORKER *workers, int started, struct sockaddr_un *address)
+{
+  __atomic_store_n(workers[0].stopping, 1, __ATOMIC_RELEASE);
+  // Wake each worker waiting to accept a connection with one of its own
+  for (int i = 0; i < started; i++)
+  {
+    int wake = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (wake >= 0)
+    {
+      connect(wake, (struct sockaddr *)address, sizeof(*address));
+      close(wake);
+    }
+  }
+  for (int i = 0; i < started; i++)
+  {
+    pthread_join(workers[i].thread, NULL);
+  }
+}
+
+int serveFilings(const char *socketPath, int workers, int silent)
+{
+  struct sockaddr_un address;
+  if (strlen(socketPath) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+    return 1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0)
+  {
+    fprintf(stderr, "Couldn't create a socket: %s\n", strerror(errno));
+    return 1;
+  }
+  // Replace a socket left behind by a server that didn't stop cleanly,
+  // but not one that's still serving
+  struct stat info;
+  if ((stat(socketPath, &info) == 0) && S_ISSOCK(info.st_mode))
+  {
+    if (connect(listener, (struct sockaddr *)&address, sizeof(address)) == 0)
+    {
+      fprintf(stderr, "Another server is listening on %s\n", socketPath);
+      close(listener);
+      return 1;
+    }
+    unlink(socketPath);
+  }
+  if ((bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0) || (listen(listener, SERVE_BACKLOG) != 0))
+  {
+    fprintf(stderr, "Couldn't listen on %s: %s\n", socketPath, strerror(errno));
+    close(listener);
+    return 1;
+  }
+
+  // Signals are only taken on this thread (workers inherit the mask),
+  // and a client hanging up shouldn't end the server
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  int status = 0;
+  int stopping = 0;
+  SERVE_WORKER *pool = (SERVE_WORKER *)calloc(workers, sizeof(SERVE_WORKER));
+  int started = 0;
+  while ((pool != NULL) && (started < workers))
+  {
+    SERVE_WORKER *worker = &pool[started];
+    worker->listener = listener;
+    worker->stopping = &stopping;
+    worker->persistentMemory = newPersistentMemoryContext(NULL);
+    if (worker->persistentMemory == NULL)
+    {
+      break;
+    }
+    if (pthread_create(&worker->thread, NULL, serveWorker, worker) != 0)
+    {
+      freePersistentMemoryContext(worker->persistentMemory);
+      break;
+    }
+    started++;
+  }
+
+  if (started < workers)
+  {
+    fprintf(stderr, "Couldn't start %d workers\n", workers);
+    status = 1;
+  }
+  else
+  {
+    if (!silent)
+    {
+      printf("Serving on %s with %d workers\n", socketPath, workers);
+      fflush(stdout);
+    }
+    int received;
+    sigwait(&signals, &received);
+    if (!silent)
+    {
+      printf("Stopping\n");
+    }
+  }
+
+  if (started > 0)
+  {
+    stopWorkers(pool, started, &address);
+  }
+  for (int i = 0; i < started; i++)
+  {
+    freePersistentMemoryContext(pool[i].persistentMemory);
+  }
+  free(pool);
+  close(listener);
+  unlink(socketPath);
+  return status;
+}
+
+#else
+
+int serveFilings(const char *socketPath, int workers, int silent)
+{
+  fprintf(stderr, "Serving isn't supported on this platform\n");
+  return 1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "fec.h"
+
+// The number of requests served at once by default
+#define SERVE_DEFAULT_WORKERS 4
+// The most workers that can be requested
+#define SERVE_MAX_WORKERS 256
+
+// Serve parse requests on a Unix domain socket at socketPath until
+// interrupted (SIGINT or SIGTERM), with a pool of workers threads that
+// each keep their persistent memory (and its compiled mappings) warm
+// across requests. Requests in progress are finished before returning.
+// Returns the exit status of the server.
+//
+// A request is a connection that sends header lines of the form
+// "<key> <value>", ended by an empty line:
+//
+//   filing_id <id>           (required) the filing ID
+//   output <directory>       where to write (default "output/")
+//   path <file>              parse this file; without it, the filing is
+//                            streamed after the empty line and ended by
+//                            shutting down the connection for writing
+//   include_filing_id 1      include a filing_id column
+//   warn 1                   print warnings on the server's stderr
+//   pipeline 1               parse on separate reading/writing threads
+//
+// The response is a single line JSON object, either
+//   {"status":"ok","filing_id":...,"output":...,"files":[...]}
+// listing the paths of the written files, or
+//   {"status":"error","filing_id":...,"error":...}
+int serveFilings(const char *socketPath, int workers, int silent);
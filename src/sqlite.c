@@ -0,0 +1,272 @@
+#include "sqlite.h"
+#include "csv.h"
+#include "tables.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef FASTFEC_SQLITE
+#include <sqlite3.h>
+#endif
+
+char *SQLITE_DATABASE = "fec";
+
+#ifdef FASTFEC_SQLITE
+
+struct sqlite_table
+{
+  TABLE_KEY key;
+  sqlite3_stmt *insert;
+};
+typedef struct sqlite_table SQLITE_TABLE;
+
+struct sqlite_output
+{
+  sqlite3 *db;
+  TABLE_LIST tables;
+  // Rows inserted since the transaction began
+  int rowsInTransaction;
+  // Whether an error was reported (only the first one is)
+  int failed;
+  // Where the output's memory comes from (NULL for the C library's)
+  ALLOCATOR *allocator;
+};
+
+int sqliteSupported()
+{
+  return 1;
+}
+
+// Report an error of the database (the first one only). Returns 0.
+int sqliteError(SQLITE_OUTPUT *output, const char *action)
+{
+  if (!output->failed)
+  {
+    fprintf(stderr, "SQLite error %s: %s\n", action, sqlite3_errmsg(output->db));
+    output->failed = 1;
+  }
+  return 0;
+}
+
+SQLITE_OUTPUT *openSqliteOutput(const char *path, ALLOCATOR *allocator)
+{
+  SQLITE_OUTPUT *output = (SQLITE_OUTPUT *)allocatorMalloc(allocator, sizeof(SQLITE_OUTPUT));
+  if (output == NULL)
+  {
+    fprintf(stderr, "Out of memory opening %s\n", path);
+    return NULL;
+  }
+  memset(output, 0, sizeof(SQLITE_OUTPUT));
+  output->allocator = allocator;
+  initTableList(&output->tables, sizeof(SQLITE_TABLE), allocator);
+  remove(path);
+  // The database is written from scratch by one parse, so it needs no
+  // journal or syncing (an interrupted parse leaves a database to
+  // throw away either way)
+  if ((sqlite3_open_v2(path, &output->db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) ||
+      (sqlite3_exec(output->db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF; BEGIN", NULL, NULL, NULL) != SQLITE_OK))
+  {
+    fprintf(stderr, "SQLite error opening %s: %s\n", path, output->db != NULL ? sqlite3_errmsg(output->db) : "out of memory");
+    sqlite3_close(output->db);
+    allocatorFree(allocator, output);
+    return NULL;
+  }
+  return output;
+}
+
+// Append a quoted SQL identifier (with a suffix) to the statement
+void appendSqliteIdentifier(sqlite3_str *sql, const char *name, int length, const char *suffix)
+{
+  sqlite3_str_appendchar(sql, 1, '"');
+  // (quotes are escaped by doubling them, as in CSV)
+  for (int i = 0; i < length; i++)
+  {
+    sqlite3_str_appendchar(sql, name[i] == '"' ? 2 : 1, name[i]);
+  }
+  sqlite3_str_appendall(sql, suffix);
+  sqlite3_str_appendchar(sql, 1, '"');
+}
+
+// Create a table and prepare the statement inserting rows into it.
+// Returns 1 if successful.
+int createSqliteTable(SQLITE_OUTPUT *output, SQLITE_TABLE *table, const char *types, int includeFilingId)
+{
+  // Tables are named like the files the rows would be written to
+  char suffix[16];
+  suffix[0] = 0;
+  if (table->key.variant > 1)
+  {
+    sprintf(suffix, ".%d", table->key.variant);
+  }
+  const char *name = table->key.name;
+  sqlite3_str *create = sqlite3_str_new(output->db);
+  sqlite3_str *insert = sqlite3_str_new(output->db);
+  sqlite3_str_appendall(create, "CREATE TABLE ");
+  appendSqliteIdentifier(create, name, strlen(name), suffix);
+  sqlite3_str_appendall(create, " (");
+  sqlite3_str_appendall(insert, "INSERT INTO ");
+  appendSqliteIdentifier(insert, name, strlen(name), suffix);
+  sqlite3_str_appendall(insert, " VALUES (");
+  if (includeFilingId)
+  {
+    sqlite3_str_appendall(create, "\"filing_id\" TEXT");
+    sqlite3_str_appendall(insert, "?");
+  }
+
+  HEADER_COLUMN column;
+  startHeaderColumns(&column, table->key.header, types);
+  while (nextHeaderColumn(&column))
+  {
+    const char *separator = (column.index > 0) || includeFilingId ? ", " : "";
+    sqlite3_str_appendall(create, separator);
+    appendSqliteIdentifier(create, column.name, column.length, column.suffix);
+    sqlite3_str_appendall(create, column.type == 'f' ? " REAL" : " TEXT");
+    sqlite3_str_appendall(insert, separator);
+    sqlite3_str_appendall(insert, "?");
+  }
+  sqlite3_str_appendall(create, ")");
+  sqlite3_str_appendall(insert, ")");
+
+  char *createSql = sqlite3_str_finish(create);
+  char *insertSql = sqlite3_str_finish(insert);
+  int created = (createSql != NULL) && (insertSql != NULL) &&
+                (sqlite3_exec(output->db, createSql, NULL, NULL, NULL) == SQLITE_OK) &&
+                (sqlite3_prepare_v2(output->db, insertSql, -1, &table->insert, NULL) == SQLITE_OK);
+  sqlite3_free(createSql);
+  sqlite3_free(insertSql);
+  return created;
+}
+
+int selectSqliteTable(SQLITE_OUTPUT *output, const char *name, const char *header, const char *types, int includeFilingId)
+{
+  int created;
+  SQLITE_TABLE *table = (SQLITE_TABLE *)selectTable(&output->tables, name, header, &created);
+  if ((table != NULL) && created && !createSqliteTable(output, table, types, includeFilingId))
+  {
+    sqlite3_finalize(table->insert);
+    discardTable(&output->tables);
+    table = NULL;
+  }
+  return table != NULL ? 1 : sqliteError(output, "creating a table");
+}
+
+void forgetSqliteTable(SQLITE_OUTPUT *output)
+{
+  forgetTable(&output->tables);
+}
+
+void bindSqliteValue(SQLITE_OUTPUT *output, int column, const char *str, int length, char type)
+{
+  SQLITE_TABLE *table = (SQLITE_TABLE *)output->tables.table;
+  if (table == NULL)
+  {
+    return;
+  }
+  sqlite3_stmt *insert = table->insert;
+  if (length == 0)
+  {
+    sqlite3_bind_null(insert, column + 1);
+    return;
+  }
+  double value;
+  if ((type == 'f') && parseNumberField(str, length, &value))
+  {
+    sqlite3_bind_double(insert, column + 1, value);
+    return;
+  }
+  sqlite3_bind_text(insert, column + 1, str, length, SQLITE_STATIC);
+}
+
+int insertSqliteRow(SQLITE_OUTPUT *output)
+{
+  SQLITE_TABLE *table = (SQLITE_TABLE *)output->tables.table;
+  if (table == NULL)
+  {
+    return 0;
+  }
+  sqlite3_stmt *insert = table->insert;
+  int inserted = sqlite3_step(insert) == SQLITE_DONE;
+  sqlite3_reset(insert);
+  if (!inserted)
+  {
+    return sqliteError(output, "inserting a row");
+  }
+
+  // Commit in large batches, so rows are inserted at the rate of a
+  // transaction per batch rather than per row
+  if (++output->rowsInTransaction >= SQLITE_TRANSACTION_ROWS)
+  {
+    output->rowsInTransaction = 0;
+    if (sqlite3_exec(output->db, "COMMIT; BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+    {
+      return sqliteError(output, "committing rows");
+    }
+  }
+  return 1;
+}
+
+void closeSqliteOutput(SQLITE_OUTPUT *output)
+{
+  for (int i = 0; i < output->tables.numTables; i++)
+  {
+    sqlite3_finalize(((SQLITE_TABLE *)tableAt(&output->tables, i))->insert);
+  }
+  freeTableList(&output->tables);
+  if (sqlite3_exec(output->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+  {
+    sqliteError(output, "committing rows");
+  }
+  sqlite3_close(output->db);
+  allocatorFree(output->allocator, output);
+}
+
+#else
+
+// Without SQLite, databases can't be opened, so nothing else is called
+
+int sqliteSupported()
+{
+  return 0;
+}
+
+SQLITE_OUTPUT *openSqliteOutput(const char *path, ALLOCATOR *allocator)
+{
+  (void)allocator;
+  fprintf(stderr, "Can't open %s: built without SQLite support\n", path);
+  return NULL;
+}
+
+int selectSqliteTable(SQLITE_OUTPUT *output, const char *name, const char *header, const char *types, int includeFilingId)
+{
+  (void)output;
+  (void)name;
+  (void)header;
+  (void)types;
+  (void)includeFilingId;
+  return 0;
+}
+
+void forgetSqliteTable(SQLITE_OUTPUT *output)
+{
+  (void)output;
+}
+
+void bindSqliteValue(SQLITE_OUTPUT *output, int column, const char *str, int length, char type)
+{
+  (void)output;
+  (void)column;
+  (void)str;
+  (void)length;
+  (void)type;
+}
+
+int insertSqliteRow(SQLITE_OUTPUT *output)
+{
+  (void)output;
+  return 0;
+}
+
+void closeSqliteOutput(SQLITE_OUTPUT *output)
+{
+  (void)output;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "writer.h"
+
+// SQLite output: rows are inserted into a database with a table per form
+// type. Only available when built with SQLite (FASTFEC_SQLITE, see the
+// sqlite option of build.zig); otherwise databases can't be opened.
+
+static const char sqliteExtension[] = ".sqlite";
+
+// The name of the database file rows are inserted into
+extern char *SQLITE_DATABASE;
+
+// Rows are inserted in transactions of this many rows
+#define SQLITE_TRANSACTION_ROWS 100000
+
+// Return whether SQLite output is available in this build
+int sqliteSupported();
+
+// Create a database at the path (replacing any database there) to insert
+// rows into, with the output's memory from the allocator (NULL for the C
+// library's). Returns NULL (after reporting why) if it can't be created.
+SQLITE_OUTPUT *openSqliteOutput(const char *path, ALLOCATOR *allocator);
+
+// Select the table rows with the header row are inserted into, creating
+// it the first time: named like the file the rows would be written to
+// (with the columns of the header row, of the types, NULL if they're all
+// strings, preceded by a filing_id column if included). Rows with a
+// header row that differs from the table's go to a variant of it, e.g.
+// SA11AI.2. String and date columns are TEXT (dates as YYYY-MM-DD) and
+// float columns REAL. Repeated column names are numbered from the
+// second, e.g. name_2. Returns 1 if successful, 0 (after reporting why)
+// if not.
+int selectSqliteTable(SQLITE_OUTPUT *output, const char *name, const char *header, const char *types, int includeFilingId);
+
+// Forget the table selected, for a database passed on to a parse whose
+// header rows may be allocated where the last parse's were
+void forgetSqliteTable(SQLITE_OUTPUT *output);
+
+// Bind a field to a column (from 0) of the row being inserted into the
+// selected table, as a value of its column type ('s', 'd' or 'f').
+// Empty fields are NULL. Float fields that aren't numbers are kept as
+// text. The field must not change until the row is inserted.
+void bindSqliteValue(SQLITE_OUTPUT *output, int column, const char *str, int length, char type);
+
+// Insert the row bound into the selected table. Returns 1 if successful,
+// 0 (after reporting why) if not.
+int insertSqliteRow(SQLITE_OUTPUT *output);
+
+// Commit the rows inserted and close the database
+void closeSqliteOutput(SQLITE_OUTPUT *output);
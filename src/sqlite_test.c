@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "sqlite.h"
+#ifdef FASTFEC_SQLITE
+#include <sqlite3.h>
+#endif
+
+int tests_run = 0;
+
+#ifdef FASTFEC_SQLITE
+
+static const char *TEST_DATABASE = "sqlite_test.sqlite";
+
+// Whether a query of the test database returns one row of one value
+// (NULL for NULL)
+static int queryIs(const char *sql, const char *expected)
+{
+  sqlite3 *db;
+  sqlite3_stmt *query;
+  if (sqlite3_open(TEST_DATABASE, &db) != SQLITE_OK)
+  {
+    return 0;
+  }
+  int matches = 0;
+  if ((sqlite3_prepare_v2(db, sql, -1, &query, NULL) == SQLITE_OK) && (sqlite3_step(query) == SQLITE_ROW))
+  {
+    const char *value = (const char *)sqlite3_column_text(query, 0);
+    matches = expected == NULL ? value == NULL : (value != NULL) && (strcmp(value, expected) == 0);
+    matches = matches && (sqlite3_step(query) == SQLITE_DONE);
+  }
+  sqlite3_finalize(query);
+  sqlite3_close(db);
+  return matches;
+}
+
+// Insert a row of fields into the selected table
+static int insertRow(SQLITE_OUTPUT *output, const char **fields, const char *types, int numFields)
+{
+  for (int i = 0; i < numFields; i++)
+  {
+    bindSqliteValue(output, i, fields[i], strlen(fields[i]), types[i]);
+  }
+  return insertSqliteRow(output);
+}
+
+static char *testTables()
+{
+  ALLOCATOR *allocator = newAllocator(NULL, NULL, NULL, NULL);
+  SQLITE_OUTPUT *output = openSqliteOutput(TEST_DATABASE, allocator);
+  mu_assert("Expected the database to open", output != NULL);
+
+  const char *row[] = {"C00123", "Smith", "2020-01-31", "12.50", "Jones"};
+  mu_assert("Expected a table", selectSqliteTable(output, "SA11AI", "id,name,date,amount,name", "ssdfs", 0));
+  mu_assert("Expected a row", insertRow(output, row, "ssdfs", 5));
+  const char *emptyRow[] = {"C00124", "", "", "n/a", "Doe"};
+  mu_assert("Expected another row", insertRow(output, emptyRow, "ssdfs", 5));
+
+  // Rows with another header row go to a variant of the table
+  const char *oldRow[] = {"C00125", "Brown"};
+  mu_assert("Expected a variant table", selectSqliteTable(output, "SA11AI", "id,name", "ss", 0));
+  mu_assert("Expected a variant row", insertRow(output, oldRow, "ss", 2));
+  mu_assert("Expected the first table again", selectSqliteTable(output, "SA11AI", "id,name,date,amount,name", "ssdfs", 0));
+  mu_assert("Expected a row after switching back", insertRow(output, row, "ssdfs", 5));
+
+  const char *textRow[] = {"123", "SCHEDULE/A"};
+  mu_assert("Expected a table named like its file", selectSqliteTable(output, "text/a", "text", NULL, 1));
+  mu_assert("Expected a text row", insertRow(output, textRow, "ss", 2));
+  closeSqliteOutput(output);
+  mu_assert("Expected every allocation to be freed", allocator->stats.bytesLive == 0);
+  freeAllocator(allocator);
+
+  mu_assert("Expected the rows of the table", queryIs("SELECT COUNT(*) FROM \"SA11AI\"", "3"));
+  mu_assert("Expected repeated names to be numbered", queryIs("SELECT \"name_2\" FROM \"SA11AI\" WHERE \"id\" = 'C00123' LIMIT 1", "Jones"));
+  mu_assert("Expected dates as text", queryIs("SELECT typeof(\"date\") FROM \"SA11AI\" LIMIT 1", "text"));
+  mu_assert("Expected floats as reals", queryIs("SELECT \"amount\" * 2 FROM \"SA11AI\" LIMIT 1", "25.0"));
+  mu_assert("Expected empty fields as NULL", queryIs("SELECT \"name\" FROM \"SA11AI\" WHERE \"id\" = 'C00124'", NULL));
+  mu_assert("Expected floats that aren't numbers as text", queryIs("SELECT \"amount\" FROM \"SA11AI\" WHERE \"id\" = 'C00124'", "n/a"));
+  mu_assert("Expected the variant table", queryIs("SELECT \"name\" FROM \"SA11AI.2\"", "Brown"));
+  mu_assert("Expected the filing id column", queryIs("SELECT \"filing_id\" || \"text\" FROM \"text-a\"", "123SCHEDULE/A"));
+  remove(TEST_DATABASE);
+
+  return 0;
+}
+
+static char *testFailures()
+{
+  mu_assert("Expected a database in a missing directory to fail", openSqliteOutput("missing/directory/fec.sqlite", NULL) == NULL);
+
+  SQLITE_OUTPUT *output = openSqliteOutput(TEST_DATABASE, NULL);
+  mu_assert("Expected the database to open", output != NULL);
+  mu_assert("Expected no row without a table", !insertSqliteRow(output));
+  closeSqliteOutput(output);
+  remove(TEST_DATABASE);
+
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_assert("Expected SQLite support", sqliteSupported());
+  mu_run_test(testTables);
+  mu_run_test(testFailures);
+  return 0;
+}
+
+#else
+
+static char *testUnsupported()
+{
+  mu_assert("Expected no SQLite support", !sqliteSupported());
+  mu_assert("Expected databases not to open", openSqliteOutput("fec.sqlite", NULL) == NULL);
+
+  return 0;
+}
+
+static char *all_tests()
+{
+  mu_run_test(testUnsupported);
+  return 0;
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+  printf("\nSQLite tests\n");
+  char *result = all_tests();
+  if (result != 0)
+  {
+    printf("%s\n", result);
+  }
+  else
+  {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", tests_run);
+
+  return result != 0;
+}
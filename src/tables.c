@@ -0,0 +1,135 @@
+#include "tables.h"
+#include "compat.h"
+#include "writer.h"
+#include <string.h>
+
+void initTableList(TABLE_LIST *list, size_t tableSize, ALLOCATOR *allocator)
+{
+  list->tables = NULL;
+  list->tableSize = tableSize;
+  list->numTables = 0;
+  list->tableCapacity = 0;
+  list->table = NULL;
+  list->lastHeader = NULL;
+  list->allocator = allocator;
+}
+
+void *tableAt(TABLE_LIST *list, int index)
+{
+  return list->tables + index * list->tableSize;
+}
+
+void freeTableKey(TABLE_LIST *list, TABLE_KEY *key)
+{
+  allocatorFree(list->allocator, key->name);
+  allocatorFree(list->allocator, key->header);
+}
+
+void freeTableList(TABLE_LIST *list)
+{
+  for (int i = 0; i < list->numTables; i++)
+  {
+    freeTableKey(list, (TABLE_KEY *)tableAt(list, i));
+  }
+  allocatorFree(list->allocator, list->tables);
+  list->tables = NULL;
+  list->numTables = 0;
+  list->tableCapacity = 0;
+  list->table = NULL;
+}
+
+// Whether the table is named for the name (names are normalized as
+// normalize_filename does)
+int tableNamed(TABLE_KEY *key, const char *name)
+{
+  const char *tableName = key->name;
+  for (; *name != 0; name++, tableName++)
+  {
+    if ((*tableName != *name) && ((*tableName != '-') || (*name != DIR_SEPARATOR_CHAR)))
+    {
+      return 0;
+    }
+  }
+  return *tableName == 0;
+}
+
+// Copy a string into a new allocation, or NULL if memory ran out
+char *copyTableString(ALLOCATOR *allocator, const char *str)
+{
+  char *copy = (char *)allocatorMalloc(allocator, strlen(str) + 1);
+  if (copy != NULL)
+  {
+    strcpy(copy, str);
+  }
+  return copy;
+}
+
+void *selectTable(TABLE_LIST *list, const char *name, const char *header, int *created)
+{
+  *created = 0;
+  if ((list->table != NULL) && (header == list->lastHeader) && tableNamed((TABLE_KEY *)list->table, name))
+  {
+    return list->table;
+  }
+
+  // Find the table with the name and header row, counting the variants
+  // of the name passed on the way
+  int variant = 1;
+  list->table = NULL;
+  for (int i = 0; i < list->numTables; i++)
+  {
+    TABLE_KEY *key = (TABLE_KEY *)tableAt(list, i);
+    if (tableNamed(key, name))
+    {
+      if (strcmp(key->header, header) == 0)
+      {
+        list->table = key;
+        list->lastHeader = header;
+        return key;
+      }
+      variant++;
+    }
+  }
+
+  if (list->numTables == list->tableCapacity)
+  {
+    int capacity = list->tableCapacity > 0 ? list->tableCapacity * 2 : 16;
+    char *tables = (char *)allocatorRealloc(list->allocator, list->tables, capacity * list->tableSize);
+    if (tables == NULL)
+    {
+      return NULL;
+    }
+    list->tables = tables;
+    list->tableCapacity = capacity;
+  }
+  TABLE_KEY *key = (TABLE_KEY *)tableAt(list, list->numTables);
+  memset(key, 0, list->tableSize);
+  key->name = copyTableString(list->allocator, name);
+  key->variant = variant;
+  key->header = copyTableString(list->allocator, header);
+  if ((key->name == NULL) || (key->header == NULL))
+  {
+    freeTableKey(list, key);
+    return NULL;
+  }
+  normalize_filename(key->name);
+  list->numTables++;
+  list->table = key;
+  list->lastHeader = header;
+  *created = 1;
+  return key;
+}
+
+void discardTable(TABLE_LIST *list)
+{
+  list->numTables--;
+  freeTableKey(list, (TABLE_KEY *)tableAt(list, list->numTables));
+  list->table = NULL;
+  list->lastHeader = NULL;
+}
+
+void forgetTable(TABLE_LIST *list)
+{
+  list->table = NULL;
+  list->lastHeader = NULL;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include "allocator.h"
+
+// Tables that rows are added to by their form type and header row (for
+// the outputs that hold rows in tables rather than files: SQLite and
+// columns).
+
+// The key a table is selected by: named like the file the rows would be
+// written to, with rows whose header row differs from the first's in
+// variants (numbered from 2, like combined files)
+struct table_key
+{
+  char *name;
+  int variant;
+  char *header;
+};
+typedef struct table_key TABLE_KEY;
+
+// Tables of an output's table type, each of tableSize bytes starting
+// with its TABLE_KEY, in the order they were created
+struct table_list
+{
+  char *tables;
+  size_t tableSize;
+  int numTables;
+  int tableCapacity;
+  // The table selected, and the header row it was selected by (so rows
+  // of the same type select it without comparing header rows)
+  void *table;
+  const char *lastHeader;
+  // Where the tables' memory comes from (NULL for the C library's)
+  ALLOCATOR *allocator;
+};
+typedef struct table_list TABLE_LIST;
+
+void initTableList(TABLE_LIST *list, size_t tableSize, ALLOCATOR *allocator);
+
+// Free the tables' keys and the list (after the output has freed what
+// else its tables hold)
+void freeTableList(TABLE_LIST *list);
+
+// The table at the index
+void *tableAt(TABLE_LIST *list, int index);
+
+// Select the table rows with the name and header row are added to,
+// creating it the first time: with its key set, the rest of it zeroed
+// and created set to 1 (so the output sets it up, or discards it if it
+// can't). Returns the table, or NULL if memory ran out.
+void *selectTable(TABLE_LIST *list, const char *name, const char *header, int *created);
+
+// Discard the table just created by selectTable
+void discardTable(TABLE_LIST *list);
+
+// Forget the table selected, so the next row compares header rows
+// (e.g. once the header rows it was selected by are freed)
+void forgetTable(TABLE_LIST *list);
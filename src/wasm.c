@@ -5,8 +5,8 @@ extern void wasmBufferWrite(char *filename, char *extension, char *contents, int
 
 void wasmFec(int bufferSize)
 {
-  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext();
-  FEC_CONTEXT *fec = newFecContext(persistentMemory, ((BufferRead)(&wasmBufferRead)), bufferSize, ((CustomWriteFunction)(&wasmBufferWrite)), bufferSize, NULL, 0, NULL, NULL, NULL, 0, 1, 0);
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory = newPersistentMemoryContext(NULL);
+  FEC_CONTEXT *fec = newFecContext(persistentMemory, ((BufferRead)(&wasmBufferRead)), bufferSize, ((CustomWriteFunction)(&wasmBufferWrite)), bufferSize, NULL, 0, NULL, NULL, NULL, 0, 1, 0, NULL);
   int fecParseResult = parseFec(fec);
   freeFecContext(fec);
   freePersistentMemoryContext(persistentMemory);
@@ -0,0 +1,421 @@
+#include "watch.h"
+#include "compat.h"
+#include <string.h>
+#include <ctype.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WATCH_INOTIFY
+#endif
+
+// The size of the input and output buffers of each parse
+#define WATCH_BUFFER_SIZE 65536
+
+char *fileFilingId(const char *name)
+{
+  const char *extension = strrchr(name, '.');
+  size_t end = extension != NULL ? (size_t)(extension - name) : strlen(name);
+  size_t start = end;
+  while ((start > 0) && isdigit((unsigned char)name[start - 1]))
+  {
+    start--;
+  }
+  if (start == end)
+  {
+    start = 0;
+  }
+  char *filingId = malloc(end - start + 1);
+  if (filingId != NULL)
+  {
+    memcpy(filingId, name + start, end - start);
+    filingId[end - start] = 0;
+  }
+  return filingId;
+}
+
+#ifdef WATCH_INOTIFY
+
+// A file that's queued or being parsed
+struct watch_job
+{
+  char *name;
+  int active; // whether a worker is parsing it
+  struct watch_job *next;
+};
+typedef struct watch_job WATCH_JOB;
+
+struct watch_queue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  // Queued and active jobs, in the order the files were seen
+  WATCH_JOB *jobs;
+  int stopping;
+
+  const char *directory;
+  char *outputDirectory;
+  int includeFilingId;
+  int silent;
+  int warn;
+};
+typedef struct watch_queue WATCH_QUEUE;
+
+struct watch_worker
+{
+  pthread_t thread;
+  WATCH_QUEUE *queue;
+  // Reused by every parse the worker does
+  PERSISTENT_MEMORY_CONTEXT *persistentMemory;
+};
+typedef struct watch_worker WATCH_WORKER;
+
+// Join a directory and a name into a new string (NULL if memory ran out)
+char *joinPath(const char *directory, const char *name)
+{
+  size_t length = strlen(directory);
+  int addSeparator = (length > 0) && (directory[length - 1] != DIR_SEPARATOR_CHAR);
+  char *path = malloc(length + addSeparator + strlen(name) + 1);
+  if (path == NULL)
+  {
+    return NULL;
+  }
+  strcpy(path, directory);
+  if (addSeparator)
+  {
+    strcat(path, DIR_SEPARATOR);
+  }
+  strcat(path, name);
+  return path;
+}
+
+// Whether a file name is a (visible) .fec file
+int isFecFileName(const char *name)
+{
+  size_t length = strlen(name);
+  if ((name[0] == '.') || (length < 5))
+  {
+    return 0;
+  }
+  const char *extension = name + length - 4;
+  return (extension[0] == '.') && (tolower(extension[1]) == 'f') && (tolower(extension[2]) == 'e') && (tolower(extension[3]) == 'c');
+}
+
+// Queue a file to be parsed, unless it's not a filing or it's already
+// queued or being parsed
+void queueFiling(WATCH_QUEUE *queue, const char *name)
+{
+  if (!isFecFileName(name))
+  {
+    return;
+  }
+  pthread_mutex_lock(&queue->lock);
+  WATCH_JOB **last = &queue->jobs;
+  while (*last != NULL)
+  {
+    if (strcmp((*last)->name, name) == 0)
+    {
+      pthread_mutex_unlock(&queue->lock);
+      return;
+    }
+    last = &(*last)->next;
+  }
+  WATCH_JOB *job = malloc(sizeof(WATCH_JOB));
+  char *copy = malloc(strlen(name) + 1);
+  if ((job == NULL) || (copy == NULL))
+  {
+    // The file is left to be picked up by the next run
+    fprintf(stderr, "Out of memory queueing %s\n", name);
+    free(job);
+    free(copy);
+    pthread_mutex_unlock(&queue->lock);
+    return;
+  }
+  strcpy(copy, name);
+  job->name = copy;
+  job->active = 0;
+  job->next = NULL;
+  *last = job;
+  pthread_cond_signal(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Queue every filing already in the directory
+void queueDirectory(WATCH_QUEUE *queue)
+{
+  DIR *dir = opendir(queue->directory);
+  if (dir == NULL)
+  {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    if ((entry->d_type == DT_REG) || (entry->d_type == DT_UNKNOWN))
+    {
+      queueFiling(queue, entry->d_name);
+    }
+  }
+  closedir(dir);
+}
+
+// Parse a filing and move it to the done or failed directory. Filings
+// that have since gone away are skipped.
+void parseWatchedFiling(WATCH_WORKER *worker, const char *name)
+{
+  WATCH_QUEUE *queue = worker->queue;
+  char *path = joinPath(queue->directory, name);
+  char *filingId = fileFilingId(name);
+  FEC_CONTEXT *fec = NULL;
+  if ((path != NULL) && (filingId != NULL))
+  {
+    fec = newFecContext(worker->persistentMemory, ((BufferRead)(&readBuffer)), WATCH_BUFFER_SIZE, NULL, WATCH_BUFFER_SIZE, NULL, 1, NULL, filingId, queue->outputDirectory, queue->includeFilingId, 1, queue->warn, NULL);
+  }
+  if (fec == NULL)
+  {
+    // The file is left to be picked up by the next run
+    fprintf(stderr, "Out of memory parsing %s\n", name);
+  }
+  else if (setFecInputPath(fec, path))
+  {
+    int result = parseFec(fec);
+    freeFecContext(fec);
+    fec = NULL;
+
+    char *moved = joinPath(queue->directory, result ? WATCH_DONE_DIRECTORY DIR_SEPARATOR : WATCH_FAILED_DIRECTORY DIR_SEPARATOR);
+    char *destination = moved != NULL ? joinPath(moved, name) : NULL;
+    if ((destination == NULL) || (rename(path, destination) != 0))
+    {
+      fprintf(stderr, "Couldn't move %s out of the watched directory\n", name);
+    }
+    else if (!queue->silent)
+    {
+      printf(result ? "Parsed %s\n" : "Failed to parse %s\n", name);
+      fflush(stdout);
+    }
+    free(moved);
+    free(destination);
+  }
+  if (fec != NULL)
+  {
+    freeFecContext(fec);
+  }
+  free(path);
+  free(filingId);
+}
+
+void *watchWorker(void *data)
+{
+  WATCH_WORKER *worker = (WATCH_WORKER *)data;
+  WATCH_QUEUE *queue = worker->queue;
+  pthread_mutex_lock(&queue->lock);
+  while (1)
+  {
+    WATCH_JOB *job = queue->jobs;
+    while ((job != NULL) && job->active)
+    {
+      job = job->next;
+    }
+    if (queue->stopping)
+    {
+      break;
+    }
+    if (job == NULL)
+    {
+      pthread_cond_wait(&queue->ready, &queue->lock);
+      continue;
+    }
+
+    job->active = 1;
+    pthread_mutex_unlock(&queue->lock);
+    parseWatchedFiling(worker, job->name);
+    pthread_mutex_lock(&queue->lock);
+
+    // Forget the job, so the same name can be queued again
+    WATCH_JOB **link = &queue->jobs;
+    while (*link != job)
+    {
+      link = &(*link)->next;
+    }
+    *link = job->next;
+    free(job->name);
+    free(job);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return NULL;
+}
+
+// Create a directory within the watched directory. Returns 0 if it
+// doesn't exist and couldn't be created.
+int makeWatchDirectory(const char *directory, const char *name)
+{
+  char *path = joinPath(directory, name);
+  int made = (path != NULL) && ((mkdir(path, 0777) == 0) || (errno == EEXIST));
+  if (!made)
+  {
+    fprintf(stderr, "Couldn't create %s in %s\n", name, directory);
+  }
+  free(path);
+  return made;
+}
+
+int watchFilings(const char *directory, char *outputDirectory, int workers, int includeFilingId, int silent, int warn)
+{
+  if (!makeWatchDirectory(directory, WATCH_DONE_DIRECTORY) || !makeWatchDirectory(directory, WATCH_FAILED_DIRECTORY))
+  {
+    return 1;
+  }
+
+  // Files that are done being written, whether written in place or
+  // moved in when complete (subdirectories aren't watched, so moving
+  // files to done or failed doesn't register)
+  int watcher = inotify_init1(IN_CLOEXEC);
+  if ((watcher < 0) || (inotify_add_watch(watcher, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0))
+  {
+    fprintf(stderr, "Couldn't watch %s: %s\n", directory, strerror(errno));
+    if (watcher >= 0)
+    {
+      close(watcher);
+    }
+    return 1;
+  }
+
+  // Signals are taken through a descriptor polled with the watcher
+  // (workers inherit the mask)
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  int signaled = signalfd(-1, &signals, SFD_CLOEXEC);
+
+  WATCH_QUEUE queue;
+  pthread_mutex_init(&queue.lock, NULL);
+  pthread_cond_init(&queue.ready, NULL);
+  queue.jobs = NULL;
+  queue.stopping = 0;
+  queue.directory = directory;
+  queue.outputDirectory = outputDirectory;
+  queue.includeFilingId = includeFilingId;
+  queue.silent = silent;
+  queue.warn = warn;
+
+  int status = 0;
+  WATCH_WORKER *pool = (WATCH_WORKER *)calloc(workers, sizeof(WATCH_WORKER));
+  int started = 0;
+  while ((signaled >= 0) && (pool != NULL) && (started < workers))
+  {
+    WATCH_WORKER *worker = &pool[started];
+    worker->queue = &queue;
+    worker->persistentMemory = newPersistentMemoryContext(NULL);
+    if (worker->persistentMemory == NULL)
+    {
+      break;
+    }
+    if (pthread_create(&worker->thread, NULL, watchWorker, worker) != 0)
+    {
+      freePersistentMemoryContext(worker->persistentMemory);
+      break;
+    }
+    started++;
+  }
+
+  if (started < workers)
+  {
+    fprintf(stderr, "Couldn't start %d workers\n", workers);
+    status = 1;
+  }
+  else
+  {
+    if (!silent)
+    {
+      printf("Watching %s with %d workers\n", directory, workers);
+      fflush(stdout);
+    }
+    // Files spooled before watching started (files completed since are
+    // queued once)
+    queueDirectory(&queue);
+
+    struct pollfd fds[2] = {{watcher, POLLIN, 0}, {signaled, POLLIN, 0}};
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1)
+    {
+      if (poll(fds, 2, -1) < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        fprintf(stderr, "Couldn't watch %s: %s\n", directory, strerror(errno));
+        status = 1;
+        break;
+      }
+      if (fds[1].revents)
+      {
+        if (!silent)
+        {
+          printf("Stopping\n");
+        }
+        break;
+      }
+      ssize_t length = read(watcher, events, sizeof(events));
+      for (char *position = events; position < events + length;)
+      {
+        struct inotify_event *event = (struct inotify_event *)position;
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+          // Events were dropped, so look for files that were missed
+          queueDirectory(&queue);
+        }
+        else if ((event->len > 0) && !(event->mask & IN_ISDIR))
+        {
+          queueFiling(&queue, event->name);
+        }
+        position += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  }
+
+  // Let the workers finish the filings they're parsing
+  pthread_mutex_lock(&queue.lock);
+  queue.stopping = 1;
+  pthread_cond_broadcast(&queue.ready);
+  pthread_mutex_unlock(&queue.lock);
+  for (int i = 0; i < started; i++)
+  {
+    pthread_join(pool[i].thread, NULL);
+    freePersistentMemoryContext(pool[i].persistentMemory);
+  }
+  while (queue.jobs != NULL)
+  {
+    WATCH_JOB *job = queue.jobs;
+    queue.jobs = job->next;
+    free(job->name);
+    free(job);
+  }
+  free(pool);
+  pthread_cond_destroy(&queue.ready);
+  pthread_mutex_destroy(&queue.lock);
+  if (signaled >= 0)
+  {
+    close(signaled);
+  }
+  close(watcher);
+  return status;
+}
+
+#else
+
+int watchFilings(const char *directory, char *outputDirectory, int workers, int includeFilingId, int silent, int warn)
+{
+  fprintf(stderr, "Watching directories isn't supported on this platform\n");
+  return 1;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "fec.h"
+
+// Where parsed filings are moved to within the watched directory
+#define WATCH_DONE_DIRECTORY "done"
+#define WATCH_FAILED_DIRECTORY "failed"
+
+// The filing ID of a file: the number its name ends with (before the
+// extension), or the whole name (without it) if it doesn't end with one.
+// Returns NULL if memory ran out.
+char *fileFilingId(const char *name);
+
+// Parse every .fec file in directory, and then each one that's written
+// (closed after writing) or moved into it, until interrupted (SIGINT or
+// SIGTERM). Filings are parsed by a pool of workers threads that each
+// keep their persistent memory (and its compiled mappings) warm, into
+// outputDirectory like the CLI. The filing ID is the number the file
+// name ends with (or the whole name, without its extension). Parsed
+// files are moved to the done directory and files that fail to parse
+// to the failed directory. Filings being parsed when interrupted are
+// finished; queued ones are left to be picked up by the next run.
+// Returns the exit status.
+int watchFilings(const char *directory, char *outputDirectory, int workers, int includeFilingId, int silent, int warn);
@@ -1,5 +1,7 @@
 #include "memory.h"
 #include "writer.h"
+#include "pipeline.h"
+#include "sqlite.h"
 #include <string.h>
 #include <limits.h>
 #include <sys/stat.h>
@@ -16,6 +18,9 @@
 #define ENAMETOOLONG 63
 #endif
 
+// File names are short, so a small chunk holds those of most filings
+#define WRITER_ARENA_CHUNK_SIZE 4096
+
 const char *NUMBER_FORMAT = "%.2f";
 
 // From https://gist.github.com/JonathonReinhart/8c0d90191c38af2dcadb102c4e202950
@@ -85,24 +90,39 @@ void normalize_filename(char *filename)
   }
 }
 
-BUFFER_FILE *newBufferFile(int bufferSize)
+BUFFER_FILE *newBufferFile(int bufferSize, ALLOCATOR *allocator)
 {
-  BUFFER_FILE *bufferFile = (BUFFER_FILE *)malloc(sizeof(BUFFER_FILE));
-  bufferFile->buffer = malloc(bufferSize);
+  BUFFER_FILE *bufferFile = (BUFFER_FILE *)allocatorMalloc(allocator, sizeof(BUFFER_FILE));
+  if (bufferFile == NULL)
+  {
+    return NULL;
+  }
+  bufferFile->buffer = allocatorMalloc(allocator, bufferSize);
+  if (bufferFile->buffer == NULL)
+  {
+    allocatorFree(allocator, bufferFile);
+    return NULL;
+  }
   bufferFile->bufferPos = 0;
   bufferFile->bufferSize = bufferSize;
+  bufferFile->flushed = 0;
   return bufferFile;
 }
 
-void freeBufferFile(BUFFER_FILE *bufferFile)
+void freeBufferFile(BUFFER_FILE *bufferFile, ALLOCATOR *allocator)
 {
-  free(bufferFile->buffer);
-  free(bufferFile);
+  allocatorFree(allocator, bufferFile->buffer);
+  allocatorFree(allocator, bufferFile);
 }
 
-WRITE_CONTEXT *newWriteContext(char *outputDirectory, char *filingId, int writeToFile, int bufferSize, CustomWriteFunction customWriteFunction, CustomLineFunction customLineFunction)
+WRITE_CONTEXT *newWriteContext(char *outputDirectory, char *filingId, int writeToFile, int bufferSize, CustomWriteFunction customWriteFunction, CustomLineFunction customLineFunction, ALLOCATOR *allocator)
 {
-  WRITE_CONTEXT *context = (WRITE_CONTEXT *)malloc(sizeof(WRITE_CONTEXT));
+  WRITE_CONTEXT *context = (WRITE_CONTEXT *)allocatorMalloc(allocator, sizeof(WRITE_CONTEXT));
+  if (context == NULL)
+  {
+    return NULL;
+  }
+  context->allocator = allocator;
   context->outputDirectory = outputDirectory;
   context->filingId = filingId;
   context->writeToFile = writeToFile;
@@ -112,15 +132,41 @@ WRITE_CONTEXT *newWriteContext(char *outputDirectory, char *filingId, int writeT
   context->bufferFiles = NULL;
   context->files = NULL;
   context->nfiles = 0;
+  context->fileCapacity = 0;
   context->lastname = NULL;
+  context->lastIndex = -1;
+  context->fileIndexById = NULL;
+  context->idCapacity = 0;
+  context->lastId = -1;
+  context->lastKey = NULL;
   context->lastBufferFile = NULL;
+  context->outputStage = NULL;
+  context->combined = 0;
+  context->rotateSize = 0;
+  context->headerRows = NULL;
+  context->variants = NULL;
+  context->parts = NULL;
+  context->binaryExtension = NULL;
+  context->binaryTrailer = NULL;
+  context->binaryTrailerLength = 0;
+  context->stream = NULL;
+  context->database = NULL;
   context->lastfile = NULL;
   context->local = 0;
   context->localBuffer = NULL;
   context->useCustomLine = customLineFunction != NULL;
-  context->customLineBuffer = context->useCustomLine ? newString(DEFAULT_STRING_SIZE) : NULL;
+  context->customLineBuffer = context->useCustomLine ? newAllocatedString(allocator, DEFAULT_STRING_SIZE) : NULL;
   context->customWriteFunction = customWriteFunction;
   context->customLineFunction = customLineFunction;
+  context->customLineDataFunction = NULL;
+  context->customLineData = NULL;
+  context->lineOnly = !writeToFile && customWriteFunction == NULL && customLineFunction != NULL;
+  context->arena = newArena(WRITER_ARENA_CHUNK_SIZE, allocator);
+  if ((context->arena == NULL) || (context->useCustomLine && context->customLineBuffer == NULL))
+  {
+    freeWriteContext(context);
+    return NULL;
+  }
   initializeCustomWriteContext(context);
   return context;
 }
@@ -153,102 +199,274 @@ void endLine(WRITE_CONTEXT *writeContext, char *types)
     return;
   }
 
-  writeContext->customLineFunction(writeContext->lastname, writeContext->customLineBuffer->str, types);
+  if (writeContext->customLineDataFunction != NULL)
+  {
+    writeContext->customLineDataFunction(writeContext->customLineData, writeContext->lastname, writeContext->customLineBuffer->str, types);
+  }
+  else
+  {
+    writeContext->customLineFunction(writeContext->lastname, writeContext->customLineBuffer->str, types);
+  }
   writeContext->customLineBufferPosition = 0;
   // Ensure the line is empty
   writeContext->customLineBuffer->str[0] = 0;
 }
 
-int getFile(WRITE_CONTEXT *context, char *filename, const char *extension)
+// Make the file at the index the one written to
+void selectFile(WRITE_CONTEXT *context, int index)
 {
-  if ((context->lastname != NULL) && (strcmp(context->lastname, filename) == 0))
+  context->lastIndex = index;
+  context->lastname = context->filenames[index];
+  context->lastBufferFile = context->bufferFiles[index];
+  if (context->writeToFile)
   {
-    // Same file as last time, just write to it
-    return 0;
+    context->lastfile = context->files[index];
   }
+}
 
-  // Different file than last time, open it
-  if (context->filenames == NULL)
+char *outputPath(WRITE_CONTEXT *context, char *filename, const char *extension, int variant, int part)
+{
+  char suffix[32];
+  suffix[0] = 0;
+  if (context->combined)
   {
-    // No files open, so open the file
-    context->filenames = (char **)malloc(sizeof(char *));
-    context->extensions = (char **)malloc(sizeof(char *));
-    context->bufferFiles = (BUFFER_FILE **)malloc(sizeof(BUFFER_FILE *));
-    if (context->writeToFile)
+    if (variant > 1)
+    {
+      sprintf(suffix, ".%d", variant);
+    }
+    if (part > 1)
     {
-      context->files = (FILE **)malloc(sizeof(FILE *));
+      sprintf(suffix + strlen(suffix), ".part%d", part);
     }
   }
-  else
+  const char *filingId = context->combined ? "" : context->filingId;
+  char *fullpath = (char *)arenaAlloc(context->arena, strlen(context->outputDirectory) + strlen(filename) + 1 + strlen(filingId) + strlen(suffix) + strlen(extension) + 1);
+  char *normalizedFilename = arenaStrdup(context->arena, filename);
+  if ((fullpath == NULL) || (normalizedFilename == NULL))
   {
-    // See if file is already open
-    for (int i = 0; i < context->nfiles; i++)
+    return NULL;
+  }
+
+  // Ensure the directory exists (will silently fail if it does)
+  strcpy(fullpath, context->outputDirectory);
+  if (!context->combined)
+  {
+    strcat(fullpath, filingId);
+  }
+  mkdir_p(fullpath);
+
+  // Add the normalized filename to path
+  if (!context->combined)
+  {
+    strcat(fullpath, DIR_SEPARATOR);
+  }
+  normalize_filename(normalizedFilename);
+  strcat(fullpath, normalizedFilename);
+  strcat(fullpath, suffix);
+  strcat(fullpath, extension);
+  return fullpath;
+}
+
+// The path of a part of the file at the index (see outputPath)
+char *filePath(WRITE_CONTEXT *context, int index, int part)
+{
+  return outputPath(context, context->filenames[index], context->extensions[index], context->combined ? context->variants[index] : 1, part);
+}
+
+// Return whether the file at the index is binary (see setBinaryFiles)
+int isBinaryFile(WRITE_CONTEXT *context, int index)
+{
+  return (context->binaryExtension != NULL) && (strcmp(context->extensions[index], context->binaryExtension) == 0);
+}
+
+// Open a file for writing, replacing what was there
+FILE *openFile(const char *fullpath, int binary)
+{
+#ifndef _WIN32
+  // Replace rather than truncate files that are hard linked elsewhere
+  // (e.g. outputs restored from a cache), leaving the other links be
+  struct stat existing;
+  if ((stat(fullpath, &existing) == 0) && S_ISREG(existing.st_mode) && (existing.st_nlink > 1))
+  {
+    remove(fullpath);
+  }
+#endif
+  return fopen(fullpath, binary ? "wb" : "w");
+}
+
+// Add a file to write to (a variant of the file with the name for
+// combined output). Returns its index, or -1 if memory ran out.
+int addFile(WRITE_CONTEXT *context, char *filename, const char *extension, int variant)
+{
+  // Make room for the file
+  if (context->nfiles == context->fileCapacity)
+  {
+    // (the old arrays stay valid in the arena if growing one fails)
+    int capacity = context->fileCapacity == 0 ? 8 : context->fileCapacity * 2;
+    char **filenames = (char **)arenaGrow(context->arena, context->filenames, sizeof(char *) * context->nfiles, sizeof(char *) * capacity);
+    char **extensions = (char **)arenaGrow(context->arena, context->extensions, sizeof(char *) * context->nfiles, sizeof(char *) * capacity);
+    BUFFER_FILE **bufferFiles = (BUFFER_FILE **)arenaGrow(context->arena, context->bufferFiles, sizeof(BUFFER_FILE *) * context->nfiles, sizeof(BUFFER_FILE *) * capacity);
+    FILE **files = context->writeToFile ? (FILE **)arenaGrow(context->arena, context->files, sizeof(FILE *) * context->nfiles, sizeof(FILE *) * capacity) : NULL;
+    if ((filenames == NULL) || (extensions == NULL) || (bufferFiles == NULL) || (context->writeToFile && files == NULL))
     {
-      if (strcmp(context->filenames[i], filename) == 0)
+      return -1;
+    }
+    context->filenames = filenames;
+    context->extensions = extensions;
+    context->bufferFiles = bufferFiles;
+    context->files = files;
+    if (context->combined)
+    {
+      char **headerRows = (char **)arenaGrow(context->arena, context->headerRows, sizeof(char *) * context->nfiles, sizeof(char *) * capacity);
+      int *variants = (int *)arenaGrow(context->arena, context->variants, sizeof(int) * context->nfiles, sizeof(int) * capacity);
+      int *parts = (int *)arenaGrow(context->arena, context->parts, sizeof(int) * context->nfiles, sizeof(int) * capacity);
+      if ((headerRows == NULL) || (variants == NULL) || (parts == NULL))
       {
-        // Write to existing file
-        context->lastname = context->filenames[i];
-        context->lastBufferFile = context->bufferFiles[i];
-        if (context->writeToFile)
-        {
-          context->lastfile = context->files[i];
-        }
-        return 0;
+        return -1;
       }
+      context->headerRows = headerRows;
+      context->variants = variants;
+      context->parts = parts;
+    }
+    context->fileCapacity = capacity;
+  }
+  int index = context->nfiles;
+  char *name = arenaStrdup(context->arena, filename);
+  char *ext = arenaStrdup(context->arena, extension);
+  if ((name == NULL) || (ext == NULL))
+  {
+    return -1;
+  }
+  context->filenames[index] = name;
+  context->extensions[index] = ext;
+  if (context->combined)
+  {
+    context->headerRows[index] = NULL;
+    context->variants[index] = variant;
+    context->parts[index] = 1;
+  }
+  // Output that only goes to the custom line function is never buffered
+  BUFFER_FILE *bufferFile = context->lineOnly ? NULL : newBufferFile(context->bufferSize, context->allocator);
+  int opened = context->writeToFile && (context->stream == NULL);
+  char *fullpath = opened ? filePath(context, index, 1) : NULL;
+  if ((!context->lineOnly && bufferFile == NULL) || (opened && fullpath == NULL))
+  {
+    if (bufferFile != NULL)
+    {
+      freeBufferFile(bufferFile, context->allocator);
     }
+    return -1;
+  }
+  context->bufferFiles[index] = bufferFile;
+  if (context->writeToFile)
+  {
+    context->files[index] = opened ? openFile(fullpath, isBinaryFile(context, index)) : context->stream;
+  }
+  context->nfiles++;
+  return index;
+}
 
-    // File is not open, open it
-    context->filenames = (char **)realloc(context->filenames, sizeof(char *) * (context->nfiles + 1));
-    context->extensions = (char **)realloc(context->extensions, sizeof(char *) * (context->nfiles + 1));
-    context->bufferFiles = (BUFFER_FILE **)realloc(context->bufferFiles, sizeof(BUFFER_FILE *) * (context->nfiles + 1));
-    if (context->writeToFile)
+// Remember the file index of an id. Returns 0 if successful, -1 if
+// memory ran out.
+int rememberFileId(WRITE_CONTEXT *context, int id, int index)
+{
+  if (id >= context->idCapacity)
+  {
+    int capacity = context->idCapacity == 0 ? 16 : context->idCapacity * 2;
+    while (capacity <= id)
     {
-      context->files = (FILE **)realloc(context->files, sizeof(FILE *) * (context->nfiles + 1));
+      capacity *= 2;
+    }
+    int *fileIndexById = (int *)arenaGrow(context->arena, context->fileIndexById, sizeof(int) * context->idCapacity, sizeof(int) * capacity);
+    if (fileIndexById == NULL)
+    {
+      return -1;
     }
+    for (int i = context->idCapacity; i < capacity; i++)
+    {
+      fileIndexById[i] = -1;
+    }
+    context->fileIndexById = fileIndexById;
+    context->idCapacity = capacity;
   }
-  // Open and write to file
-  context->filenames[context->nfiles] = malloc(strlen(filename) + 1);
-  context->extensions[context->nfiles] = malloc(strlen(extension) + 1);
-  context->bufferFiles[context->nfiles] = newBufferFile(context->bufferSize);
-  strcpy(context->filenames[context->nfiles], filename);
-  strcpy(context->extensions[context->nfiles], extension);
-  // Derive the full path to the file
+  context->fileIndexById[id] = index;
+  return 0;
+}
 
-  if (context->writeToFile)
+int getFile(WRITE_CONTEXT *context, char *filename, const char *extension)
+{
+  if (filename == context->lastKey)
+  {
+    // The file last selected by id
+    return 0;
+  }
+  if ((context->lastname != NULL) && (strcmp(context->lastname, filename) == 0))
+  {
+    // Same file as last time, just write to it
+    return 0;
+  }
+  context->lastId = -1;
+  context->lastKey = NULL;
+
+  // See if file is already open
+  for (int i = 0; i < context->nfiles; i++)
   {
-    // Ensure the directory exists (will silently fail if it does)
-    char *fullpath = (char *)malloc(sizeof(char) * (strlen(context->outputDirectory) + strlen(filename) + 1 + strlen(context->filingId) + strlen(extension) + 1));
-    strcpy(fullpath, context->outputDirectory);
-    strcat(fullpath, context->filingId);
-    mkdir_p(fullpath);
+    if (strcmp(context->filenames[i], filename) == 0)
+    {
+      // Write to existing file
+      selectFile(context, i);
+      return 0;
+    }
+  }
 
-    // Add the normalized filename to path
-    strcat(fullpath, DIR_SEPARATOR);
-    char *normalizedFilename = malloc(strlen(filename) + 1);
-    strcpy(normalizedFilename, filename);
-    normalize_filename(normalizedFilename);
-    strcat(fullpath, normalizedFilename);
-    strcat(fullpath, extension);
-
-    context->files[context->nfiles] = fopen(fullpath, "w");
-    // Free the derived file paths
-    free(normalizedFilename);
-    free(fullpath);
-  }
-  context->lastname = context->filenames[context->nfiles];
-  context->lastBufferFile = context->bufferFiles[context->nfiles];
-  if (context->writeToFile)
+  // File is not open, so open it
+  int index = addFile(context, filename, extension, 1);
+  if (index < 0)
   {
-    context->lastfile = context->files[context->nfiles];
+    return -1;
   }
-  context->nfiles++;
+  selectFile(context, index);
   return 1;
 }
 
+int getFileById(WRITE_CONTEXT *context, int id, char *filename, const char *extension)
+{
+  if (id == context->lastId)
+  {
+    return 0;
+  }
+  int index = id < context->idCapacity ? context->fileIndexById[id] : -1;
+  int status = 0;
+  if (index >= 0)
+  {
+    selectFile(context, index);
+  }
+  else
+  {
+    // First time the id is seen: find or open the file by name and
+    // remember it
+    status = getFile(context, filename, extension);
+    if ((status < 0) || (rememberFileId(context, id, context->lastIndex) < 0))
+    {
+      return -1;
+    }
+  }
+  context->lastId = id;
+  context->lastKey = filename;
+  return status;
+}
+
 void bufferFlush(WRITE_CONTEXT *context, char *filename, const char *extension, FILE *file, BUFFER_FILE *bufferFile)
 {
-  if (bufferFile->bufferPos == 0)
+  if ((bufferFile == NULL) || (bufferFile->bufferPos == 0))
+  {
+    return;
+  }
+  bufferFile->flushed += bufferFile->bufferPos;
+  if (context->outputStage != NULL)
   {
+    // Written out on the output stage's thread
+    queueOutput(context, filename, extension, file, bufferFile);
     return;
   }
   if (context->customWriteFunction != NULL)
@@ -289,21 +507,162 @@ void bufferWrite(WRITE_CONTEXT *context, char *filename, const char *extension,
   }
 }
 
+void setCombinedOutput(WRITE_CONTEXT *context, long long rotateSize)
+{
+  context->combined = 1;
+  context->rotateSize = rotateSize;
+}
+
+void setBinaryFiles(WRITE_CONTEXT *context, const char *extension, const char *trailer, int trailerLength)
+{
+  context->binaryExtension = extension;
+  context->binaryTrailer = trailer;
+  context->binaryTrailerLength = trailerLength;
+}
+
+void setStreamOutput(WRITE_CONTEXT *context, FILE *stream)
+{
+  context->stream = stream;
+}
+
+int setLineFunction(WRITE_CONTEXT *context, CustomLineDataFunction function, void *data)
+{
+  if (context->customLineBuffer == NULL)
+  {
+    context->customLineBuffer = newAllocatedString(context->allocator, DEFAULT_STRING_SIZE);
+    if (context->customLineBuffer == NULL)
+    {
+      return 0;
+    }
+  }
+  context->useCustomLine = 1;
+  context->customLineDataFunction = function;
+  context->customLineData = data;
+  context->lineOnly = !context->writeToFile && (context->customWriteFunction == NULL);
+  initializeCustomWriteContext(context);
+  return 1;
+}
+
+// Write the trailer of the file at the index, if it's binary, and flush
+// it out ahead of closing it
+void finishFile(WRITE_CONTEXT *context, int index)
+{
+  FILE *file = context->writeToFile ? context->files[index] : NULL;
+  BUFFER_FILE *bufferFile = context->bufferFiles[index];
+  if ((bufferFile != NULL) && (context->binaryTrailer != NULL) && isBinaryFile(context, index))
+  {
+    bufferWrite(context, context->filenames[index], context->extensions[index], file, bufferFile, (char *)context->binaryTrailer, context->binaryTrailerLength);
+  }
+  bufferFlush(context, context->filenames[index], context->extensions[index], file, bufferFile);
+}
+
+// Move on to the next part of the file at the index. Returns 0 if
+// successful, or -1 (still writing to the current part) if memory ran
+// out.
+int rotateFile(WRITE_CONTEXT *context, int index)
+{
+  char *fullpath = filePath(context, index, context->parts[index] + 1);
+  if (fullpath == NULL)
+  {
+    return -1;
+  }
+  BUFFER_FILE *bufferFile = context->bufferFiles[index];
+  finishFile(context, index);
+  fclose(context->files[index]);
+  context->files[index] = openFile(fullpath, isBinaryFile(context, index));
+  context->parts[index]++;
+  bufferFile->flushed = 0;
+  return 0;
+}
+
+int getCombinedFile(WRITE_CONTEXT *context, int id, char *filename, const char *extension, const char *header)
+{
+  int index = (id >= 0) && (id < context->idCapacity) ? context->fileIndexById[id] : -1;
+  int status = 0;
+  if (index < 0)
+  {
+    // Find the file with the name and header row, noting the variants
+    // of it with other header rows
+    int variant = 1;
+    for (int i = 0; i < context->nfiles; i++)
+    {
+      if ((strcmp(context->filenames[i], filename) == 0) && (strcmp(context->extensions[i], extension) == 0))
+      {
+        if (strcmp(context->headerRows[i], header) == 0)
+        {
+          index = i;
+          break;
+        }
+        if (context->variants[i] >= variant)
+        {
+          variant = context->variants[i] + 1;
+        }
+      }
+    }
+    if (index < 0)
+    {
+      char *headerRow = arenaStrdup(context->arena, header);
+      index = headerRow != NULL ? addFile(context, filename, extension, variant) : -1;
+      if (index < 0)
+      {
+        return -1;
+      }
+      context->headerRows[index] = headerRow;
+      status = 1;
+    }
+    if ((id >= 0) && (rememberFileId(context, id, index) < 0))
+    {
+      return -1;
+    }
+  }
+  BUFFER_FILE *bufferFile = context->bufferFiles[index];
+  if ((status == 0) && (context->rotateSize > 0) && context->writeToFile && (context->stream == NULL) && (bufferFile != NULL) && ((long long)(bufferFile->flushed + bufferFile->bufferPos) >= context->rotateSize))
+  {
+    status = rotateFile(context, index) == 0 ? 1 : 0;
+  }
+  selectFile(context, index);
+  // Writes passing the same filename go to the selected file
+  context->lastId = id;
+  context->lastKey = id >= 0 ? filename : NULL;
+  return status;
+}
+
+void forgetFileIds(WRITE_CONTEXT *context)
+{
+  for (int i = 0; i < context->idCapacity; i++)
+  {
+    context->fileIndexById[i] = -1;
+  }
+  context->lastId = -1;
+  context->lastKey = NULL;
+  if (context->database != NULL)
+  {
+    forgetSqliteTable(context->database);
+  }
+}
+
 void writeN(WRITE_CONTEXT *context, char *filename, const char *extension, char *string, int nchars)
 {
   if (context->local == 0)
   {
-    // Write to file
-    getFile(context, filename, extension);
-    bufferWrite(context, filename, extension, context->lastfile, context->lastBufferFile, string, nchars);
+    // Write to file (dropping the write if the file can't be tracked)
+    if (getFile(context, filename, extension) < 0)
+    {
+      return;
+    }
+    if (!context->lineOnly)
+    {
+      bufferWrite(context, context->lastname, context->extensions[context->lastIndex], context->lastfile, context->lastBufferFile, string, nchars);
+    }
 
     if (context->useCustomLine)
     {
       // Write to custom line function
       int newPosition = context->customLineBufferPosition + nchars;
-      if (newPosition + 1 > context->customLineBuffer->n)
+      if (!growStringTo(context->customLineBuffer, newPosition + 1))
       {
-        growStringTo(context->customLineBuffer, newPosition + 1);
+        // Out of memory; drop the write
+        return;
       }
       memcpy(context->customLineBuffer->str + context->customLineBufferPosition, string, nchars);
       context->customLineBufferPosition = newPosition;
@@ -315,9 +674,10 @@ void writeN(WRITE_CONTEXT *context, char *filename, const char *extension, char
   {
     // Write to local buffer
     int newPosition = context->localBufferPosition + nchars;
-    if (newPosition + 1 > context->localBuffer->n)
+    if (!growStringTo(context->localBuffer, newPosition + 1))
     {
-      growStringTo(context->localBuffer, newPosition + 1);
+      // Out of memory; drop the write
+      return;
     }
     memcpy(context->localBuffer->str + context->localBufferPosition, string, nchars);
     context->localBufferPosition = newPosition;
@@ -336,8 +696,11 @@ void writeChar(WRITE_CONTEXT *context, char *filename, const char *extension, ch
   if (context->local == 0 && (!context->useCustomLine))
   {
     // Write to file
-    getFile(context, filename, extension);
-    bufferWrite(context, filename, extension, context->lastfile, context->lastBufferFile, &c, 1);
+    if (getFile(context, filename, extension) < 0)
+    {
+      return;
+    }
+    bufferWrite(context, context->lastname, context->extensions[context->lastIndex], context->lastfile, context->lastBufferFile, &c, 1);
   }
   else
   {
@@ -357,39 +720,44 @@ void writeDouble(WRITE_CONTEXT *context, char *filename, const char *extension,
 
 void freeWriteContext(WRITE_CONTEXT *context)
 {
+  if (context == NULL)
+  {
+    return;
+  }
   for (int i = 0; i < context->nfiles; i++)
   {
     // Flush out any remaining file contents
-    bufferFlush(context, context->filenames[i], context->extensions[i], context->writeToFile ? context->files[i] : NULL, context->bufferFiles[i]);
-
-    // Free memory structures for each file
-    free(context->filenames[i]);
-    free(context->extensions[i]);
-    freeBufferFile(context->bufferFiles[i]);
-    if (context->writeToFile)
-    {
-      fclose(context->files[i]);
-    }
+    finishFile(context, i);
   }
-  if (context->filenames != NULL)
+  if (context->outputStage != NULL)
   {
-    free(context->filenames);
+    // Wait for the flushed contents to be written before closing files
+    stopOutputStage(context);
   }
-  if (context->files != NULL)
+  for (int i = 0; i < context->nfiles; i++)
   {
-    free(context->files);
+    // Free memory structures for each file
+    if (context->bufferFiles[i] != NULL)
+    {
+      freeBufferFile(context->bufferFiles[i], context->allocator);
+    }
+    if (context->writeToFile && (context->files[i] != context->stream))
+    {
+      fclose(context->files[i]);
+    }
   }
-  if (context->bufferFiles != NULL)
+  if (context->writeToFile && (context->stream != NULL))
   {
-    free(context->bufferFiles);
+    fflush(context->stream);
   }
-  if (context->extensions != NULL)
+  if (context->database != NULL)
   {
-    free(context->extensions);
+    closeSqliteOutput(context->database);
   }
+  freeArena(context->arena);
   if (context->customLineBuffer != NULL)
   {
     freeString(context->customLineBuffer);
   }
-  free(context);
+  allocatorFree(context->allocator, context);
 }
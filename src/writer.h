@@ -1,18 +1,29 @@
 #pragma once
 
 #include "memory.h"
+#include "arena.h"
 
 static const char csvExtension[] = ".csv";
 
+// Writes file buffers out on a separate thread (see pipeline.h)
+typedef struct output_stage OUTPUT_STAGE;
+
+// A database rows are inserted into (see sqlite.h)
+typedef struct sqlite_output SQLITE_OUTPUT;
+
 typedef void (*CustomWriteFunction)(char *filename, char *extension, char *contents, int numBytes);
 
 typedef void (*CustomLineFunction)(char *filename, char *line, char *types);
 
+// A custom line function that's passed data (see setLineFunction)
+typedef void (*CustomLineDataFunction)(void *data, char *filename, char *line, char *types);
+
 struct buffer_file
 {
   char *buffer;
   int bufferPos;
   int bufferSize;
+  size_t flushed; // bytes flushed out of the buffer so far
 };
 typedef struct buffer_file BUFFER_FILE;
 
@@ -26,9 +37,18 @@ struct write_context
   BUFFER_FILE **bufferFiles;
   FILE **files;
   int nfiles;
+  int fileCapacity; // the length of the per-file arrays
   char *lastname;
+  int lastIndex; // index of the last file written to
   BUFFER_FILE *lastBufferFile;
   FILE *lastfile;
+  // Files selected by interned id (see getFileById): the file index of
+  // each id (-1 if not seen yet), and the id and name of the last file
+  // selected that way (-1 and NULL if it was selected by name)
+  int *fileIndexById;
+  int idCapacity;
+  int lastId;
+  char *lastKey;
   int local;
   STRING *localBuffer;
   int localBufferPosition;
@@ -36,16 +56,60 @@ struct write_context
   STRING *customLineBuffer;
   int customLineBufferPosition;
   int writeToFile;
+  // Whether output only goes to the custom line function (no files or
+  // custom write function), in which case no file buffers are kept
+  int lineOnly;
   CustomWriteFunction customWriteFunction;
   CustomLineFunction customLineFunction;
+  // Lines go to this function with the data instead, if it's set (see
+  // setLineFunction)
+  CustomLineDataFunction customLineDataFunction;
+  void *customLineData;
+  // Holds file names and the per-file arrays
+  ARENA *arena;
+  // Where full file buffers go to be written out (NULL to write them
+  // out when they fill)
+  OUTPUT_STAGE *outputStage;
+  // Whether the files are shared by the parses of many filings (see
+  // setCombinedOutput), and the size files are rotated at (0 to never
+  // rotate them)
+  int combined;
+  long long rotateSize;
+  // The header row, variant and part of each combined file
+  char **headerRows;
+  int *variants;
+  int *parts;
+  // Files with this extension are binary (see setBinaryFiles; NULL if
+  // there are none) and end with the trailer
+  const char *binaryExtension;
+  const char *binaryTrailer;
+  int binaryTrailerLength;
+  // Files are written to this stream rather than opened (see
+  // setStreamOutput; NULL to open them)
+  FILE *stream;
+  // The database rows are inserted into instead of files (NULL if
+  // there's none), closed as the context is freed
+  SQLITE_OUTPUT *database;
+  ALLOCATOR *allocator;
 };
 typedef struct write_context WRITE_CONTEXT;
 
-BUFFER_FILE *newBufferFile(int bufferSize);
+// Create a directory and any missing parents. Returns 0 if successful
+// (or the directory already exists), -1 otherwise.
+int mkdir_p(const char *path);
+
+// Normalize a file name (in place) the way output files are named, by
+// converting slashes to dashes
+void normalize_filename(char *filename);
 
-void freeBufferFile(BUFFER_FILE *bufferFile);
+BUFFER_FILE *newBufferFile(int bufferSize, ALLOCATOR *allocator);
 
-WRITE_CONTEXT *newWriteContext(char *outputDirectory, char *filingId, int writeToFile, int bufferSize, CustomWriteFunction customWriteFunction, CustomLineFunction customLineFunction);
+void freeBufferFile(BUFFER_FILE *bufferFile, ALLOCATOR *allocator);
+
+// Create a context for writing output. Allocations go through the
+// allocator (or the C library's if it's NULL). Returns NULL if memory
+// runs out.
+WRITE_CONTEXT *newWriteContext(char *outputDirectory, char *filingId, int writeToFile, int bufferSize, CustomWriteFunction customWriteFunction, CustomLineFunction customLineFunction, ALLOCATOR *allocator);
 
 void initializeLocalWriteContext(WRITE_CONTEXT *writeContext, STRING *line);
 
@@ -53,9 +117,60 @@ void initializeCustomWriteContext(WRITE_CONTEXT *writeContext);
 
 void endLine(WRITE_CONTEXT *writeContext, char *types);
 
-// Return 0 if file is cached, or 1 if it is newly created for writing
+// The path a file with the name and extension is written to (creating
+// its directory if needed), or NULL if memory ran out: {output
+// directory}{filing id}/{normalized name}{extension}, or for combined
+// output {output directory}{normalized name}[.{variant}][.part{part}]
+// {extension}. The path is freed with the context.
+char *outputPath(WRITE_CONTEXT *context, char *filename, const char *extension, int variant, int part);
+
+// Return 0 if file is cached, 1 if it is newly created for writing, or
+// -1 if memory ran out
 int getFile(WRITE_CONTEXT *context, char *filename, const char *extension);
 
+// Like getFile, but for a file identified by a small non-negative id
+// that always goes with the same filename (e.g. an interned form type),
+// so switching files is an array lookup rather than string comparisons.
+// Until another file is selected, writes passing the same filename
+// pointer go straight to the file, so the filename must not change while
+// its id is in use.
+int getFileById(WRITE_CONTEXT *context, int id, char *filename, const char *extension);
+
+// Write files shared by the parses of many filings: rows of each form
+// type are appended to {output directory}/{form type}.csv (no filing id
+// subdirectory), with one header row. Rows whose header row differs
+// from the file's (e.g. from an older version of a form) go to a
+// variant of it, {form type}.{n}.csv. With a rotate size, once a file
+// has reached it the next row starts a new part, {form type}.part{n}.csv,
+// with its own header row. Must be set before anything is written.
+void setCombinedOutput(WRITE_CONTEXT *context, long long rotateSize);
+
+// Like getFileById (with an id of -1 selecting the file by name), but
+// for combined output: select the file for rows with the header row,
+// opening a variant or the next part of it as needed. Return 1 if the
+// header row needs writing, 0 if not, or -1 if memory ran out.
+int getCombinedFile(WRITE_CONTEXT *context, int id, char *filename, const char *extension, const char *header);
+
+// Write the files with the extension as binary files: they're opened in
+// binary mode (so nothing is translated) and each ends with the trailer,
+// written when it's closed. Must be set before anything is written.
+void setBinaryFiles(WRITE_CONTEXT *context, const char *extension, const char *trailer, int trailerLength);
+
+// Write every file to the stream (e.g. stdout) instead of opening it in
+// the output directory, for output that's written as one file. The
+// stream is flushed but left open as the context is freed. Must be set
+// before anything is written.
+void setStreamOutput(WRITE_CONTEXT *context, FILE *stream);
+
+// Pass each line to the function with the data (e.g. the state a caller
+// collects lines into), instead of the custom line function. Returns 0
+// if memory ran out. Must be set before anything is written.
+int setLineFunction(WRITE_CONTEXT *context, CustomLineDataFunction function, void *data);
+
+// Forget the ids files (and the table of the database) were selected by,
+// for a write context that's passed on to a parse with its own ids
+void forgetFileIds(WRITE_CONTEXT *context);
+
 void writeN(WRITE_CONTEXT *context, char *filename, const char *extension, char *string, int nchars);
 
 void writeString(WRITE_CONTEXT *context, char *filename, const char *extension, char *string);
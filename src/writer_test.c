@@ -42,7 +42,7 @@ static char *testWriter()
 {
   resetOutput();
 
-  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 3, writeToFile, writeToLine);
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 3, writeToFile, writeToLine, NULL);
 
   // Write a small string that won't flush the buffer
   writeString(ctx, testFile, testExt, "hi");
@@ -70,7 +70,7 @@ static char *testWriterEndOnBufferSize()
 {
   resetOutput();
 
-  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 3, writeToFile, writeToLine);
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 3, writeToFile, writeToLine, NULL);
 
   // Write a small string that won't flush the buffer
   writeString(ctx, testFile, testExt, "hi");
@@ -98,7 +98,7 @@ static char *testWriterMassiveBuffer()
 {
   resetOutput();
 
-  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 300, writeToFile, writeToLine);
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 300, writeToFile, writeToLine, NULL);
 
   // Write a small string that won't flush the buffer
   writeString(ctx, testFile, testExt, "hi");
@@ -126,7 +126,7 @@ static char *testLineBuffer()
 {
   resetOutput();
 
-  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 300, writeToFile, writeToLine);
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 300, writeToFile, writeToLine, NULL);
 
   // Write a small string that won't flush the buffer
   writeString(ctx, testFile, testExt, "hi there\n");
@@ -142,12 +142,144 @@ static char *testLineBuffer()
   return 0;
 }
 
+static char *testLineOnly()
+{
+  resetOutput();
+
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 3, NULL, writeToLine, NULL);
+  mu_assert("expected line only mode", ctx->lineOnly == 1);
+
+  // Writes longer than the buffer size only go to the line
+  writeString(ctx, testFile, testExt, "hi there");
+  writeChar(ctx, testFile, testExt, '\n');
+  mu_assert("expected a new file to be tracked", getFile(ctx, "other", testExt) == 1);
+  mu_assert("expected the file to be cached", getFile(ctx, testFile, testExt) == 0);
+  mu_assert("expected no file buffer", ctx->lastBufferFile == NULL);
+  endLine(ctx, NULL);
+  mu_assert("expected line contents to be \"hi there\n\"", strcmp(outputLine, "hi there\n") == 0);
+
+  freeWriteContext(ctx);
+  mu_assert("expected file contents to be \"\"", strcmp(outputFile, "") == 0);
+
+  // A custom write function needs the file buffers
+  ctx = newWriteContext(NULL, NULL, 0, 3, writeToFile, writeToLine, NULL);
+  mu_assert("expected no line only mode", ctx->lineOnly == 0);
+  freeWriteContext(ctx);
+
+  return 0;
+}
+
+static char *testFilesById()
+{
+  resetOutput();
+
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 100, NULL, writeToLine, NULL);
+  char *otherFile = "other";
+
+  mu_assert("expected a new file for the id", getFileById(ctx, 3, testFile, testExt) == 1);
+  mu_assert("expected the id to be cached", getFileById(ctx, 3, testFile, testExt) == 0);
+  writeString(ctx, testFile, testExt, "a");
+
+  // Files opened by name are found again by id (and vice versa)
+  mu_assert("expected a new file by name", getFile(ctx, otherFile, testExt) == 1);
+  mu_assert("expected the name to be cached for a new id", getFileById(ctx, 40, otherFile, testExt) == 0);
+  mu_assert("expected the other file to be selected", strcmp(ctx->lastname, otherFile) == 0);
+  writeString(ctx, otherFile, testExt, "b");
+  mu_assert("expected switching back by id", getFileById(ctx, 3, testFile, testExt) == 0);
+  mu_assert("expected the test file to be selected", strcmp(ctx->lastname, testFile) == 0);
+  mu_assert("expected switching back by name", getFile(ctx, otherFile, testExt) == 0);
+  mu_assert("expected no id after selecting by name", ctx->lastId == -1);
+  mu_assert("expected two files", ctx->nfiles == 2);
+
+  writeString(ctx, testFile, testExt, "c");
+  endLine(ctx, NULL);
+  mu_assert("expected line contents to be \"abc\"", strcmp(outputLine, "abc") == 0);
+
+  freeWriteContext(ctx);
+
+  return 0;
+}
+
+static char *testCombinedFiles()
+{
+  resetOutput();
+
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 100, NULL, writeToLine, NULL);
+  setCombinedOutput(ctx, 0);
+
+  mu_assert("expected a new file for the header row", getCombinedFile(ctx, 3, testFile, testExt, "a,b") == 1);
+  mu_assert("expected the id to be cached", getCombinedFile(ctx, 3, testFile, testExt, "a,b") == 0);
+
+  // Another parse's ids find the file by its name and header row
+  forgetFileIds(ctx);
+  mu_assert("expected the file for the header row", getCombinedFile(ctx, 5, testFile, testExt, "a,b") == 0);
+  mu_assert("expected one file", ctx->nfiles == 1);
+
+  // Rows with another header row go to a variant of the file
+  forgetFileIds(ctx);
+  mu_assert("expected a new variant for the header row", getCombinedFile(ctx, 3, testFile, testExt, "a,b,c") == 1);
+  mu_assert("expected the second variant", ctx->variants[ctx->lastIndex] == 2);
+  mu_assert("expected the variant to keep the file name", strcmp(ctx->lastname, testFile) == 0);
+  writeString(ctx, testFile, testExt, "x");
+  endLine(ctx, NULL);
+  mu_assert("expected line contents to be \"x\"", strcmp(outputLine, "x") == 0);
+  mu_assert("expected the first variant by name", getCombinedFile(ctx, -1, testFile, testExt, "a,b") == 0);
+  mu_assert("expected the first variant", ctx->variants[ctx->lastIndex] == 1);
+  mu_assert("expected two files", ctx->nfiles == 2);
+
+  freeWriteContext(ctx);
+
+  return 0;
+}
+
+static char *testBinaryFiles()
+{
+  resetOutput();
+
+  WRITE_CONTEXT *ctx = newWriteContext(NULL, NULL, 0, 100, writeToFile, NULL, NULL);
+  setBinaryFiles(ctx, testExt, "!", 1);
+
+  // Binary files end with the trailer as they're closed; others don't
+  writeString(ctx, testFile, ".csv", "a");
+  writeString(ctx, "other", testExt, "b");
+  freeWriteContext(ctx);
+  mu_assert("expected file contents to be \"ab!\"", strcmp(outputFile, "ab!") == 0);
+
+  return 0;
+}
+
+static char *testStreamOutput()
+{
+  FILE *stream = tmpfile();
+  WRITE_CONTEXT *ctx = newWriteContext("nonexistent/", "1", 1, 100, NULL, NULL, NULL);
+  setStreamOutput(ctx, stream);
+
+  // Every file goes to the stream (as its buffer is flushed), which is
+  // left open
+  writeString(ctx, testFile, testExt, "a");
+  writeString(ctx, "other", testExt, "b");
+  writeString(ctx, testFile, testExt, "c");
+  freeWriteContext(ctx);
+  char contents[8] = {0};
+  rewind(stream);
+  mu_assert("expected the stream to be open", fread(contents, 1, sizeof(contents) - 1, stream) == 3);
+  mu_assert("expected stream contents to be \"acb\"", strcmp(contents, "acb") == 0);
+  fclose(stream);
+
+  return 0;
+}
+
 static char *all_tests()
 {
   mu_run_test(testWriter);
   mu_run_test(testWriterEndOnBufferSize);
   mu_run_test(testWriterMassiveBuffer);
   mu_run_test(testLineBuffer);
+  mu_run_test(testLineOnly);
+  mu_run_test(testFilesById);
+  mu_run_test(testCombinedFiles);
+  mu_run_test(testBinaryFiles);
+  mu_run_test(testStreamOutput);
   return 0;
 }
 